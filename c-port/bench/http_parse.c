@@ -0,0 +1,324 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* HTTP request parsing: the byte-at-a-time CRLF search the parser used
+ * to do, against ct_parse_request under each scanner this CPU has. The
+ * request is what a desktop Chrome sends for a page load - whole, and
+ * trickled in small segments the way a slow link delivers it. */
+
+#define ITERATIONS 2000000
+#define SEGMENT 16
+
+static const char request[] =
+    "GET /static/js/terminal.bundle.js?v=3f9a1c2e HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,es;q=0.8\r\n"
+    "Cookie: session=6b1f0c9e2d8a4f7b93e5a1c0d2f4b6e8; theme=dark; "
+    "_ga=GA1.1.1234567890.1712345678; _ga_XYZ=GS1.1.1712345678.4.1.1712345999.0.0.0\r\n"
+    "If-None-Match: \"5f3c-18e2a7b4c10\"\r\n"
+    "If-Modified-Since: Tue, 09 Apr 2024 10:15:42 GMT\r\n"
+    "\r\n";
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The request as it was - pointers into the buffer */
+typedef struct {
+    ct_http_method_t method;
+    const char *url;
+    const char *version;
+    ct_header_t headers[CT_MAX_HEADERS];
+    size_t header_count;
+    const char *body;
+    size_t body_len;
+    ct_parse_state_t parse_state;
+    bool is_websocket;
+    bool keep_alive;
+} old_request_t;
+
+/* The parser as it was - CRLF found one byte at a time, fields split
+ * with memchr, nothing validated, restarted from the request line
+ * whenever more data arrived */
+static const char *find_crlf(const char *data, size_t len) {
+    const char *end = data + len;
+    while (data < end - 1) {
+        if (data[0] == '\r' && data[1] == '\n') return data;
+        data++;
+    }
+    return NULL;
+}
+
+static int parse_baseline(old_request_t *req, const char *data, size_t len) {
+    const char *p = data;
+    const char *end = data + len;
+    const char *line_end;
+    
+    /* Already completed */
+    if (req->parse_state == CT_PARSE_COMPLETE) {
+        return 0;
+    }
+    
+    /* Parse request line if not done */
+    if (req->parse_state == CT_PARSE_METHOD) {
+        line_end = find_crlf(p, end - p);
+        if (!line_end) {
+            return -1; /* Need more data */
+        }
+        
+        /* Parse method */
+        const char *space = memchr(p, ' ', line_end - p);
+        if (!space) {
+            req->parse_state = CT_PARSE_ERROR;
+            return -2;
+        }
+        
+        req->method = space - p == 3 && memcmp(p, "GET", 3) == 0 ?
+            CT_METHOD_GET : CT_METHOD_UNKNOWN;
+        if (req->method == CT_METHOD_UNKNOWN) {
+            req->parse_state = CT_PARSE_ERROR;
+            return -2;
+        }
+        
+        /* Parse URL */
+        p = space + 1;
+        space = memchr(p, ' ', line_end - p);
+        if (!space) {
+            req->parse_state = CT_PARSE_ERROR;
+            return -2;
+        }
+        
+        req->url = p;
+        
+        /* Parse version - HTTP/1.1 connections persist unless closed */
+        p = space + 1;
+        req->version = p;
+        req->keep_alive = line_end - p == 8 && memcmp(p, "HTTP/1.1", 8) == 0;
+        
+        p = line_end + 2; /* Skip CRLF */
+        req->parse_state = CT_PARSE_HEADER_NAME;
+    }
+    
+    /* Parse headers */
+    while (req->parse_state == CT_PARSE_HEADER_NAME && p < end) {
+        line_end = find_crlf(p, end - p);
+        if (!line_end) {
+            return -1; /* Need more data */
+        }
+        
+        /* Empty line = end of headers */
+        if (line_end == p) {
+            p += 2; /* Skip CRLF */
+            req->parse_state = CT_PARSE_BODY;
+            
+            /* Check for WebSocket upgrade */
+            for (size_t i = 0; i < req->header_count; i++) {
+                if (strcasecmp(req->headers[i].name, "Upgrade") == 0 &&
+                    strcasecmp(req->headers[i].value, "websocket") == 0) {
+                    req->is_websocket = true;
+                }
+                if (req->headers[i].name_len == 10 &&
+                    strncasecmp(req->headers[i].name, "Connection", 10) == 0) {
+                    const char *value = req->headers[i].value;
+                    size_t value_len = req->headers[i].value_len;
+                    if (memmem(value, value_len, "close", 5)) {
+                        req->keep_alive = false;
+                    } else if (memmem(value, value_len, "keep-alive", 10)) {
+                        req->keep_alive = true;
+                    }
+                }
+            }
+            break;
+        }
+        
+        /* Parse header name:value */
+        const char *colon = memchr(p, ':', line_end - p);
+        if (!colon || req->header_count >= CT_MAX_HEADERS) {
+            req->parse_state = CT_PARSE_ERROR;
+            return -2;
+        }
+        
+        /* Store header pointers (zero-copy) */
+        req->headers[req->header_count].name = p;
+        req->headers[req->header_count].name_len = colon - p;
+        
+        /* Skip colon and whitespace */
+        p = colon + 1;
+        while (p < line_end && (*p == ' ' || *p == '\t')) p++;
+        
+        req->headers[req->header_count].value = p;
+        req->headers[req->header_count].value_len = line_end - p;
+        
+        req->header_count++;
+        p = line_end + 2; /* Skip CRLF */
+    }
+    
+    /* Parse body if needed */
+    if (req->parse_state == CT_PARSE_BODY) {
+        /* Find Content-Length header */
+        size_t content_length = 0;
+        for (size_t i = 0; i < req->header_count; i++) {
+            if (strncasecmp(req->headers[i].name, "Content-Length", 
+                           req->headers[i].name_len) == 0) {
+                content_length = strtoul(req->headers[i].value, NULL, 10);
+                break;
+            }
+        }
+        
+        if (content_length > 0) {
+            size_t body_available = end - p;
+            if (body_available < content_length) {
+                return -1; /* Need more data */
+            }
+            
+            req->body = p;
+            req->body_len = content_length;
+            p += content_length;
+        }
+        
+        req->parse_state = CT_PARSE_COMPLETE;
+    }
+    
+    return p - data; /* Return bytes consumed */
+}
+
+static void report(const char *name, double elapsed, int iterations) {
+    double ns = elapsed * 1e9 / iterations;
+    printf("  %-10s %8.1f ns/request  %6.2f GB/s\n", name, ns,
+           (sizeof(request) - 1) / ns);
+}
+
+/* Every scanner must stop where the scalar one does */
+static int cross_check(void) {
+    const char *(*scans[])(const char *, const char *) = {
+        ct_scan_token, ct_scan_target, ct_scan_value
+    };
+    char buf[256];
+    const char *stops[64][3];
+    
+    srand(1);
+    for (int round = 0; round < 64; round++) {
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            /* Mostly printable so scans run long before stopping */
+            buf[i] = rand() % 40 ? 0x21 + rand() % 94 : rand() % 256;
+        }
+        
+        int start = rand() % 64;
+        ct_http_scan_init("scalar");
+        for (int s = 0; s < 3; s++) {
+            stops[round][s] = scans[s](buf + start, buf + sizeof(buf));
+        }
+        
+        static const char *impls[] = {"sse4.2", "avx2"};
+        for (int i = 0; i < 2; i++) {
+            if (ct_http_scan_init(impls[i]) < 0) continue;
+            for (int s = 0; s < 3; s++) {
+                if (scans[s](buf + start, buf + sizeof(buf)) != stops[round][s]) {
+                    fprintf(stderr, "%s scanner %d disagrees with scalar\n", impls[i], s);
+                    return -1;
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/* Deliver len bytes SEGMENT at a time, parsing after each arrival */
+static int parse_segmented(ct_request_t *req, bool restart) {
+    size_t len = sizeof(request) - 1;
+    int rc = -1;
+    
+    for (size_t have = SEGMENT; rc == -1; have += SEGMENT) {
+        if (have > len) have = len;
+        
+        if (restart) {
+            old_request_t old = {0};
+            rc = parse_baseline(&old, request, have);
+            req->header_count = old.header_count;
+        } else {
+            rc = ct_parse_request(req, request, have);
+        }
+    }
+    
+    return rc;
+}
+
+int main(void) {
+    size_t len = sizeof(request) - 1;
+    volatile size_t sink = 0;
+    static const char *impls[] = {"scalar", "sse4.2", "avx2"};
+    
+    if (cross_check() < 0) return 1;
+    
+    printf("HTTP request parse (%zu bytes, %d iterations)\n", len, ITERATIONS);
+    
+    old_request_t old;
+    double start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        memset(&old, 0, sizeof(old));
+        if (parse_baseline(&old, request, len) != (int)len) {
+            fprintf(stderr, "baseline: parse failed\n");
+            return 1;
+        }
+        sink += old.header_count;
+    }
+    report("baseline", now() - start, ITERATIONS);
+    
+    ct_request_t req;
+    for (int i = 0; i < 3; i++) {
+        if (ct_http_scan_init(impls[i]) < 0) {
+            printf("  %-10s unsupported\n", impls[i]);
+            continue;
+        }
+        
+        start = now();
+        for (int n = 0; n < ITERATIONS; n++) {
+            memset(&req, 0, sizeof(req));
+            if (ct_parse_request(&req, request, len) != (int)len) {
+                fprintf(stderr, "%s: parse failed\n", impls[i]);
+                return 1;
+            }
+            sink += req.header_count;
+        }
+        report(impls[i], now() - start, ITERATIONS);
+    }
+    
+    /* Slow link - the old parser rescans from the request line on every
+     * segment, the resumable one only looks at the new bytes */
+    printf("In %d-byte segments (%d iterations)\n", SEGMENT, ITERATIONS / 20);
+    ct_http_scan_init(NULL);
+    
+    for (int resume = 0; resume < 2; resume++) {
+        start = now();
+        for (int n = 0; n < ITERATIONS / 20; n++) {
+            memset(&req, 0, sizeof(req));
+            if (parse_segmented(&req, !resume) != (int)len) {
+                fprintf(stderr, "segmented parse failed\n");
+                return 1;
+            }
+            sink += req.header_count;
+        }
+        report(resume ? "resumable" : "restart", now() - start, ITERATIONS / 20);
+    }
+    
+    (void)sink;
+    return 0;
+}
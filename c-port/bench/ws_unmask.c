@@ -0,0 +1,129 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* WebSocket unmasking: the 4-bytes-per-cast loop ct_ws_parse_frame used
+ * to run, against ct_ws_unmask under each implementation this CPU has.
+ * Payloads are a typed keystroke, a pasted line and a large paste or
+ * upload frame, each starting one byte off alignment the way a payload
+ * behind a 2-byte header and 4-byte key does. */
+
+#define TOTAL_BYTES (1ULL << 31)     /* per size and implementation */
+
+static const size_t sizes[] = {16, 1024, 1 << 20};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The unmask as it was - 4 bytes per step against an unaligned key
+ * word, its casts made memcpy so the benchmark itself stays defined */
+static void unmask_baseline(char *data, size_t len, const uint8_t key[4]) {
+    uint8_t *p = (uint8_t *)data;
+    uint32_t k;
+    size_t i;
+    
+    memcpy(&k, key, 4);
+    for (i = 0; i + 3 < len; i += 4) {
+        uint32_t v;
+        memcpy(&v, p + i, 4);
+        v ^= k;
+        memcpy(p + i, &v, 4);
+    }
+    for (; i < len; i++) {
+        p[i] ^= key[i & 3];
+    }
+}
+
+/* Every implementation must match the bytewise definition, for any
+ * alignment, length and starting payload offset */
+static int cross_check(void) {
+    static const char *impls[] = {"avx2", "sse2", "neon", "scalar"};
+    static uint8_t buf[600], expect[600];
+    const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    
+    srand(1);
+    for (int round = 0; round < 2000; round++) {
+        size_t start = rand() % 64;
+        size_t len = rand() % (sizeof(buf) - start);
+        uint64_t pos = rand();
+        
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            buf[i] = (uint8_t)rand();
+        }
+        
+        for (int i = 0; i < 4; i++) {
+            if (ct_ws_unmask_init(impls[i]) < 0) continue;
+            
+            memcpy(expect, buf, sizeof(buf));
+            for (size_t j = 0; j < len; j++) {
+                expect[start + j] ^= key[(pos + j) & 3];
+            }
+            
+            static uint8_t got[600];
+            memcpy(got, buf, sizeof(buf));
+            ct_ws_unmask((char *)got + start, len, key, pos);
+            if (memcmp(got, expect, sizeof(buf)) != 0) {
+                fprintf(stderr, "%s unmask disagrees (start %zu, len %zu, pos %llu)\n",
+                        impls[i], start, len, (unsigned long long)pos);
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static void report(const char *name, double elapsed, uint64_t bytes) {
+    printf("  %-10s %8.2f GB/s\n", name, bytes / elapsed / 1e9);
+}
+
+int main(void) {
+    static const char *impls[] = {"avx2", "sse2", "neon", "scalar"};
+    const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    volatile uint8_t sink = 0;
+    
+    if (cross_check() < 0) return 1;
+    
+    char *buf = aligned_alloc(64, (1 << 20) + 64);
+    if (!buf) return 1;
+    memset(buf, 'a', (1 << 20) + 64);
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t len = sizes[s];
+        uint64_t iterations = TOTAL_BYTES / len;
+        char *payload = buf + 1;
+        
+        printf("Unmask %zu-byte payload (%llu iterations)\n", len,
+               (unsigned long long)iterations);
+        
+        double start = now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            unmask_baseline(payload, len, key);
+            sink ^= (uint8_t)payload[i & (len - 1)];
+        }
+        report("baseline", now() - start, iterations * len);
+        
+        for (int i = 0; i < 4; i++) {
+            if (ct_ws_unmask_init(impls[i]) < 0) {
+                printf("  %-10s unsupported\n", impls[i]);
+                continue;
+            }
+            
+            start = now();
+            for (uint64_t n = 0; n < iterations; n++) {
+                ct_ws_unmask(payload, len, key, 0);
+                sink ^= (uint8_t)payload[n & (len - 1)];
+            }
+            report(impls[i], now() - start, iterations * len);
+        }
+    }
+    
+    free(buf);
+    (void)sink;
+    return 0;
+}
@@ -4,8 +4,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,8 +21,30 @@ extern "C" {
 #define CT_BUFFER_SIZE          65536
 #define CT_MAX_HEADERS          64
 #define CT_MAX_PATH_LEN         4096
-#define CT_HASH_TABLE_SIZE      16384
+#define CT_HASH_TABLE_SIZE      1024    /* initial - tables grow */
 #define CT_MEM_POOL_CHUNK_SIZE  1024
+#define CT_MAX_WORKERS          256
+#define CT_ACCEPT_BATCH         64      /* accepts per loop iteration */
+#define CT_ACCEPT_BACKOFF_MS    100     /* listener pause on fd exhaustion */
+#define CT_FILE_CACHE_SIZE      (64 << 20)  /* larger files stream via sendfile */
+#define CT_FILE_CACHE_RECHECK   1       /* seconds between mtime checks */
+#define CT_RESPONSE_HEAD_MAX    8192
+#define CT_RESPONSE_BLOCKS      4       /* header blocks per response */
+#define CT_U64_DIGITS           20
+#define CT_ETAG_MAX             40      /* quoted "<mtime hex>-<size hex>" */
+#define CT_OUTPUT_INLINE_MAX    16384   /* smaller bodies are copied */
+#define CT_OUTPUT_IOV_MAX       16
+#define CT_PIPELINE_MAX         16      /* requests per connection per pass */
+#define CT_IO_BUDGET            (256 << 10) /* bytes per connection per pass */
+#define CT_BODY_INLINE_MAX      (64 << 10)  /* larger request bodies stream */
+#define CT_STREAM_WATERMARK     (32 << 10)  /* output buffered ahead of a body stream */
+#define CT_H2_MAX_STREAMS       100     /* concurrent HTTP/2 streams per connection */
+#define CT_WS_DEFLATE_POOL      64      /* idle zlib stream pairs kept per reactor */
+#define CT_WS_DEFLATE_MIN       64      /* smaller messages go uncompressed */
+#define CT_WS_DEFLATE_RESPONSE_MAX 128  /* Sec-WebSocket-Extensions we send */
+#define CT_WS_FRAME_WHOLE       CT_BUFFER_SIZE  /* larger frames are read in pieces */
+#define CT_WS_MAX_MESSAGE       (16 << 20)  /* default message size limit */
+#define CT_HPACK_TABLE_SIZE     4096    /* HPACK decoder table - the protocol default */
 
 /* Platform-specific definitions */
 #ifdef LINUX
@@ -36,24 +61,88 @@ extern "C" {
 typedef struct ct_connection ct_connection_t;
 typedef struct ct_session ct_session_t;
 typedef struct ct_server ct_server_t;
+typedef struct ct_reactor ct_reactor_t;
 typedef struct ct_request ct_request_t;
 typedef struct ct_response ct_response_t;
+typedef struct ct_thread_pool ct_thread_pool_t;
+typedef struct ct_h2_conn ct_h2_conn_t;
+typedef struct ct_ws_deflate ct_ws_deflate_t;
+
+/* Slab pool for fixed-size objects with O(1) allocation. Chunks are
+ * carved from 2 MB-aligned blocks - huge pages where the system has them -
+ * touched only on first use; a block that empties is unmapped unless it is
+ * the last spare. Memory is not zeroed unless asked (ct_mem_pool_calloc).
+ * CT_MEM_POOL_SHARED pools may be used from any thread: each thread keeps
+ * a small chunk cache and refills or flushes it in batches under the
+ * pool lock. Other pools belong to a single thread and never lock. */
+#define CT_MEM_POOL_BLOCK       ((size_t)2 << 20)
+#define CT_MEM_POOL_CACHE       32      /* chunks per thread cache */
+#define CT_MEM_POOL_SHARED      0x1
+
+typedef struct ct_mem_block ct_mem_block_t;
+
+typedef struct ct_mem_pool_stats {
+    uint64_t allocs;
+    uint64_t hits;              /* recycled chunk, no lock or new memory */
+    uint64_t refills;           /* thread cache batches from the pool */
+    size_t blocks;
+    size_t bytes;               /* mapped */
+    size_t in_use;              /* chunks out of blocks (incl. caches) */
+    size_t huge_blocks;         /* backed by MAP_HUGETLB pages */
+} ct_mem_pool_stats_t;
 
-/* Memory pool for O(1) allocation */
 typedef struct ct_mem_pool {
-    void *free_list;
-    void *chunks;
     size_t chunk_size;
-    size_t total_chunks;
-    size_t free_chunks;
+    size_t chunks_per_block;
+    unsigned flags;
+    uint64_t id;
+    int cache_slot;             /* thread cache index, -1 if none */
+    pthread_mutex_t lock;       /* CT_MEM_POOL_SHARED only */
+    
+    ct_mem_block_t *blocks;     /* every block */
+    ct_mem_block_t *avail;      /* blocks with a free chunk */
+    size_t empty_blocks;        /* fully free, kept as spares */
+    
+    ct_mem_pool_stats_t stats;
 } ct_mem_pool_t;
 
-/* Lock-free ring buffer for async I/O */
+/* Size-classed buffer pool - power-of-two buffers from 4 KB to 1 MB.
+ * One per reactor, so no locking; freed buffers are cached per class up
+ * to CT_BUF_CACHE_BYTES and the rest go back to malloc. */
+#define CT_BUF_MIN_SHIFT        12
+#define CT_BUF_MAX_SHIFT        20
+#define CT_BUF_CLASSES          (CT_BUF_MAX_SHIFT - CT_BUF_MIN_SHIFT + 1)
+#define CT_BUF_MIN_SIZE         ((size_t)1 << CT_BUF_MIN_SHIFT)
+#define CT_BUF_MAX_SIZE         ((size_t)1 << CT_BUF_MAX_SHIFT)
+#define CT_BUF_CACHE_BYTES      (4 << 20)   /* per class */
+
+typedef struct ct_buf_pool {
+    bool mirrored;                      /* ct_mirror_map() works here */
+    void *free_list[CT_BUF_CLASSES];    /* mirrored buffers */
+    void *plain_list[CT_BUF_CLASSES];   /* malloc() fallbacks */
+    size_t cached[CT_BUF_CLASSES];      /* buffers on either list */
+    size_t in_use[CT_BUF_CLASSES];      /* buffers handed out */
+} ct_buf_pool_t;
+
+/* Lock-free ring buffer for async I/O. A pooled ring (pool != NULL) holds
+ * no memory until data is written, grows by doubling up to
+ * CT_BUF_MAX_SIZE, and returns its buffer to the pool once drained.
+ * A mirrored ring maps its storage twice back-to-back, so data[i + size]
+ * aliases data[i] and every readable span is contiguous. */
 typedef struct ct_ring_buffer {
     char *data;
     size_t size;
     _Atomic size_t read_pos;
     _Atomic size_t write_pos;
+    
+    ct_buf_pool_t *pool;
+    size_t size_hint;       /* size of the next allocation */
+    size_t high_water;      /* most bytes held since allocation */
+    bool pinned;            /* kernel holds a pointer into data */
+    bool mirrored;          /* this buffer is - set per allocation */
+    char *retired;          /* buffer outgrown while pinned, freed on unpin */
+    size_t retired_size;
+    bool retired_mirrored;
 } ct_ring_buffer_t;
 
 /* Red-black tree node for O(log n) operations */
@@ -64,14 +153,306 @@ typedef struct ct_rb_node {
     int color;
 } ct_rb_node_t;
 
-/* Hash table for O(1) lookups */
-typedef struct ct_hash_table {
-    void **buckets;
-    size_t size;
+/* Hierarchical timing wheel - O(1) add/cancel at 1 ms resolution.
+ * Six levels of 64 slots cover any realistic timeout; timers are embedded
+ * in their owner (like ct_rb_node_t) and recovered with offsetof(). */
+#define CT_TIMER_WHEEL_BITS     6
+#define CT_TIMER_WHEEL_SLOTS    (1 << CT_TIMER_WHEEL_BITS)
+#define CT_TIMER_WHEEL_LEVELS   6
+
+typedef struct ct_timer ct_timer_t;
+typedef void (*ct_timer_cb)(ct_timer_t *timer);
+
+struct ct_timer {
+    ct_timer_t *next;
+    ct_timer_t **pprev;     /* NULL when not scheduled */
+    uint64_t expires;       /* monotonic ms */
+    uint16_t index;         /* level * CT_TIMER_WHEEL_SLOTS + slot */
+    ct_timer_cb callback;
+};
+
+typedef struct ct_timer_wheel {
+    ct_timer_t *slots[CT_TIMER_WHEEL_LEVELS][CT_TIMER_WHEEL_SLOTS];
+    uint64_t occupied[CT_TIMER_WHEEL_LEVELS];   /* non-empty slot bitmap */
+    uint64_t current;                           /* next tick to expire */
     size_t count;
+} ct_timer_wheel_t;
+
+/* Cached clock - sampled once per event loop wakeup instead of on every
+ * request. Per thread: reactors refresh it after each wait returns; other
+ * threads must call ct_clock_update() themselves before reading it. */
+#define CT_HTTP_DATE_LEN        29      /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+#define CT_ISO_TIME_LEN         20      /* "1994-11-06T08:49:37Z" */
+
+typedef struct ct_clock {
+    uint64_t mono_ms;                       /* CLOCK_MONOTONIC(_COARSE) */
+    time_t wall;                            /* CLOCK_REALTIME(_COARSE) */
+    time_t formatted;                       /* second the strings show */
+    char http_date[CT_HTTP_DATE_LEN + 1];   /* RFC 7231 IMF-fixdate */
+    char iso_time[CT_ISO_TIME_LEN + 1];     /* ISO 8601, UTC */
+} ct_clock_t;
+
+extern __thread ct_clock_t ct_clock;
+
+void ct_clock_update(void);
+
+static inline const ct_clock_t *ct_clock_get(void) {
+    if (__builtin_expect(ct_clock.mono_ms == 0, 0)) {
+        ct_clock_update();
+    }
+    return &ct_clock;
+}
+
+/* Monotonic milliseconds, as of the last loop wakeup */
+static inline uint64_t ct_now_ms(void) {
+    return ct_clock_get()->mono_ms;
+}
+
+/* Wall-clock seconds, as of the last loop wakeup */
+static inline time_t ct_now(void) {
+    return ct_clock_get()->wall;
+}
+
+/* Preformatted Date header value, CT_HTTP_DATE_LEN bytes */
+static inline const char *ct_http_date(void) {
+    return ct_clock_get()->http_date;
+}
+
+/* Event loop self-instrumentation. Durations are recorded in raw cycle
+ * counter ticks (rdtsc / cntvct, clock_gettime ns elsewhere) into log2
+ * buckets and only converted to time when reported - one counter read and
+ * a few adds per sample, cheap enough to stay on in production. Each
+ * reactor writes only its own stats; readers tolerate torn snapshots. */
+#define CT_HIST_BUCKETS         48
+
+typedef struct ct_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[CT_HIST_BUCKETS];  /* [i] counts values < 2^i */
+} ct_histogram_t;
+
+typedef enum {
+    CT_LOOP_ACCEPT,
+    CT_LOOP_HTTP,
+    CT_LOOP_WEBSOCKET,
+    CT_LOOP_PROXY,
+    CT_LOOP_WRITE,
+    CT_LOOP_TIMERS,
+    CT_LOOP_JOBS,
+    CT_LOOP_HANDLER_COUNT
+} ct_loop_handler_t;
+
+typedef struct ct_loop_stats {
+    ct_histogram_t events;      /* events per wakeup (count, not time) */
+    ct_histogram_t blocked;     /* time in epoll_wait / io_uring_enter */
+    ct_histogram_t busy;        /* time from wakeup to next wait */
+    ct_histogram_t handler[CT_LOOP_HANDLER_COUNT];
+} ct_loop_stats_t;
+
+/* Buffer memory by connection state - snapshot refreshed by each reactor
+ * every CT_MEM_STATS_INTERVAL_MS */
+#define CT_MEM_STATS_INTERVAL_MS 1000
+
+typedef enum {
+    CT_MEM_IDLE,                /* keep-alive, nothing pending */
+    CT_MEM_HTTP,
+    CT_MEM_WEBSOCKET,
+    CT_MEM_PROXY,
+    CT_MEM_AWAITING_JOB,
+    CT_MEM_CLASS_COUNT
+} ct_mem_class_t;
+
+typedef struct ct_mem_class_stats {
+    uint64_t connections;
+    uint64_t buffered;          /* connections holding a pooled buffer */
+    uint64_t bytes;             /* buffer capacity held */
+} ct_mem_class_stats_t;
+
+typedef struct ct_mem_stats {
+    ct_mem_class_stats_t classes[CT_MEM_CLASS_COUNT];
+} ct_mem_stats_t;
+
+static inline uint64_t ct_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (value));
+    return value;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void ct_histogram_add(ct_histogram_t *hist, uint64_t value) {
+    unsigned bucket = value ? 64 - __builtin_clzll(value) : 0;
+    if (bucket >= CT_HIST_BUCKETS) bucket = CT_HIST_BUCKETS - 1;
+    
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max) hist->max = value;
+}
+
+/* Record time since start (a ct_cycles() value) against a handler class */
+static inline void ct_loop_stats_record(ct_loop_stats_t *stats, 
+                                        ct_loop_handler_t handler,
+                                        uint64_t start) {
+    ct_histogram_add(&stats->handler[handler], ct_cycles() - start);
+}
+
+/* Blocking job (bcrypt, compression) - run() executes on a pool thread,
+ * complete() back on the submitting reactor's thread. Embedded in its
+ * owner and recovered with offsetof(), like ct_timer_t. */
+typedef struct ct_job ct_job_t;
+typedef void (*ct_job_fn)(ct_job_t *job);
+
+struct ct_job {
+    ct_job_t *next;
+    ct_reactor_t *reactor;      /* completion is delivered here */
+    ct_connection_t *conn;      /* NULL once the connection has closed */
+    ct_job_fn run;
+    ct_job_fn complete;         /* must free the job */
+};
+
+/* Chunked response body, produced as the connection drains. produce()
+ * writes with ct_response_write_chunk whenever less than
+ * CT_STREAM_WATERMARK is buffered, and returns 1 for more, 0 at the end,
+ * -1 to abort (the connection closes). done() runs once however the
+ * stream ended, teardown included. Embedded like ct_job_t. */
+typedef struct ct_body_stream ct_body_stream_t;
+
+struct ct_body_stream {
+    int (*produce)(ct_connection_t *conn, ct_body_stream_t *stream);
+    void (*done)(ct_connection_t *conn, ct_body_stream_t *stream);
+};
+
+/* Streamed request body consumer, installed by a handler with
+ * ct_request_stream_body. consume() gets each decoded piece as it
+ * arrives - return -1 to refuse the rest, which closes the connection
+ * after the response. done() runs once at the end, before conn->response
+ * is sent; the body was whole if request.parse_state is
+ * CT_PARSE_COMPLETE. */
+typedef struct ct_body_sink ct_body_sink_t;
+
+struct ct_body_sink {
+    int (*consume)(ct_connection_t *conn, ct_body_sink_t *sink,
+                   const char *data, size_t len);
+    void (*done)(ct_connection_t *conn, ct_body_sink_t *sink);
+};
+
+/* Open-addressing hash table (Swiss-table style). Linear probing over
+ * one control byte per slot - empty, or 7 bits of the hash - matched 16
+ * at a time with SSE2/NEON. Keys up to CT_HT_INLINE_KEY bytes live in the
+ * slot itself. Deletion shifts the probe run back, so there are no
+ * tombstones. Past 7/8 load the table doubles and entries migrate from
+ * the old array a few slots per insert instead of all at once. */
+#define CT_HT_GROUP             16
+#define CT_HT_INLINE_KEY        32      /* fits a session id */
+#define CT_HT_MIGRATE_STEP      16      /* old slots moved per insert */
+
+typedef struct ct_hash_slot ct_hash_slot_t;
+
+typedef struct ct_hash_array {
+    uint8_t *ctrl;              /* capacity + CT_HT_GROUP, tail mirrors head */
+    ct_hash_slot_t *slots;
+    size_t capacity;            /* power of two, >= CT_HT_GROUP */
+    size_t used;
+} ct_hash_array_t;
+
+typedef struct ct_hash_table {
+    ct_hash_array_t cur;
+    ct_hash_array_t old;        /* draining during a resize, else empty */
+    size_t migrate_pos;
+    size_t count;               /* entries in both arrays */
     uint32_t (*hash_func)(const void *key, size_t len);
 } ct_hash_table_t;
 
+/* Preformatted header lines ("Name: value\r\n"...) - a response head
+ * takes a block with one memcpy. CT_HEADER_BLOCK builds one from a string
+ * literal at compile time. */
+typedef struct ct_header_block {
+    const char *data;
+    size_t len;
+} ct_header_block_t;
+
+#define CT_HEADER_BLOCK(lines) { (lines), sizeof(lines) - 1 }
+
+/* Static file cache entry - content is heap or mmap()ed, shared by every
+ * reactor and pinned by ref_count while a response references it */
+typedef struct ct_file_entry {
+    char *path;
+    char *content;
+    size_t size;
+    const char *content_type;
+    time_t mtime;
+    time_t checked;         /* last mtime check, under the cache lock */
+    
+    /* Compressed version */
+    char *gzip_content;
+    size_t gzip_size;
+    
+    /* Response templates - status line through ETag, built on load so a
+     * 200 is the template, the Date and the length digits */
+    char etag[CT_ETAG_MAX];
+    size_t etag_len;
+    ct_header_block_t head;
+    ct_header_block_t head_gzip;
+    
+    /* Memory mapping info */
+    void *mmap_addr;
+    size_t mmap_size;
+    
+    /* LRU tracking */
+    struct ct_file_entry *lru_prev;
+    struct ct_file_entry *lru_next;
+    
+    /* Reference counting - the cache holds one reference while the entry
+     * is in the table; whoever drops the last one frees it */
+    _Atomic int ref_count;
+} ct_file_entry_t;
+
+typedef struct ct_file_cache {
+    pthread_mutex_t lock; /* shared by all reactors - never held for I/O */
+    ct_hash_table_t *entries;
+    ct_file_entry_t *lru_head;
+    ct_file_entry_t *lru_tail;
+    size_t max_size;
+    size_t current_size;
+    _Atomic size_t hits;
+    _Atomic size_t misses;
+} ct_file_cache_t;
+
+/* Response output queue. Bytes written to conn->write_buf go out in
+ * order, but a body that shouldn't be copied - cached file content or a
+ * file too large to cache - is queued as a segment. Ring bytes written
+ * before a segment are covered by a CT_OUT_RING segment ahead of it; ring
+ * bytes after the last segment follow implicitly. */
+typedef enum {
+    CT_OUT_RING,                /* len bytes from the front of write_buf */
+    CT_OUT_MEM,                 /* data, pinned by entry (if any) */
+    CT_OUT_BUF,                 /* data in an owned buf_pool buffer */
+    CT_OUT_FILE                 /* len bytes of fd from offset - fd owned */
+} ct_out_type_t;
+
+typedef struct ct_out_seg {
+    struct ct_out_seg *next;
+    ct_out_type_t type;
+    size_t len;                 /* bytes left to send */
+    const char *data;
+    ct_file_entry_t *entry;
+    void *buf;
+    size_t buf_size;
+    bool buf_mirrored;
+    int fd;
+    off_t offset;
+} ct_out_seg_t;
+
 /* HTTP request parser state */
 typedef enum {
     CT_PARSE_METHOD,
@@ -90,6 +471,7 @@ typedef enum {
     CT_CONN_READING,
     CT_CONN_WRITING,
     CT_CONN_PROXYING,
+    CT_CONN_AWAITING_JOB,       /* parked until conn->job completes */
     CT_CONN_CLOSING
 } ct_conn_state_t;
 
@@ -115,6 +497,97 @@ typedef enum {
     CT_WS_PONG = 0xA
 } ct_ws_opcode_t;
 
+/* One piece of a WebSocket message, or a whole control frame. data
+ * points into the buffer read from, valid until the next ct_ws_read. */
+typedef struct {
+    const char *data;
+    size_t len;
+    ct_ws_opcode_t opcode;      /* the message's - never CONTINUATION */
+    bool first;                 /* first piece of the message */
+    bool fin;                   /* last piece of the message */
+    bool compressed;            /* permessage-deflate data, still compressed */
+} ct_ws_piece_t;
+
+/* WebSocket receive state - the frame being read and the message it
+ * belongs to. Frames up to CT_WS_FRAME_WHOLE are read whole; larger ones
+ * are unmasked and handed on as their bytes arrive, so neither a frame
+ * nor a fragmented message has to fit in a buffer. */
+typedef struct {
+    uint64_t frame_left;        /* payload bytes of the frame still to come */
+    uint64_t frame_pos;         /* payload bytes of it read - the mask offset */
+    uint64_t message_len;       /* message bytes delivered, after inflating */
+    size_t consumed;            /* bytes of the last piece, skipped next read */
+    uint8_t mask_key[4];
+    ct_ws_opcode_t message_opcode;  /* TEXT/BINARY in progress, else CONTINUATION */
+    bool in_frame;              /* header read, payload streaming */
+    bool masked;
+    bool frame_fin;
+    bool message_first;         /* nothing of the message delivered yet */
+    bool message_compressed;    /* RSV1 on its first frame */
+    bool paused;                /* piece's delivery stopped on a full sink */
+    ct_ws_piece_t pending;      /* that piece - the rest is in the inflater */
+} ct_ws_rx_t;
+
+/* WebSocket message consumer, installed with ct_ws_set_handler once the
+ * handshake is done. message() gets each data message in pieces as it
+ * arrives - unmasked, inflated, fragments joined - with first set on its
+ * first piece and fin on its last; messages that fit a frame buffer
+ * arrive as one piece. Return 1 once the piece is taken but no more can
+ * be for now (output backed up, say): input waits until the
+ * connection's output drains, or the next loop pass if there is none.
+ * Return -1 to close the connection. done() runs once at teardown.
+ * Without a handler, messages are echoed. */
+typedef struct ct_ws_handler ct_ws_handler_t;
+
+struct ct_ws_handler {
+    int (*message)(ct_connection_t *conn, ct_ws_handler_t *handler,
+                   ct_ws_opcode_t opcode, const char *data, size_t len,
+                   bool first, bool fin);
+    void (*done)(ct_connection_t *conn, ct_ws_handler_t *handler);
+};
+
+/* Request headers the server looks up - the parser interns them so a
+ * lookup is one load (http_parser.c keeps the name table) */
+typedef enum {
+    CT_HDR_UNKNOWN,
+    CT_HDR_HOST,
+    CT_HDR_CONNECTION,
+    CT_HDR_CONTENT_LENGTH,
+    CT_HDR_CONTENT_TYPE,
+    CT_HDR_USER_AGENT,
+    CT_HDR_ACCEPT,
+    CT_HDR_ACCEPT_ENCODING,
+    CT_HDR_COOKIE,
+    CT_HDR_IF_NONE_MATCH,
+    CT_HDR_RANGE,
+    CT_HDR_UPGRADE,
+    CT_HDR_SEC_WEBSOCKET_KEY,
+    CT_HDR_SEC_WEBSOCKET_VERSION,
+    CT_HDR_SEC_WEBSOCKET_PROTOCOL,
+    CT_HDR_TRANSFER_ENCODING,
+    CT_HDR_SEC_WEBSOCKET_EXTENSIONS,
+    CT_HDR_COUNT
+} ct_header_id_t;
+
+/* HPACK decoder state - the dynamic table the peer indexes into, newest
+ * entry at head. Each entry's name and value share one allocation. */
+typedef struct ct_hpack_entry {
+    char *data;
+    uint32_t name_len;
+    uint32_t value_len;
+} ct_hpack_entry_t;
+
+typedef struct ct_hpack {
+    ct_hpack_entry_t entries[CT_HPACK_TABLE_SIZE / 32];
+    size_t head;
+    size_t count;
+    size_t size;                /* name + value + 32 per entry (RFC 7541) */
+    size_t max_size;
+} ct_hpack_t;
+
+typedef int (*ct_hpack_field_fn)(void *ctx, const char *name, size_t name_len,
+                                 const char *value, size_t value_len);
+
 /* HTTP header */
 typedef struct ct_header {
     const char *name;
@@ -123,18 +596,41 @@ typedef struct ct_header {
     size_t value_len;
 } ct_header_t;
 
-/* HTTP request */
+/* Request header - offsets from the request's first byte, so they stay
+ * valid while the read buffer grows or moves */
+typedef struct ct_req_header {
+    uint32_t name;
+    uint32_t name_len;
+    uint32_t value;
+    uint32_t value_len;
+} ct_req_header_t;
+
+/* HTTP request - parsed incrementally, fields as offsets from base */
 struct ct_request {
     ct_http_method_t method;
-    const char *url;
-    const char *version;
-    ct_header_t headers[CT_MAX_HEADERS];
+    const char *base;               /* first byte, as of the last parse call */
+    uint32_t url;
+    uint32_t url_len;
+    ct_req_header_t headers[CT_MAX_HEADERS];
     size_t header_count;
-    const char *body;
-    size_t body_len;
+    uint8_t known[CT_HDR_COUNT];    /* headers[] index + 1, 0 if absent */
+    size_t content_length;
+    uint32_t body;
+    size_t body_len;                /* streamed: bytes decoded so far */
+    uint32_t scanned;               /* bytes examined - a resumed parse starts here */
+    uint32_t mark;                  /* start of the field being parsed */
     ct_parse_state_t parse_state;
     bool is_websocket;
     bool keep_alive;
+    
+    /* Streamed body - chunked, or over CT_BODY_INLINE_MAX. The head is
+     * complete with parse_state still CT_PARSE_BODY, and the body is
+     * decoded from the bytes that follow with ct_request_body_next. */
+    bool chunked;
+    bool body_streamed;
+    uint8_t chunk_state;
+    uint8_t chunk_digits;
+    uint64_t body_left;             /* of the body, or of the current chunk */
 };
 
 /* HTTP response */
@@ -146,18 +642,36 @@ struct ct_response {
     const char *body;
     size_t body_len;
     bool chunked;
+    ct_body_stream_t *stream;   /* chunked body producer, owned until done() */
+    
+    /* Preformatted parts - a template stands in for the status line and
+     * the headers before the Date; blocks follow the Date */
+    const ct_header_block_t *head_template;
+    const ct_header_block_t *blocks[CT_RESPONSE_BLOCKS];
+    size_t block_count;
+    
+    /* Body sources that are queued instead of copied - both owned by the
+     * response until it is sent. body/body_len must point into the entry. */
+    ct_file_entry_t *body_entry;
+    int body_fd;                /* valid if body_from_fd */
+    off_t body_offset;
+    bool body_from_fd;
 };
 
 /* Session data with O(1) hash lookup and O(log n) expiry */
+/* A session is shared by every reactor. Lookups hand out a reference
+ * (dropped with ct_session_release); destroying or expiring one unlinks
+ * it at once, but its memory goes back to the pool only when the last
+ * reference does. Fields other than id and authenticated change only
+ * under server->session_lock. */
 struct ct_session {
     char id[CT_SESSION_ID_LEN + 1];
     time_t created;
     time_t last_access;
-    bool authenticated;
+    _Atomic bool authenticated;
     void *user_data;
-    
-    /* Hash table chain */
-    struct ct_session *hash_next;
+    uint32_t refs;
+    bool unlinked;              /* destroyed or expired, awaiting release */
     
     /* Red-black tree node for expiry */
     ct_rb_node_t expiry_node;
@@ -167,6 +681,7 @@ struct ct_session {
 struct ct_connection {
     int fd;
     uint64_t id;
+    uint32_t slot;              /* index in reactor->conns */
     ct_conn_state_t state;
     ct_session_t *session;
     ct_request_t request;
@@ -176,21 +691,60 @@ struct ct_connection {
     ct_ring_buffer_t read_buf;
     ct_ring_buffer_t write_buf;
     
+    /* Queued body segments, in send order ahead of the unqueued tail of
+     * write_buf; out_ring_queued counts write_buf bytes already covered */
+    ct_out_seg_t *out_head;
+    ct_out_seg_t *out_tail;
+    size_t out_ring_queued;
+    
+    /* Streamed bodies - a response being produced (later requests wait),
+     * a request body being fed to a handler. head_copy holds the request
+     * head once its bytes have left read_buf. */
+    ct_body_stream_t *body_stream;
+    ct_body_sink_t *body_sink;
+    char *head_copy;
+    
+    /* HTTP/2 state once the connection has switched (http2.c) */
+    ct_h2_conn_t *h2;
+    
     /* WebSocket state */
     bool is_websocket;
     bool ws_handshake_done;
-    uint8_t ws_mask_key[4];
+    ct_ws_rx_t ws_rx;
+    ct_ws_handler_t *ws_handler;
+    ct_ws_deflate_t *ws_deflate;    /* permessage-deflate, if negotiated */
+    bool ws_blocked;                /* input waits for the output to drain */
     
-    /* Proxy state */
-    int proxy_fd;
+    /* Proxy state (ws_proxy.c) */
+    void *proxy_state;
     bool is_proxying;
     
-    /* Timing */
-    time_t created;
-    time_t last_activity;
+    /* Timing (monotonic ms) */
+    uint64_t created;
+    uint64_t last_activity;
+    uint64_t request_start;     /* first byte of the pending request, 0 if idle */
+    uint64_t ws_ping_sent;      /* outstanding ping, 0 if none */
+    ct_timer_t timer;           /* idle / header-read / ping deadline */
+    
+    /* Outstanding pool job (CT_CONN_AWAITING_JOB) */
+    ct_job_t *job;
+    
+    /* Reactor ready list - input or output left over when a pass ran out
+     * of budget; read_more means the socket may still hold unread bytes */
+    struct ct_connection *ready_prev;
+    struct ct_connection *ready_next;
+    bool ready;
+    bool read_more;
     
-    /* Hash table chain */
-    struct ct_connection *hash_next;
+    /* Owning server and reactor (event loop thread) */
+    ct_server_t *server;
+    ct_reactor_t *reactor;
+    
+    /* Completion-based I/O state (io_uring backend) */
+    uint32_t io_pending;
+    uint32_t io_flags;
+    int io_backend_fd;          /* proxy backend being polled */
+    struct ct_connection *io_next;
 };
 
 /* Server configuration */
@@ -203,28 +757,97 @@ typedef struct ct_config {
     const char *password_hash;
     size_t max_connections;
     size_t max_sessions;
+    size_t workers;
+    size_t job_threads;         /* blocking-job pool size (0 = run inline) */
+    size_t io_budget;           /* bytes read/written per connection before
+                                   yielding to others (0 = CT_IO_BUDGET) */
     time_t session_timeout;
+    time_t idle_timeout;        /* keep-alive idle, seconds (0 = off) */
+    time_t header_timeout;      /* full request must arrive within, seconds */
+    time_t ws_ping_interval;    /* ping idle WebSockets after, seconds */
+    time_t ws_ping_timeout;     /* close if no traffic after ping, seconds */
+    int ws_deflate_window_bits; /* permessage-deflate window, 9-15 (0 = off) */
+    size_t ws_max_message;      /* WebSocket message limit, bytes (0 = CT_WS_MAX_MESSAGE) */
     bool enable_compression;
     bool enable_ssl;
+    bool use_io_uring;
 } ct_config_t;
 
-/* Main server structure */
-struct ct_server {
+/* Reactor - one event loop per worker thread. Each reactor owns its own
+ * SO_REUSEPORT listen socket, event fd and connection table, so the hot
+ * path never takes a lock. */
+struct ct_reactor {
+    ct_server_t *server;
+    size_t index;
+    pthread_t thread;
+    
     int listen_fd;
     int event_fd;
-    ct_config_t config;
+    int wake_fd;
     
-    /* Connection management */
-    ct_hash_table_t *connections;
+    /* No SO_REUSEPORT: reactors share one listener, woken exclusively */
+    bool listen_shared;
+    
+    /* Connection management - live connections are packed densely in
+     * conns (conn->slot is the index), so walking them is a flat scan */
+    ct_connection_t **conns;
+    size_t conn_count;
+    size_t conn_capacity;
     ct_mem_pool_t *conn_pool;
+    ct_mem_pool_t *seg_pool;    /* ct_out_seg_t */
+    ct_buf_pool_t buf_pool;     /* connection read/write buffers */
+    ct_ws_deflate_t *deflate_pool;  /* reset permessage-deflate streams */
+    size_t deflate_pool_count;
+    
+    /* Connection deadlines and periodic work (session expiry on reactor 0) */
+    ct_timer_wheel_t timers;
+    ct_timer_t session_timer;
+    ct_timer_t accept_timer;
+    ct_timer_t stats_timer;
+    
+    /* Loop instrumentation - written only by this reactor's thread */
+    ct_loop_stats_t stats;
+    ct_mem_stats_t mem_stats;
+    
+    /* Connections with buffered requests, unread input or unsent output
+     * still to serve - drained every loop iteration, and the loop doesn't
+     * block while non-empty */
+    ct_connection_t *ready_head;
+    ct_connection_t *ready_tail;
+    
+    /* Finished pool jobs, pushed by pool threads; the wake fd signals */
+    pthread_mutex_t job_lock;
+    ct_job_t *jobs_done;
+    
+    /* Backend hooks - how the active event backend flushes or closes a
+     * connection outside its own I/O callbacks (e.g. from a timer), and
+     * watches a proxy's second socket on its behalf */
+    void (*flush_connection)(ct_reactor_t *reactor, ct_connection_t *conn);
+    void (*close_connection)(ct_reactor_t *reactor, ct_connection_t *conn);
+    int (*add_backend)(ct_reactor_t *reactor, int fd, ct_connection_t *conn);
+    void (*remove_backend)(ct_reactor_t *reactor, ct_connection_t *conn);
+    void *backend;
+};
+
+/* Main server structure */
+struct ct_server {
+    ct_config_t config;
+    
+    /* Event loops - reactors[0] runs on the calling thread */
+    ct_reactor_t *reactors;
+    size_t reactor_count;
     
-    /* Session management */
+    /* Session management - shared by all reactors */
+    pthread_mutex_t session_lock;
     ct_hash_table_t *sessions;
     ct_rb_node_t *session_expiry_tree;
     ct_mem_pool_t *session_pool;
     
     /* File cache */
-    ct_hash_table_t *file_cache;
+    ct_file_cache_t *file_cache;
+    
+    /* Blocking-job pool - NULL when disabled */
+    ct_thread_pool_t *job_pool;
     
     /* Statistics */
     _Atomic uint64_t total_requests;
@@ -237,30 +860,193 @@ ct_server_t *ct_server_create(const ct_config_t *config);
 void ct_server_destroy(ct_server_t *server);
 int ct_server_run(ct_server_t *server);
 void ct_server_stop(ct_server_t *server);
+void ct_reactor_wake(ct_reactor_t *reactor);
+void ct_reactor_handle_wake(ct_reactor_t *reactor);
+void ct_reactor_mark_ready(ct_reactor_t *reactor, ct_connection_t *conn);
+void ct_reactor_unmark_ready(ct_reactor_t *reactor, ct_connection_t *conn);
+void ct_reactor_run_ready(ct_reactor_t *reactor);
+int ct_reactor_add_backend(ct_reactor_t *reactor, int fd, ct_connection_t *conn);
+void ct_reactor_remove_backend(ct_reactor_t *reactor, ct_connection_t *conn);
+void ct_server_request_stats_dump(ct_server_t *server);
+
+/* Loop statistics */
+void ct_loop_stats_calibrate(void);
+size_t ct_loop_stats_json(ct_server_t *server, char *buf, size_t buf_len);
+void ct_loop_stats_dump(ct_server_t *server, FILE *out);
+void ct_mem_stats_collect(ct_reactor_t *reactor);
+size_t ct_mem_stats_json(ct_server_t *server, char *buf, size_t buf_len);
+
+/* Blocking-job pool */
+ct_thread_pool_t *ct_thread_pool_create(size_t threads);
+void ct_thread_pool_destroy(ct_thread_pool_t *pool);
+int ct_thread_pool_submit(ct_thread_pool_t *pool, ct_job_t *job);
+void ct_reactor_complete_jobs(ct_reactor_t *reactor);
+
+/* io_uring backend - returns 1 if io_uring is unavailable (caller falls
+ * back to epoll), 0 on clean shutdown, -1 on error */
+int ct_uring_run(ct_reactor_t *reactor, const _Atomic bool *running);
 
 /* Connection management */
-ct_connection_t *ct_connection_create(ct_server_t *server, int fd);
-void ct_connection_destroy(ct_server_t *server, ct_connection_t *conn);
+ct_connection_t *ct_connection_create(ct_reactor_t *reactor, int fd);
+void ct_connection_destroy(ct_reactor_t *reactor, ct_connection_t *conn);
 int ct_connection_read(ct_connection_t *conn);
+int ct_connection_drain(ct_server_t *server, ct_connection_t *conn);
 int ct_connection_write(ct_connection_t *conn);
 int ct_connection_process(ct_server_t *server, ct_connection_t *conn);
+int ct_connection_process_websocket(ct_server_t *server, ct_connection_t *conn);
+int ct_connection_stream(ct_connection_t *conn);
+int ct_connection_refill(ct_connection_t *conn);
+void ct_connection_dispatch(ct_server_t *server, ct_connection_t *conn);
+void ct_connection_touch(ct_connection_t *conn);
+ct_loop_handler_t ct_connection_handler_class(const ct_connection_t *conn);
+ct_mem_class_t ct_connection_mem_class(const ct_connection_t *conn);
+
+/* Request routing and API handlers */
+void ct_route_request(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_api_request(ct_server_t *server, ct_connection_t *conn,
+                           const char *path);
+void ct_handle_login(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_logout(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_terminal_config(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_session_status(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_loop_stats(ct_server_t *server, ct_connection_t *conn);
+void ct_handle_memory_stats(ct_server_t *server, ct_connection_t *conn);
+
+/* Response output queue */
+int ct_output_queue_mem(ct_connection_t *conn, const char *data, size_t len,
+                        ct_file_entry_t *entry);
+int ct_output_queue_file(ct_connection_t *conn, int fd, off_t offset, size_t len);
+bool ct_output_pending(ct_connection_t *conn);
+unsigned ct_output_iov(ct_connection_t *conn, struct iovec *iov,
+                       unsigned max_iov);
+void ct_output_consume(ct_connection_t *conn, size_t len);
+int ct_output_stage_file(ct_connection_t *conn);
+int ct_output_write(ct_connection_t *conn);
+void ct_output_clear(ct_connection_t *conn);
+void ct_response_release(ct_connection_t *conn);
+
+/* Static files */
+ct_file_cache_t *ct_file_cache_create(size_t max_size);
+void ct_file_cache_destroy(ct_file_cache_t *cache);
+ct_file_entry_t *ct_file_cache_get(ct_file_cache_t *cache, const char *path);
+void ct_file_cache_release(ct_file_cache_t *cache, ct_file_entry_t *entry);
+const char *ct_file_mime_type(const char *path);
+int ct_serve_static_file(ct_connection_t *conn, const char *base_dir,
+                        const char *url_path);
 
 /* Session management */
 ct_session_t *ct_session_create(ct_server_t *server);
 ct_session_t *ct_session_find(ct_server_t *server, const char *id);
+char *ct_session_from_cookie(const char *cookie_header, size_t len);
+void ct_session_release(ct_server_t *server, ct_session_t *session);
 void ct_session_destroy(ct_server_t *server, ct_session_t *session);
+void ct_session_set_authenticated(ct_server_t *server, ct_session_t *session);
+bool ct_session_is_authenticated(ct_session_t *session);
 void ct_session_cleanup_expired(ct_server_t *server);
+time_t ct_session_next_expiry(ct_server_t *server);
 
 /* HTTP parsing */
 int ct_parse_request(ct_request_t *req, const char *data, size_t len);
+ct_header_t ct_request_header(const ct_request_t *req, ct_header_id_t id);
+const char *ct_request_get_header(ct_request_t *req, const char *name);
+int ct_request_path(const ct_request_t *req, char *path, size_t path_len);
+const char *ct_request_body(const ct_request_t *req);
+int ct_request_body_next(ct_request_t *req, const char *data, size_t len,
+                         const char **piece, size_t *piece_len);
+void ct_request_stream_body(ct_connection_t *conn, ct_body_sink_t *sink);
 int ct_build_response(ct_response_t *resp, char *buf, size_t buf_len);
+int ct_build_response_head(ct_response_t *resp, char *buf, size_t buf_len);
+void ct_response_init(ct_response_t *resp, int status_code, const char *status_text);
+int ct_response_add_header(ct_response_t *resp, const char *name, const char *value);
+int ct_response_add_header_len(ct_response_t *resp, const char *name,
+                               const char *value, size_t value_len);
+void ct_response_json(ct_response_t *resp, int status_code, const char *json_body);
+void ct_response_html(ct_response_t *resp, int status_code, const char *html_body);
+int ct_response_add_block(ct_response_t *resp, const ct_header_block_t *block);
+void ct_response_stream(ct_response_t *resp, ct_body_stream_t *stream);
+int ct_response_write_chunk(ct_connection_t *conn, const void *data, size_t len);
+void ct_response_add_cors_headers(ct_response_t *resp);
+void ct_response_add_security_headers(ct_response_t *resp);
+
+/* Constant header blocks (http_response.c) */
+extern const ct_header_block_t ct_headers_security;
+extern const ct_header_block_t ct_headers_cors;
+extern const ct_header_block_t ct_headers_upgrade;
+
+/* HTTP byte-class scanners - SIMD where the CPU has it (http_scan.c) */
+int ct_http_scan_init(const char *name);
+const char *ct_http_scan_name(void);
+const char *ct_scan_token(const char *p, const char *end);
+const char *ct_scan_target(const char *p, const char *end);
+const char *ct_scan_value(const char *p, const char *end);
+
+/* HTTP/2 over cleartext (http2.c) */
+int ct_h2_preface(const char *data, size_t len);
+bool ct_h2_upgrade_requested(const ct_request_t *req);
+int ct_h2_start(ct_connection_t *conn, const ct_request_t *upgrade);
+int ct_h2_process(ct_server_t *server, ct_connection_t *conn);
+void ct_h2_respond(ct_connection_t *conn);
+int ct_h2_pump(ct_connection_t *conn);
+void ct_h2_free(ct_connection_t *conn);
+
+/* HPACK (hpack.c) */
+void ct_hpack_init(void);
+void ct_hpack_table_init(ct_hpack_t *hp);
+void ct_hpack_table_free(ct_hpack_t *hp);
+int ct_hpack_decode(ct_hpack_t *hp, const uint8_t *block, size_t len,
+                    ct_hpack_field_fn field, void *ctx);
+uint8_t *ct_hpack_encode_status(uint8_t *p, int status);
+uint8_t *ct_hpack_encode_field(uint8_t *p, const char *name, size_t name_len,
+                               const char *value, size_t value_len);
 
 /* WebSocket handling */
 int ct_ws_handshake(ct_connection_t *conn);
-int ct_ws_parse_frame(const char *data, size_t len, ct_ws_opcode_t *opcode, 
-                      const char **payload, size_t *payload_len);
+int ct_ws_read(ct_ws_rx_t *rx, ct_ring_buffer_t *rb, bool deflate,
+               ct_ws_piece_t *piece);
+void ct_ws_set_handler(ct_connection_t *conn, ct_ws_handler_t *handler);
+typedef int (*ct_ws_piece_fn)(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                              const char *data, size_t len, bool first, bool fin);
+int ct_ws_deliver(ct_connection_t *conn, const ct_ws_piece_t *piece,
+                  ct_ws_piece_fn fn);
+int ct_ws_deliver_resume(ct_connection_t *conn, ct_ws_piece_fn fn);
 int ct_ws_build_frame(ct_ws_opcode_t opcode, const char *payload, 
                       size_t payload_len, char *buf, size_t buf_len);
+int ct_ws_process_frame(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                        const char *payload, size_t payload_len);
+int ct_ws_send_message(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                       const char *data, size_t len);
+int ct_ws_send_fragment(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                        const char *data, size_t len, bool first, bool fin);
+int ct_ws_send_text(ct_connection_t *conn, const char *text);
+int ct_ws_send_binary(ct_connection_t *conn, const void *data, size_t len);
+int ct_ws_send_ping(ct_connection_t *conn, const char *data, size_t len);
+int ct_ws_send_pong(ct_connection_t *conn, const char *data, size_t len);
+int ct_ws_send_close(ct_connection_t *conn, uint16_t code, const char *reason);
+void ct_base64_encode(const unsigned char *in, size_t in_len, char *out);
+
+/* permessage-deflate (ws_deflate.c) */
+size_t ct_ws_deflate_negotiate(ct_connection_t *conn, const char *value,
+                               size_t value_len, char *out);
+int ct_ws_deflate_message(ct_connection_t *conn, const char *data, size_t len,
+                          const char **out, size_t *out_len);
+void ct_ws_inflate_begin(ct_connection_t *conn, const char *data, size_t len,
+                         bool fin);
+int ct_ws_inflate_next(ct_connection_t *conn, const char **out, size_t *out_len);
+void ct_ws_inflate_rebase(ct_connection_t *conn, const char *end);
+void ct_ws_deflate_release(ct_connection_t *conn);
+void ct_ws_deflate_pool_destroy(ct_reactor_t *reactor);
+
+/* Terminal WebSocket proxy (ws_proxy.c) */
+int ct_proxy_terminal(ct_connection_t *conn, const char *terminal_host,
+                      uint16_t terminal_port);
+int ct_proxy_process(ct_connection_t *conn);
+int ct_proxy_refill(ct_connection_t *conn);
+void ct_proxy_cleanup(ct_connection_t *conn);
+
+/* WebSocket payload unmasking - SIMD where the CPU has it (ws_mask.c) */
+int ct_ws_unmask_init(const char *name);
+const char *ct_ws_unmask_name(void);
+void ct_ws_unmask(char *data, size_t len, const uint8_t key[4], uint64_t pos);
 
 /* Authentication */
 bool ct_auth_verify_password(const char *password, const char *hash);
@@ -270,21 +1056,46 @@ char *ct_auth_hash_password(const char *password);
 uint32_t ct_hash_fnv1a(const void *key, size_t len);
 uint32_t ct_hash_murmur3(const void *key, size_t len);
 void ct_get_timestamp(char *buf, size_t buf_len);
+char *ct_fmt_u64(char *p, uint64_t v);
+char *ct_fmt_hex(char *p, uint64_t v);
 int ct_parse_url(const char *url, char *path, size_t path_len, 
                  char *query, size_t query_len);
 
 /* Memory pool operations */
-ct_mem_pool_t *ct_mem_pool_create(size_t chunk_size, size_t initial_chunks);
+ct_mem_pool_t *ct_mem_pool_create(size_t chunk_size, size_t initial_chunks,
+                                  unsigned flags);
 void ct_mem_pool_destroy(ct_mem_pool_t *pool);
 void *ct_mem_pool_alloc(ct_mem_pool_t *pool);
+void *ct_mem_pool_calloc(ct_mem_pool_t *pool);
 void ct_mem_pool_free(ct_mem_pool_t *pool, void *ptr);
+void ct_mem_pool_get_stats(ct_mem_pool_t *pool, ct_mem_pool_stats_t *out);
 
 /* Ring buffer operations */
 ct_ring_buffer_t *ct_ring_buffer_create(size_t size);
 void ct_ring_buffer_destroy(ct_ring_buffer_t *rb);
+void ct_ring_buffer_init_pooled(ct_ring_buffer_t *rb, ct_buf_pool_t *pool);
+size_t ct_ring_buffer_reserve(ct_ring_buffer_t *rb, size_t len);
+void ct_ring_buffer_release(ct_ring_buffer_t *rb);
+void ct_ring_buffer_unpin(ct_ring_buffer_t *rb);
 size_t ct_ring_buffer_write(ct_ring_buffer_t *rb, const char *data, size_t len);
 size_t ct_ring_buffer_read(ct_ring_buffer_t *rb, char *data, size_t len);
+size_t ct_ring_buffer_peek(ct_ring_buffer_t *rb, char *data, size_t len);
+size_t ct_ring_buffer_skip(ct_ring_buffer_t *rb, size_t len);
 size_t ct_ring_buffer_available(ct_ring_buffer_t *rb);
+size_t ct_ring_buffer_free_space(ct_ring_buffer_t *rb);
+int ct_ring_buffer_free_iov(ct_ring_buffer_t *rb, struct iovec iov[2]);
+void ct_ring_buffer_commit(ct_ring_buffer_t *rb, size_t len);
+int ct_ring_buffer_data_iov(ct_ring_buffer_t *rb, struct iovec iov[2]);
+const char *ct_ring_buffer_peek_ptr(ct_ring_buffer_t *rb, size_t *len);
+void *ct_mirror_map(size_t size);
+void ct_mirror_unmap(void *base, size_t size);
+
+/* Buffer pool operations */
+void ct_buf_pool_init(ct_buf_pool_t *pool);
+void ct_buf_pool_destroy(ct_buf_pool_t *pool);
+void *ct_buf_pool_alloc(ct_buf_pool_t *pool, size_t size, bool *mirrored);
+void ct_buf_pool_free(ct_buf_pool_t *pool, void *buf, size_t size,
+                      bool mirrored);
 
 /* Hash table operations */
 ct_hash_table_t *ct_hash_table_create(size_t size, 
@@ -294,6 +1105,19 @@ void *ct_hash_table_get(ct_hash_table_t *ht, const void *key, size_t key_len);
 void ct_hash_table_set(ct_hash_table_t *ht, const void *key, size_t key_len, 
                        void *value);
 void ct_hash_table_delete(ct_hash_table_t *ht, const void *key, size_t key_len);
+void ct_hash_table_foreach(ct_hash_table_t *ht,
+                          void (*callback)(void *key, size_t key_len,
+                                         void *value, void *ctx),
+                          void *ctx);
+
+/* Timing wheel operations */
+void ct_timer_wheel_init(ct_timer_wheel_t *wheel, uint64_t now_ms);
+void ct_timer_init(ct_timer_t *timer, ct_timer_cb callback);
+bool ct_timer_pending(const ct_timer_t *timer);
+void ct_timer_add(ct_timer_wheel_t *wheel, ct_timer_t *timer, uint64_t expires_ms);
+void ct_timer_cancel(ct_timer_wheel_t *wheel, ct_timer_t *timer);
+void ct_timer_wheel_advance(ct_timer_wheel_t *wheel, uint64_t now_ms);
+int ct_timer_wheel_timeout(ct_timer_wheel_t *wheel, uint64_t now_ms);
 
 /* Red-black tree operations */
 void ct_rb_insert(ct_rb_node_t **root, ct_rb_node_t *node, 
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <time.h>
 
 /* Session comparison for red-black tree */
@@ -17,20 +18,24 @@ static int session_expiry_compare(ct_rb_node_t *a, ct_rb_node_t *b) {
     return strcmp(sa->id, sb->id);
 }
 
-/* Create new session */
+/* Create new session - the caller holds its first reference */
 ct_session_t *ct_session_create(ct_server_t *server) {
     /* Allocate from pool - O(1) */
-    ct_session_t *session = ct_mem_pool_alloc(server->session_pool);
-    if (!session) return NULL;
+    pthread_mutex_lock(&server->session_lock);
+    ct_session_t *session = ct_mem_pool_calloc(server->session_pool);
+    if (!session) {
+        pthread_mutex_unlock(&server->session_lock);
+        return NULL;
+    }
     
     /* Initialize session */
-    memset(session, 0, sizeof(ct_session_t));
-    ct_generate_session_id(session->id, CT_SESSION_ID_LEN);
+    ct_generate_session_id(session->id, CT_SESSION_ID_LEN + 1);
     
-    time_t now = time(NULL);
+    time_t now = ct_now();
     session->created = now;
     session->last_access = now;
     session->authenticated = false;
+    session->refs = 1;
     
     /* Add to hash table - O(1) */
     ct_hash_table_set(server->sessions, session->id, strlen(session->id), session);
@@ -38,57 +43,98 @@ ct_session_t *ct_session_create(ct_server_t *server) {
     /* Add to expiry tree - O(log n) */
     ct_rb_insert(&server->session_expiry_tree, &session->expiry_node, 
                  session_expiry_compare);
+    pthread_mutex_unlock(&server->session_lock);
     
     atomic_fetch_add(&server->active_sessions, 1);
     
     return session;
 }
 
-/* Find session by ID - O(1) average */
+/* Find session by ID - O(1) average. The session comes back referenced;
+ * drop it with ct_session_release. */
 ct_session_t *ct_session_find(ct_server_t *server, const char *id) {
     if (!id || strlen(id) != CT_SESSION_ID_LEN) return NULL;
     
+    pthread_mutex_lock(&server->session_lock);
     ct_session_t *session = ct_hash_table_get(server->sessions, id, strlen(id));
     
     if (session) {
         /* Update last access time */
-        time_t now = time(NULL);
+        time_t now = ct_now();
         
         /* Remove from tree, update time, reinsert - O(log n) */
         ct_rb_delete(&server->session_expiry_tree, &session->expiry_node);
         session->last_access = now;
         ct_rb_insert(&server->session_expiry_tree, &session->expiry_node,
                     session_expiry_compare);
+        session->refs++;
     }
+    pthread_mutex_unlock(&server->session_lock);
     
     return session;
 }
 
-/* Destroy session */
-void ct_session_destroy(ct_server_t *server, ct_session_t *session) {
-    if (!session) return;
+/* Free an unlinked session nobody references - caller holds session_lock */
+static void session_free_locked(ct_server_t *server, ct_session_t *session) {
+    /* Clear sensitive data */
+    memset(session, 0, sizeof(ct_session_t));
+    
+    /* Return to pool - O(1) */
+    ct_mem_pool_free(server->session_pool, session);
+}
+
+/* Unlink session so it can't be found again - caller holds session_lock.
+ * Its memory stays until the last reference is dropped. */
+static void session_unlink_locked(ct_server_t *server, ct_session_t *session) {
+    if (session->unlinked) return;
     
     /* Remove from hash table - O(1) */
     ct_hash_table_delete(server->sessions, session->id, strlen(session->id));
     
     /* Remove from expiry tree - O(log n) */
     ct_rb_delete(&server->session_expiry_tree, &session->expiry_node);
+    session->unlinked = true;
     
-    /* Clear sensitive data */
-    memset(session, 0, sizeof(ct_session_t));
+    atomic_fetch_sub(&server->active_sessions, 1);
+}
+
+/* Drop a reference from ct_session_create or ct_session_find */
+void ct_session_release(ct_server_t *server, ct_session_t *session) {
+    if (!session) return;
     
-    /* Return to pool - O(1) */
-    ct_mem_pool_free(server->session_pool, session);
+    pthread_mutex_lock(&server->session_lock);
+    if (--session->refs == 0 && session->unlinked) {
+        session_free_locked(server, session);
+    }
+    pthread_mutex_unlock(&server->session_lock);
+}
+
+/* Destroy session (logout), dropping the caller's reference */
+void ct_session_destroy(ct_server_t *server, ct_session_t *session) {
+    if (!session) return;
     
-    atomic_fetch_sub(&server->active_sessions, 1);
+    pthread_mutex_lock(&server->session_lock);
+    session_unlink_locked(server, session);
+    if (--session->refs == 0) {
+        session_free_locked(server, session);
+    }
+    pthread_mutex_unlock(&server->session_lock);
+}
+
+/* Mark a referenced session as logged in */
+void ct_session_set_authenticated(ct_server_t *server, ct_session_t *session) {
+    pthread_mutex_lock(&server->session_lock);
+    session->authenticated = true;
+    pthread_mutex_unlock(&server->session_lock);
 }
 
 /* Clean up expired sessions - O(k log n) where k is expired count */
 void ct_session_cleanup_expired(ct_server_t *server) {
-    time_t now = time(NULL);
+    time_t now = ct_now();
     time_t expiry_time = now - server->config.session_timeout;
     
     /* Find all expired sessions from tree minimum */
+    pthread_mutex_lock(&server->session_lock);
     while (1) {
         ct_rb_node_t *node = ct_rb_find_min(server->session_expiry_tree);
         if (!node) break;
@@ -99,14 +145,36 @@ void ct_session_cleanup_expired(ct_server_t *server) {
         /* If this session isn't expired, we're done */
         if (session->last_access > expiry_time) break;
         
-        /* Destroy expired session */
-        ct_session_destroy(server, session);
+        /* Destroy expired session - connections still holding it keep
+         * it until they let go */
+        session_unlink_locked(server, session);
+        if (session->refs == 0) {
+            session_free_locked(server, session);
+        }
     }
+    pthread_mutex_unlock(&server->session_lock);
+}
+
+/* Wall-clock time the oldest session expires, 0 if there are none */
+time_t ct_session_next_expiry(ct_server_t *server) {
+    time_t expiry = 0;
+    
+    pthread_mutex_lock(&server->session_lock);
+    ct_rb_node_t *node = ct_rb_find_min(server->session_expiry_tree);
+    if (node) {
+        ct_session_t *session = (ct_session_t *)((char *)node - 
+                                offsetof(ct_session_t, expiry_node));
+        expiry = session->last_access + server->config.session_timeout;
+    }
+    pthread_mutex_unlock(&server->session_lock);
+    
+    return expiry;
 }
 
 /* Session cookie handling */
 void ct_session_set_cookie(ct_response_t *resp, const char *session_id) {
-    char cookie[256];
+    /* Headers hold pointers until the response is built */
+    static __thread char cookie[256];
     
     /* Build secure cookie */
     snprintf(cookie, sizeof(cookie),
@@ -117,20 +185,21 @@ void ct_session_set_cookie(ct_response_t *resp, const char *session_id) {
 }
 
 /* Extract session ID from cookie header */
-char *ct_session_from_cookie(const char *cookie_header) {
-    static char session_id[CT_SESSION_ID_LEN + 1];
+char *ct_session_from_cookie(const char *cookie_header, size_t len) {
+    static __thread char session_id[CT_SESSION_ID_LEN + 1];
     
     if (!cookie_header) return NULL;
     
     /* Find sessionId cookie */
-    const char *p = strstr(cookie_header, "sessionId=");
+    const char *p = memmem(cookie_header, len, "sessionId=", 10);
     if (!p) return NULL;
     
     p += 10; /* Skip "sessionId=" */
+    size_t avail = cookie_header + len - p;
     
     /* Extract session ID */
     size_t i;
-    for (i = 0; i < CT_SESSION_ID_LEN && p[i] && p[i] != ';' && p[i] != ' '; i++) {
+    for (i = 0; i < CT_SESSION_ID_LEN && i < avail && p[i] != ';' && p[i] != ' '; i++) {
         session_id[i] = p[i];
     }
     
@@ -150,9 +219,9 @@ bool ct_session_authenticate(ct_session_t *session, const char *password,
         return false;
     }
     
-    /* Mark session as authenticated */
+    /* Mark session as authenticated - last_access is the expiry tree's
+     * key and is only refreshed by ct_session_find */
     session->authenticated = true;
-    session->last_access = time(NULL);
     
     return true;
 }
@@ -182,6 +251,8 @@ void ct_session_get_stats(ct_server_t *server, size_t *total, size_t *authentica
         }
     }
     
+    pthread_mutex_lock(&server->session_lock);
     ct_hash_table_foreach(server->sessions, count_authenticated, &ctx);
+    pthread_mutex_unlock(&server->session_lock);
     *authenticated = ctx.count;
 }
\ No newline at end of file
@@ -7,18 +7,26 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 
-/* Proxy connection state */
+/* Proxy connection state. The backend rings come from the reactor's
+ * buffer pool, so they grow with a chatty terminal and shrink after. */
 typedef struct {
     int backend_fd;
-    ct_ring_buffer_t *backend_read_buf;
-    ct_ring_buffer_t *backend_write_buf;
+    ct_ring_buffer_t backend_read_buf;
+    ct_ring_buffer_t backend_write_buf;
+    ct_ws_rx_t backend_rx;      /* backend frames, when re-framed */
     bool backend_connected;
     bool backend_handshake_done;
+    bool backend_message_open;  /* a fragmented message to it in progress */
 } proxy_state_t;
 
+/* Frame header, mask key included - the most a client frame grows by on
+ * its way to the backend */
+#define PROXY_FRAME_HEADER_MAX 14
+
 /* Connect to backend terminal server */
 static int connect_to_backend(const char *host, uint16_t port) {
     int fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -66,22 +74,19 @@ int ct_proxy_init(ct_connection_t *conn, const char *backend_host,
     proxy_state_t *proxy = calloc(1, sizeof(proxy_state_t));
     if (!proxy) return -1;
     
-    /* Create buffers */
-    proxy->backend_read_buf = ct_ring_buffer_create(CT_BUFFER_SIZE);
-    proxy->backend_write_buf = ct_ring_buffer_create(CT_BUFFER_SIZE);
+    ct_ring_buffer_init_pooled(&proxy->backend_read_buf, &conn->reactor->buf_pool);
+    ct_ring_buffer_init_pooled(&proxy->backend_write_buf, &conn->reactor->buf_pool);
     
-    if (!proxy->backend_read_buf || !proxy->backend_write_buf) {
-        ct_ring_buffer_destroy(proxy->backend_read_buf);
-        ct_ring_buffer_destroy(proxy->backend_write_buf);
+    /* Connect to backend */
+    proxy->backend_fd = connect_to_backend(backend_host, backend_port);
+    if (proxy->backend_fd < 0) {
         free(proxy);
         return -1;
     }
     
-    /* Connect to backend */
-    proxy->backend_fd = connect_to_backend(backend_host, backend_port);
-    if (proxy->backend_fd < 0) {
-        ct_ring_buffer_destroy(proxy->backend_read_buf);
-        ct_ring_buffer_destroy(proxy->backend_write_buf);
+    /* Add backend to event loop - its events arrive as the client's */
+    if (ct_reactor_add_backend(conn->reactor, proxy->backend_fd, conn) < 0) {
+        close(proxy->backend_fd);
         free(proxy);
         return -1;
     }
@@ -89,14 +94,20 @@ int ct_proxy_init(ct_connection_t *conn, const char *backend_host,
     conn->proxy_state = proxy;
     conn->is_proxying = true;
     
-    /* Add backend to event loop */
-    if (event_add_backend(conn->server, proxy->backend_fd, conn) < 0) {
-        close(proxy->backend_fd);
-        ct_ring_buffer_destroy(proxy->backend_read_buf);
-        ct_ring_buffer_destroy(proxy->backend_write_buf);
-        free(proxy);
-        conn->proxy_state = NULL;
-        return -1;
+    /* Proxied streams can't carry our pings - let TCP keepalive reap
+     * clients that vanished without a FIN */
+    const ct_config_t *config = &conn->server->config;
+    if (config->ws_ping_interval > 0) {
+        int yes = 1;
+        setsockopt(conn->fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+#ifdef TCP_KEEPIDLE
+        int idle = config->ws_ping_interval;
+        int interval = config->ws_ping_timeout > 0 ? config->ws_ping_timeout : 10;
+        int count = 3;
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
     }
     
     return 0;
@@ -107,16 +118,17 @@ static int send_backend_handshake(proxy_state_t *proxy, const char *path) {
     char handshake[1024];
     
     /* Generate random WebSocket key */
-    char ws_key[25];
+    unsigned char ws_key[16];
     for (int i = 0; i < 16; i++) {
         ws_key[i] = rand() & 0xFF;
     }
     
     /* Base64 encode */
     char ws_key_b64[32];
-    base64_encode((unsigned char *)ws_key, 16, ws_key_b64);
+    ct_base64_encode(ws_key, sizeof(ws_key), ws_key_b64);
     
-    /* Build handshake */
+    /* Build handshake - no extensions offered, so backend frames arrive
+     * uncompressed whatever the client negotiated */
     int len = snprintf(handshake, sizeof(handshake),
         "GET %s HTTP/1.1\r\n"
         "Host: terminal\r\n"
@@ -127,16 +139,17 @@ static int send_backend_handshake(proxy_state_t *proxy, const char *path) {
         "\r\n",
         path, ws_key_b64);
     
-    return ct_ring_buffer_write(proxy->backend_write_buf, handshake, len);
+    return ct_ring_buffer_write(&proxy->backend_write_buf, handshake, len) ==
+           (size_t)len ? 0 : -1;
 }
 
 /* Parse backend handshake response */
 static int parse_backend_handshake(proxy_state_t *proxy) {
-    char buf[CT_BUFFER_SIZE];
-    size_t len = ct_ring_buffer_peek(proxy->backend_read_buf, buf, sizeof(buf));
+    size_t len;
+    const char *buf = ct_ring_buffer_peek_ptr(&proxy->backend_read_buf, &len);
     
-    /* Look for end of headers */
-    const char *end = strstr(buf, "\r\n\r\n");
+    /* Look for end of headers - the ring isn't NUL-terminated */
+    const char *end = buf ? memmem(buf, len, "\r\n\r\n", 4) : NULL;
     if (!end) return -1; /* Need more data */
     
     /* Check status */
@@ -146,49 +159,272 @@ static int parse_backend_handshake(proxy_state_t *proxy) {
     
     /* Consume headers */
     size_t header_len = (end - buf) + 4;
-    ct_ring_buffer_skip(proxy->backend_read_buf, header_len);
+    ct_ring_buffer_skip(&proxy->backend_read_buf, header_len);
     
     proxy->backend_handshake_done = true;
     return 0;
 }
 
-/* Forward data between client and backend using zero-copy splice */
-static int forward_data_splice(int from_fd, int to_fd, size_t max_bytes) {
-#ifdef __linux__
-    /* Use splice for zero-copy on Linux */
-    ssize_t n = splice(from_fd, NULL, to_fd, NULL, max_bytes, 
-                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
-    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-        return -1;
+/* Write what is queued for the backend. Returns -1 if it failed. */
+static int backend_flush(proxy_state_t *proxy) {
+    while (ct_ring_buffer_available(&proxy->backend_write_buf) > 0) {
+        struct iovec iov[2];
+        int iovcnt = ct_ring_buffer_data_iov(&proxy->backend_write_buf, iov);
+        
+        ssize_t n = writev(proxy->backend_fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        
+        ct_ring_buffer_skip(&proxy->backend_write_buf, n);
+    }
+    
+    return 0;
+}
+
+/* Read what the backend has into backend_read_buf, up to CT_BUFFER_SIZE
+ * at a time so a piece of a large frame stays a size the client's write
+ * buffer can take. Returns bytes read, 0 if there was nothing, -1 if the
+ * backend closed or failed. */
+static ssize_t backend_read(proxy_state_t *proxy) {
+    if (ct_ring_buffer_reserve(&proxy->backend_read_buf, CT_BUF_MIN_SIZE / 2) == 0) {
+        return 0;
+    }
+    
+    struct iovec iov[2];
+    int iovcnt = ct_ring_buffer_free_iov(&proxy->backend_read_buf, iov);
+    if (iov[0].iov_len >= CT_BUFFER_SIZE) {
+        iov[0].iov_len = CT_BUFFER_SIZE;
+        iovcnt = 1;
+    } else if (iovcnt == 2 && iov[0].iov_len + iov[1].iov_len > CT_BUFFER_SIZE) {
+        iov[1].iov_len = CT_BUFFER_SIZE - iov[0].iov_len;
+    }
+    
+    ssize_t n = readv(proxy->backend_fd, iov, iovcnt);
+    if (n == 0) return -1;
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    
+    ct_ring_buffer_commit(&proxy->backend_read_buf, n);
+    return n;
+}
+
+/* Queue a frame for the backend, masked, as a client must send it. The
+ * payload is copied into the ring and masked there, in as many pieces as
+ * the ring's free space has. A full ring is flushed to the backend first.
+ * Returns 1 if queued, 0 if the ring has no room. */
+static int backend_queue_frame(proxy_state_t *proxy, ct_ws_opcode_t opcode,
+                               const char *payload, size_t len, bool fin) {
+    ct_ring_buffer_t *rb = &proxy->backend_write_buf;
+    uint8_t header[PROXY_FRAME_HEADER_MAX];
+    size_t header_len;
+    
+    if (ct_ring_buffer_reserve(rb, PROXY_FRAME_HEADER_MAX + len) <
+        PROXY_FRAME_HEADER_MAX + len) {
+        if (backend_flush(proxy) < 0 ||
+            ct_ring_buffer_reserve(rb, PROXY_FRAME_HEADER_MAX + len) <
+            PROXY_FRAME_HEADER_MAX + len) {
+            return 0;
+        }
+    }
+    
+    header[0] = (fin ? 0x80 : 0) | (opcode & 0x0F);
+    if (len < 126) {
+        header[1] = 0x80 | len;
+        header_len = 2;
+    } else if (len < 65536) {
+        header[1] = 0x80 | 126;
+        header[2] = len >> 8;
+        header[3] = len & 0xFF;
+        header_len = 4;
+    } else {
+        header[1] = 0x80 | 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (uint64_t)len >> (56 - 8 * i);
+        }
+        header_len = 10;
+    }
+    
+    uint8_t *key = header + header_len;
+    for (int i = 0; i < 4; i++) {
+        key[i] = rand() & 0xFF;
+    }
+    header_len += 4;
+    
+    ct_ring_buffer_write(rb, (const char *)header, header_len);
+    
+    struct iovec iov[2];
+    int iovcnt = ct_ring_buffer_free_iov(rb, iov);
+    size_t done = 0;
+    for (int i = 0; i < iovcnt && done < len; i++) {
+        size_t n = len - done < iov[i].iov_len ? len - done : iov[i].iov_len;
+        memcpy(iov[i].iov_base, payload + done, n);
+        ct_ws_unmask(iov[i].iov_base, n, key, done);
+        done += n;
+    }
+    ct_ring_buffer_commit(rb, len);
+    
+    return 1;
+}
+
+/* Whether the backend's ring can take another piece - at most
+ * CT_BUFFER_SIZE, read or inflated - flushing it first if not */
+static bool backend_has_room(proxy_state_t *proxy) {
+    ct_ring_buffer_t *rb = &proxy->backend_write_buf;
+    size_t need = PROXY_FRAME_HEADER_MAX + CT_BUFFER_SIZE;
+    
+    if (ct_ring_buffer_reserve(rb, need) >= need) return true;
+    return backend_flush(proxy) == 0 && ct_ring_buffer_reserve(rb, need) >= need;
+}
+
+/* A piece of a client message, plain - on to the backend as a frame of
+ * its own. The backend link has no extensions, so the fragmentation is
+ * ours to choose (RFC 6455 5.4): empty pieces mid-message are dropped.
+ * Returns 1 once the ring can't take another, so a compressed piece
+ * stops inflating until the backend drains. */
+static int proxy_forward(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                         const char *data, size_t len, bool first, bool fin) {
+    proxy_state_t *proxy = conn->proxy_state;
+    (void)first;
+    
+    if (len == 0 && !fin) return 0;
+    
+    if (proxy->backend_message_open) {
+        opcode = CT_WS_CONTINUATION;
     }
-    return n > 0 ? n : 0;
-#else
-    /* Fallback for non-Linux */
-    char buf[8192];
-    ssize_t n = read(from_fd, buf, sizeof(buf));
-    if (n <= 0) return n;
-    
-    ssize_t written = 0;
-    while (written < n) {
-        ssize_t w = write(to_fd, buf + written, n - written);
-        if (w < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    proxy->backend_message_open = !fin;
+    
+    if (!backend_queue_frame(proxy, opcode, data, len, fin)) return -1;
+    return backend_has_room(proxy) ? 0 : 1;
+}
+
+/* Client -> Backend. Client frames are unmasked (and inflated) here, so
+ * each piece is framed again with a fresh mask before it goes on. Large
+ * frames and fragmented messages move a piece at a time. Stops when the
+ * backend's ring is full - mid-piece, if a compressed one inflates past
+ * it; the backend's EPOLLOUT resumes it. */
+static int proxy_client_to_backend(ct_connection_t *conn, proxy_state_t *proxy) {
+    bool moved = false;
+    ct_ws_piece_t piece;
+    
+    while (conn->state != CT_CONN_CLOSING) {
+        /* Reading unmasks in place, so a piece is read exactly once:
+         * room for it is made first - as for the rest of a piece the
+         * ring filled up on */
+        if (!backend_has_room(proxy)) break;
+        
+        if (conn->ws_rx.paused) {
+            if (ct_ws_deliver_resume(conn, proxy_forward) < 0) return -1;
+            moved = true;
+            continue;
+        }
+        
+        int ret = ct_ws_read(&conn->ws_rx, &conn->read_buf,
+                             conn->ws_deflate != NULL, &piece);
+        if (ret == 0) break; /* Need more data */
+        if (ret < 0) {
+            ct_ws_send_close(conn, 1002, "Protocol error");
+            conn->state = CT_CONN_CLOSING;
+            return -1;
+        }
+        moved = true;
+        
+        /* Control frames go through whole */
+        if (piece.opcode & 0x8) {
+            if (!backend_queue_frame(proxy, piece.opcode, piece.data, piece.len, true)) {
+                return -1;
+            }
+            continue;
+        }
+        
+        if (ct_ws_deliver(conn, &piece, proxy_forward) < 0) {
             return -1;
         }
-        written += w;
     }
-    return written;
-#endif
+    
+    /* Input left in the client's socket while its ring was full */
+    if (moved && conn->read_more) {
+        ct_reactor_mark_ready(conn->reactor, conn);
+    }
+    
+    return backend_flush(proxy);
 }
 
-/* Process proxy data */
-int ct_proxy_process(ct_connection_t *conn) {
+/* Backend -> Client. Without compression backend frames are already
+ * what the client wants - unmasked - and are read straight into its
+ * write buffer, whatever their size. With it, they are read a piece at
+ * a time and re-framed: a message that arrives whole is compressed once
+ * by ct_ws_send_message, a larger one goes on in uncompressed fragments.
+ * Either way reading stops once CT_STREAM_WATERMARK is buffered for the
+ * client; its EPOLLOUT resumes. Returns bytes produced for the client,
+ * -1 on error. */
+static int proxy_backend_to_client(ct_connection_t *conn, proxy_state_t *proxy) {
+    size_t produced = 0;
+    
+    /* Frames that came in behind the handshake response */
+    if (!conn->ws_deflate && ct_ring_buffer_available(&proxy->backend_read_buf) > 0) {
+        size_t len;
+        const char *buf = ct_ring_buffer_peek_ptr(&proxy->backend_read_buf, &len);
+        size_t n = ct_ring_buffer_write(&conn->write_buf, buf, len);
+        ct_ring_buffer_skip(&proxy->backend_read_buf, n);
+        produced += n;
+        if (n < len) return produced;
+    }
+    
+    while (ct_ring_buffer_available(&conn->write_buf) < CT_STREAM_WATERMARK) {
+        if (!conn->ws_deflate) {
+            size_t room = ct_ring_buffer_reserve(&conn->write_buf, CT_BUF_MIN_SIZE / 2);
+            if (room == 0) break;
+            
+            struct iovec iov[2];
+            int iovcnt = ct_ring_buffer_free_iov(&conn->write_buf, iov);
+            
+            ssize_t n = readv(proxy->backend_fd, iov, iovcnt);
+            if (n == 0) return -1; /* Backend closed */
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return -1;
+            }
+            
+            ct_ring_buffer_commit(&conn->write_buf, n);
+            produced += n;
+            
+            /* A short read means the socket is empty */
+            if ((size_t)n < room) break;
+            continue;
+        }
+        
+        ct_ws_piece_t piece;
+        int ret = ct_ws_read(&proxy->backend_rx, &proxy->backend_read_buf, false, &piece);
+        if (ret < 0) return -1;
+        if (ret == 0) {
+            ssize_t n = backend_read(proxy);
+            if (n < 0) return -1;
+            if (n == 0) break;
+            continue;
+        }
+        
+        int sent = piece.opcode & 0x8
+                 ? ct_ws_send_message(conn, piece.opcode, piece.data, piece.len)
+                 : ct_ws_send_fragment(conn, piece.opcode, piece.data, piece.len,
+                                       piece.first, piece.fin);
+        if (sent < 0) return -1;
+        produced += sent;
+    }
+    
+    return (int)produced;
+}
+
+/* Move whatever can move in either direction. Returns bytes produced for
+ * the client, -1 if the proxy must close. */
+static int proxy_pump(ct_connection_t *conn) {
     proxy_state_t *proxy = conn->proxy_state;
     if (!proxy) return -1;
     
-    /* Handle backend connection */
+    /* Handle backend connection - a connect still in progress has no peer */
     if (!proxy->backend_connected) {
-        /* Check if connected */
         int error = 0;
         socklen_t len = sizeof(error);
         if (getsockopt(proxy->backend_fd, SOL_SOCKET, SO_ERROR, 
@@ -196,73 +432,49 @@ int ct_proxy_process(ct_connection_t *conn) {
             return -1; /* Connection failed */
         }
         
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        if (getpeername(proxy->backend_fd, (struct sockaddr *)&peer, &peer_len) < 0) {
+            return errno == ENOTCONN ? 0 : -1;
+        }
+        
         proxy->backend_connected = true;
         
         /* Send WebSocket handshake */
-        send_backend_handshake(proxy, "/ws");
+        if (send_backend_handshake(proxy, "/ws") < 0) return -1;
     }
     
     /* Handle backend handshake */
     if (!proxy->backend_handshake_done) {
-        /* Read backend response */
-        char buf[CT_BUFFER_SIZE];
-        ssize_t n = read(proxy->backend_fd, buf, sizeof(buf));
-        if (n > 0) {
-            ct_ring_buffer_write(proxy->backend_read_buf, buf, n);
-            
-            /* Try to parse handshake */
-            if (parse_backend_handshake(proxy) < 0) {
-                return -1;
-            }
-        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-            return -1;
-        }
-    }
-    
-    if (!proxy->backend_handshake_done) {
-        return 0; /* Still waiting for handshake */
-    }
-    
-    /* Forward WebSocket frames between client and backend */
-    
-    /* Client -> Backend */
-    while (ct_ring_buffer_available(&conn->read_buf) > 0) {
-        char buf[CT_BUFFER_SIZE];
-        size_t available = ct_ring_buffer_peek(&conn->read_buf, buf, sizeof(buf));
+        if (backend_flush(proxy) < 0) return -1;
         
-        /* Parse WebSocket frame */
-        ct_ws_opcode_t opcode;
-        const char *payload;
-        size_t payload_len;
+        ssize_t n = backend_read(proxy);
+        if (n < 0) return -1;
         
-        int frame_size = ct_ws_parse_frame(buf, available, &opcode, 
-                                          &payload, &payload_len);
-        if (frame_size < 0) break; /* Need more data */
-        
-        /* Forward to backend (frames from client are masked) */
-        ssize_t n = write(proxy->backend_fd, buf, frame_size);
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
-            break;
+        int ret = parse_backend_handshake(proxy);
+        if (ret == -2) return -1;
+        if (ret < 0) {
+            /* Headers that can't fit are no handshake */
+            if (ct_ring_buffer_available(&proxy->backend_read_buf) >= CT_BUFFER_SIZE) {
+                return -1;
+            }
+            return 0; /* Still waiting for handshake */
         }
-        
-        ct_ring_buffer_skip(&conn->read_buf, frame_size);
     }
     
-    /* Backend -> Client */
-    char buf[CT_BUFFER_SIZE];
-    ssize_t n = read(proxy->backend_fd, buf, sizeof(buf));
-    if (n > 0) {
-        /* Backend frames are not masked, forward as-is */
-        ct_ring_buffer_write(&conn->write_buf, buf, n);
-    } else if (n == 0) {
-        /* Backend closed */
-        return -1;
-    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-        return -1;
-    }
-    
-    return 0;
+    if (proxy_client_to_backend(conn, proxy) < 0) return -1;
+    return proxy_backend_to_client(conn, proxy);
+}
+
+/* Process proxy data - client or backend readable */
+int ct_proxy_process(ct_connection_t *conn) {
+    return proxy_pump(conn) < 0 ? -1 : 0;
+}
+
+/* Client or backend writable - queued bytes can move on. Returns bytes
+ * produced for the client, -1 if the proxy must close. */
+int ct_proxy_refill(ct_connection_t *conn) {
+    return proxy_pump(conn);
 }
 
 /* Clean up proxy resources */
@@ -271,41 +483,38 @@ void ct_proxy_cleanup(ct_connection_t *conn) {
     if (!proxy) return;
     
     if (proxy->backend_fd >= 0) {
+        ct_reactor_remove_backend(conn->reactor, conn);
         close(proxy->backend_fd);
     }
     
-    ct_ring_buffer_destroy(proxy->backend_read_buf);
-    ct_ring_buffer_destroy(proxy->backend_write_buf);
+    ct_ring_buffer_release(&proxy->backend_read_buf);
+    ct_ring_buffer_release(&proxy->backend_write_buf);
     
     free(proxy);
     conn->proxy_state = NULL;
     conn->is_proxying = false;
 }
 
-/* High-performance terminal proxy with zero-copy */
+/* High-performance terminal proxy. The backend is connected before the
+ * client gets its 101, so a dead terminal server is a plain 502; the
+ * 101 goes out as the route's response, and the backend's first
+ * writable event starts the backend handshake. */
 int ct_proxy_terminal(ct_connection_t *conn, const char *terminal_host,
                      uint16_t terminal_port) {
-    /* Perform WebSocket handshake with client first */
-    if (!conn->ws_handshake_done) {
-        if (ct_ws_handshake(conn) < 0) {
-            return -1;
-        }
-        
-        /* Send handshake response */
-        char buf[1024];
-        int len = ct_build_response(&conn->response, buf, sizeof(buf));
-        ct_ring_buffer_write(&conn->write_buf, buf, len);
-    }
-    
-    /* Initialize proxy if not done */
     if (!conn->is_proxying) {
         if (ct_proxy_init(conn, terminal_host, terminal_port) < 0) {
-            /* Send error to client */
-            ct_ws_send_text(conn, "{\"error\":\"Failed to connect to terminal\"}");
+            ct_response_json(&conn->response, 502,
+                            "{\"error\":\"Failed to connect to terminal\"}");
             return -1;
         }
     }
     
-    /* Process proxy data */
-    return ct_proxy_process(conn);
-}
\ No newline at end of file
+    if (!conn->ws_handshake_done && ct_ws_handshake(conn) < 0) {
+        ct_proxy_cleanup(conn);
+        ct_response_json(&conn->response, 400,
+                        "{\"error\":\"Bad WebSocket handshake\"}");
+        return -1;
+    }
+    
+    return 0;
+}
@@ -5,117 +5,301 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 /* Connection ID counter */
 static _Atomic uint64_t next_conn_id = 1;
 
+/* Next deadline for the connection's current state, 0 if none */
+static uint64_t connection_deadline(ct_connection_t *conn) {
+    const ct_config_t *config = &conn->server->config;
+    
+    if (conn->is_websocket && conn->ws_handshake_done) {
+        /* Proxied streams are raw backend bytes, so a ping can't be
+         * spliced in; TCP keepalive covers them instead */
+        if (conn->is_proxying || config->ws_ping_interval == 0) return 0;
+        
+        /* Any traffic after the ping proves the peer is alive */
+        if (conn->ws_ping_sent && conn->last_activity > conn->ws_ping_sent) {
+            conn->ws_ping_sent = 0;
+        }
+        
+        if (conn->ws_ping_sent) {
+            return conn->ws_ping_sent + config->ws_ping_timeout * 1000;
+        }
+        return conn->last_activity + config->ws_ping_interval * 1000;
+    }
+    
+    /* Request in flight - the whole head must arrive in time */
+    if (conn->request_start && config->header_timeout) {
+        return conn->request_start + config->header_timeout * 1000;
+    }
+    
+    if (config->idle_timeout) {
+        return conn->last_activity + config->idle_timeout * 1000;
+    }
+    
+    return 0;
+}
+
+/* Timer fired - deadlines are pushed back lazily, so re-check first */
+static void connection_timer_cb(ct_timer_t *timer) {
+    ct_connection_t *conn = (ct_connection_t *)((char *)timer - 
+                            offsetof(ct_connection_t, timer));
+    ct_reactor_t *reactor = conn->reactor;
+    uint64_t now = ct_now_ms();
+    uint64_t deadline = connection_deadline(conn);
+    
+    if (deadline == 0) return;
+    
+    if (deadline > now) {
+        ct_timer_add(&reactor->timers, timer, deadline);
+        return;
+    }
+    
+    /* Idle WebSocket - probe it before giving up */
+    if (conn->is_websocket && conn->ws_handshake_done && !conn->ws_ping_sent) {
+        conn->ws_ping_sent = now;
+        ct_ws_send_ping(conn, NULL, 0);
+        reactor->flush_connection(reactor, conn);
+        ct_timer_add(&reactor->timers, timer, connection_deadline(conn));
+        return;
+    }
+    
+    /* Idle, slow request head or unanswered ping */
+    reactor->close_connection(reactor, conn);
+}
+
+/* Record inbound activity and start the header-read clock on a new request */
+void ct_connection_touch(ct_connection_t *conn) {
+    conn->last_activity = ct_now_ms();
+    
+    if (!conn->is_websocket && !conn->request_start) {
+        conn->request_start = conn->last_activity;
+        
+        /* The header deadline is usually shorter than the idle one */
+        uint64_t deadline = connection_deadline(conn);
+        if (deadline && deadline < conn->timer.expires) {
+            ct_timer_add(&conn->reactor->timers, &conn->timer, deadline);
+        }
+    }
+}
+
 /* Create new connection */
-ct_connection_t *ct_connection_create(ct_server_t *server, int fd) {
+/* Per-connection socket options. Listener-level options (buffer sizes,
+ * reuse, fast open) are inherited from the listen socket at accept time,
+ * so only what must be set on the accepted socket lives here. Shared by
+ * every event backend. */
+static void set_connection_options(int fd) {
+    int yes = 1;
+    
+    /* Disable Nagle's algorithm for low latency */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+ct_connection_t *ct_connection_create(ct_reactor_t *reactor, int fd) {
+    set_connection_options(fd);
+    
+    /* Table slot first - it only grows (doubling) past its high water */
+    if (reactor->conn_count == reactor->conn_capacity) {
+        size_t capacity = reactor->conn_capacity * 2;
+        ct_connection_t **conns = realloc(reactor->conns, capacity * sizeof(*conns));
+        if (!conns) return NULL;
+        reactor->conns = conns;
+        reactor->conn_capacity = capacity;
+    }
+    
     /* Allocate from pool - O(1) */
-    ct_connection_t *conn = ct_mem_pool_alloc(server->conn_pool);
+    ct_connection_t *conn = ct_mem_pool_calloc(reactor->conn_pool);
     if (!conn) return NULL;
     
     /* Initialize connection */
-    memset(conn, 0, sizeof(ct_connection_t));
     conn->fd = fd;
     conn->id = atomic_fetch_add(&next_conn_id, 1);
+    conn->server = reactor->server;
+    conn->reactor = reactor;
     conn->state = CT_CONN_IDLE;
-    conn->created = time(NULL);
+    conn->created = ct_now_ms();
     conn->last_activity = conn->created;
+    conn->request_start = conn->created;
     
-    /* Initialize buffers */
-    conn->read_buf.data = malloc(CT_BUFFER_SIZE);
-    conn->read_buf.size = CT_BUFFER_SIZE;
-    atomic_init(&conn->read_buf.read_pos, 0);
-    atomic_init(&conn->read_buf.write_pos, 0);
+    /* Buffers are taken from the reactor's pool on first use and handed
+     * back once drained, so idle connections hold no buffer memory */
+    ct_ring_buffer_init_pooled(&conn->read_buf, &reactor->buf_pool);
+    ct_ring_buffer_init_pooled(&conn->write_buf, &reactor->buf_pool);
     
-    conn->write_buf.data = malloc(CT_BUFFER_SIZE);
-    conn->write_buf.size = CT_BUFFER_SIZE;
-    atomic_init(&conn->write_buf.read_pos, 0);
-    atomic_init(&conn->write_buf.write_pos, 0);
+    /* Append to the connection table - O(1) */
+    conn->slot = reactor->conn_count;
+    reactor->conns[reactor->conn_count++] = conn;
     
-    if (!conn->read_buf.data || !conn->write_buf.data) {
-        free(conn->read_buf.data);
-        free(conn->write_buf.data);
-        ct_mem_pool_free(server->conn_pool, conn);
-        return NULL;
+    /* Arm the first-request deadline */
+    ct_timer_init(&conn->timer, connection_timer_cb);
+    uint64_t deadline = connection_deadline(conn);
+    if (deadline) {
+        ct_timer_add(&reactor->timers, &conn->timer, deadline);
     }
     
-    /* Add to connection hash table - O(1) */
-    ct_hash_table_set(server->connections, &conn->id, sizeof(conn->id), conn);
-    
     return conn;
 }
 
+/* Hand a streamed request body's sink back to its handler */
+static void connection_end_body(ct_connection_t *conn) {
+    ct_body_sink_t *sink = conn->body_sink;
+    if (sink) {
+        conn->body_sink = NULL;
+        sink->done(conn, sink);
+    }
+}
+
+/* Hand a WebSocket's message handler back, and its compressor */
+static void connection_end_websocket(ct_connection_t *conn) {
+    ct_ws_handler_t *handler = conn->ws_handler;
+    if (handler) {
+        conn->ws_handler = NULL;
+        handler->done(conn, handler);
+    }
+    ct_ws_deflate_release(conn);
+}
+
+/* Hand a streamed response body back to its producer */
+static void connection_end_stream(ct_connection_t *conn) {
+    ct_body_stream_t *stream = conn->body_stream;
+    if (stream) {
+        conn->body_stream = NULL;
+        stream->done(conn, stream);
+    }
+}
+
 /* Destroy connection */
-void ct_connection_destroy(ct_server_t *server, ct_connection_t *conn) {
+void ct_connection_destroy(ct_reactor_t *reactor, ct_connection_t *conn) {
     if (!conn) return;
     
+    ct_server_t *server = reactor->server;
+    
     /* Remove from event loop */
-    event_del_connection(server, conn);
+    event_del_connection(reactor, conn);
+    ct_timer_cancel(&reactor->timers, &conn->timer);
+    ct_reactor_unmark_ready(reactor, conn);
+    
+    /* A running job can't be recalled - detach it; its completion sees
+     * the NULL connection and only frees itself */
+    if (conn->job) {
+        conn->job->conn = NULL;
+        conn->job = NULL;
+    }
     
     /* Clean up proxy if active */
     if (conn->is_proxying) {
         ct_proxy_cleanup(conn);
     }
+    connection_end_websocket(conn);
     
-    /* Release file cache reference */
-    if (conn->file_entry) {
-        ct_file_cache_release(server->file_cache, conn->file_entry);
-    }
+    /* Streams cut short still get their done() */
+    connection_end_body(conn);
+    connection_end_stream(conn);
+    free(conn->head_copy);
+    ct_h2_free(conn);
+    ct_session_release(server, conn->session);
+    
+    /* Release file cache references and files - queued or not yet sent */
+    ct_output_clear(conn);
+    ct_response_release(conn);
     
     /* Close socket */
     if (conn->fd >= 0) {
         close(conn->fd);
     }
     
-    /* Remove from hash table - O(1) */
-    ct_hash_table_delete(server->connections, &conn->id, sizeof(conn->id));
+    /* Remove from the table - O(1), the last connection fills the gap */
+    ct_connection_t *last = reactor->conns[--reactor->conn_count];
+    reactor->conns[conn->slot] = last;
+    last->slot = conn->slot;
     
-    /* Free buffers */
-    free(conn->read_buf.data);
-    free(conn->write_buf.data);
+    /* Return buffers to the pool */
+    ct_ring_buffer_release(&conn->read_buf);
+    ct_ring_buffer_release(&conn->write_buf);
     
     /* Clear sensitive data */
     memset(conn, 0, sizeof(ct_connection_t));
     
     /* Return to pool - O(1) */
-    ct_mem_pool_free(server->conn_pool, conn);
+    ct_mem_pool_free(reactor->conn_pool, conn);
     
     atomic_fetch_sub(&server->active_connections, 1);
 }
 
 /* Read data from connection */
 int ct_connection_read(ct_connection_t *conn) {
-    /* Calculate available space */
-    size_t free_space = ct_ring_buffer_free_space(&conn->read_buf);
+    /* Make room for at least a small read - allocates on first use */
+    size_t free_space = ct_ring_buffer_reserve(&conn->read_buf, CT_BUF_MIN_SIZE / 2);
     if (free_space == 0) {
-        /* Buffer full */
+        /* Buffer full - the socket may still hold more */
+        conn->read_more = true;
         return 0;
     }
     
-    /* Read directly into ring buffer */
-    char temp[8192];
-    size_t to_read = (free_space < sizeof(temp)) ? free_space : sizeof(temp);
+    /* Scatter straight into the ring's free span(s) */
+    struct iovec iov[2];
+    int iovcnt = ct_ring_buffer_free_iov(&conn->read_buf, iov);
     
-    ssize_t n = read(conn->fd, temp, to_read);
+    ssize_t n = readv(conn->fd, iov, iovcnt);
     if (n > 0) {
-        ct_ring_buffer_write(&conn->read_buf, temp, n);
-        conn->last_activity = time(NULL);
+        ct_ring_buffer_commit(&conn->read_buf, n);
+        ct_connection_touch(conn);
+        
+        /* A short read means the socket is empty */
+        conn->read_more = (size_t)n == free_space;
         return n;
     } else if (n == 0) {
         /* Connection closed */
         return -1;
     } else {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn->read_more = false;
             return 0; /* No data available */
         }
         return -1; /* Error */
     }
 }
 
+/* Read and process until the socket is empty - edge-triggered readiness
+ * won't report bytes left behind. After io_budget bytes the connection
+ * yields to the ready list instead, so one busy peer can't starve the
+ * rest. A full buffer the parser can't drain (e.g. a parked job) stops
+ * reading with read_more still set. Returns -1 if the connection should
+ * close. */
+int ct_connection_drain(ct_server_t *server, ct_connection_t *conn) {
+    size_t total = 0;
+    
+    while (1) {
+        int n = ct_connection_read(conn);
+        if (n < 0) return -1;
+        
+        if (ct_connection_process(server, conn) < 0) return -1;
+        
+        if (!conn->read_more || n == 0) return 0;
+        
+        total += n;
+        if (total >= server->config.io_budget) {
+            ct_reactor_mark_ready(conn->reactor, conn);
+            return 0;
+        }
+    }
+}
+
 /* Write data to connection */
-int ct_connection_write(ct_connection_t *conn) {
+static int connection_flush(ct_connection_t *conn) {
+    /* Queued body segments go through the output queue */
+    if (conn->out_head) {
+        int n = ct_output_write(conn);
+        if (n > 0) {
+            conn->last_activity = ct_now_ms();
+        }
+        return n;
+    }
+    
     /* Calculate available data */
     size_t available = ct_ring_buffer_available(&conn->write_buf);
     if (available == 0) {
@@ -123,34 +307,329 @@ int ct_connection_write(ct_connection_t *conn) {
         return 0;
     }
     
-    /* Write from ring buffer */
-    char temp[8192];
-    size_t to_write = (available < sizeof(temp)) ? available : sizeof(temp);
-    size_t actual = ct_ring_buffer_read(&conn->write_buf, temp, to_write);
+    /* Gather straight from the ring and consume only what the socket
+     * took - the unsent tail stays in place and in order */
+    struct iovec iov[2];
+    int iovcnt = ct_ring_buffer_data_iov(&conn->write_buf, iov);
     
-    ssize_t n = write(conn->fd, temp, actual);
+    ssize_t n = writev(conn->fd, iov, iovcnt);
     if (n > 0) {
-        conn->last_activity = time(NULL);
-        
-        /* If we couldn't write everything, put it back */
-        if (n < actual) {
-            /* This is inefficient but rare - could optimize with peek/skip */
-            ct_ring_buffer_write(&conn->write_buf, temp + n, actual - n);
-        }
-        
+        conn->last_activity = ct_now_ms();
+        ct_ring_buffer_skip(&conn->write_buf, n);
         return n;
     } else {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            /* Put data back */
-            ct_ring_buffer_write(&conn->write_buf, temp, actual);
             return 0;
         }
         return -1; /* Error */
     }
 }
 
-/* Process connection - main request handler */
-int ct_connection_process(ct_server_t *server, ct_connection_t *conn) {
+/* WebSocket input that waited for the output to drain - read on, and
+ * mark the connection ready if its socket may hold more. Returns bytes
+ * produced. */
+static int connection_ws_refill(ct_connection_t *conn) {
+    size_t before = ct_ring_buffer_available(&conn->write_buf);
+    
+    if (ct_connection_process_websocket(conn->server, conn) < 0) return -1;
+    if (!conn->ws_blocked && conn->read_more) {
+        ct_reactor_mark_ready(conn->reactor, conn);
+    }
+    
+    size_t after = ct_ring_buffer_available(&conn->write_buf);
+    return after > before ? (int)(after - before) : 0;
+}
+
+/* Produce more output for a connection whose response is generated as
+ * it drains - a streamed body, HTTP/2 DATA frames, terminal output
+ * waiting at the proxy's backend, or echoes of WebSocket input held
+ * back. Returns bytes produced, -1 if the connection must close. */
+int ct_connection_refill(ct_connection_t *conn) {
+    if (conn->h2) {
+        return ct_h2_pump(conn);
+    }
+    if (conn->is_proxying) {
+        return ct_proxy_refill(conn);
+    }
+    if (conn->ws_blocked) {
+        return connection_ws_refill(conn);
+    }
+    return ct_connection_stream(conn);
+}
+
+/* Write what is buffered; a streamed response body or HTTP/2 streams are
+ * refilled as it drains, until the socket is full or io_budget has gone
+ * out */
+int ct_connection_write(ct_connection_t *conn) {
+    size_t total = 0;
+    
+    while (1) {
+        int n = connection_flush(conn);
+        if (n < 0) return -1;
+        total += n;
+        
+        if (!conn->body_stream && !conn->h2 && !conn->is_proxying &&
+            !conn->ws_blocked) {
+            break;
+        }
+        if (total >= conn->server->config.io_budget) {
+            ct_reactor_mark_ready(conn->reactor, conn);
+            break;
+        }
+        
+        int produced = ct_connection_refill(conn);
+        if (produced < 0) return -1;
+        if (produced == 0) break;
+    }
+    
+    return (int)(total > INT32_MAX ? INT32_MAX : total);
+}
+
+/* Which loop-stats handler class the connection's input belongs to */
+ct_loop_handler_t ct_connection_handler_class(const ct_connection_t *conn) {
+    if (conn->is_proxying) return CT_LOOP_PROXY;
+    if (conn->is_websocket && conn->ws_handshake_done) return CT_LOOP_WEBSOCKET;
+    return CT_LOOP_HTTP;
+}
+
+/* Which memory-stats class the connection's buffers are charged to */
+ct_mem_class_t ct_connection_mem_class(const ct_connection_t *conn) {
+    if (conn->state == CT_CONN_AWAITING_JOB) return CT_MEM_AWAITING_JOB;
+    if (conn->is_proxying) return CT_MEM_PROXY;
+    if (conn->is_websocket && conn->ws_handshake_done) return CT_MEM_WEBSOCKET;
+    if (conn->state == CT_CONN_IDLE && !conn->read_buf.data && 
+        !conn->write_buf.data) {
+        return CT_MEM_IDLE;
+    }
+    return CT_MEM_HTTP;
+}
+
+/* Queue the response body. Small bodies are copied after the headers;
+ * cached file content is referenced and files are sent with sendfile, so
+ * neither is copied however large it is. */
+static void connection_queue_body(ct_connection_t *conn) {
+    ct_response_t *resp = &conn->response;
+    
+    if (resp->body_from_fd) {
+        if (ct_output_queue_file(conn, resp->body_fd, resp->body_offset,
+                                 resp->body_len) == 0) {
+            resp->body_from_fd = false;
+        }
+        return;
+    }
+    
+    if (!resp->body || resp->body_len == 0) return;
+    
+    if (resp->body_entry && resp->body_len > CT_OUTPUT_INLINE_MAX) {
+        if (ct_output_queue_mem(conn, resp->body, resp->body_len,
+                                resp->body_entry) == 0) {
+            resp->body_entry = NULL;
+        }
+        return;
+    }
+    
+    ct_ring_buffer_write(&conn->write_buf, resp->body, resp->body_len);
+}
+
+/* Reset for the next keep-alive request, or close once the response
+ * has gone out */
+static void connection_finish_request(ct_connection_t *conn) {
+    free(conn->head_copy);
+    conn->head_copy = NULL;
+    
+    if (conn->request.keep_alive && !conn->is_websocket) {
+        memset(&conn->request, 0, sizeof(conn->request));
+        memset(&conn->response, 0, sizeof(conn->response));
+    } else if (!conn->is_websocket) {
+        conn->state = CT_CONN_CLOSING;
+    }
+}
+
+/* Serialize conn->response into the write buffer. A streamed body starts
+ * producing straight away and the request ends with it; otherwise the
+ * connection is reset for the next keep-alive request. */
+static void connection_send_response(ct_connection_t *conn) {
+    /* Framed on the stream the request came in on */
+    if (conn->h2) {
+        ct_h2_respond(conn);
+        return;
+    }
+    
+    char head[CT_RESPONSE_HEAD_MAX];
+    int head_len = ct_build_response_head(&conn->response, head, sizeof(head));
+    if (head_len > 0) {
+        ct_ring_buffer_write(&conn->write_buf, head, head_len);
+        if (conn->response.stream) {
+            conn->body_stream = conn->response.stream;
+            conn->response.stream = NULL;
+        } else {
+            connection_queue_body(conn);
+        }
+    }
+    
+    /* Whatever wasn't handed to the output queue */
+    ct_response_release(conn);
+    
+    if (conn->body_stream) {
+        if (ct_connection_stream(conn) < 0) {
+            conn->state = CT_CONN_CLOSING;
+        }
+        return;
+    }
+    
+    connection_finish_request(conn);
+}
+
+/* Produce a streamed response body while less than CT_STREAM_WATERMARK
+ * waits to go out, so the body never sits in memory whole. After the
+ * last chunk the terminator is queued and the connection moves on to
+ * any pipelined request. Returns bytes produced, -1 if the stream
+ * aborted - the response is cut short and the connection must close. */
+int ct_connection_stream(ct_connection_t *conn) {
+    ct_ring_buffer_t *rb = &conn->write_buf;
+    size_t start = ct_ring_buffer_available(rb);
+    int rc = 1;
+    
+    /* Don't outgrow a ring the kernel is sending from - the completion
+     * resumes the stream */
+    if (!conn->body_stream || rb->pinned) return 0;
+    
+    while (ct_ring_buffer_available(rb) < CT_STREAM_WATERMARK) {
+        size_t before = ct_ring_buffer_available(rb);
+        rc = conn->body_stream->produce(conn, conn->body_stream);
+        if (rc <= 0) break;
+        
+        /* Nothing written - the producer is waiting on something else */
+        if (ct_ring_buffer_available(rb) == before) break;
+    }
+    
+    if (rc > 0) {
+        return (int)(ct_ring_buffer_available(rb) - start);
+    }
+    
+    connection_end_stream(conn);
+    if (rc < 0) {
+        conn->state = CT_CONN_CLOSING;
+        return -1;
+    }
+    
+    ct_ring_buffer_write(rb, "0\r\n\r\n", 5);
+    connection_finish_request(conn);
+    
+    /* Requests that arrived behind the stream */
+    if (conn->state != CT_CONN_CLOSING &&
+        (ct_ring_buffer_available(&conn->read_buf) > 0 || conn->read_more)) {
+        ct_reactor_mark_ready(conn->reactor, conn);
+    }
+    
+    return (int)(ct_ring_buffer_available(rb) - start);
+}
+
+/* Install a sink for a streamed request body (request.body_streamed) -
+ * called by the handler the request was routed to. Without one the body
+ * is read and dropped before the handler's response is sent. */
+void ct_request_stream_body(ct_connection_t *conn, ct_body_sink_t *sink) {
+    conn->body_sink = sink;
+}
+
+/* Count the request, attach its session and route it */
+void ct_connection_dispatch(ct_server_t *server, ct_connection_t *conn) {
+    atomic_fetch_add(&server->total_requests, 1);
+    conn->request_start = 0;
+    
+    /* Extract session from cookie - the previous request's is let go */
+    ct_session_release(server, conn->session);
+    conn->session = NULL;
+    ct_header_t cookie = ct_request_header(&conn->request, CT_HDR_COOKIE);
+    if (cookie.value) {
+        char *session_id = ct_session_from_cookie(cookie.value, cookie.value_len);
+        if (session_id) {
+            conn->session = ct_session_find(server, session_id);
+        }
+    }
+    
+    ct_route_request(server, conn);
+}
+
+/* Move a request head out of read_buf, so the body behind it can be
+ * consumed as it is decoded while the headers stay readable */
+static int connection_detach_head(ct_connection_t *conn, const char *buf,
+                                  size_t len) {
+    conn->head_copy = malloc(len);
+    if (!conn->head_copy) return -1;
+    
+    memcpy(conn->head_copy, buf, len);
+    conn->request.base = conn->head_copy;
+    ct_ring_buffer_skip(&conn->read_buf, len);
+    return 0;
+}
+
+/* Feed buffered body bytes to the handler's sink, consuming them as they
+ * are decoded - a body of any size passes through a bounded read_buf.
+ * Once the body ends the handler's response is sent. Returns like
+ * connection_process_once. */
+static int connection_feed_body(ct_connection_t *conn) {
+    ct_request_t *req = &conn->request;
+    bool malformed = false;
+    
+    while (req->parse_state == CT_PARSE_BODY) {
+        size_t available;
+        const char *buf = ct_ring_buffer_peek_ptr(&conn->read_buf, &available);
+        if (available == 0) return 0;
+        
+        const char *piece;
+        size_t piece_len;
+        int n = ct_request_body_next(req, buf, available, &piece, &piece_len);
+        if (n < 0) {
+            malformed = true;
+            break;
+        }
+        
+        if (piece_len > 0 && conn->body_sink &&
+            conn->body_sink->consume(conn, conn->body_sink, piece, piece_len) < 0) {
+            /* The rest would have to be read and dropped - close instead */
+            req->keep_alive = false;
+            ct_ring_buffer_skip(&conn->read_buf, n);
+            break;
+        }
+        
+        /* Consume only now, as that may release the buffer */
+        ct_ring_buffer_skip(&conn->read_buf, n);
+    }
+    
+    connection_end_body(conn);
+    
+    if (malformed) {
+        /* Bad chunk framing - the stream can't be resynchronised */
+        req->keep_alive = false;
+        ct_response_release(conn);
+        ct_response_html(&conn->response, 400,
+                        "<html><body><h1>400 Bad Request</h1></body></html>");
+    }
+    
+    connection_send_response(conn);
+    return conn->state == CT_CONN_CLOSING ? 0 : 1;
+}
+
+/* Handle one unit of buffered input. Returns 1 after an HTTP request was
+ * answered and the connection can take the next one, 0 when waiting for
+ * more data (or a job), -1 on error. */
+static int connection_process_once(ct_server_t *server, ct_connection_t *conn) {
+    /* Parked on a pool job - pipelined bytes wait in read_buf */
+    if (conn->state == CT_CONN_AWAITING_JOB) {
+        return 0;
+    }
+    
+    /* A response body is still being produced - likewise */
+    if (conn->body_stream) {
+        return 0;
+    }
+    
+    /* HTTP/2 - frames, not requests */
+    if (conn->h2) {
+        return ct_h2_process(server, conn);
+    }
+    
     /* Handle WebSocket proxy */
     if (conn->is_proxying) {
         return ct_proxy_process(conn);
@@ -161,115 +640,193 @@ int ct_connection_process(ct_server_t *server, ct_connection_t *conn) {
         return ct_connection_process_websocket(server, conn);
     }
     
-    /* Parse HTTP request */
-    char buf[CT_BUFFER_SIZE];
-    size_t available = ct_ring_buffer_peek(&conn->read_buf, buf, sizeof(buf));
+    /* Request body streaming to its handler */
+    if (conn->head_copy) {
+        return connection_feed_body(conn);
+    }
+    
+    /* Parse HTTP request in place - the request points into the ring, so
+     * the bytes are consumed only once the response has been built */
+    size_t available;
+    const char *buf = ct_ring_buffer_peek_ptr(&conn->read_buf, &available);
     if (available == 0) return 0;
     
+    /* HTTP/2 with prior knowledge - the preface instead of a request */
+    if (conn->request.parse_state == CT_PARSE_METHOD && buf[0] == 'P') {
+        int preface = ct_h2_preface(buf, available);
+        if (preface == 0) return 0;
+        if (preface > 0) {
+            if (ct_h2_start(conn, NULL) < 0) return -1;
+            return ct_h2_process(server, conn);
+        }
+    }
+    
     int consumed = ct_parse_request(&conn->request, buf, available);
     if (consumed < 0) {
         if (consumed == -1) {
             /* Need more data */
             return 0;
         }
-        /* Parse error */
-        ct_response_init(&conn->response, 400, "Bad Request");
-        ct_response_html(&conn->response, 400,
-                        "<html><body><h1>400 Bad Request</h1></body></html>");
+        /* Parse error - the stream can't be resynchronised */
+        conn->request.keep_alive = false;
+        if (consumed == -3) {
+            ct_response_init(&conn->response, 501, "Not Implemented");
+            ct_response_html(&conn->response, 501,
+                            "<html><body><h1>501 Not Implemented</h1></body></html>");
+        } else {
+            ct_response_init(&conn->response, 400, "Bad Request");
+            ct_response_html(&conn->response, 400,
+                            "<html><body><h1>400 Bad Request</h1></body></html>");
+        }
         goto send_response;
     }
     
-    /* Consume parsed data */
-    ct_ring_buffer_skip(&conn->read_buf, consumed);
+    /* Head complete, body to stream - route now, answer once the body
+     * has been fed through */
+    if (conn->request.parse_state == CT_PARSE_BODY) {
+        if (connection_detach_head(conn, buf, consumed) < 0) {
+            conn->request.keep_alive = false;
+            ct_response_json(&conn->response, 500,
+                            "{\"error\":\"Server error\"}");
+            goto send_response;
+        }
+        
+        ct_connection_dispatch(server, conn);
+        return connection_feed_body(conn);
+    }
     
     /* Request complete - process it */
     if (conn->request.parse_state == CT_PARSE_COMPLETE) {
-        atomic_fetch_add(&server->total_requests, 1);
-        
-        /* Extract session from cookie */
-        const char *cookie = ct_request_get_header(&conn->request, "Cookie");
-        if (cookie) {
-            char *session_id = ct_session_from_cookie(cookie);
-            if (session_id) {
-                conn->session = ct_session_find(server, session_id);
+        /* h2c upgrade - the request is answered as stream 1, and the
+         * client preface follows it */
+        if (ct_h2_upgrade_requested(&conn->request) &&
+            !conn->request.is_websocket && conn->request.body_len == 0 &&
+            ct_h2_start(conn, &conn->request) == 0) {
+            ct_connection_dispatch(server, conn);
+            if (conn->state != CT_CONN_AWAITING_JOB) {
+                ct_h2_respond(conn);
             }
+            ct_ring_buffer_skip(&conn->read_buf, consumed);
+            return ct_h2_process(server, conn);
         }
         
-        /* Route request */
-        ct_route_request(server, conn);
+        ct_connection_dispatch(server, conn);
+        
+        /* Handler offloaded to the pool - its completion responds */
+        if (conn->state == CT_CONN_AWAITING_JOB) {
+            ct_ring_buffer_skip(&conn->read_buf, consumed);
+            return 0;
+        }
         
         /* Send response */
 send_response:
-        {
-            char resp_buf[CT_BUFFER_SIZE];
-            int resp_len = ct_build_response(&conn->response, resp_buf, 
-                                           sizeof(resp_buf));
-            if (resp_len > 0) {
-                ct_ring_buffer_write(&conn->write_buf, resp_buf, resp_len);
-            }
-            
-            /* Reset for next request if keep-alive */
-            if (conn->request.keep_alive && !conn->is_websocket) {
-                memset(&conn->request, 0, sizeof(conn->request));
-                memset(&conn->response, 0, sizeof(conn->response));
-            } else if (!conn->is_websocket) {
-                conn->state = CT_CONN_CLOSING;
-            }
-        }
+        connection_send_response(conn);
+    }
+    
+    /* Consume parsed data */
+    if (consumed > 0) {
+        ct_ring_buffer_skip(&conn->read_buf, consumed);
+    }
+    
+    return conn->state == CT_CONN_CLOSING ? 0 : 1;
+}
+
+/* Process connection - main request handler. Every pipelined request
+ * already buffered is answered in one pass, so the responses leave in a
+ * single write; past CT_PIPELINE_MAX the connection yields and is
+ * finished from the reactor's ready list. */
+int ct_connection_process(ct_server_t *server, ct_connection_t *conn) {
+    for (int handled = 0; handled < CT_PIPELINE_MAX; handled++) {
+        int ret = connection_process_once(server, conn);
+        if (ret <= 0) return ret;
     }
     
+    if (ct_ring_buffer_available(&conn->read_buf) > 0) {
+        ct_reactor_mark_ready(conn->reactor, conn);
+    }
     return 0;
 }
 
-/* Process WebSocket connection */
+/* A piece of a received message - to the installed handler */
+static int websocket_message(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                             const char *data, size_t len, bool first, bool fin) {
+    ct_ws_handler_t *handler = conn->ws_handler;
+    if (handler) {
+        return handler->message(conn, handler, opcode, data, len, first, fin);
+    }
+    
+    /* Echo server example - replace with actual logic */
+    if (ct_ws_send_fragment(conn, opcode, data, len, first, fin) < 0) return -1;
+    return ct_ring_buffer_available(&conn->write_buf) >= CT_STREAM_WATERMARK ? 1 : 0;
+}
+
+/* Process WebSocket connection - frames are read in place, in pieces
+ * once they outgrow the buffer, and messages handed on as they arrive.
+ * Reading stops while CT_STREAM_WATERMARK of output waits for a slow
+ * peer, or the handler is full; ct_connection_refill carries on once
+ * the output drains. */
 int ct_connection_process_websocket(ct_server_t *server, ct_connection_t *conn) {
-    char buf[CT_BUFFER_SIZE];
+    (void)server;
+    ct_ws_piece_t piece;
+    int ret;
     
-    while (1) {
-        size_t available = ct_ring_buffer_peek(&conn->read_buf, buf, sizeof(buf));
-        if (available == 0) break;
-        
-        /* Parse WebSocket frame */
-        ct_ws_opcode_t opcode;
-        const char *payload;
-        size_t payload_len;
+    conn->ws_blocked = false;
+    
+    while (conn->state != CT_CONN_CLOSING) {
+        if (ct_ring_buffer_available(&conn->write_buf) >= CT_STREAM_WATERMARK) {
+            conn->ws_blocked = true;
+            break;
+        }
         
-        int frame_size = ct_ws_parse_frame(buf, available, &opcode,
-                                          &payload, &payload_len);
-        if (frame_size < 0) {
-            if (frame_size == -1) {
-                /* Need more data */
-                break;
+        /* The rest of a piece the handler filled up on */
+        if (conn->ws_rx.paused) {
+            ret = ct_ws_deliver_resume(conn, websocket_message);
+        } else {
+            ret = ct_ws_read(&conn->ws_rx, &conn->read_buf,
+                             conn->ws_deflate != NULL, &piece);
+            if (ret == 0) break;
+            if (ret < 0) {
+                /* Protocol error */
+                ct_ws_send_close(conn, 1002, "Protocol error");
+                conn->state = CT_CONN_CLOSING;
+                return -1;
             }
-            /* Protocol error */
-            ct_ws_send_close(conn, 1002, "Protocol error");
-            conn->state = CT_CONN_CLOSING;
-            return -1;
+            
+            if (piece.opcode & 0x8) {
+                /* Control frame - ping, pong or close */
+                ct_ws_process_frame(conn, piece.opcode, piece.data, piece.len);
+                continue;
+            }
+            ret = ct_ws_deliver(conn, &piece, websocket_message);
         }
         
-        /* Consume frame */
-        ct_ring_buffer_skip(&conn->read_buf, frame_size);
-        
-        /* Process frame */
-        ct_ws_process_frame(conn, opcode, payload, payload_len);
-        
-        /* Handle application-specific messages */
-        if (opcode == CT_WS_TEXT || opcode == CT_WS_BINARY) {
-            /* Echo server example - replace with actual logic */
-            ct_ws_send_message(conn, opcode, payload, payload_len);
+        if (ret < 0) return -1;
+        if (ret > 0) {
+            conn->ws_blocked = true;
+            break;
         }
     }
     
+    /* Full with nothing queued to drain - try again next loop pass */
+    if (conn->ws_blocked && !ct_output_pending(conn)) {
+        ct_reactor_mark_ready(conn->reactor, conn);
+    }
+    
     return 0;
 }
 
 /* Route HTTP request to appropriate handler */
 void ct_route_request(ct_server_t *server, ct_connection_t *conn) {
-    const char *path = conn->request.url;
+    char path[CT_MAX_PATH_LEN];
+    if (ct_request_path(&conn->request, path, sizeof(path)) < 0) {
+        ct_response_html(&conn->response, 414,
+                        "<html><body><h1>414 URI Too Long</h1></body></html>");
+        return;
+    }
     
     /* API endpoints */
     if (strncmp(path, "/api/", 5) == 0) {
-        ct_handle_api_request(server, conn);
+        ct_handle_api_request(server, conn, path);
         return;
     }
     
@@ -291,9 +848,8 @@ void ct_route_request(ct_server_t *server, ct_connection_t *conn) {
 }
 
 /* Handle API requests */
-void ct_handle_api_request(ct_server_t *server, ct_connection_t *conn) {
-    const char *path = conn->request.url;
-    
+void ct_handle_api_request(ct_server_t *server, ct_connection_t *conn,
+                           const char *path) {
     /* Login endpoint */
     if (strcmp(path, "/api/login") == 0 && 
         conn->request.method == CT_METHOD_POST) {
@@ -316,31 +872,105 @@ void ct_handle_api_request(ct_server_t *server, ct_connection_t *conn) {
         ct_handle_terminal_config(server, conn);
     } else if (strcmp(path, "/api/session-status") == 0) {
         ct_handle_session_status(server, conn);
+    } else if (strcmp(path, "/api/loop-stats") == 0) {
+        ct_handle_loop_stats(server, conn);
+    } else if (strcmp(path, "/api/memory-stats") == 0) {
+        ct_handle_memory_stats(server, conn);
     } else {
         ct_response_json(&conn->response, 404,
                         "{\"error\":\"Not Found\"}");
     }
 }
 
+/* Login verification offloaded to the job pool - bcrypt takes tens of
+ * milliseconds and would stall every connection on the reactor */
+typedef struct {
+    ct_job_t job;
+    ct_server_t *server;
+    char session_id[CT_SESSION_ID_LEN + 1];
+    bool new_session;
+    bool verified;
+    char password[256];
+} login_job_t;
+
+static void login_send_result(ct_connection_t *conn, bool verified) {
+    if (verified) {
+        ct_response_json(&conn->response, 200,
+                        "{\"success\":true,\"sessionInfo\":{\"expiresIn\":\"30 days\",\"persistent\":true}}");
+    } else {
+        ct_response_json(&conn->response, 401,
+                        "{\"success\":false,\"message\":\"Invalid password\"}");
+    }
+}
+
+/* Pool thread */
+static void login_job_run(ct_job_t *job) {
+    login_job_t *login = (login_job_t *)((char *)job - offsetof(login_job_t, job));
+    
+    login->verified = ct_auth_verify_password(login->password, 
+                                              login->server->config.password_hash);
+    memset(login->password, 0, sizeof(login->password));
+}
+
+/* Reactor thread */
+static void login_job_complete(ct_job_t *job) {
+    login_job_t *login = (login_job_t *)((char *)job - offsetof(login_job_t, job));
+    ct_connection_t *conn = job->conn;
+    
+    if (conn) {
+        ct_reactor_t *reactor = conn->reactor;
+        
+        conn->job = NULL;
+        conn->state = CT_CONN_IDLE;
+        
+        /* The session may have been destroyed while bcrypt ran - look it
+         * up again rather than trusting the reference from before */
+        ct_session_t *session = ct_session_find(login->server, login->session_id);
+        if (session && login->verified) {
+            ct_session_set_authenticated(login->server, session);
+        }
+        ct_session_release(login->server, conn->session);
+        conn->session = session;
+        
+        login_send_result(conn, session && login->verified);
+        if (session && login->new_session) {
+            ct_session_set_cookie(&conn->response, session->id);
+        }
+        connection_send_response(conn);
+        
+        /* Serve anything pipelined behind the login, then flush; input
+         * left in the socket while parked is read from the ready list */
+        if (ct_connection_process(login->server, conn) < 0) {
+            reactor->close_connection(reactor, conn);
+        } else {
+            if (conn->read_more) {
+                ct_reactor_mark_ready(reactor, conn);
+            }
+            reactor->flush_connection(reactor, conn);
+        }
+    }
+    
+    memset(login, 0, sizeof(*login));
+    free(login);
+}
+
 /* Handle login request */
 void ct_handle_login(ct_server_t *server, ct_connection_t *conn) {
     /* Parse JSON body - simplified, real implementation needs JSON parser */
     const char *password = NULL;
+    size_t password_len = 0;
     
-    if (conn->request.body && conn->request.body_len > 0) {
+    const char *body = ct_request_body(&conn->request);
+    if (body) {
         /* Extract password from JSON - this is simplified */
-        const char *p = strstr(conn->request.body, "\"password\":\"");
+        const char *body_end = body + conn->request.body_len;
+        const char *p = memmem(body, body_end - body, "\"password\":\"", 12);
         if (p) {
             p += 12;
-            const char *end = strchr(p, '"');
-            if (end) {
-                static char pwd_buf[256];
-                size_t len = end - p;
-                if (len < sizeof(pwd_buf)) {
-                    memcpy(pwd_buf, p, len);
-                    pwd_buf[len] = '\0';
-                    password = pwd_buf;
-                }
+            const char *end = memchr(p, '"', body_end - p);
+            if (end && (size_t)(end - p) < sizeof(((login_job_t *)0)->password)) {
+                password = p;
+                password_len = end - p;
             }
         }
     }
@@ -352,6 +982,7 @@ void ct_handle_login(ct_server_t *server, ct_connection_t *conn) {
     }
     
     /* Create or get session */
+    bool new_session = false;
     if (!conn->session) {
         conn->session = ct_session_create(server);
         if (!conn->session) {
@@ -359,18 +990,44 @@ void ct_handle_login(ct_server_t *server, ct_connection_t *conn) {
                             "{\"success\":false,\"message\":\"Session error\"}");
             return;
         }
-        ct_session_set_cookie(&conn->response, conn->session->id);
+        new_session = true;
     }
     
-    /* Authenticate */
-    if (ct_session_authenticate(conn->session, password, 
-                               server->config.password_hash)) {
-        ct_response_json(&conn->response, 200,
-                        "{\"success\":true,\"sessionInfo\":{\"expiresIn\":\"30 days\",\"persistent\":true}}");
-    } else {
-        ct_response_json(&conn->response, 401,
-                        "{\"success\":false,\"message\":\"Invalid password\"}");
+    login_job_t *login = calloc(1, sizeof(login_job_t));
+    if (!login) {
+        ct_response_json(&conn->response, 500,
+                        "{\"success\":false,\"message\":\"Server error\"}");
+        return;
+    }
+    
+    login->job.reactor = conn->reactor;
+    login->job.conn = conn;
+    login->job.run = login_job_run;
+    login->job.complete = login_job_complete;
+    login->server = server;
+    login->new_session = new_session;
+    memcpy(login->session_id, conn->session->id, sizeof(login->session_id));
+    memcpy(login->password, password, password_len);
+    
+    /* Park the connection until the pool answers */
+    if (ct_thread_pool_submit(server->job_pool, &login->job) == 0) {
+        conn->job = &login->job;
+        conn->state = CT_CONN_AWAITING_JOB;
+        return;
+    }
+    
+    /* No pool - verify inline */
+    login_job_run(&login->job);
+    if (login->verified) {
+        ct_session_set_authenticated(server, conn->session);
     }
+    login_send_result(conn, login->verified);
+    if (new_session) {
+        ct_session_set_cookie(&conn->response, conn->session->id);
+    }
+    
+    memset(login, 0, sizeof(*login));
+    free(login);
 }
 
 /* Handle logout request */
@@ -409,4 +1066,31 @@ void ct_handle_session_status(ct_server_t *server, ct_connection_t *conn) {
             time_buf, time_buf, time_buf);
     
     ct_response_json(&conn->response, 200, json);
-}
\ No newline at end of file
+}
+
+/* Handle event loop statistics request */
+void ct_handle_loop_stats(ct_server_t *server, ct_connection_t *conn) {
+    /* Body must outlive the handler - it is serialized afterwards */
+    static __thread char json[8192];
+    
+    if (ct_loop_stats_json(server, json, sizeof(json)) == 0) {
+        ct_response_json(&conn->response, 500,
+                        "{\"error\":\"Stats unavailable\"}");
+        return;
+    }
+    
+    ct_response_json(&conn->response, 200, json);
+}
+
+/* Handle buffer memory statistics request */
+void ct_handle_memory_stats(ct_server_t *server, ct_connection_t *conn) {
+    static __thread char json[2048];
+    
+    if (ct_mem_stats_json(server, json, sizeof(json)) == 0) {
+        ct_response_json(&conn->response, 500,
+                        "{\"error\":\"Stats unavailable\"}");
+        return;
+    }
+    
+    ct_response_json(&conn->response, 200, json);
+}
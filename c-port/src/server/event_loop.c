@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -12,30 +13,39 @@
 
 #ifdef LINUX
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #elif defined(DARWIN) || defined(BSD)
 #include <sys/event.h>
 #include <sys/time.h>
 #endif
 
-static volatile bool g_running = true;
+/* Shared by every reactor - cleared once by ct_server_stop() */
+static atomic_bool g_running = true;
 
-/* Set socket to non-blocking mode */
+/* Set from the SIGUSR1 handler - reactor 0 dumps loop stats when woken */
+static atomic_bool g_dump_stats = false;
+
+#ifndef SOCK_NONBLOCK
+/* Set socket to non-blocking, close-on-exec mode - only needed where
+ * socket() and accept4() can't take the flags directly */
 static int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
+#endif
 
-/* Set socket options for performance */
-static void set_socket_options(int fd) {
+/* Listener options - applied once per listen socket. Buffer sizes must be
+ * set before listen() so the window scale is negotiated with them; accepted
+ * sockets inherit them. Returns true if SO_REUSEPORT took effect. */
+static bool set_listen_options(int fd) {
     int yes = 1;
+    bool reuseport = false;
     
     /* Reuse address */
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
     
-    /* Disable Nagle's algorithm for low latency */
-    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
-    
     /* Set socket buffer sizes */
     int bufsize = 256 * 1024;
     setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
@@ -43,7 +53,7 @@ static void set_socket_options(int fd) {
     
 #ifdef SO_REUSEPORT
     /* Enable SO_REUSEPORT for load balancing */
-    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+    reuseport = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == 0;
 #endif
     
 #ifdef TCP_FASTOPEN
@@ -51,18 +61,26 @@ static void set_socket_options(int fd) {
     int qlen = 5;
     setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
 #endif
+    
+    return reuseport;
 }
 
 /* Create listening socket */
-static int create_listen_socket(const char *host, uint16_t port) {
+static int create_listen_socket(const char *host, uint16_t port, bool *reuseport) {
+#ifdef SOCK_NONBLOCK
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
     int fd = socket(AF_INET, SOCK_STREAM, 0);
+#endif
     if (fd < 0) {
         perror("socket");
         return -1;
     }
     
-    set_socket_options(fd);
+#ifndef SOCK_NONBLOCK
     set_nonblocking(fd);
+#endif
+    *reuseport = set_listen_options(fd);
     
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -89,140 +107,265 @@ static int create_listen_socket(const char *host, uint16_t port) {
     return fd;
 }
 
+/* Accept one client as a non-blocking, close-on-exec socket */
+static int accept_client(int listen_fd) {
+#ifdef SOCK_NONBLOCK
+    return accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd >= 0 && set_nonblocking(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
 #ifdef LINUX
 /* Linux epoll implementation */
 
-static int event_init(ct_server_t *server) {
-    server->event_fd = epoll_create1(EPOLL_CLOEXEC);
-    if (server->event_fd < 0) {
+/* The listener is level-triggered: when an accept batch stops short, the
+ * remaining backlog is reported again on the next wait */
+static int event_add_listener(ct_reactor_t *reactor) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; /* NULL means listen socket */
+    
+#ifdef EPOLLEXCLUSIVE
+    /* A shared listener wakes one reactor per connection, not all of them */
+    if (reactor->listen_shared) {
+        ev.events |= EPOLLEXCLUSIVE;
+    }
+#endif
+    
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_ADD, reactor->listen_fd, &ev);
+}
+
+static int event_del_listener(ct_reactor_t *reactor) {
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_DEL, reactor->listen_fd, NULL);
+}
+
+static int event_init(ct_reactor_t *reactor) {
+    reactor->event_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->event_fd < 0) {
         perror("epoll_create1");
         return -1;
     }
     
     /* Add listen socket to epoll */
+    if (event_add_listener(reactor) < 0) {
+        perror("epoll_ctl");
+        close(reactor->event_fd);
+        return -1;
+    }
+    
+    /* Wakeup eventfd so ct_server_stop() can interrupt epoll_wait */
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wake_fd < 0) {
+        perror("eventfd");
+        close(reactor->event_fd);
+        return -1;
+    }
+    
     struct epoll_event ev;
     ev.events = EPOLLIN | EPOLLET;
-    ev.data.ptr = NULL; /* NULL means listen socket */
+    ev.data.ptr = &reactor->wake_fd;
     
-    if (epoll_ctl(server->event_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) < 0) {
+    if (epoll_ctl(reactor->event_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev) < 0) {
         perror("epoll_ctl");
-        close(server->event_fd);
+        close(reactor->wake_fd);
+        close(reactor->event_fd);
         return -1;
     }
     
     return 0;
 }
 
-static int event_add_connection(ct_server_t *server, ct_connection_t *conn) {
+static void event_wake(ct_reactor_t *reactor) {
+    uint64_t one = 1;
+    ssize_t n = write(reactor->wake_fd, &one, sizeof(one));
+    (void)n;
+}
+
+static void event_drain_wake(ct_reactor_t *reactor) {
+    uint64_t value;
+    ssize_t n = read(reactor->wake_fd, &value, sizeof(value));
+    (void)n;
+}
+
+static int event_add_connection(ct_reactor_t *reactor, ct_connection_t *conn) {
     struct epoll_event ev;
     ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
     ev.data.ptr = conn;
     
-    return epoll_ctl(server->event_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_ADD, conn->fd, &ev);
 }
 
-static int event_mod_connection(ct_server_t *server, ct_connection_t *conn, 
+static int event_mod_connection(ct_reactor_t *reactor, ct_connection_t *conn, 
                                uint32_t events) {
     struct epoll_event ev;
     ev.events = events | EPOLLET;
     ev.data.ptr = conn;
     
-    return epoll_ctl(server->event_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static int event_del_connection(ct_reactor_t *reactor, ct_connection_t *conn) {
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_DEL, conn->fd, NULL);
 }
 
-static int event_del_connection(ct_server_t *server, ct_connection_t *conn) {
-    return epoll_ctl(server->event_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+/* A proxy backend - its events report as the client connection's */
+static int event_add_backend(ct_reactor_t *reactor, int fd, ct_connection_t *conn) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = conn;
+    
+    return epoll_ctl(reactor->event_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-static int event_wait(ct_server_t *server, ct_event_t *events, int max_events) {
-    return epoll_wait(server->event_fd, events, max_events, 1000);
+static int event_wait(ct_reactor_t *reactor, ct_event_t *events, int max_events,
+                      int timeout_ms) {
+    return epoll_wait(reactor->event_fd, events, max_events, timeout_ms);
 }
 
 #elif defined(DARWIN) || defined(BSD)
 /* macOS/BSD kqueue implementation */
 
-static int event_init(ct_server_t *server) {
-    server->event_fd = kqueue();
-    if (server->event_fd < 0) {
+#define CT_WAKE_IDENT 1
+
+static int event_add_listener(ct_reactor_t *reactor) {
+    struct kevent ev;
+    EV_SET(&ev, reactor->listen_fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+    return kevent(reactor->event_fd, &ev, 1, NULL, 0, NULL);
+}
+
+static int event_del_listener(ct_reactor_t *reactor) {
+    struct kevent ev;
+    EV_SET(&ev, reactor->listen_fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    return kevent(reactor->event_fd, &ev, 1, NULL, 0, NULL);
+}
+
+static int event_init(ct_reactor_t *reactor) {
+    reactor->event_fd = kqueue();
+    if (reactor->event_fd < 0) {
         perror("kqueue");
         return -1;
     }
     
-    /* Add listen socket to kqueue */
-    struct kevent ev;
-    EV_SET(&ev, server->listen_fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+    /* Add listen socket and user wakeup event to kqueue */
+    struct kevent ev[2];
+    EV_SET(&ev[0], reactor->listen_fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+    EV_SET(&ev[1], CT_WAKE_IDENT, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0,
+           &reactor->wake_fd);
     
-    if (kevent(server->event_fd, &ev, 1, NULL, 0, NULL) < 0) {
+    if (kevent(reactor->event_fd, ev, 2, NULL, 0, NULL) < 0) {
         perror("kevent");
-        close(server->event_fd);
+        close(reactor->event_fd);
         return -1;
     }
     
+    reactor->wake_fd = -1; /* EVFILT_USER needs no descriptor */
+    
     return 0;
 }
 
-static int event_add_connection(ct_server_t *server, ct_connection_t *conn) {
+static void event_wake(ct_reactor_t *reactor) {
+    struct kevent ev;
+    EV_SET(&ev, CT_WAKE_IDENT, EVFILT_USER, 0, NOTE_TRIGGER, 0, &reactor->wake_fd);
+    kevent(reactor->event_fd, &ev, 1, NULL, 0, NULL);
+}
+
+static void event_drain_wake(ct_reactor_t *reactor) {
+    /* EV_CLEAR resets the user event on delivery */
+    (void)reactor;
+}
+
+static int event_add_connection(ct_reactor_t *reactor, ct_connection_t *conn) {
     struct kevent ev[2];
     EV_SET(&ev[0], conn->fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, conn);
     EV_SET(&ev[1], conn->fd, EVFILT_WRITE, EV_ADD | EV_ENABLE, 0, 0, conn);
     
-    return kevent(server->event_fd, ev, 2, NULL, 0, NULL);
+    return kevent(reactor->event_fd, ev, 2, NULL, 0, NULL);
 }
 
-static int event_mod_connection(ct_server_t *server, ct_connection_t *conn, 
+static int event_mod_connection(ct_reactor_t *reactor, ct_connection_t *conn, 
                                uint32_t events) {
     /* kqueue doesn't need explicit modification */
     return 0;
 }
 
-static int event_del_connection(ct_server_t *server, ct_connection_t *conn) {
+static int event_del_connection(ct_reactor_t *reactor, ct_connection_t *conn) {
     struct kevent ev[2];
     EV_SET(&ev[0], conn->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
     EV_SET(&ev[1], conn->fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
     
-    return kevent(server->event_fd, ev, 2, NULL, 0, NULL);
+    return kevent(reactor->event_fd, ev, 2, NULL, 0, NULL);
+}
+
+static int event_add_backend(ct_reactor_t *reactor, int fd, ct_connection_t *conn) {
+    struct kevent ev[2];
+    EV_SET(&ev[0], fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, conn);
+    EV_SET(&ev[1], fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, conn);
+    
+    return kevent(reactor->event_fd, ev, 2, NULL, 0, NULL);
 }
 
-static int event_wait(ct_server_t *server, ct_event_t *events, int max_events) {
-    struct timespec timeout = {1, 0}; /* 1 second timeout */
-    return kevent(server->event_fd, NULL, 0, events, max_events, &timeout);
+static int event_wait(ct_reactor_t *reactor, ct_event_t *events, int max_events,
+                      int timeout_ms) {
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    return kevent(reactor->event_fd, NULL, 0, events, max_events,
+                  timeout_ms < 0 ? NULL : &timeout);
 }
 #endif
 
-/* Accept new connections */
-static void accept_connections(ct_server_t *server) {
-    while (1) {
-        struct sockaddr_in addr;
-        socklen_t addrlen = sizeof(addr);
-        
-        int fd = accept(server->listen_fd, (struct sockaddr *)&addr, &addrlen);
+/* Listener paused after fd exhaustion - start accepting again */
+static void accept_timer_cb(ct_timer_t *timer) {
+    ct_reactor_t *reactor = (ct_reactor_t *)((char *)timer - 
+                            offsetof(ct_reactor_t, accept_timer));
+    event_add_listener(reactor);
+}
+
+/* Accept new connections - at most CT_ACCEPT_BATCH per call so a connect
+ * storm can't starve established connections; the level-triggered
+ * listener brings us back for the rest */
+static void accept_connections(ct_reactor_t *reactor) {
+    ct_server_t *server = reactor->server;
+    
+    for (int i = 0; i < CT_ACCEPT_BATCH; i++) {
+        int fd = accept_client(reactor->listen_fd);
         if (fd < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break; /* No more connections */
             }
-            perror("accept");
-            continue;
+            if (errno == EMFILE || errno == ENFILE || 
+                errno == ENOBUFS || errno == ENOMEM) {
+                /* The backlog can't drain until descriptors free up;
+                 * stop polling the listener for a moment instead of
+                 * spinning on it */
+                event_del_listener(reactor);
+                ct_timer_add(&reactor->timers, &reactor->accept_timer,
+                             ct_now_ms() + CT_ACCEPT_BACKOFF_MS);
+                break;
+            }
+            continue; /* ECONNABORTED, EINTR, EPROTO - client gone */
         }
         
-        /* Check connection limit */
+        /* Check connection limit - shared across all reactors */
         if (server->active_connections >= server->config.max_connections) {
             close(fd);
             continue;
         }
         
-        set_nonblocking(fd);
-        set_socket_options(fd);
-        
-        /* Create connection object */
-        ct_connection_t *conn = ct_connection_create(server, fd);
+        /* Create connection object - applies per-connection options */
+        ct_connection_t *conn = ct_connection_create(reactor, fd);
         if (!conn) {
             close(fd);
             continue;
         }
         
         /* Add to event loop */
-        if (event_add_connection(server, conn) < 0) {
-            ct_connection_destroy(server, conn);
+        if (event_add_connection(reactor, conn) < 0) {
+            ct_connection_destroy(reactor, conn);
             continue;
         }
         
@@ -230,6 +373,135 @@ static void accept_connections(ct_server_t *server) {
     }
 }
 
+/* Readiness backends write inline; a full socket finishes on EPOLLOUT */
+static void reactor_flush_connection(ct_reactor_t *reactor, ct_connection_t *conn) {
+    if (ct_connection_write(conn) < 0) {
+        ct_connection_destroy(reactor, conn);
+    }
+}
+
+/* Sweep expired sessions, then sleep until the oldest one is due. Sessions
+ * created meanwhile expire no earlier than now + session_timeout. */
+static void session_timer_cb(ct_timer_t *timer) {
+    ct_reactor_t *reactor = (ct_reactor_t *)((char *)timer - 
+                            offsetof(ct_reactor_t, session_timer));
+    ct_server_t *server = reactor->server;
+    
+    ct_session_cleanup_expired(server);
+    
+    time_t now = ct_now();
+    time_t expiry = ct_session_next_expiry(server);
+    if (expiry == 0) {
+        expiry = now + server->config.session_timeout;
+    }
+    
+    time_t delay = expiry > now ? expiry - now : 1;
+    ct_timer_add(&reactor->timers, timer, ct_now_ms() + (uint64_t)delay * 1000);
+}
+
+/* Refresh the per-state buffer memory snapshot */
+static void stats_timer_cb(ct_timer_t *timer) {
+    ct_reactor_t *reactor = (ct_reactor_t *)((char *)timer - 
+                            offsetof(ct_reactor_t, stats_timer));
+    
+    ct_mem_stats_collect(reactor);
+    ct_timer_add(&reactor->timers, timer, ct_now_ms() + CT_MEM_STATS_INTERVAL_MS);
+}
+
+/* Initialize one reactor - listen socket, event fd, connection table */
+static int reactor_init(ct_server_t *server, ct_reactor_t *reactor, size_t index) {
+    reactor->server = server;
+    reactor->index = index;
+    reactor->wake_fd = -1;
+    
+    /* Every reactor binds its own SO_REUSEPORT socket, so the kernel
+     * load-balances incoming connections between them. Without it the
+     * other reactors share reactor 0's listener. */
+    if (index > 0 && server->reactors[0].listen_shared) {
+        reactor->listen_fd = fcntl(server->reactors[0].listen_fd, F_DUPFD_CLOEXEC, 0);
+        reactor->listen_shared = true;
+    } else {
+        bool reuseport = false;
+        reactor->listen_fd = create_listen_socket(server->config.host, 
+                                                  server->config.port, &reuseport);
+        reactor->listen_shared = !reuseport && server->config.workers > 1;
+    }
+    if (reactor->listen_fd < 0) {
+        return -1;
+    }
+    
+    /* Initialize event system */
+    if (event_init(reactor) < 0) {
+        close(reactor->listen_fd);
+        return -1;
+    }
+    
+    /* Create connection table and pool */
+    reactor->conns = malloc(1024 * sizeof(ct_connection_t *));
+    reactor->conn_capacity = 1024;
+    reactor->conn_pool = ct_mem_pool_create(sizeof(ct_connection_t), 1024, 0);
+    reactor->seg_pool = ct_mem_pool_create(sizeof(ct_out_seg_t), 256, 0);
+    
+    if (!reactor->conns || !reactor->conn_pool || !reactor->seg_pool) {
+        free(reactor->conns);
+        ct_mem_pool_destroy(reactor->conn_pool);
+        ct_mem_pool_destroy(reactor->seg_pool);
+        if (reactor->wake_fd >= 0) close(reactor->wake_fd);
+        close(reactor->event_fd);
+        close(reactor->listen_fd);
+        return -1;
+    }
+    
+    ct_buf_pool_init(&reactor->buf_pool);
+    
+    reactor->flush_connection = reactor_flush_connection;
+    reactor->close_connection = ct_connection_destroy;
+    reactor->add_backend = event_add_backend;
+    reactor->remove_backend = NULL;     /* closing the socket unregisters it */
+    
+    pthread_mutex_init(&reactor->job_lock, NULL);
+    reactor->jobs_done = NULL;
+    
+    /* Timers - sessions are shared, so only reactor 0 expires them */
+    ct_timer_wheel_init(&reactor->timers, ct_now_ms());
+    ct_timer_init(&reactor->session_timer, session_timer_cb);
+    ct_timer_init(&reactor->accept_timer, accept_timer_cb);
+    ct_timer_init(&reactor->stats_timer, stats_timer_cb);
+    ct_timer_add(&reactor->timers, &reactor->stats_timer,
+                 ct_now_ms() + CT_MEM_STATS_INTERVAL_MS);
+    if (index == 0 && server->config.session_timeout > 0) {
+        ct_timer_add(&reactor->timers, &reactor->session_timer,
+                     ct_now_ms() + (uint64_t)server->config.session_timeout * 1000);
+    }
+    
+    return 0;
+}
+
+static void reactor_destroy(ct_reactor_t *reactor) {
+    /* Close whatever is still open - releases buffers and cache refs, and
+     * detaches any job a connection still waits on */
+    while (reactor->conn_count > 0) {
+        ct_connection_destroy(reactor, reactor->conns[reactor->conn_count - 1]);
+    }
+    
+    /* Jobs finished after the loop stopped now have no connection, so
+     * they complete as cancelled and only free themselves */
+    ct_reactor_complete_jobs(reactor);
+    pthread_mutex_destroy(&reactor->job_lock);
+    
+    close(reactor->listen_fd);
+    close(reactor->event_fd);
+    if (reactor->wake_fd >= 0) {
+        close(reactor->wake_fd);
+    }
+    
+    free(reactor->conns);
+    ct_mem_pool_destroy(reactor->conn_pool);
+    ct_mem_pool_destroy(reactor->seg_pool);
+    ct_ws_deflate_pool_destroy(reactor);
+    ct_buf_pool_destroy(&reactor->buf_pool);
+}
+
 /* Main server implementation */
 ct_server_t *ct_server_create(const ct_config_t *config) {
     ct_server_t *server = calloc(1, sizeof(ct_server_t));
@@ -238,30 +510,61 @@ ct_server_t *ct_server_create(const ct_config_t *config) {
     /* Copy configuration */
     memcpy(&server->config, config, sizeof(ct_config_t));
     
-    /* Create listen socket */
-    server->listen_fd = create_listen_socket(config->host, config->port);
-    if (server->listen_fd < 0) {
-        free(server);
-        return NULL;
+    /* Loop stats record cycle counts - learn the counter's rate once */
+    ct_loop_stats_calibrate();
+    
+    /* Fastest HTTP scanner and WebSocket unmasker this CPU supports */
+    ct_http_scan_init(NULL);
+    ct_ws_unmask_init(NULL);
+    
+    /* HPACK Huffman decode tables */
+    ct_hpack_init();
+    
+    /* Worker count - 0 means one reactor per online CPU */
+    size_t workers = config->workers;
+    if (workers == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = ncpu > 0 ? (size_t)ncpu : 1;
     }
+    if (workers > CT_MAX_WORKERS) {
+        workers = CT_MAX_WORKERS;
+    }
+    server->config.workers = workers;
     
-    /* Initialize event system */
-    if (event_init(server) < 0) {
-        close(server->listen_fd);
+    if (server->config.io_budget == 0) {
+        server->config.io_budget = CT_IO_BUDGET;
+    }
+    
+    server->reactors = calloc(workers, sizeof(ct_reactor_t));
+    if (!server->reactors) {
         free(server);
         return NULL;
     }
     
-    /* Create connection hash table and pool */
-    server->connections = ct_hash_table_create(CT_HASH_TABLE_SIZE, ct_hash_fnv1a);
-    server->conn_pool = ct_mem_pool_create(sizeof(ct_connection_t), 1024);
+    /* Create one event loop per worker */
+    for (size_t i = 0; i < workers; i++) {
+        if (reactor_init(server, &server->reactors[i], i) < 0) {
+            while (i-- > 0) {
+                reactor_destroy(&server->reactors[i]);
+            }
+            free(server->reactors);
+            free(server);
+            return NULL;
+        }
+        server->reactor_count++;
+    }
     
     /* Create session hash table and pool */
+    pthread_mutex_init(&server->session_lock, NULL);
     server->sessions = ct_hash_table_create(CT_HASH_TABLE_SIZE, ct_hash_fnv1a);
-    server->session_pool = ct_mem_pool_create(sizeof(ct_session_t), 256);
+    server->session_pool = ct_mem_pool_create(sizeof(ct_session_t), 256,
+                                              CT_MEM_POOL_SHARED);
     
     /* Create file cache */
-    server->file_cache = ct_hash_table_create(1024, ct_hash_fnv1a);
+    server->file_cache = ct_file_cache_create(CT_FILE_CACHE_SIZE);
+    
+    /* Blocking-job pool - if it can't start, jobs run inline */
+    server->job_pool = ct_thread_pool_create(config->job_threads);
     
     /* Initialize statistics */
     atomic_init(&server->total_requests, 0);
@@ -274,29 +577,196 @@ ct_server_t *ct_server_create(const ct_config_t *config) {
 void ct_server_destroy(ct_server_t *server) {
     if (!server) return;
     
-    close(server->listen_fd);
-    close(server->event_fd);
+    /* Join pool threads first - they deliver into the reactors */
+    ct_thread_pool_destroy(server->job_pool);
     
-    ct_hash_table_destroy(server->connections);
-    ct_mem_pool_destroy(server->conn_pool);
+    for (size_t i = 0; i < server->reactor_count; i++) {
+        reactor_destroy(&server->reactors[i]);
+    }
+    free(server->reactors);
     
     ct_hash_table_destroy(server->sessions);
     ct_mem_pool_destroy(server->session_pool);
+    pthread_mutex_destroy(&server->session_lock);
     
-    ct_hash_table_destroy(server->file_cache);
+    ct_file_cache_destroy(server->file_cache);
     
     free(server);
 }
 
+/* Stop all reactors - async-signal-safe */
 void ct_server_stop(ct_server_t *server) {
-    g_running = false;
+    atomic_store(&g_running, false);
+    
+    if (!server) return;
+    
+    for (size_t i = 0; i < server->reactor_count; i++) {
+        event_wake(&server->reactors[i]);
+    }
 }
 
-int ct_server_run(ct_server_t *server) {
+/* Interrupt a reactor's wait from another thread */
+void ct_reactor_wake(ct_reactor_t *reactor) {
+    event_wake(reactor);
+}
+
+/* Watch a second socket on conn's behalf (the terminal proxy's backend);
+ * its readiness is reported as conn's. Remove it before closing the
+ * socket - io_uring holds the file open while it watches. */
+int ct_reactor_add_backend(ct_reactor_t *reactor, int fd, ct_connection_t *conn) {
+    return reactor->add_backend(reactor, fd, conn);
+}
+
+void ct_reactor_remove_backend(ct_reactor_t *reactor, ct_connection_t *conn) {
+    if (reactor->remove_backend) {
+        reactor->remove_backend(reactor, conn);
+    }
+}
+
+/* Readiness on a client connection - shared by epoll and kqueue */
+static void reactor_dispatch(ct_reactor_t *reactor, ct_connection_t *conn,
+                             bool readable, bool writable, bool hangup) {
+    ct_server_t *server = reactor->server;
+    
+    if (readable) {
+        ct_loop_handler_t handler = ct_connection_handler_class(conn);
+        uint64_t start = ct_cycles();
+        
+        int ret = ct_connection_drain(server, conn);
+        ct_loop_stats_record(&reactor->stats, handler, start);
+        
+        if (ret < 0) {
+            ct_connection_destroy(reactor, conn);
+            return;
+        }
+    }
+    
+    if (writable) {
+        uint64_t start = ct_cycles();
+        int ret = ct_connection_write(conn);
+        ct_loop_stats_record(&reactor->stats, CT_LOOP_WRITE, start);
+        
+        if (ret < 0) {
+            ct_connection_destroy(reactor, conn);
+            return;
+        }
+    }
+    
+    if (hangup) {
+        ct_connection_destroy(reactor, conn);
+    }
+}
+
+/* SIGUSR1 sets the flag and wakes reactor 0, which prints the table */
+void ct_server_request_stats_dump(ct_server_t *server) {
+    atomic_store(&g_dump_stats, true);
+    
+    if (server && server->reactor_count > 0) {
+        event_wake(&server->reactors[0]);
+    }
+}
+
+/* Wake fd fired - stats dump request or finished pool jobs. Shared with
+ * the io_uring backend. */
+void ct_reactor_handle_wake(ct_reactor_t *reactor) {
+    if (reactor->index == 0 && atomic_exchange(&g_dump_stats, false)) {
+        ct_loop_stats_dump(reactor->server, stderr);
+    }
+    
+    ct_reactor_complete_jobs(reactor);
+}
+
+/* Queue a connection that ran out of budget with work left - buffered
+ * requests, unread input or unsent output. FIFO, so every connection
+ * gets a turn before any gets two. */
+void ct_reactor_mark_ready(ct_reactor_t *reactor, ct_connection_t *conn) {
+    if (conn->ready) return;
+    
+    conn->ready = true;
+    conn->ready_next = NULL;
+    conn->ready_prev = reactor->ready_tail;
+    if (reactor->ready_tail) {
+        reactor->ready_tail->ready_next = conn;
+    } else {
+        reactor->ready_head = conn;
+    }
+    reactor->ready_tail = conn;
+}
+
+void ct_reactor_unmark_ready(ct_reactor_t *reactor, ct_connection_t *conn) {
+    if (!conn->ready) return;
+    
+    if (conn->ready_prev) {
+        conn->ready_prev->ready_next = conn->ready_next;
+    } else {
+        reactor->ready_head = conn->ready_next;
+    }
+    if (conn->ready_next) {
+        conn->ready_next->ready_prev = conn->ready_prev;
+    } else {
+        reactor->ready_tail = conn->ready_prev;
+    }
+    
+    conn->ready = false;
+    conn->ready_prev = NULL;
+    conn->ready_next = NULL;
+}
+
+/* Give each queued connection another budget. Only the connections
+ * queued on entry run; any that re-queue wait for the next loop
+ * iteration, after fresh events. Shared with the io_uring backend, which
+ * never sets read_more. */
+void ct_reactor_run_ready(ct_reactor_t *reactor) {
+    ct_connection_t *last = reactor->ready_tail;
+    
+    while (reactor->ready_head) {
+        ct_connection_t *conn = reactor->ready_head;
+        bool done = conn == last;
+        ct_loop_handler_t handler = ct_connection_handler_class(conn);
+        uint64_t start = ct_cycles();
+        
+        ct_reactor_unmark_ready(reactor, conn);
+        int ret = conn->read_more ? ct_connection_drain(reactor->server, conn)
+                                  : ct_connection_process(reactor->server, conn);
+        if (ret < 0) {
+            reactor->close_connection(reactor, conn);
+        } else {
+            reactor->flush_connection(reactor, conn);
+        }
+        ct_loop_stats_record(&reactor->stats, handler, start);
+        
+        if (done) break;
+    }
+}
+
+/* Event loop for a single reactor */
+static int reactor_run(ct_reactor_t *reactor) {
+    ct_server_t *server = reactor->server;
     ct_event_t events[1024];
     
-    while (g_running) {
-        int nev = event_wait(server, events, 1024);
+    /* Completion-based backend takes over the whole loop when enabled */
+    if (server->config.use_io_uring) {
+        int ret = ct_uring_run(reactor, &g_running);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (reactor->index == 0) {
+            fprintf(stderr, "io_uring unavailable, falling back to epoll\n");
+        }
+    }
+    
+    while (atomic_load_explicit(&g_running, memory_order_relaxed)) {
+        /* Sleep exactly until the next timer is due - or just poll while
+         * pipelined requests are waiting */
+        int timeout = reactor->ready_head ? 0 :
+                      ct_timer_wheel_timeout(&reactor->timers, ct_now_ms());
+        uint64_t blocked = ct_cycles();
+        int nev = event_wait(reactor, events, 1024, timeout);
+        uint64_t woke = ct_cycles();
+        ct_histogram_add(&reactor->stats.blocked, woke - blocked);
+        
+        /* One clock sample serves every event in this batch */
+        ct_clock_update();
         
         if (nev < 0) {
             if (errno == EINTR) continue;
@@ -306,78 +776,97 @@ int ct_server_run(ct_server_t *server) {
         
         for (int i = 0; i < nev; i++) {
 #ifdef LINUX
-            if (events[i].data.ptr == NULL) {
-                /* Listen socket event */
-                accept_connections(server);
-            } else {
-                /* Connection event */
-                ct_connection_t *conn = events[i].data.ptr;
-                
-                if (events[i].events & EPOLLIN) {
-                    if (ct_connection_read(conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                    
-                    if (ct_connection_process(server, conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                }
-                
-                if (events[i].events & EPOLLOUT) {
-                    if (ct_connection_write(conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                }
-                
-                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
-                    ct_connection_destroy(server, conn);
-                }
-            }
+            void *ptr = events[i].data.ptr;
+            bool readable = events[i].events & EPOLLIN;
+            bool writable = events[i].events & EPOLLOUT;
+            bool hangup = events[i].events & (EPOLLHUP | EPOLLERR);
+            bool is_wake = ptr == &reactor->wake_fd;
 #elif defined(DARWIN) || defined(BSD)
-            if (events[i].udata == NULL) {
+            void *ptr = events[i].udata;
+            bool readable = events[i].filter == EVFILT_READ;
+            bool writable = events[i].filter == EVFILT_WRITE;
+            bool hangup = events[i].flags & EV_EOF;
+            bool is_wake = events[i].filter == EVFILT_USER;
+#endif
+            uint64_t start = ct_cycles();
+            
+            if (is_wake) {
+                /* Stop request, stats dump or finished pool jobs - loop
+                 * condition re-checks g_running */
+                event_drain_wake(reactor);
+                ct_reactor_handle_wake(reactor);
+                ct_loop_stats_record(&reactor->stats, CT_LOOP_JOBS, start);
+            } else if (ptr == NULL) {
                 /* Listen socket event */
-                accept_connections(server);
+                accept_connections(reactor);
+                ct_loop_stats_record(&reactor->stats, CT_LOOP_ACCEPT, start);
             } else {
                 /* Connection event */
-                ct_connection_t *conn = events[i].udata;
-                
-                if (events[i].filter == EVFILT_READ) {
-                    if (ct_connection_read(conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                    
-                    if (ct_connection_process(server, conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                }
-                
-                if (events[i].filter == EVFILT_WRITE) {
-                    if (ct_connection_write(conn) < 0) {
-                        ct_connection_destroy(server, conn);
-                        continue;
-                    }
-                }
-                
-                if (events[i].flags & EV_EOF) {
-                    ct_connection_destroy(server, conn);
-                }
+                reactor_dispatch(reactor, ptr, readable, writable, hangup);
             }
-#endif
         }
         
-        /* Periodic cleanup */
-        static time_t last_cleanup = 0;
-        time_t now = time(NULL);
-        if (now - last_cleanup > 60) {
-            ct_session_cleanup_expired(server);
-            last_cleanup = now;
-        }
+        /* Pipelined requests left over from earlier passes */
+        ct_reactor_run_ready(reactor);
+        
+        /* Idle/header/ping deadlines and session expiry */
+        uint64_t timers_start = ct_cycles();
+        ct_timer_wheel_advance(&reactor->timers, ct_now_ms());
+        ct_loop_stats_record(&reactor->stats, CT_LOOP_TIMERS, timers_start);
+        
+        ct_histogram_add(&reactor->stats.events, nev);
+        ct_histogram_add(&reactor->stats.busy, ct_cycles() - woke);
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+static void *reactor_thread(void *arg) {
+    ct_reactor_t *reactor = arg;
+    
+#ifdef LINUX
+    /* Pin each reactor to its own core to keep connection state cache-hot */
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(reactor->index % (size_t)ncpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+    
+    if (reactor_run(reactor) < 0) {
+        /* A dead reactor would silently drop its share of connections */
+        ct_server_stop(reactor->server);
+    }
+    
+    return NULL;
+}
+
+int ct_server_run(ct_server_t *server) {
+    /* Spawn reactors 1..N-1, run reactor 0 on the calling thread */
+    size_t started = 1;
+    for (size_t i = 1; i < server->reactor_count; i++) {
+        ct_reactor_t *reactor = &server->reactors[i];
+        if (pthread_create(&reactor->thread, NULL, reactor_thread, reactor) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+    
+    int ret = 0;
+    if (started == server->reactor_count) {
+        ret = reactor_run(&server->reactors[0]);
+    } else {
+        ret = -1;
+    }
+    
+    /* Make sure every reactor exits, then wait for them */
+    ct_server_stop(server);
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(server->reactors[i].thread, NULL);
+    }
+    
+    return ret;
+}
@@ -0,0 +1,559 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* HPACK (RFC 7541) for the HTTP/2 mode. The decoder keeps the dynamic
+ * table the peer indexes into. The encoder never indexes, so responses
+ * need no table state: a field is a static-table entry, a static name
+ * with a literal value, or literal both, and strings go out raw - the
+ * Huffman code is only ever decoded. */
+
+#define STATIC_COUNT 61
+
+static const struct {
+    const char *name;
+    const char *value;
+    uint8_t name_len;
+    uint8_t value_len;
+} static_table[STATIC_COUNT + 1] = {
+    /*  0 */ {NULL, NULL, 0, 0},
+    /*  1 */ {":authority", "", 10, 0},
+    /*  2 */ {":method", "GET", 7, 3},
+    /*  3 */ {":method", "POST", 7, 4},
+    /*  4 */ {":path", "/", 5, 1},
+    /*  5 */ {":path", "/index.html", 5, 11},
+    /*  6 */ {":scheme", "http", 7, 4},
+    /*  7 */ {":scheme", "https", 7, 5},
+    /*  8 */ {":status", "200", 7, 3},
+    /*  9 */ {":status", "204", 7, 3},
+    /* 10 */ {":status", "206", 7, 3},
+    /* 11 */ {":status", "304", 7, 3},
+    /* 12 */ {":status", "400", 7, 3},
+    /* 13 */ {":status", "404", 7, 3},
+    /* 14 */ {":status", "500", 7, 3},
+    /* 15 */ {"accept-charset", "", 14, 0},
+    /* 16 */ {"accept-encoding", "gzip, deflate", 15, 13},
+    /* 17 */ {"accept-language", "", 15, 0},
+    /* 18 */ {"accept-ranges", "", 13, 0},
+    /* 19 */ {"accept", "", 6, 0},
+    /* 20 */ {"access-control-allow-origin", "", 27, 0},
+    /* 21 */ {"age", "", 3, 0},
+    /* 22 */ {"allow", "", 5, 0},
+    /* 23 */ {"authorization", "", 13, 0},
+    /* 24 */ {"cache-control", "", 13, 0},
+    /* 25 */ {"content-disposition", "", 19, 0},
+    /* 26 */ {"content-encoding", "", 16, 0},
+    /* 27 */ {"content-language", "", 16, 0},
+    /* 28 */ {"content-length", "", 14, 0},
+    /* 29 */ {"content-location", "", 16, 0},
+    /* 30 */ {"content-range", "", 13, 0},
+    /* 31 */ {"content-type", "", 12, 0},
+    /* 32 */ {"cookie", "", 6, 0},
+    /* 33 */ {"date", "", 4, 0},
+    /* 34 */ {"etag", "", 4, 0},
+    /* 35 */ {"expect", "", 6, 0},
+    /* 36 */ {"expires", "", 7, 0},
+    /* 37 */ {"from", "", 4, 0},
+    /* 38 */ {"host", "", 4, 0},
+    /* 39 */ {"if-match", "", 8, 0},
+    /* 40 */ {"if-modified-since", "", 17, 0},
+    /* 41 */ {"if-none-match", "", 13, 0},
+    /* 42 */ {"if-range", "", 8, 0},
+    /* 43 */ {"if-unmodified-since", "", 19, 0},
+    /* 44 */ {"last-modified", "", 13, 0},
+    /* 45 */ {"link", "", 4, 0},
+    /* 46 */ {"location", "", 8, 0},
+    /* 47 */ {"max-forwards", "", 12, 0},
+    /* 48 */ {"proxy-authenticate", "", 18, 0},
+    /* 49 */ {"proxy-authorization", "", 19, 0},
+    /* 50 */ {"range", "", 5, 0},
+    /* 51 */ {"referer", "", 7, 0},
+    /* 52 */ {"refresh", "", 7, 0},
+    /* 53 */ {"retry-after", "", 11, 0},
+    /* 54 */ {"server", "", 6, 0},
+    /* 55 */ {"set-cookie", "", 10, 0},
+    /* 56 */ {"strict-transport-security", "", 25, 0},
+    /* 57 */ {"transfer-encoding", "", 17, 0},
+    /* 58 */ {"user-agent", "", 10, 0},
+    /* 59 */ {"vary", "", 4, 0},
+    /* 60 */ {"via", "", 3, 0},
+    /* 61 */ {"www-authenticate", "", 16, 0},
+};
+
+/* Canonical Huffman code (Appendix B) - code, length in bits */
+static const struct {
+    uint32_t code;
+    uint8_t len;
+} huff_codes[256] = {
+    {0x00001ff8, 13}, {0x007fffd8, 23}, {0x0fffffe2, 28}, {0x0fffffe3, 28},
+    {0x0fffffe4, 28}, {0x0fffffe5, 28}, {0x0fffffe6, 28}, {0x0fffffe7, 28},
+    {0x0fffffe8, 28}, {0x00ffffea, 24}, {0x3ffffffc, 30}, {0x0fffffe9, 28},
+    {0x0fffffea, 28}, {0x3ffffffd, 30}, {0x0fffffeb, 28}, {0x0fffffec, 28},
+    {0x0fffffed, 28}, {0x0fffffee, 28}, {0x0fffffef, 28}, {0x0ffffff0, 28},
+    {0x0ffffff1, 28}, {0x0ffffff2, 28}, {0x3ffffffe, 30}, {0x0ffffff3, 28},
+    {0x0ffffff4, 28}, {0x0ffffff5, 28}, {0x0ffffff6, 28}, {0x0ffffff7, 28},
+    {0x0ffffff8, 28}, {0x0ffffff9, 28}, {0x0ffffffa, 28}, {0x0ffffffb, 28},
+    {0x00000014,  6}, {0x000003f8, 10}, {0x000003f9, 10}, {0x00000ffa, 12},
+    {0x00001ff9, 13}, {0x00000015,  6}, {0x000000f8,  8}, {0x000007fa, 11},
+    {0x000003fa, 10}, {0x000003fb, 10}, {0x000000f9,  8}, {0x000007fb, 11},
+    {0x000000fa,  8}, {0x00000016,  6}, {0x00000017,  6}, {0x00000018,  6},
+    {0x00000000,  5}, {0x00000001,  5}, {0x00000002,  5}, {0x00000019,  6},
+    {0x0000001a,  6}, {0x0000001b,  6}, {0x0000001c,  6}, {0x0000001d,  6},
+    {0x0000001e,  6}, {0x0000001f,  6}, {0x0000005c,  7}, {0x000000fb,  8},
+    {0x00007ffc, 15}, {0x00000020,  6}, {0x00000ffb, 12}, {0x000003fc, 10},
+    {0x00001ffa, 13}, {0x00000021,  6}, {0x0000005d,  7}, {0x0000005e,  7},
+    {0x0000005f,  7}, {0x00000060,  7}, {0x00000061,  7}, {0x00000062,  7},
+    {0x00000063,  7}, {0x00000064,  7}, {0x00000065,  7}, {0x00000066,  7},
+    {0x00000067,  7}, {0x00000068,  7}, {0x00000069,  7}, {0x0000006a,  7},
+    {0x0000006b,  7}, {0x0000006c,  7}, {0x0000006d,  7}, {0x0000006e,  7},
+    {0x0000006f,  7}, {0x00000070,  7}, {0x00000071,  7}, {0x00000072,  7},
+    {0x000000fc,  8}, {0x00000073,  7}, {0x000000fd,  8}, {0x00001ffb, 13},
+    {0x0007fff0, 19}, {0x00001ffc, 13}, {0x00003ffc, 14}, {0x00000022,  6},
+    {0x00007ffd, 15}, {0x00000003,  5}, {0x00000023,  6}, {0x00000004,  5},
+    {0x00000024,  6}, {0x00000005,  5}, {0x00000025,  6}, {0x00000026,  6},
+    {0x00000027,  6}, {0x00000006,  5}, {0x00000074,  7}, {0x00000075,  7},
+    {0x00000028,  6}, {0x00000029,  6}, {0x0000002a,  6}, {0x00000007,  5},
+    {0x0000002b,  6}, {0x00000076,  7}, {0x0000002c,  6}, {0x00000008,  5},
+    {0x00000009,  5}, {0x0000002d,  6}, {0x00000077,  7}, {0x00000078,  7},
+    {0x00000079,  7}, {0x0000007a,  7}, {0x0000007b,  7}, {0x00007ffe, 15},
+    {0x000007fc, 11}, {0x00003ffd, 14}, {0x00001ffd, 13}, {0x0ffffffc, 28},
+    {0x000fffe6, 20}, {0x003fffd2, 22}, {0x000fffe7, 20}, {0x000fffe8, 20},
+    {0x003fffd3, 22}, {0x003fffd4, 22}, {0x003fffd5, 22}, {0x007fffd9, 23},
+    {0x003fffd6, 22}, {0x007fffda, 23}, {0x007fffdb, 23}, {0x007fffdc, 23},
+    {0x007fffdd, 23}, {0x007fffde, 23}, {0x00ffffeb, 24}, {0x007fffdf, 23},
+    {0x00ffffec, 24}, {0x00ffffed, 24}, {0x003fffd7, 22}, {0x007fffe0, 23},
+    {0x00ffffee, 24}, {0x007fffe1, 23}, {0x007fffe2, 23}, {0x007fffe3, 23},
+    {0x007fffe4, 23}, {0x001fffdc, 21}, {0x003fffd8, 22}, {0x007fffe5, 23},
+    {0x003fffd9, 22}, {0x007fffe6, 23}, {0x007fffe7, 23}, {0x00ffffef, 24},
+    {0x003fffda, 22}, {0x001fffdd, 21}, {0x000fffe9, 20}, {0x003fffdb, 22},
+    {0x003fffdc, 22}, {0x007fffe8, 23}, {0x007fffe9, 23}, {0x001fffde, 21},
+    {0x007fffea, 23}, {0x003fffdd, 22}, {0x003fffde, 22}, {0x00fffff0, 24},
+    {0x001fffdf, 21}, {0x003fffdf, 22}, {0x007fffeb, 23}, {0x007fffec, 23},
+    {0x001fffe0, 21}, {0x001fffe1, 21}, {0x003fffe0, 22}, {0x001fffe2, 21},
+    {0x007fffed, 23}, {0x003fffe1, 22}, {0x007fffee, 23}, {0x007fffef, 23},
+    {0x000fffea, 20}, {0x003fffe2, 22}, {0x003fffe3, 22}, {0x003fffe4, 22},
+    {0x007ffff0, 23}, {0x003fffe5, 22}, {0x003fffe6, 22}, {0x007ffff1, 23},
+    {0x03ffffe0, 26}, {0x03ffffe1, 26}, {0x000fffeb, 20}, {0x0007fff1, 19},
+    {0x003fffe7, 22}, {0x007ffff2, 23}, {0x003fffe8, 22}, {0x01ffffec, 25},
+    {0x03ffffe2, 26}, {0x03ffffe3, 26}, {0x03ffffe4, 26}, {0x07ffffde, 27},
+    {0x07ffffdf, 27}, {0x03ffffe5, 26}, {0x00fffff1, 24}, {0x01ffffed, 25},
+    {0x0007fff2, 19}, {0x001fffe3, 21}, {0x03ffffe6, 26}, {0x07ffffe0, 27},
+    {0x07ffffe1, 27}, {0x03ffffe7, 26}, {0x07ffffe2, 27}, {0x00fffff2, 24},
+    {0x001fffe4, 21}, {0x001fffe5, 21}, {0x03ffffe8, 26}, {0x03ffffe9, 26},
+    {0x0ffffffd, 28}, {0x07ffffe3, 27}, {0x07ffffe4, 27}, {0x07ffffe5, 27},
+    {0x000fffec, 20}, {0x00fffff3, 24}, {0x000fffed, 20}, {0x001fffe6, 21},
+    {0x003fffe9, 22}, {0x001fffe7, 21}, {0x001fffe8, 21}, {0x007ffff3, 23},
+    {0x003fffea, 22}, {0x003fffeb, 22}, {0x01ffffee, 25}, {0x01ffffef, 25},
+    {0x00fffff4, 24}, {0x00fffff5, 24}, {0x03ffffea, 26}, {0x007ffff4, 23},
+    {0x03ffffeb, 26}, {0x07ffffe6, 27}, {0x03ffffec, 26}, {0x03ffffed, 26},
+    {0x07ffffe7, 27}, {0x07ffffe8, 27}, {0x07ffffe9, 27}, {0x07ffffea, 27},
+    {0x07ffffeb, 27}, {0x0ffffffe, 28}, {0x07ffffec, 27}, {0x07ffffed, 27},
+    {0x07ffffee, 27}, {0x07ffffef, 27}, {0x07fffff0, 27}, {0x03ffffee, 26},
+};
+
+/* Decoding tables, 8 bits per step. An entry either ends a code - its
+ * symbol, and how many of the 8 bits the code used - or names the node
+ * for the next 8 bits. Codes shorter than 8 bits fill every entry they
+ * prefix. Node 0 is the root, so next == 0 means no code continues. */
+#define HUFF_NODES 16
+
+typedef struct {
+    uint8_t sym;
+    uint8_t len;
+    uint8_t next;
+} huff_entry_t;
+
+static huff_entry_t huff_nodes[HUFF_NODES][256];
+
+/* Static names by hash, for the encoder - the first index carrying the
+ * name, 0 for an empty slot */
+#define NAME_SLOTS 128
+
+static uint8_t name_slots[NAME_SLOTS];
+
+static void huff_build(void) {
+    int nodes = 1;
+    
+    for (int sym = 0; sym < 256; sym++) {
+        uint32_t code = huff_codes[sym].code;
+        int len = huff_codes[sym].len;
+        int node = 0;
+        
+        while (len > 8) {
+            len -= 8;
+            huff_entry_t *e = &huff_nodes[node][(code >> len) & 0xff];
+            if (!e->next) {
+                e->next = (uint8_t)nodes++;
+            }
+            node = e->next;
+        }
+        
+        int shift = 8 - len;
+        int start = (int)(code & ((1u << len) - 1)) << shift;
+        for (int i = start; i < start + (1 << shift); i++) {
+            huff_nodes[node][i].sym = (uint8_t)sym;
+            huff_nodes[node][i].len = (uint8_t)len;
+        }
+    }
+}
+
+/* Build the lookup tables - call once before any reactor starts */
+void ct_hpack_init(void) {
+    huff_build();
+    
+    for (int i = 1; i <= STATIC_COUNT; i++) {
+        uint32_t slot = ct_hash_fnv1a(static_table[i].name,
+                                      static_table[i].name_len) & (NAME_SLOTS - 1);
+        while (name_slots[slot] &&
+               strcmp(static_table[name_slots[slot]].name, static_table[i].name) != 0) {
+            slot = (slot + 1) & (NAME_SLOTS - 1);
+        }
+        if (!name_slots[slot]) {
+            name_slots[slot] = (uint8_t)i;
+        }
+    }
+}
+
+/* Static index for a lowercase name, 0 if it has none */
+static int static_name_index(const char *name, size_t len) {
+    uint32_t slot = ct_hash_fnv1a(name, len) & (NAME_SLOTS - 1);
+    
+    while (name_slots[slot]) {
+        int i = name_slots[slot];
+        if (static_table[i].name_len == len &&
+            memcmp(static_table[i].name, name, len) == 0) {
+            return i;
+        }
+        slot = (slot + 1) & (NAME_SLOTS - 1);
+    }
+    
+    return 0;
+}
+
+/* Decode len Huffman-coded bytes into dst. Returns the decoded length, or
+ * -1 for an invalid code, padding that isn't an EOS prefix, or output
+ * beyond dst_len. */
+static int huff_decode(const uint8_t *src, size_t len, char *dst, size_t dst_len) {
+    uint64_t cur = 0;
+    int cbits = 0;      /* unconsumed bits in cur */
+    int sbits = 0;      /* bits since the last symbol ended */
+    int node = 0;
+    size_t n = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        cur = cur << 8 | src[i];
+        cbits += 8;
+        sbits += 8;
+        
+        while (cbits >= 8) {
+            const huff_entry_t *e = &huff_nodes[node][(cur >> (cbits - 8)) & 0xff];
+            if (e->len) {
+                if (n == dst_len) return -1;
+                dst[n++] = (char)e->sym;
+                cbits -= e->len;
+                sbits = cbits;
+                node = 0;
+            } else if (e->next) {
+                cbits -= 8;
+                node = e->next;
+            } else {
+                return -1;  /* EOS, or no such code */
+            }
+        }
+    }
+    
+    /* Codes ending in the last partial byte */
+    while (cbits > 0) {
+        const huff_entry_t *e = &huff_nodes[node][(cur << (8 - cbits)) & 0xff];
+        if (!e->len || e->len > cbits) break;
+        if (n == dst_len) return -1;
+        dst[n++] = (char)e->sym;
+        cbits -= e->len;
+        sbits = cbits;
+        node = 0;
+    }
+    
+    /* Padding is under 8 bits, all ones */
+    uint64_t mask = (1u << cbits) - 1;
+    if (sbits > 7 || (cur & mask) != mask) return -1;
+    
+    return (int)n;
+}
+
+/* Prefixed integer (5.1) - values past 2^28 are refused */
+static int decode_int(const uint8_t **p, const uint8_t *end, int prefix,
+                      uint32_t *out) {
+    uint32_t max = (1u << prefix) - 1;
+    
+    if (*p == end) return -1;
+    uint32_t v = *(*p)++ & max;
+    if (v < max) {
+        *out = v;
+        return 0;
+    }
+    
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (*p == end) return -1;
+        uint8_t b = *(*p)++;
+        v += (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
+/* String literal (5.2). Raw strings are returned in place; Huffman-coded
+ * ones are decoded into scratch at *used. */
+static int decode_string(const uint8_t **p, const uint8_t *end, char *scratch,
+                         size_t scratch_len, size_t *used,
+                         const char **out, size_t *out_len) {
+    if (*p == end) return -1;
+    bool huffman = **p & 0x80;
+    
+    uint32_t len;
+    if (decode_int(p, end, 7, &len) < 0 || len > (size_t)(end - *p)) return -1;
+    
+    if (!huffman) {
+        *out = (const char *)*p;
+        *out_len = len;
+    } else {
+        int n = huff_decode(*p, len, scratch + *used, scratch_len - *used);
+        if (n < 0) return -1;
+        *out = scratch + *used;
+        *out_len = n;
+        *used += n;
+    }
+    
+    *p += len;
+    return 0;
+}
+
+void ct_hpack_table_init(ct_hpack_t *hp) {
+    memset(hp, 0, sizeof(*hp));
+    hp->max_size = CT_HPACK_TABLE_SIZE;
+}
+
+static void table_evict(ct_hpack_t *hp, size_t max_size) {
+    size_t cap = sizeof(hp->entries) / sizeof(hp->entries[0]);
+    
+    while (hp->count > 0 && hp->size > max_size) {
+        ct_hpack_entry_t *e = &hp->entries[(hp->head + hp->count - 1) % cap];
+        hp->size -= e->name_len + e->value_len + 32;
+        free(e->data);
+        e->data = NULL;
+        hp->count--;
+    }
+}
+
+void ct_hpack_table_free(ct_hpack_t *hp) {
+    table_evict(hp, 0);
+}
+
+/* Index 1..61 is static, 62 on the dynamic table, newest first */
+static int table_get(ct_hpack_t *hp, uint32_t index, const char **name,
+                     size_t *name_len, const char **value, size_t *value_len) {
+    size_t cap = sizeof(hp->entries) / sizeof(hp->entries[0]);
+    
+    if (index == 0) return -1;
+    if (index <= STATIC_COUNT) {
+        *name = static_table[index].name;
+        *name_len = static_table[index].name_len;
+        *value = static_table[index].value;
+        *value_len = static_table[index].value_len;
+        return 0;
+    }
+    
+    index -= STATIC_COUNT + 1;
+    if (index >= hp->count) return -1;
+    
+    const ct_hpack_entry_t *e = &hp->entries[(hp->head + index) % cap];
+    *name = e->data;
+    *name_len = e->name_len;
+    *value = e->data + e->name_len;
+    *value_len = e->value_len;
+    return 0;
+}
+
+/* Insert at the head, evicting from the tail. The copy is made first -
+ * the name may be an entry that is about to go. */
+static int table_add(ct_hpack_t *hp, const char *name, size_t name_len,
+                     const char *value, size_t value_len) {
+    size_t cap = sizeof(hp->entries) / sizeof(hp->entries[0]);
+    size_t size = name_len + value_len + 32;
+    
+    /* An entry larger than the table empties it (4.4) */
+    if (size > hp->max_size) {
+        table_evict(hp, 0);
+        return 0;
+    }
+    
+    char *data = malloc(name_len + value_len);
+    if (!data && name_len + value_len > 0) return -1;
+    memcpy(data, name, name_len);
+    memcpy(data + name_len, value, value_len);
+    
+    table_evict(hp, hp->max_size - size);
+    
+    hp->head = (hp->head + cap - 1) % cap;
+    hp->entries[hp->head].data = data;
+    hp->entries[hp->head].name_len = (uint32_t)name_len;
+    hp->entries[hp->head].value_len = (uint32_t)value_len;
+    hp->count++;
+    hp->size += size;
+    return 0;
+}
+
+/* Decode a complete header block, calling field for each header in
+ * order; names and values are valid only during the call. Returns -1 if
+ * the block is malformed (a connection error - the table is now out of
+ * step with the peer's) or field returned -1. */
+int ct_hpack_decode(ct_hpack_t *hp, const uint8_t *block, size_t len,
+                    ct_hpack_field_fn field, void *ctx) {
+    /* Huffman output - 8/5 of the coded size at worst */
+    static __thread char scratch[64 << 10];
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    bool fields_seen = false;
+    
+    while (p < end) {
+        const char *name, *value;
+        size_t name_len, value_len;
+        size_t used = 0;
+        uint32_t index;
+        uint8_t b = *p;
+        
+        if (b & 0x80) {
+            /* Indexed field */
+            if (decode_int(&p, end, 7, &index) < 0 ||
+                table_get(hp, index, &name, &name_len, &value, &value_len) < 0) {
+                return -1;
+            }
+        } else if ((b & 0xe0) == 0x20) {
+            /* Table size update - only ahead of the first field */
+            if (fields_seen || decode_int(&p, end, 5, &index) < 0 ||
+                index > CT_HPACK_TABLE_SIZE) {
+                return -1;
+            }
+            hp->max_size = index;
+            table_evict(hp, index);
+            continue;
+        } else {
+            /* Literal - with incremental indexing, without, or never */
+            bool indexing = b & 0x40;
+            if (decode_int(&p, end, indexing ? 6 : 4, &index) < 0) return -1;
+            
+            if (index) {
+                const char *unused;
+                size_t unused_len;
+                if (table_get(hp, index, &name, &name_len, &unused, &unused_len) < 0) {
+                    return -1;
+                }
+            } else if (decode_string(&p, end, scratch, sizeof(scratch), &used,
+                                     &name, &name_len) < 0) {
+                return -1;
+            }
+            
+            if (decode_string(&p, end, scratch, sizeof(scratch), &used,
+                              &value, &value_len) < 0) {
+                return -1;
+            }
+            
+            /* Handed over before the insert - a name taken from the table
+             * may be the entry the insert evicts */
+            fields_seen = true;
+            if (field(ctx, name, name_len, value, value_len) < 0) return -1;
+            
+            if (indexing && table_add(hp, name, name_len, value, value_len) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        fields_seen = true;
+        if (field(ctx, name, name_len, value, value_len) < 0) return -1;
+    }
+    
+    return 0;
+}
+
+static inline char ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+}
+
+static uint8_t *encode_int(uint8_t *p, uint8_t first, int prefix, size_t v) {
+    size_t max = ((size_t)1 << prefix) - 1;
+    
+    if (v < max) {
+        *p++ = first | (uint8_t)v;
+        return p;
+    }
+    
+    *p++ = first | (uint8_t)max;
+    v -= max;
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/* :status - one byte for the seven codes in the static table */
+uint8_t *ct_hpack_encode_status(uint8_t *p, int status) {
+    switch (status) {
+        case 200: *p++ = 0x80 | 8; return p;
+        case 204: *p++ = 0x80 | 9; return p;
+        case 206: *p++ = 0x80 | 10; return p;
+        case 304: *p++ = 0x80 | 11; return p;
+        case 400: *p++ = 0x80 | 12; return p;
+        case 404: *p++ = 0x80 | 13; return p;
+        case 500: *p++ = 0x80 | 14; return p;
+        default:
+            break;
+    }
+    
+    /* Literal without indexing, static name */
+    *p++ = 0x08;
+    *p++ = 3;
+    *p++ = (uint8_t)('0' + status / 100 % 10);
+    *p++ = (uint8_t)('0' + status / 10 % 10);
+    *p++ = (uint8_t)('0' + status % 10);
+    return p;
+}
+
+/* One header as a literal without indexing - by static name where there
+ * is one. The name is lowercased on the way, as HTTP/2 requires. p needs
+ * name_len + value_len + 11 bytes. */
+uint8_t *ct_hpack_encode_field(uint8_t *p, const char *name, size_t name_len,
+                               const char *value, size_t value_len) {
+    char lower[64];
+    int index = 0;
+    
+    /* Only the name_len bytes written are read. Empty names have no
+     * static index and skip the lookup, so lower[] is never passed on
+     * unwritten. */
+    if (name_len > 0 && name_len <= sizeof(lower)) {
+        for (size_t i = 0; i < name_len; i++) {
+            lower[i] = ascii_lower(name[i]);
+        }
+        index = static_name_index(lower, name_len);
+    }
+    
+    if (index) {
+        p = encode_int(p, 0x00, 4, (size_t)index);
+    } else {
+        *p++ = 0x00;
+        p = encode_int(p, 0x00, 7, name_len);
+        for (size_t i = 0; i < name_len; i++) {
+            *p++ = (uint8_t)ascii_lower(name[i]);
+        }
+    }
+    
+    p = encode_int(p, 0x00, 7, value_len);
+    memcpy(p, value, value_len);
+    return p + value_len;
+}
@@ -0,0 +1,1161 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+/* HTTP/2 over cleartext (RFC 9113), by prior knowledge or an h2c upgrade.
+ * Each request is decoded from HPACK into its HTTP/1.1 text form and run
+ * through ct_parse_request and the usual handlers, so routing, sessions
+ * and static files behave the same on either protocol. A response is
+ * built as an HTTP/1.1 head and re-encoded as a HEADERS frame, with
+ * CONTINUATIONs past the peer's frame size; bodies go out as DATA frames
+ * within the peer's flow-control windows, produced as the connection
+ * drains - the same watermark as a streamed body, so one connection
+ * carries every asset with bounded buffers. */
+
+#define H2_FRAME_HEADER     9
+#define H2_FRAME_MAX        16384           /* what we accept - the default */
+#define H2_DEFAULT_WINDOW   65535
+#define H2_WINDOW_MAX       0x7fffffff
+#define H2_HEADER_BLOCK_MAX (16 << 10)      /* request block, CONTINUATIONs included */
+#define H2_REQUEST_MAX      (CT_BODY_INLINE_MAX + (16 << 10)) /* head text + body */
+
+enum {
+    H2_DATA,
+    H2_HEADERS,
+    H2_PRIORITY,
+    H2_RST_STREAM,
+    H2_SETTINGS,
+    H2_PUSH_PROMISE,
+    H2_PING,
+    H2_GOAWAY,
+    H2_WINDOW_UPDATE,
+    H2_CONTINUATION
+};
+
+enum {
+    H2_FLAG_END_STREAM = 0x1,
+    H2_FLAG_ACK = 0x1,
+    H2_FLAG_END_HEADERS = 0x4,
+    H2_FLAG_PADDED = 0x8,
+    H2_FLAG_PRIORITY = 0x20
+};
+
+enum {
+    H2_NO_ERROR,
+    H2_PROTOCOL_ERROR,
+    H2_INTERNAL_ERROR,
+    H2_FLOW_CONTROL_ERROR,
+    H2_SETTINGS_TIMEOUT,
+    H2_STREAM_CLOSED,
+    H2_FRAME_SIZE_ERROR,
+    H2_REFUSED_STREAM,
+    H2_CANCEL,
+    H2_COMPRESSION_ERROR,
+    H2_CONNECT_ERROR,
+    H2_ENHANCE_YOUR_CALM
+};
+
+enum {
+    H2_SETTINGS_HEADER_TABLE_SIZE = 1,
+    H2_SETTINGS_ENABLE_PUSH,
+    H2_SETTINGS_MAX_CONCURRENT_STREAMS,
+    H2_SETTINGS_INITIAL_WINDOW_SIZE,
+    H2_SETTINGS_MAX_FRAME_SIZE,
+    H2_SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+static const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+typedef struct h2_stream {
+    uint32_t id;
+    int64_t send_window;
+    bool end_remote;            /* request fully received */
+    
+    /* The request as HTTP/1.1 text, its body appended */
+    char *req;
+    size_t req_len;
+    size_t req_cap;
+    size_t head_len;
+    
+    /* Response body still to send - from memory (a cache entry's, or an
+     * owned copy) or from fd */
+    const char *data;
+    size_t data_len;
+    ct_file_entry_t *entry;
+    char *owned;
+    int fd;
+    off_t offset;
+    
+    struct h2_stream *send_next;
+} h2_stream_t;
+
+struct ct_h2_conn {
+    ct_hpack_t hpack;
+    
+    /* Open streams - few enough that a scan beats a table */
+    h2_stream_t *streams[CT_H2_MAX_STREAMS];
+    size_t stream_count;
+    uint32_t last_stream;       /* highest stream the client opened */
+    uint32_t current;           /* stream whose response the handler builds */
+    
+    /* Send side flow control and framing, as the peer set them */
+    int64_t send_window;
+    uint32_t initial_window;
+    uint32_t max_frame;
+    
+    /* Header block collected across CONTINUATION frames */
+    uint8_t *block;
+    size_t block_len;
+    uint32_t block_stream;      /* 0 when no block is open */
+    bool block_end_stream;
+    
+    /* Streams with body left, served round-robin */
+    h2_stream_t *send_head;
+    h2_stream_t *send_tail;
+    
+    bool preface;               /* client preface seen */
+    bool goaway;
+};
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+/* Frame header straight into the write buffer - the payload follows */
+static void frame_header(ct_connection_t *conn, size_t len, uint8_t type,
+                         uint8_t flags, uint32_t stream_id) {
+    uint8_t hdr[H2_FRAME_HEADER];
+    
+    hdr[0] = (uint8_t)(len >> 16);
+    hdr[1] = (uint8_t)(len >> 8);
+    hdr[2] = (uint8_t)len;
+    hdr[3] = type;
+    hdr[4] = flags;
+    put_u32(hdr + 5, stream_id & 0x7fffffff);
+    ct_ring_buffer_write(&conn->write_buf, (const char *)hdr, sizeof(hdr));
+}
+
+static void send_frame(ct_connection_t *conn, uint8_t type, uint8_t flags,
+                       uint32_t stream_id, const void *payload, size_t len) {
+    frame_header(conn, len, type, flags, stream_id);
+    if (len > 0) {
+        ct_ring_buffer_write(&conn->write_buf, payload, len);
+    }
+}
+
+static void send_u32(ct_connection_t *conn, uint8_t type, uint32_t stream_id,
+                     uint32_t value) {
+    uint8_t payload[4];
+    put_u32(payload, value);
+    send_frame(conn, type, 0, stream_id, payload, sizeof(payload));
+}
+
+/* A header block as one HEADERS frame and as many CONTINUATIONs as the
+ * peer's frame size needs. Nothing may come between them, so the whole
+ * block is reserved before any of it is written. flags go on the HEADERS
+ * frame; END_HEADERS on the last. Returns -1 if the write buffer can't
+ * take it. */
+static int send_header_block(ct_connection_t *conn, uint32_t stream_id,
+                             uint8_t flags, const uint8_t *block, size_t len) {
+    size_t max = conn->h2->max_frame;
+    size_t frames = len > max ? (len + max - 1) / max : 1;
+    size_t need = len + frames * H2_FRAME_HEADER;
+    
+    if (ct_ring_buffer_reserve(&conn->write_buf, need) < need) return -1;
+    
+    uint8_t type = H2_HEADERS;
+    do {
+        size_t n = len < max ? len : max;
+        if (n == len) flags |= H2_FLAG_END_HEADERS;
+        send_frame(conn, type, flags, stream_id, block, n);
+        
+        block += n;
+        len -= n;
+        type = H2_CONTINUATION;
+        flags = 0;
+    } while (len > 0);
+    
+    return 0;
+}
+
+/* Connection error - the last frame we send. Returns -1 for the caller
+ * to stop reading. */
+static int send_goaway(ct_connection_t *conn, uint32_t code) {
+    uint8_t payload[8];
+    put_u32(payload, conn->h2->last_stream);
+    put_u32(payload + 4, code);
+    send_frame(conn, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    
+    conn->h2->goaway = true;
+    conn->state = CT_CONN_CLOSING;
+    return -1;
+}
+
+static void send_settings(ct_connection_t *conn) {
+    uint8_t payload[18], *p = payload;
+    
+    *p++ = 0;
+    *p++ = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    p = put_u32(p, CT_H2_MAX_STREAMS);
+    *p++ = 0;
+    *p++ = H2_SETTINGS_ENABLE_PUSH;
+    p = put_u32(p, 0);
+    *p++ = 0;
+    *p++ = H2_SETTINGS_MAX_HEADER_LIST_SIZE;
+    p = put_u32(p, H2_HEADER_BLOCK_MAX);
+    
+    send_frame(conn, H2_SETTINGS, 0, 0, payload, p - payload);
+}
+
+static h2_stream_t *stream_find(ct_h2_conn_t *h2, uint32_t id) {
+    for (size_t i = 0; i < h2->stream_count; i++) {
+        if (h2->streams[i]->id == id) return h2->streams[i];
+    }
+    return NULL;
+}
+
+static h2_stream_t *stream_open(ct_h2_conn_t *h2, uint32_t id) {
+    if (h2->stream_count == CT_H2_MAX_STREAMS) return NULL;
+    
+    h2_stream_t *stream = calloc(1, sizeof(h2_stream_t));
+    if (!stream) return NULL;
+    
+    stream->id = id;
+    stream->send_window = h2->initial_window;
+    stream->fd = -1;
+    h2->streams[h2->stream_count++] = stream;
+    return stream;
+}
+
+/* Forget a stream and drop whatever it still held. It must be off the
+ * send list. */
+static void stream_close(ct_connection_t *conn, h2_stream_t *stream) {
+    ct_h2_conn_t *h2 = conn->h2;
+    
+    for (size_t i = 0; i < h2->stream_count; i++) {
+        if (h2->streams[i] == stream) {
+            h2->streams[i] = h2->streams[--h2->stream_count];
+            break;
+        }
+    }
+    
+    if (stream->entry) {
+        ct_file_cache_release(conn->server->file_cache, stream->entry);
+    }
+    if (stream->fd >= 0) {
+        close(stream->fd);
+    }
+    free(stream->owned);
+    free(stream->req);
+    free(stream);
+}
+
+static void send_list_remove(ct_h2_conn_t *h2, h2_stream_t *stream) {
+    h2_stream_t *prev = NULL;
+    
+    for (h2_stream_t *s = h2->send_head; s; prev = s, s = s->send_next) {
+        if (s != stream) continue;
+        
+        if (prev) {
+            prev->send_next = s->send_next;
+        } else {
+            h2->send_head = s->send_next;
+        }
+        if (h2->send_tail == s) {
+            h2->send_tail = prev;
+        }
+        s->send_next = NULL;
+        return;
+    }
+}
+
+/* Stream error - the connection carries on */
+static void stream_reset(ct_connection_t *conn, h2_stream_t *stream, uint32_t code) {
+    send_u32(conn, H2_RST_STREAM, stream->id, code);
+    send_list_remove(conn->h2, stream);
+    stream_close(conn, stream);
+}
+
+static int req_append(h2_stream_t *stream, const char *data, size_t len) {
+    if (stream->req_len + len > stream->req_cap) {
+        size_t cap = stream->req_cap ? stream->req_cap : 512;
+        while (cap < stream->req_len + len) cap *= 2;
+        if (cap > H2_REQUEST_MAX) {
+            if (stream->req_len + len > H2_REQUEST_MAX) return -1;
+            cap = H2_REQUEST_MAX;
+        }
+        
+        char *req = realloc(stream->req, cap);
+        if (!req) return -1;
+        stream->req = req;
+        stream->req_cap = cap;
+    }
+    
+    memcpy(stream->req + stream->req_len, data, len);
+    stream->req_len += len;
+    return 0;
+}
+
+/* The client preface, or a prefix of it: 1 once whole, 0 while it may
+ * still be, -1 if data is something else */
+int ct_h2_preface(const char *data, size_t len) {
+    size_t n = len < sizeof(client_preface) - 1 ? len : sizeof(client_preface) - 1;
+    
+    if (memcmp(data, client_preface, n) != 0) return -1;
+    return n == sizeof(client_preface) - 1 ? 1 : 0;
+}
+
+/* Upgrade: h2c with an HTTP2-Settings header (RFC 7540 3.2) */
+bool ct_h2_upgrade_requested(const ct_request_t *req) {
+    ct_header_t upgrade = ct_request_header(req, CT_HDR_UPGRADE);
+    
+    return upgrade.value && upgrade.value_len == 3 &&
+           strncasecmp(upgrade.value, "h2c", 3) == 0 &&
+           ct_request_get_header((ct_request_t *)req, "HTTP2-Settings");
+}
+
+/* Apply a SETTINGS payload from the client */
+static int apply_settings(ct_connection_t *conn, const uint8_t *p, size_t len) {
+    ct_h2_conn_t *h2 = conn->h2;
+    
+    for (; len >= 6; p += 6, len -= 6) {
+        uint16_t id = (uint16_t)(p[0] << 8 | p[1]);
+        uint32_t value = get_u32(p + 2);
+        
+        switch (id) {
+            case H2_SETTINGS_ENABLE_PUSH:
+                if (value > 1) return H2_PROTOCOL_ERROR;
+                break;
+            case H2_SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > H2_WINDOW_MAX) return H2_FLOW_CONTROL_ERROR;
+                
+                /* Open streams move by the difference */
+                int64_t delta = (int64_t)value - h2->initial_window;
+                for (size_t i = 0; i < h2->stream_count; i++) {
+                    h2->streams[i]->send_window += delta;
+                    if (h2->streams[i]->send_window > H2_WINDOW_MAX) {
+                        return H2_FLOW_CONTROL_ERROR;
+                    }
+                }
+                h2->initial_window = value;
+                break;
+            }
+            case H2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 0xffffff) return H2_PROTOCOL_ERROR;
+                h2->max_frame = value;
+                break;
+            default:
+                /* Our encoder never indexes, so the table size is moot */
+                break;
+        }
+    }
+    
+    return 0;
+}
+
+/* base64url without padding, as HTTP2-Settings carries it */
+static int base64url_decode(const char *src, size_t len, uint8_t *dst, size_t dst_len) {
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '-' || c == '+') v = 62;
+        else if (c == '_' || c == '/') v = 63;
+        else if (c == '=') break;
+        else return -1;
+        
+        acc = acc << 6 | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n == dst_len) return -1;
+            dst[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    
+    return (int)n;
+}
+
+/* Switch the connection to HTTP/2. With upgrade, the request that asked
+ * (Upgrade: h2c) becomes stream 1, answered by the caller once it has
+ * been routed, and its HTTP2-Settings apply; without, the client preface
+ * comes next. Returns -1 if the connection can't switch. */
+int ct_h2_start(ct_connection_t *conn, const ct_request_t *upgrade) {
+    ct_h2_conn_t *h2 = calloc(1, sizeof(ct_h2_conn_t));
+    if (!h2) return -1;
+    
+    ct_hpack_table_init(&h2->hpack);
+    h2->send_window = H2_DEFAULT_WINDOW;
+    h2->initial_window = H2_DEFAULT_WINDOW;
+    h2->max_frame = H2_FRAME_MAX;
+    conn->h2 = h2;
+    
+    if (upgrade) {
+        uint8_t settings[256];
+        int len = -1;
+        
+        for (size_t i = 0; i < upgrade->header_count; i++) {
+            const ct_req_header_t *hdr = &upgrade->headers[i];
+            if (hdr->name_len == 14 &&
+                strncasecmp(upgrade->base + hdr->name, "HTTP2-Settings", 14) == 0) {
+                len = base64url_decode(upgrade->base + hdr->value, hdr->value_len,
+                                       settings, sizeof(settings));
+                break;
+            }
+        }
+        
+        /* Implicitly acknowledged by the 101 - no ACK */
+        if (len < 0 || len % 6 != 0 || apply_settings(conn, settings, len) != 0 ||
+            !stream_open(h2, 1)) {
+            ct_h2_free(conn);
+            return -1;
+        }
+        
+        static const char switching[] =
+            "HTTP/1.1 101 Switching Protocols\r\n"
+            "Connection: Upgrade\r\n"
+            "Upgrade: h2c\r\n\r\n";
+        ct_ring_buffer_write(&conn->write_buf, switching, sizeof(switching) - 1);
+        
+        h2->streams[0]->end_remote = true;
+        h2->last_stream = 1;
+        h2->current = 1;
+    }
+    
+    send_settings(conn);
+    return 0;
+}
+
+void ct_h2_free(ct_connection_t *conn) {
+    ct_h2_conn_t *h2 = conn->h2;
+    if (!h2) return;
+    
+    h2->send_head = NULL;
+    while (h2->stream_count > 0) {
+        stream_close(conn, h2->streams[0]);
+    }
+    
+    ct_hpack_table_free(&h2->hpack);
+    free(h2->block);
+    free(h2);
+    conn->h2 = NULL;
+}
+
+/* Building the HTTP/1.1 text of a request while its block is decoded.
+ * Pseudo-headers come first and are held until the request line can be
+ * written; cookie crumbs are joined back into one header (8.2.3). */
+typedef struct {
+    h2_stream_t *stream;
+    char pseudo[CT_MAX_PATH_LEN + 512];
+    size_t pseudo_len;
+    size_t method, method_len;
+    size_t path, path_len;
+    size_t authority, authority_len;
+    char cookie[8192];
+    size_t cookie_len;
+    bool regular;               /* a regular header has been seen */
+    bool malformed;
+} h2_request_builder_t;
+
+static int builder_request_line(h2_request_builder_t *b) {
+    h2_stream_t *s = b->stream;
+    
+    if (!b->method_len || !b->path_len) {
+        b->malformed = true;
+        return 0;
+    }
+    
+    if (req_append(s, b->pseudo + b->method, b->method_len) < 0 ||
+        req_append(s, " ", 1) < 0 ||
+        req_append(s, b->pseudo + b->path, b->path_len) < 0 ||
+        req_append(s, " HTTP/1.1\r\n", 11) < 0) {
+        return -1;
+    }
+    
+    if (b->authority_len &&
+        (req_append(s, "host: ", 6) < 0 ||
+         req_append(s, b->pseudo + b->authority, b->authority_len) < 0 ||
+         req_append(s, "\r\n", 2) < 0)) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Headers that only mean something to an HTTP/1.1 hop, and
+ * content-length, which the DATA frames stand in for */
+static bool hop_header(const char *name, size_t len) {
+    switch (len) {
+        case 2:  return memcmp(name, "te", 2) == 0;
+        case 7:  return memcmp(name, "upgrade", 7) == 0;
+        case 10: return memcmp(name, "connection", 10) == 0 ||
+                        memcmp(name, "keep-alive", 10) == 0;
+        case 14: return memcmp(name, "content-length", 14) == 0;
+        case 16: return memcmp(name, "proxy-connection", 16) == 0;
+        case 17: return memcmp(name, "transfer-encoding", 17) == 0;
+        default: return false;
+    }
+}
+
+static int builder_field(void *ctx, const char *name, size_t name_len,
+                         const char *value, size_t value_len) {
+    h2_request_builder_t *b = ctx;
+    
+    if (b->malformed || !b->stream) return 0;
+    
+    if (name_len > 0 && name[0] == ':') {
+        size_t *off, *len;
+        if (name_len == 7 && memcmp(name, ":method", 7) == 0) {
+            off = &b->method;
+            len = &b->method_len;
+        } else if (name_len == 5 && memcmp(name, ":path", 5) == 0) {
+            off = &b->path;
+            len = &b->path_len;
+        } else if (name_len == 10 && memcmp(name, ":authority", 10) == 0) {
+            off = &b->authority;
+            len = &b->authority_len;
+        } else if (name_len == 7 && memcmp(name, ":scheme", 7) == 0) {
+            return 0;
+        } else {
+            b->malformed = true;
+            return 0;
+        }
+        
+        /* Pseudo-headers after a regular one, repeated, or too long */
+        if (b->regular || *len || value_len == 0 ||
+            value_len > sizeof(b->pseudo) - b->pseudo_len) {
+            b->malformed = true;
+            return 0;
+        }
+        
+        memcpy(b->pseudo + b->pseudo_len, value, value_len);
+        *off = b->pseudo_len;
+        *len = value_len;
+        b->pseudo_len += value_len;
+        return 0;
+    }
+    
+    if (!b->regular) {
+        b->regular = true;
+        if (builder_request_line(b) < 0) return -1;
+        if (b->malformed) return 0;
+    }
+    
+    if (hop_header(name, name_len)) return 0;
+    
+    if (name_len == 6 && memcmp(name, "cookie", 6) == 0) {
+        if (b->cookie_len + value_len + 2 > sizeof(b->cookie)) {
+            b->malformed = true;
+            return 0;
+        }
+        if (b->cookie_len) {
+            memcpy(b->cookie + b->cookie_len, "; ", 2);
+            b->cookie_len += 2;
+        }
+        memcpy(b->cookie + b->cookie_len, value, value_len);
+        b->cookie_len += value_len;
+        return 0;
+    }
+    
+    /* The parser validates both when the text is parsed */
+    h2_stream_t *s = b->stream;
+    if (req_append(s, name, name_len) < 0 ||
+        req_append(s, ": ", 2) < 0 ||
+        req_append(s, value, value_len) < 0 ||
+        req_append(s, "\r\n", 2) < 0) {
+        b->malformed = true;
+    }
+    return 0;
+}
+
+/* Finish the head text after the last field */
+static void builder_finish(h2_request_builder_t *b) {
+    h2_stream_t *s = b->stream;
+    
+    if (!b->malformed && !b->regular && builder_request_line(b) < 0) {
+        b->malformed = true;
+    }
+    if (b->malformed) return;
+    
+    if (b->cookie_len &&
+        (req_append(s, "cookie: ", 8) < 0 ||
+         req_append(s, b->cookie, b->cookie_len) < 0 ||
+         req_append(s, "\r\n", 2) < 0)) {
+        b->malformed = true;
+        return;
+    }
+    
+    if (req_append(s, "\r\n", 2) < 0) {
+        b->malformed = true;
+        return;
+    }
+    s->head_len = s->req_len;
+}
+
+/* HTTP/1.1 head to HPACK: the status from the status line, then every
+ * header but the connection-specific ones. Returns the block length. */
+static size_t encode_head(const char *head, size_t head_len, uint8_t *out) {
+    const char *p = head;
+    const char *end = head + head_len;
+    uint8_t *q = out;
+    
+    /* "HTTP/1.1 200 ..." */
+    int status = (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+    q = ct_hpack_encode_status(q, status);
+    
+    p = memchr(p, '\n', end - p) + 1;
+    
+    while (p < end) {
+        const char *eol = memchr(p, '\r', end - p);
+        if (!eol || eol == p) break;
+        
+        const char *colon = memchr(p, ':', eol - p);
+        if (colon) {
+            size_t name_len = colon - p;
+            const char *value = colon + 1;
+            while (value < eol && *value == ' ') value++;
+            
+            char lower[20];
+            bool hop = false;
+            if (name_len < sizeof(lower)) {
+                for (size_t i = 0; i < name_len; i++) {
+                    lower[i] = (char)(p[i] >= 'A' && p[i] <= 'Z' ? p[i] | 0x20 : p[i]);
+                }
+                hop = hop_header(lower, name_len) &&
+                      !(name_len == 14 && memcmp(lower, "content-length", 14) == 0);
+            }
+            
+            if (!hop) {
+                q = ct_hpack_encode_field(q, p, name_len, value, eol - value);
+            }
+        }
+        
+        p = eol + 2;
+    }
+    
+    return q - out;
+}
+
+/* Frame one DATA frame of the stream's body - as much as the windows,
+ * the peer's frame size and the write buffer allow. Returns bytes
+ * framed, 0 if blocked, -1 on a read error. */
+static int send_data(ct_connection_t *conn, h2_stream_t *stream) {
+    ct_h2_conn_t *h2 = conn->h2;
+    size_t n = stream->data_len;
+    
+    if (n > h2->max_frame) n = h2->max_frame;
+    if ((int64_t)n > h2->send_window) n = h2->send_window > 0 ? (size_t)h2->send_window : 0;
+    if ((int64_t)n > stream->send_window) n = stream->send_window > 0 ? (size_t)stream->send_window : 0;
+    if (n == 0 && stream->data_len > 0) return 0;
+    
+    size_t need = H2_FRAME_HEADER + n;
+    if (ct_ring_buffer_reserve(&conn->write_buf, need) < need) return 0;
+    
+    bool last = n == stream->data_len;
+    frame_header(conn, n, H2_DATA, last ? H2_FLAG_END_STREAM : 0, stream->id);
+    
+    if (stream->fd >= 0) {
+        /* Straight from the file into the ring's free space */
+        struct iovec iov[2];
+        int iovcnt = ct_ring_buffer_free_iov(&conn->write_buf, iov);
+        size_t want = n;
+        for (int i = 0; i < iovcnt; i++) {
+            if (iov[i].iov_len > want) iov[i].iov_len = want;
+            want -= iov[i].iov_len;
+        }
+        
+        ssize_t got;
+        do {
+            got = preadv(stream->fd, iov, iovcnt, stream->offset);
+        } while (got < 0 && errno == EINTR);
+        
+        /* A file that shrank can't be framed - the header is out */
+        if (got != (ssize_t)n) return -1;
+        ct_ring_buffer_commit(&conn->write_buf, n);
+        stream->offset += n;
+    } else {
+        ct_ring_buffer_write(&conn->write_buf, stream->data, n);
+        stream->data += n;
+    }
+    
+    stream->data_len -= n;
+    stream->send_window -= n;
+    h2->send_window -= n;
+    return (int)(H2_FRAME_HEADER + n);
+}
+
+/* Frame pending bodies, one DATA frame per stream per round, while less
+ * than CT_STREAM_WATERMARK is buffered and the windows allow. Returns
+ * bytes produced, -1 if the connection must close. */
+int ct_h2_pump(ct_connection_t *conn) {
+    ct_h2_conn_t *h2 = conn->h2;
+    ct_ring_buffer_t *rb = &conn->write_buf;
+    size_t start = ct_ring_buffer_available(rb);
+    bool progress = true;
+    
+    /* Don't outgrow a ring the kernel is sending from - the completion
+     * pumps again */
+    if (!h2 || rb->pinned) return 0;
+    
+    while (progress && h2->send_head &&
+           ct_ring_buffer_available(rb) < CT_STREAM_WATERMARK) {
+        h2_stream_t **link = &h2->send_head;
+        h2_stream_t *prev = NULL;
+        progress = false;
+        
+        while (*link && ct_ring_buffer_available(rb) < CT_STREAM_WATERMARK) {
+            h2_stream_t *stream = *link;
+            int n = send_data(conn, stream);
+            if (n < 0) return -1;
+            if (n > 0) progress = true;
+            
+            if (stream->data_len > 0) {
+                prev = stream;
+                link = &stream->send_next;
+                continue;
+            }
+            
+            /* Body done - END_STREAM went with the last frame */
+            *link = stream->send_next;
+            if (h2->send_tail == stream) {
+                h2->send_tail = prev;
+            }
+            stream_close(conn, stream);
+        }
+    }
+    
+    if (h2->goaway && h2->stream_count == 0) {
+        conn->state = CT_CONN_CLOSING;
+    }
+    
+    return (int)(ct_ring_buffer_available(rb) - start);
+}
+
+/* Send conn->response on the stream it answers, then reset the request
+ * and response for the next stream. Called after routing, and by
+ * connection_send_response for answers that come later (pool jobs). */
+void ct_h2_respond(ct_connection_t *conn) {
+    ct_h2_conn_t *h2 = conn->h2;
+    ct_response_t *resp = &conn->response;
+    h2_stream_t *stream = stream_find(h2, h2->current);
+    
+    h2->current = 0;
+    
+    /* Reset by the client while the handler ran */
+    if (!stream) goto done;
+    
+    /* Streamed bodies are HTTP/1.1 chunks - not framed here yet */
+    if (resp->stream) {
+        ct_response_release(conn);
+        ct_response_json(resp, 500, "{\"error\":\"Not supported over HTTP/2\"}");
+    }
+    
+    char head[CT_RESPONSE_HEAD_MAX];
+    int head_len = ct_build_response_head(resp, head, sizeof(head));
+    if (head_len < 0) {
+        stream_reset(conn, stream, H2_INTERNAL_ERROR);
+        goto done;
+    }
+    
+    uint8_t block[CT_RESPONSE_HEAD_MAX * 2];
+    size_t block_len = encode_head(head, head_len, block);
+    
+    /* A write buffer that can't take the block can't take a reset
+     * either - the connection is past saving */
+    bool has_body = resp->body_from_fd || (resp->body && resp->body_len > 0);
+    if (send_header_block(conn, stream->id, has_body ? 0 : H2_FLAG_END_STREAM,
+                          block, block_len) < 0) {
+        conn->state = CT_CONN_CLOSING;
+        goto done;
+    }
+    
+    if (!has_body) {
+        stream_close(conn, stream);
+        goto done;
+    }
+    
+    /* The stream takes over the body's source */
+    stream->data_len = resp->body_len;
+    if (resp->body_from_fd) {
+        stream->fd = resp->body_fd;
+        stream->offset = resp->body_offset;
+        resp->body_from_fd = false;
+    } else {
+        stream->data = resp->body;
+        stream->entry = resp->body_entry;
+        resp->body_entry = NULL;
+    }
+    
+    if (h2->send_tail) {
+        h2->send_tail->send_next = stream;
+    } else {
+        h2->send_head = stream;
+    }
+    h2->send_tail = stream;
+    
+    /* Frame what fits now; a body the handler still owns (a thread-local
+     * buffer, say) is copied if any of it has to wait */
+    uint32_t id = stream->id;
+    if (ct_h2_pump(conn) < 0) {
+        conn->state = CT_CONN_CLOSING;
+    } else if ((stream = stream_find(h2, id)) && !stream->entry && stream->fd < 0 &&
+               !stream->owned) {
+        stream->owned = malloc(stream->data_len);
+        if (stream->owned) {
+            memcpy(stream->owned, stream->data, stream->data_len);
+            stream->data = stream->owned;
+        } else {
+            stream_reset(conn, stream, H2_INTERNAL_ERROR);
+        }
+    }
+
+done:
+    ct_response_release(conn);
+    memset(&conn->request, 0, sizeof(conn->request));
+    memset(&conn->response, 0, sizeof(conn->response));
+}
+
+/* A complete request - parse its text and route it like any other */
+static void dispatch(ct_server_t *server, ct_connection_t *conn, h2_stream_t *stream) {
+    ct_request_t *req = &conn->request;
+    
+    memset(req, 0, sizeof(*req));
+    memset(&conn->response, 0, sizeof(conn->response));
+    conn->h2->current = stream->id;
+    
+    int rc = ct_parse_request(req, stream->req, stream->head_len);
+    if (rc != (int)stream->head_len || req->parse_state != CT_PARSE_COMPLETE) {
+        ct_response_html(&conn->response, 400,
+                        "<html><body><h1>400 Bad Request</h1></body></html>");
+        ct_h2_respond(conn);
+        return;
+    }
+    
+    /* The body followed in DATA frames */
+    req->body = (uint32_t)stream->head_len;
+    req->body_len = stream->req_len - stream->head_len;
+    
+    ct_connection_dispatch(server, conn);
+    
+    /* Handler offloaded to the pool - its completion responds */
+    if (conn->state == CT_CONN_AWAITING_JOB) return;
+    
+    ct_h2_respond(conn);
+}
+
+/* Decode the collected header block - always, as the HPACK table must
+ * follow the peer's even for a stream that is refused */
+static int headers_done(ct_server_t *server, ct_connection_t *conn) {
+    ct_h2_conn_t *h2 = conn->h2;
+    static __thread h2_request_builder_t builder;
+    h2_stream_t *stream = stream_find(h2, h2->block_stream);
+    bool trailers = stream != NULL;
+    bool refused = false;
+    
+    if (!stream) {
+        stream = stream_open(h2, h2->block_stream);
+        refused = !stream;
+    }
+    
+    builder.pseudo_len = 0;
+    builder.method_len = builder.path_len = builder.authority_len = 0;
+    builder.cookie_len = 0;
+    builder.regular = builder.malformed = false;
+    builder.stream = trailers || refused ? NULL : stream;
+    
+    int rc = ct_hpack_decode(&h2->hpack, h2->block, h2->block_len,
+                             builder_field, &builder);
+    
+    bool end_stream = h2->block_end_stream;
+    h2->block_len = 0;
+    h2->block_stream = 0;
+    
+    if (rc < 0) return H2_COMPRESSION_ERROR;
+    
+    if (refused) {
+        send_u32(conn, H2_RST_STREAM, h2->last_stream, H2_REFUSED_STREAM);
+        return 0;
+    }
+    
+    /* Trailers end the request; their fields are dropped */
+    if (trailers) {
+        if (!end_stream) return H2_PROTOCOL_ERROR;
+    } else {
+        builder_finish(&builder);
+        if (builder.malformed) {
+            stream_reset(conn, stream, H2_PROTOCOL_ERROR);
+            return 0;
+        }
+    }
+    
+    if (end_stream) {
+        stream->end_remote = true;
+        dispatch(server, conn, stream);
+    }
+    
+    return 0;
+}
+
+static int block_append(ct_h2_conn_t *h2, const uint8_t *data, size_t len) {
+    if (h2->block_len + len > H2_HEADER_BLOCK_MAX) return -1;
+    
+    if (!h2->block) {
+        h2->block = malloc(H2_HEADER_BLOCK_MAX);
+        if (!h2->block) return -1;
+    }
+    
+    memcpy(h2->block + h2->block_len, data, len);
+    h2->block_len += len;
+    return 0;
+}
+
+/* Padding and priority fields ahead of a payload. Returns -1 if the
+ * padding runs past the frame. */
+static int strip_padding(uint8_t flags, const uint8_t **p, size_t *len,
+                         bool priority) {
+    size_t pad = 0;
+    
+    if (flags & H2_FLAG_PADDED) {
+        if (*len < 1) return -1;
+        pad = **p;
+        (*p)++;
+        (*len)--;
+    }
+    if (priority && (flags & H2_FLAG_PRIORITY)) {
+        if (*len < 5) return -1;
+        *p += 5;
+        *len -= 5;
+    }
+    if (pad > *len) return -1;
+    
+    *len -= pad;
+    return 0;
+}
+
+/* One frame. Returns 0, or a connection error code. */
+static int handle_frame(ct_server_t *server, ct_connection_t *conn, uint8_t type,
+                        uint8_t flags, uint32_t id, const uint8_t *p, size_t len) {
+    ct_h2_conn_t *h2 = conn->h2;
+    h2_stream_t *stream;
+    size_t frame_len = len;
+    
+    /* Mid header block, only its CONTINUATIONs may arrive */
+    if (h2->block_stream && (type != H2_CONTINUATION || id != h2->block_stream)) {
+        return H2_PROTOCOL_ERROR;
+    }
+    
+    switch (type) {
+        case H2_HEADERS:
+            if (id == 0 || strip_padding(flags, &p, &len, true) < 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            
+            stream = stream_find(h2, id);
+            if (stream) {
+                /* Trailers - only while the request is still open */
+                if (stream->end_remote) return H2_STREAM_CLOSED;
+            } else {
+                /* New streams are odd and ascending */
+                if (!(id & 1) || h2->goaway) return H2_PROTOCOL_ERROR;
+                if (id <= h2->last_stream) return H2_STREAM_CLOSED;
+                h2->last_stream = id;
+            }
+            
+            h2->block_stream = id;
+            h2->block_end_stream = flags & H2_FLAG_END_STREAM;
+            /* fall through */
+        case H2_CONTINUATION:
+            if (!h2->block_stream) return H2_PROTOCOL_ERROR;
+            if (block_append(h2, p, len) < 0) return H2_ENHANCE_YOUR_CALM;
+            if (flags & H2_FLAG_END_HEADERS) {
+                return headers_done(server, conn);
+            }
+            return 0;
+        
+        case H2_DATA:
+            if (id == 0) return H2_PROTOCOL_ERROR;
+            if (id > h2->last_stream) return H2_PROTOCOL_ERROR;
+            if (strip_padding(flags, &p, &len, false) < 0) return H2_PROTOCOL_ERROR;
+            
+            /* Hand the window straight back - bodies are bounded below,
+             * not by flow control */
+            if (frame_len > 0) {
+                send_u32(conn, H2_WINDOW_UPDATE, 0, (uint32_t)frame_len);
+            }
+            
+            stream = stream_find(h2, id);
+            if (!stream || stream->end_remote) {
+                send_u32(conn, H2_RST_STREAM, id, H2_STREAM_CLOSED);
+                return 0;
+            }
+            
+            if (req_append(stream, (const char *)p, len) < 0) {
+                /* Too large - answer now and stop the upload (8.1) */
+                h2->current = id;
+                memset(&conn->response, 0, sizeof(conn->response));
+                ct_response_init(&conn->response, 413, "Content Too Large");
+                stream->end_remote = true;
+                ct_h2_respond(conn);
+                send_u32(conn, H2_RST_STREAM, id, H2_NO_ERROR);
+                return 0;
+            }
+            
+            if (flags & H2_FLAG_END_STREAM) {
+                stream->end_remote = true;
+                dispatch(server, conn, stream);
+            } else if (frame_len > 0) {
+                send_u32(conn, H2_WINDOW_UPDATE, id, (uint32_t)frame_len);
+            }
+            return 0;
+        
+        case H2_SETTINGS:
+            if (id != 0) return H2_PROTOCOL_ERROR;
+            if (flags & H2_FLAG_ACK) {
+                return len == 0 ? 0 : H2_FRAME_SIZE_ERROR;
+            }
+            if (len % 6 != 0) return H2_FRAME_SIZE_ERROR;
+            
+            int rc = apply_settings(conn, p, len);
+            if (rc != 0) return rc;
+            send_frame(conn, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+            return 0;
+        
+        case H2_PING:
+            if (id != 0) return H2_PROTOCOL_ERROR;
+            if (len != 8) return H2_FRAME_SIZE_ERROR;
+            if (!(flags & H2_FLAG_ACK)) {
+                send_frame(conn, H2_PING, H2_FLAG_ACK, 0, p, 8);
+            }
+            return 0;
+        
+        case H2_WINDOW_UPDATE: {
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            uint32_t increment = get_u32(p) & 0x7fffffff;
+            
+            if (id == 0) {
+                if (increment == 0) return H2_PROTOCOL_ERROR;
+                h2->send_window += increment;
+                if (h2->send_window > H2_WINDOW_MAX) return H2_FLOW_CONTROL_ERROR;
+                return 0;
+            }
+            
+            stream = stream_find(h2, id);
+            if (!stream) return 0;
+            
+            stream->send_window += increment;
+            if (increment == 0) {
+                stream_reset(conn, stream, H2_PROTOCOL_ERROR);
+            } else if (stream->send_window > H2_WINDOW_MAX) {
+                stream_reset(conn, stream, H2_FLOW_CONTROL_ERROR);
+            }
+            return 0;
+        }
+        
+        case H2_RST_STREAM:
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            if (id == 0 || id > h2->last_stream) return H2_PROTOCOL_ERROR;
+            
+            stream = stream_find(h2, id);
+            if (stream) {
+                send_list_remove(h2, stream);
+                stream_close(conn, stream);
+            }
+            return 0;
+        
+        case H2_GOAWAY:
+            if (id != 0) return H2_PROTOCOL_ERROR;
+            
+            /* The client is done - finish what is open, then close */
+            h2->goaway = true;
+            if (h2->stream_count == 0) {
+                conn->state = CT_CONN_CLOSING;
+            }
+            return 0;
+        
+        case H2_PRIORITY:
+            if (id == 0) return H2_PROTOCOL_ERROR;
+            return len == 5 ? 0 : H2_FRAME_SIZE_ERROR;
+        
+        case H2_PUSH_PROMISE:
+            return H2_PROTOCOL_ERROR;
+        
+        default:
+            /* Unknown frame types are ignored */
+            return 0;
+    }
+}
+
+/* Read frames from read_buf until it runs out of whole frames, the
+ * connection parks on a job, or a connection error ends it (GOAWAY is
+ * queued and the connection closes). Returns 0, -1 if the client never
+ * spoke HTTP/2. */
+int ct_h2_process(ct_server_t *server, ct_connection_t *conn) {
+    ct_h2_conn_t *h2 = conn->h2;
+    
+    while (conn->state != CT_CONN_CLOSING && conn->state != CT_CONN_AWAITING_JOB) {
+        size_t available;
+        const uint8_t *buf = (const uint8_t *)ct_ring_buffer_peek_ptr(&conn->read_buf,
+                                                                      &available);
+        if (available == 0) break;
+        
+        if (!h2->preface) {
+            int rc = ct_h2_preface((const char *)buf, available);
+            if (rc < 0) return -1;
+            if (rc == 0) break;
+            
+            ct_ring_buffer_skip(&conn->read_buf, sizeof(client_preface) - 1);
+            h2->preface = true;
+            continue;
+        }
+        
+        if (available < H2_FRAME_HEADER) break;
+        
+        size_t len = (size_t)buf[0] << 16 | (size_t)buf[1] << 8 | buf[2];
+        if (len > H2_FRAME_MAX) {
+            send_goaway(conn, H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if (available < H2_FRAME_HEADER + len) break;
+        
+        uint32_t id = get_u32(buf + 5) & 0x7fffffff;
+        int rc = handle_frame(server, conn, buf[3], buf[4], id,
+                              buf + H2_FRAME_HEADER, len);
+        
+        /* Consume only now - the frame was read in place */
+        ct_ring_buffer_skip(&conn->read_buf, H2_FRAME_HEADER + len);
+        
+        if (rc != 0) {
+            send_goaway(conn, (uint32_t)rc);
+            break;
+        }
+    }
+    
+    /* Between requests nothing is pending - the header deadline is only
+     * for a block still coming in */
+    if (!h2->block_stream) {
+        conn->request_start = 0;
+    }
+    
+    if (conn->state != CT_CONN_CLOSING && ct_h2_pump(conn) < 0) {
+        return -1;
+    }
+    return 0;
+}
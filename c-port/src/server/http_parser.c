@@ -10,11 +10,66 @@ static const char *method_strings[] = {
     "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS", "CONNECT"
 };
 
-/* Common HTTP headers - perfect hash would be ideal here */
-static const char *common_headers[] = {
-    "Host", "Connection", "Content-Length", "Content-Type",
-    "User-Agent", "Accept", "Cookie", "Upgrade", "Sec-WebSocket-Key",
-    "Sec-WebSocket-Version", "Sec-WebSocket-Protocol"
+/* Known request headers, placed by a perfect hash over length, first and
+ * last byte (case-folded). The constants were searched offline for no
+ * collisions; adding a name means re-checking that every slot below is
+ * still distinct. */
+#define HEADER_SLOTS 32
+
+static inline unsigned header_hash(const char *name, size_t len) {
+    unsigned first = (uint8_t)name[0] | 0x20;
+    unsigned last = (uint8_t)name[len - 1] | 0x20;
+    return (unsigned)(len + first + 3 * last) & (HEADER_SLOTS - 1);
+}
+
+static const struct {
+    const char *name;
+    uint8_t len;
+    uint8_t id;
+} header_table[HEADER_SLOTS] = {
+    [ 3] = {"Accept", 6, CT_HDR_ACCEPT},
+    [ 4] = {"Sec-WebSocket-Extensions", 24, CT_HDR_SEC_WEBSOCKET_EXTENSIONS},
+    [ 5] = {"Accept-Encoding", 15, CT_HDR_ACCEPT_ENCODING},
+    [ 6] = {"Range", 5, CT_HDR_RANGE},
+    [ 8] = {"Host", 4, CT_HDR_HOST},
+    [ 9] = {"Content-Length", 14, CT_HDR_CONTENT_LENGTH},
+    [11] = {"Upgrade", 7, CT_HDR_UPGRADE},
+    [13] = {"Sec-WebSocket-Protocol", 22, CT_HDR_SEC_WEBSOCKET_PROTOCOL},
+    [14] = {"If-None-Match", 13, CT_HDR_IF_NONE_MATCH},
+    [15] = {"Sec-WebSocket-Key", 17, CT_HDR_SEC_WEBSOCKET_KEY},
+    [18] = {"Sec-WebSocket-Version", 21, CT_HDR_SEC_WEBSOCKET_VERSION},
+    [23] = {"Connection", 10, CT_HDR_CONNECTION},
+    [24] = {"Cookie", 6, CT_HDR_COOKIE},
+    [26] = {"Transfer-Encoding", 17, CT_HDR_TRANSFER_ENCODING},
+    [27] = {"User-Agent", 10, CT_HDR_USER_AGENT},
+    [30] = {"Content-Type", 12, CT_HDR_CONTENT_TYPE},
+};
+
+/* One hash and one compare - unknown names cost the same as known ones */
+static ct_header_id_t header_id(const char *name, size_t len) {
+    if (len == 0) return CT_HDR_UNKNOWN;
+    
+    unsigned slot = header_hash(name, len);
+    if (header_table[slot].len != len ||
+        strncasecmp(name, header_table[slot].name, len) != 0) {
+        return CT_HDR_UNKNOWN;
+    }
+    
+    return (ct_header_id_t)header_table[slot].id;
+}
+
+/* Chunked body framing - request.chunk_state */
+enum {
+    CHUNK_SIZE,             /* hex digits */
+    CHUNK_EXT,              /* ;name=value up to CR */
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,
+    CHUNK_DATA_LF,
+    CHUNK_TRAILER,          /* start of a trailer line, or the final CRLF */
+    CHUNK_TRAILER_LINE,
+    CHUNK_TRAILER_LF,
+    CHUNK_END_LF
 };
 
 /* Fast method parsing using prefix matching */
@@ -37,19 +92,18 @@ static ct_http_method_t parse_method(const char *data, size_t len) {
     return CT_METHOD_UNKNOWN;
 }
 
-/* Find end of line (CRLF) - optimized with SIMD when available */
-static const char *find_crlf(const char *data, size_t len) {
-    const char *end = data + len;
-    
-    /* Simple implementation - can be optimized with SIMD */
-    while (data < end - 1) {
-        if (data[0] == '\r' && data[1] == '\n') {
-            return data;
-        }
-        data++;
-    }
-    
-    return NULL;
+/* Where a field scan stopped: 0 on its delimiter, -1 out of data, -2 on
+ * any other byte or an empty field */
+static inline int field_end(const char *q, const char *mark, const char *end,
+                            char delim) {
+    if (q == end) return -1;
+    return *q == delim && q > mark ? 0 : -2;
+}
+
+/* A version or field value ends at CRLF - bare CR is malformed */
+static inline int line_end(const char *q, const char *end) {
+    if (q == end || (*q == '\r' && q + 1 == end)) return -1;
+    return q[0] == '\r' && q[1] == '\n' ? 0 : -2;
 }
 
 /* Parse URL and extract path/query - zero-copy */
@@ -95,226 +149,499 @@ int ct_parse_url(const char *url, char *path, size_t path_len,
     return 0;
 }
 
-/* Zero-copy HTTP request parser with state machine */
-int ct_parse_request(ct_request_t *req, const char *data, size_t len) {
-    const char *p = data;
-    const char *end = data + len;
-    const char *line_end;
+/* A Content-Length value: one or more digits, nothing else */
+static int parse_content_length(const char *value, size_t len, size_t *length) {
+    size_t n = 0;
     
-    /* Already completed */
-    if (req->parse_state == CT_PARSE_COMPLETE) {
-        return 0;
+    if (len == 0) return -1;
+    
+    for (size_t i = 0; i < len; i++) {
+        unsigned digit = (unsigned char)value[i] - '0';
+        if (digit > 9 || n > (SIZE_MAX - digit) / 10) return -1;
+        n = n * 10 + digit;
     }
     
-    /* Parse request line if not done */
-    if (req->parse_state == CT_PARSE_METHOD) {
-        line_end = find_crlf(p, end - p);
-        if (!line_end) {
-            return -1; /* Need more data */
+    *length = n;
+    return 0;
+}
+
+/* Next element of a comma-separated header value, OWS trimmed - NULL
+ * once the list is used up. Empty elements ("a,,b") come back with len 0. */
+static const char *list_next(const char **pos, const char *end, size_t *len) {
+    const char *p = *pos;
+    if (p >= end) return NULL;
+    
+    const char *comma = memchr(p, ',', end - p);
+    const char *stop = comma ? comma : end;
+    *pos = comma ? comma + 1 : end;
+    
+    while (p < stop && (*p == ' ' || *p == '\t')) p++;
+    while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+    *len = stop - p;
+    return p;
+}
+
+static bool token_is(const char *p, size_t len, const char *token) {
+    return strlen(token) == len && strncasecmp(p, token, len) == 0;
+}
+
+/* Transfer codings we recognise but don't decode */
+static bool coding_known(const char *p, size_t len) {
+    return token_is(p, len, "gzip") || token_is(p, len, "x-gzip") ||
+           token_is(p, len, "deflate") || token_is(p, len, "compress") ||
+           token_is(p, len, "x-compress") || token_is(p, len, "identity");
+}
+
+/* Whether a known header appears more than once */
+static bool header_repeats(const ct_request_t *req, ct_header_id_t id) {
+    for (size_t i = req->known[id]; i < req->header_count; i++) {
+        const ct_req_header_t *h = &req->headers[i];
+        if (header_id(req->base + h->name, h->name_len) == id) {
+            return true;
         }
+    }
+    return false;
+}
+
+/* Connection semantics and body length, once the header block is in.
+ * Returns -2 for a body whose length can't be trusted, -3 for one in a
+ * transfer coding we don't implement. */
+static int headers_done(ct_request_t *req) {
+    /* Check for WebSocket upgrade */
+    ct_header_t hdr = ct_request_header(req, CT_HDR_UPGRADE);
+    if (hdr.value && hdr.value_len == 9 &&
+        strncasecmp(hdr.value, "websocket", 9) == 0) {
+        req->is_websocket = true;
+    }
+    
+    /* Whole tokens only - "close" anywhere in the list wins */
+    hdr = ct_request_header(req, CT_HDR_CONNECTION);
+    if (hdr.value) {
+        const char *pos = hdr.value;
+        const char *end = hdr.value + hdr.value_len;
+        const char *token;
+        size_t token_len;
         
-        /* Parse method */
-        const char *space = memchr(p, ' ', line_end - p);
-        if (!space) {
-            req->parse_state = CT_PARSE_ERROR;
-            return -2;
+        while ((token = list_next(&pos, end, &token_len))) {
+            if (token_is(token, token_len, "close")) {
+                req->keep_alive = false;
+                break;
+            }
+            if (token_is(token, token_len, "keep-alive")) {
+                req->keep_alive = true;
+            }
         }
-        
-        req->method = parse_method(p, space - p);
-        if (req->method == CT_METHOD_UNKNOWN) {
-            req->parse_state = CT_PARSE_ERROR;
+    }
+    
+    /* Only "chunked", on its own, delimits a body we can read. A coding we
+     * know but don't decode is unsupported; anything unrecognised, a
+     * repeat, or a Content-Length alongside is how requests get smuggled
+     * past a proxy - refuse rather than guess. */
+    hdr = ct_request_header(req, CT_HDR_TRANSFER_ENCODING);
+    if (hdr.value) {
+        if (header_repeats(req, CT_HDR_TRANSFER_ENCODING) ||
+            ct_request_header(req, CT_HDR_CONTENT_LENGTH).value) {
             return -2;
         }
         
-        /* Parse URL */
-        p = space + 1;
-        space = memchr(p, ' ', line_end - p);
-        if (!space) {
-            req->parse_state = CT_PARSE_ERROR;
-            return -2;
-        }
+        const char *pos = hdr.value;
+        const char *end = hdr.value + hdr.value_len;
+        const char *token;
+        size_t token_len;
+        int chunked = 0;
+        bool unsupported = false;
         
-        req->url = p;
+        while ((token = list_next(&pos, end, &token_len))) {
+            if (token_len == 0) {
+                continue;
+            } else if (token_is(token, token_len, "chunked")) {
+                chunked++;
+            } else if (coding_known(token, token_len)) {
+                unsupported = true;
+            } else {
+                return -2;
+            }
+        }
         
-        /* Parse version */
-        p = space + 1;
-        req->version = p;
+        if (chunked > 1) return -2;
+        if (unsupported) return -3;
+        if (chunked == 0) return -2;
         
-        p = line_end + 2; /* Skip CRLF */
-        req->parse_state = CT_PARSE_HEADER_NAME;
+        req->chunked = true;
+        req->body_streamed = true;
+        req->chunk_state = CHUNK_SIZE;
+        return 0;
     }
     
-    /* Parse headers */
-    while (req->parse_state == CT_PARSE_HEADER_NAME && p < end) {
-        line_end = find_crlf(p, end - p);
-        if (!line_end) {
-            return -1; /* Need more data */
+    /* Digits only - a sign, a list or junk would make the length a guess.
+     * Repeats must agree, or two parsers could frame the body apart. */
+    hdr = ct_request_header(req, CT_HDR_CONTENT_LENGTH);
+    if (hdr.value) {
+        size_t length;
+        if (parse_content_length(hdr.value, hdr.value_len, &length) < 0) {
+            return -2;
         }
         
-        /* Empty line = end of headers */
-        if (line_end == p) {
-            p += 2; /* Skip CRLF */
-            req->parse_state = CT_PARSE_BODY;
+        for (size_t i = req->known[CT_HDR_CONTENT_LENGTH]; i < req->header_count; i++) {
+            const ct_req_header_t *h = &req->headers[i];
+            size_t repeat;
             
-            /* Check for WebSocket upgrade */
-            for (size_t i = 0; i < req->header_count; i++) {
-                if (strcasecmp(req->headers[i].name, "Upgrade") == 0 &&
-                    strcasecmp(req->headers[i].value, "websocket") == 0) {
-                    req->is_websocket = true;
-                }
-                if (strcasecmp(req->headers[i].name, "Connection") == 0) {
-                    if (strstr(req->headers[i].value, "keep-alive")) {
-                        req->keep_alive = true;
-                    }
-                }
+            if (header_id(req->base + h->name, h->name_len) != CT_HDR_CONTENT_LENGTH) {
+                continue;
+            }
+            if (parse_content_length(req->base + h->value, h->value_len, &repeat) < 0 ||
+                repeat != length) {
+                return -2;
             }
-            break;
         }
         
-        /* Parse header name:value */
-        const char *colon = memchr(p, ':', line_end - p);
-        if (!colon || req->header_count >= CT_MAX_HEADERS) {
-            req->parse_state = CT_PARSE_ERROR;
+        req->content_length = length;
+        req->body_left = req->content_length;
+        req->body_streamed = req->content_length > CT_BODY_INLINE_MAX;
+    }
+    
+    return 0;
+}
+
+/* Zero-copy, resumable HTTP request parser. data is the request's first
+ * byte and len everything buffered behind it. When the data runs out the
+ * request keeps the field it was in (mark) and how far it got (scanned),
+ * and the next call - with the same request start, possibly moved -
+ * continues from there, so each byte is examined once however the
+ * request is split. Returns bytes consumed when complete, -1 for more
+ * data, -2 on a malformed request, -3 for a transfer coding we don't
+ * implement. A streamed body (body_streamed) isn't
+ * waited for: the head's length is returned with parse_state still
+ * CT_PARSE_BODY. */
+int ct_parse_request(ct_request_t *req, const char *data, size_t len) {
+    const char *end = data + len;
+    const char *p = data + req->scanned;
+    const char *mark = data + req->mark;
+    const char *q = p;
+    int rc = 0;
+    
+    req->base = data;
+    
+    /* Already completed */
+    if (req->parse_state == CT_PARSE_COMPLETE) {
+        return 0;
+    }
+    
+    /* Request line - each field is one byte-class scan that both finds its
+     * delimiter and validates what precedes it */
+    switch (req->parse_state) {
+        case CT_PARSE_METHOD:
+            q = ct_scan_token(p, end);
+            rc = field_end(q, mark, end, ' ');
+            if (rc < 0) goto stop;
+            
+            req->method = parse_method(mark, q - mark);
+            if (req->method == CT_METHOD_UNKNOWN) {
+                rc = -2;
+                goto stop;
+            }
+            
+            p = mark = q + 1;
+            req->parse_state = CT_PARSE_URL;
+            /* fall through */
+        case CT_PARSE_URL:
+            q = ct_scan_target(p, end);
+            rc = field_end(q, mark, end, ' ');
+            if (rc < 0) goto stop;
+            
+            req->url = mark - data;
+            req->url_len = q - mark;
+            
+            p = mark = q + 1;
+            req->parse_state = CT_PARSE_VERSION;
+            /* fall through */
+        case CT_PARSE_VERSION:
+            q = ct_scan_value(p, end);
+            rc = line_end(q, end);
+            if (rc < 0) goto stop;
+            
+            /* HTTP/1.1 connections persist unless closed */
+            req->keep_alive = q - mark == 8 && memcmp(mark, "HTTP/1.1", 8) == 0;
+            
+            p = mark = q + 2; /* Skip CRLF */
+            req->parse_state = CT_PARSE_HEADER_NAME;
+            break;
+        case CT_PARSE_ERROR:
             return -2;
+        default:
+            break;
+    }
+    
+    /* Parse headers */
+    while (req->parse_state == CT_PARSE_HEADER_NAME ||
+           req->parse_state == CT_PARSE_HEADER_VALUE) {
+        ct_req_header_t *hdr = &req->headers[req->header_count];
+        
+        if (req->parse_state == CT_PARSE_HEADER_NAME) {
+            /* Empty line = end of headers */
+            if (p == mark && p < end && *p == '\r') {
+                q = p;
+                rc = line_end(q, end);
+                if (rc < 0) goto stop;
+                
+                p = mark = q + 2; /* Skip CRLF */
+                req->body = p - data;
+                req->parse_state = CT_PARSE_BODY;
+                rc = headers_done(req);
+                if (rc < 0) goto stop;
+                break;
+            }
+            
+            /* Header name is a token ending at the colon */
+            q = ct_scan_token(p, end);
+            rc = field_end(q, mark, end, ':');
+            if (rc == 0 && req->header_count >= CT_MAX_HEADERS) rc = -2;
+            if (rc < 0) goto stop;
+            
+            hdr->name = mark - data;
+            hdr->name_len = q - mark;
+            
+            p = mark = q + 1;
+            req->parse_state = CT_PARSE_HEADER_VALUE;
         }
         
-        /* Store header pointers (zero-copy) */
-        req->headers[req->header_count].name = p;
-        req->headers[req->header_count].name_len = colon - p;
+        /* Skip whitespace ahead of the value */
+        if (p == mark) {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            mark = p;
+        }
         
-        /* Skip colon and whitespace */
-        p = colon + 1;
-        while (p < line_end && (*p == ' ' || *p == '\t')) p++;
+        q = ct_scan_value(p, end);
+        rc = line_end(q, end);
+        if (rc < 0) goto stop;
         
-        req->headers[req->header_count].value = p;
-        req->headers[req->header_count].value_len = line_end - p;
+        /* Trailing whitespace isn't part of the value */
+        const char *value_end = q;
+        while (value_end > mark && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+        
+        hdr->value = mark - data;
+        hdr->value_len = value_end - mark;
+        
+        /* First occurrence of a known header claims its slot */
+        ct_header_id_t id = header_id(data + hdr->name, hdr->name_len);
+        if (id != CT_HDR_UNKNOWN && !req->known[id]) {
+            req->known[id] = (uint8_t)(req->header_count + 1);
+        }
         
         req->header_count++;
-        p = line_end + 2; /* Skip CRLF */
+        p = mark = q + 2; /* Skip CRLF */
+        req->parse_state = CT_PARSE_HEADER_NAME;
     }
     
-    /* Parse body if needed */
+    /* A streamed body is the caller's to decode - the head is done */
+    if (req->parse_state == CT_PARSE_BODY && req->body_streamed) {
+        return req->body;
+    }
+    
+    /* Body - nothing to scan, just wait until all of it is buffered */
     if (req->parse_state == CT_PARSE_BODY) {
-        /* Find Content-Length header */
-        size_t content_length = 0;
-        for (size_t i = 0; i < req->header_count; i++) {
-            if (strncasecmp(req->headers[i].name, "Content-Length", 
-                           req->headers[i].name_len) == 0) {
-                content_length = strtoul(req->headers[i].value, NULL, 10);
-                break;
-            }
-        }
-        
-        if (content_length > 0) {
-            size_t body_available = end - p;
-            if (body_available < content_length) {
-                return -1; /* Need more data */
-            }
-            
-            req->body = p;
-            req->body_len = content_length;
-            p += content_length;
+        if (len - req->body < req->content_length) {
+            q = mark = data + req->body;
+            rc = -1;
+            goto stop;
         }
         
+        req->body_len = req->content_length;
         req->parse_state = CT_PARSE_COMPLETE;
     }
     
-    return p - data; /* Return bytes consumed */
-}
+    return req->body + req->body_len; /* Return bytes consumed */
 
-/* Build HTTP response - optimized for common cases */
-int ct_build_response(ct_response_t *resp, char *buf, size_t buf_len) {
-    char *p = buf;
-    char *end = buf + buf_len;
-    
-    /* Status line */
-    int n = snprintf(p, end - p, "HTTP/1.1 %d %s\r\n", 
-                     resp->status_code, resp->status_text);
-    if (n < 0 || n >= end - p) return -1;
-    p += n;
-    
-    /* Headers */
-    for (size_t i = 0; i < resp->header_count; i++) {
-        n = snprintf(p, end - p, "%s: %s\r\n",
-                     resp->headers[i].name, resp->headers[i].value);
-        if (n < 0 || n >= end - p) return -1;
-        p += n;
+stop:
+    if (rc <= -2) {
+        req->parse_state = CT_PARSE_ERROR;
+        return rc;
     }
     
-    /* Content-Length if not chunked */
-    if (!resp->chunked && resp->body_len > 0) {
-        n = snprintf(p, end - p, "Content-Length: %zu\r\n", resp->body_len);
-        if (n < 0 || n >= end - p) return -1;
-        p += n;
-    }
-    
-    /* End of headers */
-    if (p + 2 > end) return -1;
-    *p++ = '\r';
-    *p++ = '\n';
-    
-    /* Body */
-    if (resp->body && resp->body_len > 0) {
-        if (p + resp->body_len > end) return -1;
-        memcpy(p, resp->body, resp->body_len);
-        p += resp->body_len;
+    /* Need more data - resume where the scan stopped */
+    req->scanned = q - data;
+    req->mark = mark - data;
+    return -1;
+}
+
+/* Known header by ID - value is NULL if absent, otherwise value_len
+ * bytes in the buffer last passed to ct_parse_request (not NUL-terminated) */
+ct_header_t ct_request_header(const ct_request_t *req, ct_header_id_t id) {
+    ct_header_t hdr = {0};
+    unsigned slot = req->known[id];
+    if (slot) {
+        const ct_req_header_t *h = &req->headers[slot - 1];
+        hdr.name = req->base + h->name;
+        hdr.name_len = h->name_len;
+        hdr.value = req->base + h->value;
+        hdr.value_len = h->value_len;
     }
-    
-    return p - buf;
+    return hdr;
 }
 
-/* Find header value by name - O(n) but typically small n */
+/* Find header value by name - one load for known names, a scan for the
+ * rest. The value runs to the header's CRLF, it isn't NUL-terminated. */
 const char *ct_request_get_header(ct_request_t *req, const char *name) {
     size_t name_len = strlen(name);
     
+    /* Known names never need the scan */
+    ct_header_id_t id = header_id(name, name_len);
+    if (id != CT_HDR_UNKNOWN) {
+        return ct_request_header(req, id).value;
+    }
+    
     for (size_t i = 0; i < req->header_count; i++) {
-        if (req->headers[i].name_len == name_len &&
-            strncasecmp(req->headers[i].name, name, name_len) == 0) {
-            return req->headers[i].value;
+        const ct_req_header_t *h = &req->headers[i];
+        if (h->name_len == name_len &&
+            strncasecmp(req->base + h->name, name, name_len) == 0) {
+            return req->base + h->value;
         }
     }
     
     return NULL;
 }
 
-/* Add response header */
-int ct_response_add_header(ct_response_t *resp, const char *name, 
-                          const char *value) {
-    if (resp->header_count >= CT_MAX_HEADERS) {
-        return -1;
-    }
-    
-    resp->headers[resp->header_count].name = name;
-    resp->headers[resp->header_count].value = value;
-    resp->headers[resp->header_count].name_len = strlen(name);
-    resp->headers[resp->header_count].value_len = strlen(value);
-    resp->header_count++;
+/* Copy the request path, query stripped, NUL-terminated. Returns its
+ * length, or -1 if it doesn't fit. */
+int ct_request_path(const ct_request_t *req, char *path, size_t path_len) {
+    const char *url = req->base + req->url;
+    const char *query = memchr(url, '?', req->url_len);
+    size_t len = query ? (size_t)(query - url) : req->url_len;
     
-    return 0;
+    if (len >= path_len) return -1;
+    memcpy(path, url, len);
+    path[len] = '\0';
+    return (int)len;
 }
 
-/* Quick response builders for common cases */
-void ct_response_init(ct_response_t *resp, int status_code, 
-                     const char *status_text) {
-    memset(resp, 0, sizeof(ct_response_t));
-    resp->status_code = status_code;
-    resp->status_text = status_text;
+/* Body bytes (body_len of them), or NULL without a body - or with a
+ * streamed one, which is never buffered whole */
+const char *ct_request_body(const ct_request_t *req) {
+    return req->body_len > 0 && !req->body_streamed ? req->base + req->body : NULL;
 }
 
-void ct_response_json(ct_response_t *resp, int status_code, 
-                     const char *json_body) {
-    ct_response_init(resp, status_code, 
-                    status_code == 200 ? "OK" : "Error");
-    ct_response_add_header(resp, "Content-Type", "application/json");
-    resp->body = json_body;
-    resp->body_len = strlen(json_body);
+static inline int hex_digit(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
 }
 
-void ct_response_html(ct_response_t *resp, int status_code, 
-                     const char *html_body) {
-    ct_response_init(resp, status_code,
-                    status_code == 200 ? "OK" : "Error");
-    ct_response_add_header(resp, "Content-Type", "text/html; charset=utf-8");
-    resp->body = html_body;
-    resp->body_len = strlen(html_body);
-}
\ No newline at end of file
+/* Next piece of a streamed body from data, the bytes that follow what
+ * was consumed so far. Content-Length bodies pass through; chunked ones
+ * have their framing stripped a byte at a time, while chunk data is
+ * handed out in place. Sets *piece and *piece_len (0 if data held only
+ * framing) and returns the bytes consumed - parse_state turns
+ * CT_PARSE_COMPLETE after the last. -2 on malformed framing. */
+int ct_request_body_next(ct_request_t *req, const char *data, size_t len,
+                         const char **piece, size_t *piece_len) {
+    const char *p = data;
+    const char *end = data + len;
+    
+    *piece = NULL;
+    *piece_len = 0;
+    
+    if (req->parse_state != CT_PARSE_BODY) {
+        return req->parse_state == CT_PARSE_ERROR ? -2 : 0;
+    }
+    
+    if (!req->chunked) {
+        size_t take = len < req->body_left ? len : (size_t)req->body_left;
+        *piece = data;
+        *piece_len = take;
+        req->body_left -= take;
+        req->body_len += take;
+        if (req->body_left == 0) {
+            req->parse_state = CT_PARSE_COMPLETE;
+        }
+        return (int)take;
+    }
+    
+    while (p < end) {
+        uint8_t c = (uint8_t)*p;
+        
+        switch (req->chunk_state) {
+            case CHUNK_SIZE: {
+                int digit = hex_digit(c);
+                if (digit >= 0) {
+                    /* 15 digits - well past any body worth streaming */
+                    if (++req->chunk_digits > 15) goto malformed;
+                    req->body_left = req->body_left << 4 | (uint64_t)digit;
+                    break;
+                }
+                if (req->chunk_digits == 0) goto malformed;
+                if (c == '\r') {
+                    req->chunk_state = CHUNK_SIZE_LF;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    req->chunk_state = CHUNK_EXT;
+                } else {
+                    goto malformed;
+                }
+                break;
+            }
+            case CHUNK_EXT:
+                /* Extensions are ignored, but must be printable */
+                if (c == '\r') {
+                    req->chunk_state = CHUNK_SIZE_LF;
+                } else if ((c < 0x20 && c != '\t') || c == 0x7f) {
+                    goto malformed;
+                }
+                break;
+            case CHUNK_SIZE_LF:
+                if (c != '\n') goto malformed;
+                req->chunk_digits = 0;
+                req->chunk_state = req->body_left ? CHUNK_DATA : CHUNK_TRAILER;
+                break;
+            case CHUNK_DATA: {
+                /* Data is returned in place, as much as is buffered */
+                size_t take = (size_t)(end - p);
+                if (take > req->body_left) take = (size_t)req->body_left;
+                
+                *piece = p;
+                *piece_len = take;
+                req->body_left -= take;
+                req->body_len += take;
+                if (req->body_left == 0) {
+                    req->chunk_state = CHUNK_DATA_CR;
+                }
+                return (int)(p + take - data);
+            }
+            case CHUNK_DATA_CR:
+                if (c != '\r') goto malformed;
+                req->chunk_state = CHUNK_DATA_LF;
+                break;
+            case CHUNK_DATA_LF:
+                if (c != '\n') goto malformed;
+                req->chunk_state = CHUNK_SIZE;
+                break;
+            case CHUNK_TRAILER:
+                /* Trailer fields are skipped - an empty line ends the body */
+                req->chunk_state = c == '\r' ? CHUNK_END_LF : CHUNK_TRAILER_LINE;
+                break;
+            case CHUNK_TRAILER_LINE:
+                if (c == '\r') {
+                    req->chunk_state = CHUNK_TRAILER_LF;
+                } else if ((c < 0x20 && c != '\t') || c == 0x7f) {
+                    goto malformed;
+                }
+                break;
+            case CHUNK_TRAILER_LF:
+                if (c != '\n') goto malformed;
+                req->chunk_state = CHUNK_TRAILER;
+                break;
+            case CHUNK_END_LF:
+                if (c != '\n') goto malformed;
+                req->parse_state = CT_PARSE_COMPLETE;
+                return (int)(p + 1 - data);
+        }
+        p++;
+    }
+    
+    return (int)(p - data);
+
+malformed:
+    req->parse_state = CT_PARSE_ERROR;
+    return -2;
+}
@@ -0,0 +1,236 @@
+#include "terminal.h"
+#include <string.h>
+
+/* Response serialization without snprintf: status lines are constants,
+ * fixed header sets are preformatted blocks, and the only formatting per
+ * response is the Content-Length digits. A response with a template
+ * (static files) skips straight to the Date. */
+
+const ct_header_block_t ct_headers_security = CT_HEADER_BLOCK(
+    "X-Content-Type-Options: nosniff\r\n"
+    "X-Frame-Options: SAMEORIGIN\r\n"
+    "X-XSS-Protection: 1; mode=block\r\n"
+    "Referrer-Policy: strict-origin-when-cross-origin\r\n"
+    "Content-Security-Policy: default-src 'self'; "
+    "script-src 'self' 'unsafe-inline' 'unsafe-eval'; "
+    "style-src 'self' 'unsafe-inline'; font-src 'self' data:; "
+    "img-src 'self' data: blob:; connect-src 'self' ws: wss:\r\n");
+
+const ct_header_block_t ct_headers_cors = CT_HEADER_BLOCK(
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, POST, PUT, DELETE, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type, Authorization\r\n"
+    "Access-Control-Max-Age: 86400\r\n");
+
+const ct_header_block_t ct_headers_upgrade = CT_HEADER_BLOCK(
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n");
+
+#define STATUS_LINE(code, text) "HTTP/1.1 " #code " " text "\r\n"
+#define STATUS(code, text) \
+    case code: *len = sizeof(STATUS_LINE(code, text)) - 1; return STATUS_LINE(code, text)
+
+/* Status lines for the codes the server sends. Returns NULL for others,
+ * which are formatted from the response's status_text. */
+static const char *status_line(int code, size_t *len) {
+    switch (code) {
+        STATUS(101, "Switching Protocols");
+        STATUS(200, "OK");
+        STATUS(204, "No Content");
+        STATUS(206, "Partial Content");
+        STATUS(301, "Moved Permanently");
+        STATUS(302, "Found");
+        STATUS(304, "Not Modified");
+        STATUS(400, "Bad Request");
+        STATUS(401, "Unauthorized");
+        STATUS(403, "Forbidden");
+        STATUS(404, "Not Found");
+        STATUS(405, "Method Not Allowed");
+        STATUS(413, "Content Too Large");
+        STATUS(414, "URI Too Long");
+        STATUS(416, "Range Not Satisfiable");
+        STATUS(500, "Internal Server Error");
+        STATUS(501, "Not Implemented");
+        STATUS(503, "Service Unavailable");
+        default:
+            return NULL;
+    }
+}
+
+#undef STATUS
+
+static inline char *put(char *p, const void *data, size_t len) {
+    memcpy(p, data, len);
+    return p + len;
+}
+
+/* Build the status line and headers - the body is sent separately. The
+ * size is summed first, so the copies that follow need no bounds checks. */
+int ct_build_response_head(ct_response_t *resp, char *buf, size_t buf_len) {
+    const char *status = NULL;
+    size_t status_len = 0;
+    size_t text_len = 0;
+    
+    if (resp->head_template) {
+        status_len = resp->head_template->len;
+    } else {
+        status = status_line(resp->status_code, &status_len);
+        if (!status) {
+            /* "HTTP/1.1 " code " " text CRLF */
+            text_len = resp->status_text ? strlen(resp->status_text) : 0;
+            status_len = 9 + CT_U64_DIGITS + 1 + text_len + 2;
+        }
+    }
+    
+    size_t need = status_len + sizeof("Date: \r\n") - 1 + CT_HTTP_DATE_LEN;
+    for (size_t i = 0; i < resp->block_count; i++) {
+        need += resp->blocks[i]->len;
+    }
+    for (size_t i = 0; i < resp->header_count; i++) {
+        need += resp->headers[i].name_len + resp->headers[i].value_len + 4;
+    }
+    need += sizeof("Transfer-Encoding: chunked\r\n") - 1;
+    need += sizeof("Content-Length: \r\n") - 1 + CT_U64_DIGITS + 2;
+    if (need > buf_len) return -1;
+    
+    char *p = buf;
+    
+    /* Status line - or the template, which starts with one */
+    if (resp->head_template) {
+        p = put(p, resp->head_template->data, resp->head_template->len);
+    } else if (status) {
+        p = put(p, status, status_len);
+    } else {
+        p = put(p, "HTTP/1.1 ", 9);
+        p = ct_fmt_u64(p, resp->status_code > 0 ? (uint64_t)resp->status_code : 0);
+        *p++ = ' ';
+        p = put(p, resp->status_text, text_len);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    
+    /* Date - preformatted once per second by the loop clock */
+    p = put(p, "Date: ", 6);
+    p = put(p, ct_http_date(), CT_HTTP_DATE_LEN);
+    *p++ = '\r';
+    *p++ = '\n';
+    
+    for (size_t i = 0; i < resp->block_count; i++) {
+        p = put(p, resp->blocks[i]->data, resp->blocks[i]->len);
+    }
+    
+    /* Headers */
+    for (size_t i = 0; i < resp->header_count; i++) {
+        p = put(p, resp->headers[i].name, resp->headers[i].name_len);
+        *p++ = ':';
+        *p++ = ' ';
+        p = put(p, resp->headers[i].value, resp->headers[i].value_len);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    
+    /* Chunked bodies frame their own length. Everything else says how long
+     * it is, even when empty, or a persistent client waits for more -
+     * except the statuses that never carry a body. */
+    int code = resp->status_code;
+    if (resp->chunked) {
+        p = put(p, "Transfer-Encoding: chunked\r\n", 28);
+    } else if (code >= 200 && code != 204 && code != 304) {
+        p = put(p, "Content-Length: ", 16);
+        p = ct_fmt_u64(p, resp->body_len);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    
+    /* End of headers */
+    *p++ = '\r';
+    *p++ = '\n';
+    
+    return p - buf;
+}
+
+/* Build HTTP response with its body in one buffer */
+int ct_build_response(ct_response_t *resp, char *buf, size_t buf_len) {
+    int head_len = ct_build_response_head(resp, buf, buf_len);
+    if (head_len < 0) return -1;
+    
+    char *p = buf + head_len;
+    char *end = buf + buf_len;
+    
+    /* Body */
+    if (resp->body && resp->body_len > 0) {
+        if (p + resp->body_len > end) return -1;
+        memcpy(p, resp->body, resp->body_len);
+        p += resp->body_len;
+    }
+    
+    return p - buf;
+}
+
+/* Add response header */
+int ct_response_add_header(ct_response_t *resp, const char *name,
+                          const char *value) {
+    return ct_response_add_header_len(resp, name, value, strlen(value));
+}
+
+/* Add a header whose value isn't NUL-terminated - e.g. echoed from the
+ * request, which stays in the read buffer until the head is built */
+int ct_response_add_header_len(ct_response_t *resp, const char *name,
+                               const char *value, size_t value_len) {
+    if (resp->header_count >= CT_MAX_HEADERS) {
+        return -1;
+    }
+    
+    resp->headers[resp->header_count].name = name;
+    resp->headers[resp->header_count].value = value;
+    resp->headers[resp->header_count].name_len = strlen(name);
+    resp->headers[resp->header_count].value_len = value_len;
+    resp->header_count++;
+    
+    return 0;
+}
+
+/* Add a preformatted header block - it must outlive the response */
+int ct_response_add_block(ct_response_t *resp, const ct_header_block_t *block) {
+    if (resp->block_count >= CT_RESPONSE_BLOCKS) {
+        return -1;
+    }
+    
+    resp->blocks[resp->block_count++] = block;
+    return 0;
+}
+
+/* Send the body as chunks from stream instead of body/body_len. The
+ * stream is the response's until its done() runs. */
+void ct_response_stream(ct_response_t *resp, ct_body_stream_t *stream) {
+    resp->chunked = true;
+    resp->stream = stream;
+    resp->body = NULL;
+    resp->body_len = 0;
+}
+
+/* Quick response builders for common cases */
+void ct_response_init(ct_response_t *resp, int status_code,
+                     const char *status_text) {
+    memset(resp, 0, sizeof(ct_response_t));
+    resp->status_code = status_code;
+    resp->status_text = status_text;
+}
+
+void ct_response_json(ct_response_t *resp, int status_code,
+                     const char *json_body) {
+    ct_response_init(resp, status_code,
+                    status_code == 200 ? "OK" : "Error");
+    ct_response_add_header(resp, "Content-Type", "application/json");
+    resp->body = json_body;
+    resp->body_len = strlen(json_body);
+}
+
+void ct_response_html(ct_response_t *resp, int status_code,
+                     const char *html_body) {
+    ct_response_init(resp, status_code,
+                    status_code == 200 ? "OK" : "Error");
+    ct_response_add_header(resp, "Content-Type", "text/html; charset=utf-8");
+    resp->body = html_body;
+    resp->body_len = strlen(html_body);
+}
@@ -0,0 +1,262 @@
+#include "terminal.h"
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/* HTTP byte-class scanners. Each returns the first byte at or after p
+ * that leaves its class, or end:
+ *   token  - RFC 9110 tchar (method, header name)
+ *   target - anything but controls, DEL and SP (request-target)
+ *   value  - anything but controls and DEL, HTAB allowed (field value)
+ * so finding the delimiter and validating the bytes before it is one
+ * pass. SSE4.2 and AVX2 versions look at 16/32 bytes per step; the
+ * implementation is picked once at startup from cpuid. */
+
+/* tchar as a nibble product: a byte is a tchar iff
+ * tchar_lo[b & 15] & tchar_hi[b >> 4] is non-zero. Each bit stands for
+ * one row of the ASCII table (0x2_, 0x3_, ...) and the columns it
+ * allows; bytes >= 0x80 have no row. */
+static const uint8_t tchar_lo[16] = {
+    0x3a, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,
+    0x3e, 0x3e, 0x3d, 0x15, 0x34, 0x15, 0x3d, 0x1c
+};
+static const uint8_t tchar_hi[16] = {
+    0x00, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static inline bool is_tchar(uint8_t c) {
+    return (tchar_lo[c & 15] & tchar_hi[c >> 4]) != 0;
+}
+
+static inline bool is_target_char(uint8_t c) {
+    return c > 0x20 && c != 0x7f;
+}
+
+static inline bool is_value_char(uint8_t c) {
+    return (c >= 0x20 || c == '\t') && c != 0x7f;
+}
+
+/* Scalar - the fallback, and the tail of every vector scan. Targets and
+ * values run long (URLs, cookies, user agents), so those look at 8 bytes
+ * per step: a word with no byte below the bound and no DEL is all in
+ * class. A flagged word is walked byte by byte, which also lets a tab
+ * through in a value. */
+#define SCAN_ONES  0x0101010101010101ULL
+#define SCAN_HIGHS 0x8080808080808080ULL
+
+/* High bit set in each byte of x below n (n <= 0x80), or equal to DEL */
+static inline uint64_t word_stops(uint64_t x, uint8_t n) {
+    uint64_t del = x ^ (SCAN_ONES * 0x7f);
+    return ((x - SCAN_ONES * n) | (del - SCAN_ONES)) & ~x & SCAN_HIGHS;
+}
+
+static const char *scan_token_scalar(const char *p, const char *end) {
+    while (p < end && is_tchar((uint8_t)*p)) p++;
+    return p;
+}
+
+static const char *scan_target_scalar(const char *p, const char *end) {
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if (word_stops(w, 0x21)) break;
+        p += 8;
+    }
+    while (p < end && is_target_char((uint8_t)*p)) p++;
+    return p;
+}
+
+static const char *scan_value_scalar(const char *p, const char *end) {
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if (word_stops(w, 0x20)) {
+            const char *q = p + 8;
+            while (p < q && is_value_char((uint8_t)*p)) p++;
+            if (p < q) return p;
+            continue;
+        }
+        p += 8;
+    }
+    while (p < end && is_value_char((uint8_t)*p)) p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+
+/* 16 bytes per step. Token classes come from two pshufb lookups, the
+ * control checks from unsigned min/max compares. Each mask has a bit
+ * set for every byte outside the class. */
+__attribute__((target("sse4.2")))
+static inline unsigned token_mask16(__m128i v) {
+    const __m128i lo_tbl = _mm_loadu_si128((const __m128i *)tchar_lo);
+    const __m128i hi_tbl = _mm_loadu_si128((const __m128i *)tchar_hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    
+    __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(v, nibble));
+    __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()));
+}
+
+__attribute__((target("sse4.2")))
+static inline unsigned target_mask16(__m128i v) {
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    
+    __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, space), space);
+    return _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, del)));
+}
+
+__attribute__((target("sse4.2")))
+static inline unsigned value_mask16(__m128i v) {
+    const __m128i us = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    
+    __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, us), us);
+    ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl);
+    return _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, del)));
+}
+
+#define SCAN_SSE42(name)                                                \
+__attribute__((target("sse4.2")))                                       \
+static const char *scan_##name##_sse42(const char *p, const char *end) { \
+    while (end - p >= 16) {                                             \
+        unsigned mask = name##_mask16(_mm_loadu_si128((const __m128i *)p)); \
+        if (mask) return p + __builtin_ctz(mask);                       \
+        p += 16;                                                        \
+    }                                                                   \
+    return scan_##name##_scalar(p, end);                                \
+}
+
+SCAN_SSE42(token)
+SCAN_SSE42(target)
+SCAN_SSE42(value)
+
+/* 32 bytes per step - vpshufb looks up within each 128-bit lane, so the
+ * tables are repeated in both */
+__attribute__((target("avx2")))
+static inline unsigned token_mask32(__m256i v) {
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)tchar_lo));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)tchar_hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    
+    __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(hi_tbl,
+                                     _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+                                                  _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2")))
+static inline unsigned target_mask32(__m256i v) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space);
+    return _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del)));
+}
+
+__attribute__((target("avx2")))
+static inline unsigned value_mask32(__m256i v) {
+    const __m256i us = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, us), us);
+    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+    return _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del)));
+}
+
+/* Most header fields end within 16 bytes, and a lone 256-bit step costs
+ * more than it saves on those - so the first step is 128-bit and the
+ * wide loop only runs for long fields (cookies, user agents, URLs) */
+#define SCAN_AVX2(name)                                                 \
+__attribute__((target("avx2")))                                         \
+static const char *scan_##name##_avx2(const char *p, const char *end) { \
+    if (end - p >= 16) {                                                \
+        unsigned mask = name##_mask16(_mm_loadu_si128((const __m128i *)p)); \
+        if (mask) return p + __builtin_ctz(mask);                       \
+        p += 16;                                                        \
+    }                                                                   \
+    while (end - p >= 32) {                                             \
+        unsigned mask = name##_mask32(_mm256_loadu_si256((const __m256i *)p)); \
+        if (mask) return p + __builtin_ctz(mask);                       \
+        p += 32;                                                        \
+    }                                                                   \
+    return scan_##name##_sse42(p, end);                                 \
+}
+
+SCAN_AVX2(token)
+SCAN_AVX2(target)
+SCAN_AVX2(value)
+
+#endif /* SCAN_X86 */
+
+typedef struct {
+    const char *name;
+    const char *(*token)(const char *p, const char *end);
+    const char *(*target)(const char *p, const char *end);
+    const char *(*value)(const char *p, const char *end);
+} scan_impl_t;
+
+static const scan_impl_t scan_impls[] = {
+#ifdef SCAN_X86
+    {"sse4.2", scan_token_sse42, scan_target_sse42, scan_value_sse42},
+    {"avx2", scan_token_avx2, scan_target_avx2, scan_value_avx2},
+#endif
+    {"scalar", scan_token_scalar, scan_target_scalar, scan_value_scalar},
+};
+
+#define SCAN_IMPL_COUNT (sizeof(scan_impls) / sizeof(scan_impls[0]))
+
+/* Until ct_http_scan_init runs, scanning is scalar */
+static const scan_impl_t *scan = &scan_impls[SCAN_IMPL_COUNT - 1];
+
+static bool scan_supported(const scan_impl_t *impl) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(impl->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(impl->name, "sse4.2") == 0) return __builtin_cpu_supports("sse4.2");
+#endif
+    return strcmp(impl->name, "scalar") == 0;
+}
+
+/* Pick the first scanner in scan_impls the CPU supports, or the named
+ * one ("sse4.2", "avx2", "scalar"). SSE4.2 leads: request fields are
+ * short, and in bench/http_parse.c AVX2 is no faster on a real request
+ * (330-355 vs 340-384 ns). Returns -1 if the named one is unavailable.
+ * Call before any reactor starts. */
+int ct_http_scan_init(const char *name) {
+    for (size_t i = 0; i < SCAN_IMPL_COUNT; i++) {
+        const scan_impl_t *impl = &scan_impls[i];
+        if (name && strcmp(name, impl->name) != 0) continue;
+        if (!scan_supported(impl)) continue;
+        
+        scan = impl;
+        return 0;
+    }
+    
+    return -1;
+}
+
+const char *ct_http_scan_name(void) {
+    return scan->name;
+}
+
+const char *ct_scan_token(const char *p, const char *end) {
+    return scan->token(p, end);
+}
+
+const char *ct_scan_target(const char *p, const char *end) {
+    return scan->target(p, end);
+}
+
+const char *ct_scan_value(const char *p, const char *end) {
+    return scan->value(p, end);
+}
@@ -0,0 +1,346 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Cycle counter ticks per nanosecond - measured once at startup */
+static double g_ticks_per_ns = 1.0;
+
+static const char *handler_names[CT_LOOP_HANDLER_COUNT] = {
+    [CT_LOOP_ACCEPT]    = "accept",
+    [CT_LOOP_HTTP]      = "http",
+    [CT_LOOP_WEBSOCKET] = "websocket",
+    [CT_LOOP_PROXY]     = "proxy",
+    [CT_LOOP_WRITE]     = "write",
+    [CT_LOOP_TIMERS]    = "timers",
+    [CT_LOOP_JOBS]      = "jobs",
+};
+
+static const char *mem_class_names[CT_MEM_CLASS_COUNT] = {
+    [CT_MEM_IDLE]         = "idle",
+    [CT_MEM_HTTP]         = "http",
+    [CT_MEM_WEBSOCKET]    = "websocket",
+    [CT_MEM_PROXY]        = "proxy",
+    [CT_MEM_AWAITING_JOB] = "awaitingJob",
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Measure the cycle counter against CLOCK_MONOTONIC over ~10 ms */
+void ct_loop_stats_calibrate(void) {
+    uint64_t ns0 = monotonic_ns();
+    uint64_t c0 = ct_cycles();
+    
+    struct timespec pause = {0, 10000000};
+    nanosleep(&pause, NULL);
+    
+    uint64_t ns1 = monotonic_ns();
+    uint64_t c1 = ct_cycles();
+    
+    if (ns1 > ns0 && c1 > c0) {
+        g_ticks_per_ns = (double)(c1 - c0) / (double)(ns1 - ns0);
+    }
+}
+
+/* Summary of a histogram - percentiles are bucket upper bounds, so they
+ * overestimate by at most 2x */
+typedef struct {
+    uint64_t count;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+} hist_summary_t;
+
+static double bucket_bound(unsigned bucket) {
+    return bucket >= 64 ? 1.8e19 : (double)(1ULL << bucket);
+}
+
+static void hist_summarize(const ct_histogram_t *hist, double scale,
+                           hist_summary_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->count = hist->count;
+    if (hist->count == 0) return;
+    
+    out->mean = (double)hist->sum / hist->count * scale;
+    out->max = (double)hist->max * scale;
+    
+    uint64_t p50 = (hist->count * 50 + 99) / 100;
+    uint64_t p99 = (hist->count * 99 + 99) / 100;
+    uint64_t p999 = (hist->count * 999 + 999) / 1000;
+    uint64_t seen = 0;
+    
+    for (unsigned i = 0; i < CT_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        double bound = bucket_bound(i) * scale;
+        if (bound > out->max) bound = out->max;
+        
+        if (out->p50 == 0 && seen >= p50) out->p50 = bound;
+        if (out->p99 == 0 && seen >= p99) out->p99 = bound;
+        if (out->p999 == 0 && seen >= p999) {
+            out->p999 = bound;
+            break;
+        }
+    }
+}
+
+static void hist_merge(ct_histogram_t *dst, const ct_histogram_t *src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) dst->max = src->max;
+    for (unsigned i = 0; i < CT_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+/* Sum every reactor's stats - racy snapshot, good enough for monitoring */
+static void stats_aggregate(ct_server_t *server, ct_loop_stats_t *total) {
+    memset(total, 0, sizeof(*total));
+    
+    for (size_t r = 0; r < server->reactor_count; r++) {
+        const ct_loop_stats_t *stats = &server->reactors[r].stats;
+        
+        hist_merge(&total->events, &stats->events);
+        hist_merge(&total->blocked, &stats->blocked);
+        hist_merge(&total->busy, &stats->busy);
+        for (int h = 0; h < CT_LOOP_HANDLER_COUNT; h++) {
+            hist_merge(&total->handler[h], &stats->handler[h]);
+        }
+    }
+}
+
+static size_t json_hist(char *buf, size_t buf_len, const char *name,
+                        const ct_histogram_t *hist, double scale) {
+    hist_summary_t s;
+    hist_summarize(hist, scale, &s);
+    
+    int n = snprintf(buf, buf_len,
+                     "\"%s\":{\"count\":%llu,\"mean\":%.2f,\"p50\":%.2f,"
+                     "\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f}",
+                     name, (unsigned long long)s.count, s.mean, s.p50,
+                     s.p99, s.p999, s.max);
+    if (n < 0) return 0;
+    return (size_t)n < buf_len ? (size_t)n : buf_len;
+}
+
+/* JSON for /api/loop-stats - times in microseconds, events as counts */
+size_t ct_loop_stats_json(ct_server_t *server, char *buf, size_t buf_len) {
+    ct_loop_stats_t total;
+    stats_aggregate(server, &total);
+    
+    double us = 1.0 / (g_ticks_per_ns * 1000.0);
+    size_t pos = 0;
+
+#define JSON_APPEND(...) \
+    do { \
+        int n_ = snprintf(buf + pos, buf_len - pos, __VA_ARGS__); \
+        if (n_ < 0 || (size_t)n_ >= buf_len - pos) return 0; \
+        pos += n_; \
+    } while (0)
+    
+    JSON_APPEND("{\"reactors\":%zu,\"unit\":\"us\",", server->reactor_count);
+    pos += json_hist(buf + pos, buf_len - pos, "eventsPerWakeup", &total.events, 1.0);
+    JSON_APPEND(",");
+    pos += json_hist(buf + pos, buf_len - pos, "blocked", &total.blocked, us);
+    JSON_APPEND(",");
+    pos += json_hist(buf + pos, buf_len - pos, "busy", &total.busy, us);
+    JSON_APPEND(",\"handlers\":{");
+    for (int h = 0; h < CT_LOOP_HANDLER_COUNT; h++) {
+        if (h > 0) JSON_APPEND(",");
+        pos += json_hist(buf + pos, buf_len - pos, handler_names[h],
+                         &total.handler[h], us);
+    }
+    JSON_APPEND("}}");
+
+#undef JSON_APPEND
+
+    return pos;
+}
+
+static void mem_count_connection(ct_mem_stats_t *snapshot,
+                                 const ct_connection_t *conn) {
+    ct_mem_class_stats_t *stats = &snapshot->classes[ct_connection_mem_class(conn)];
+    
+    size_t bytes = conn->read_buf.size + conn->write_buf.size;
+    stats->connections++;
+    stats->bytes += bytes;
+    if (bytes > 0) stats->buffered++;
+}
+
+/* Refresh this reactor's snapshot - runs on the reactor's own thread, since
+ * the connection table is not safe to walk from anywhere else */
+void ct_mem_stats_collect(ct_reactor_t *reactor) {
+    ct_mem_stats_t snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    for (size_t i = 0; i < reactor->conn_count; i++) {
+        mem_count_connection(&snapshot, reactor->conns[i]);
+    }
+    reactor->mem_stats = snapshot;
+}
+
+/* Sum the per-reactor snapshots and pool counters - racy like the loop
+ * stats, good enough for monitoring */
+static void mem_aggregate(ct_server_t *server, ct_mem_stats_t *total,
+                          size_t *in_use, size_t *cached) {
+    memset(total, 0, sizeof(*total));
+    *in_use = 0;
+    *cached = 0;
+    
+    for (size_t r = 0; r < server->reactor_count; r++) {
+        const ct_reactor_t *reactor = &server->reactors[r];
+        
+        for (int c = 0; c < CT_MEM_CLASS_COUNT; c++) {
+            total->classes[c].connections += reactor->mem_stats.classes[c].connections;
+            total->classes[c].buffered += reactor->mem_stats.classes[c].buffered;
+            total->classes[c].bytes += reactor->mem_stats.classes[c].bytes;
+        }
+        for (unsigned i = 0; i < CT_BUF_CLASSES; i++) {
+            size_t size = CT_BUF_MIN_SIZE << i;
+            *in_use += reactor->buf_pool.in_use[i] * size;
+            *cached += reactor->buf_pool.cached[i] * size;
+        }
+    }
+}
+
+/* Object pools - connections and output segments per reactor, plus the
+ * shared session pool */
+enum { POOL_CONNECTIONS, POOL_SEGMENTS, POOL_SESSIONS, POOL_COUNT };
+
+static const char *pool_names[POOL_COUNT] = {
+    [POOL_CONNECTIONS] = "connections",
+    [POOL_SEGMENTS]    = "segments",
+    [POOL_SESSIONS]    = "sessions",
+};
+
+static void pool_stats_add(ct_mem_pool_stats_t *dst, ct_mem_pool_t *pool) {
+    ct_mem_pool_stats_t s;
+    ct_mem_pool_get_stats(pool, &s);
+    
+    dst->allocs += s.allocs;
+    dst->hits += s.hits;
+    dst->refills += s.refills;
+    dst->blocks += s.blocks;
+    dst->bytes += s.bytes;
+    dst->in_use += s.in_use;
+    dst->huge_blocks += s.huge_blocks;
+}
+
+static void pool_aggregate(ct_server_t *server, ct_mem_pool_stats_t *pools) {
+    memset(pools, 0, POOL_COUNT * sizeof(*pools));
+    
+    for (size_t r = 0; r < server->reactor_count; r++) {
+        pool_stats_add(&pools[POOL_CONNECTIONS], server->reactors[r].conn_pool);
+        pool_stats_add(&pools[POOL_SEGMENTS], server->reactors[r].seg_pool);
+    }
+    pool_stats_add(&pools[POOL_SESSIONS], server->session_pool);
+}
+
+static void dump_hist(FILE *out, const char *name, const ct_histogram_t *hist,
+                      double scale) {
+    hist_summary_t s;
+    hist_summarize(hist, scale, &s);
+    
+    fprintf(out, "  %-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            name, (unsigned long long)s.count, s.mean, s.p50, s.p99,
+            s.p999, s.max);
+}
+
+/* Human-readable table - triggered by SIGUSR1 */
+void ct_loop_stats_dump(ct_server_t *server, FILE *out) {
+    ct_loop_stats_t total;
+    stats_aggregate(server, &total);
+    
+    double us = 1.0 / (g_ticks_per_ns * 1000.0);
+    
+    fprintf(out, "Event loop statistics (%zu reactors, times in us)\n",
+            server->reactor_count);
+    fprintf(out, "  %-16s %10s %10s %10s %10s %10s %10s\n",
+            "", "count", "mean", "p50", "p99", "p99.9", "max");
+    dump_hist(out, "events/wakeup", &total.events, 1.0);
+    dump_hist(out, "blocked", &total.blocked, us);
+    dump_hist(out, "busy", &total.busy, us);
+    for (int h = 0; h < CT_LOOP_HANDLER_COUNT; h++) {
+        dump_hist(out, handler_names[h], &total.handler[h], us);
+    }
+    
+    ct_mem_stats_t mem;
+    size_t in_use, cached;
+    mem_aggregate(server, &mem, &in_use, &cached);
+    
+    fprintf(out, "Connection buffers (pool: %zu KB in use, %zu KB cached)\n",
+            in_use / 1024, cached / 1024);
+    fprintf(out, "  %-16s %10s %10s %10s\n", "", "conns", "buffered", "KB");
+    for (int c = 0; c < CT_MEM_CLASS_COUNT; c++) {
+        fprintf(out, "  %-16s %10llu %10llu %10llu\n", mem_class_names[c],
+                (unsigned long long)mem.classes[c].connections,
+                (unsigned long long)mem.classes[c].buffered,
+                (unsigned long long)mem.classes[c].bytes / 1024);
+    }
+    
+    ct_mem_pool_stats_t pools[POOL_COUNT];
+    pool_aggregate(server, pools);
+    
+    fprintf(out, "Object pools\n");
+    fprintf(out, "  %-16s %10s %10s %10s %10s %10s %10s\n", "", "allocs",
+            "hits", "refills", "in use", "KB", "huge");
+    for (int p = 0; p < POOL_COUNT; p++) {
+        fprintf(out, "  %-16s %10llu %10llu %10llu %10zu %10zu %10zu\n",
+                pool_names[p], (unsigned long long)pools[p].allocs,
+                (unsigned long long)pools[p].hits,
+                (unsigned long long)pools[p].refills, pools[p].in_use,
+                pools[p].bytes / 1024, pools[p].huge_blocks);
+    }
+    fflush(out);
+}
+
+/* JSON for /api/memory-stats - bytes of connection buffer memory */
+size_t ct_mem_stats_json(ct_server_t *server, char *buf, size_t buf_len) {
+    ct_mem_stats_t mem;
+    size_t in_use, cached;
+    mem_aggregate(server, &mem, &in_use, &cached);
+    
+    size_t pos = 0;
+
+#define JSON_APPEND(...) \
+    do { \
+        int n_ = snprintf(buf + pos, buf_len - pos, __VA_ARGS__); \
+        if (n_ < 0 || (size_t)n_ >= buf_len - pos) return 0; \
+        pos += n_; \
+    } while (0)
+    
+    JSON_APPEND("{\"pool\":{\"inUse\":%zu,\"cached\":%zu},\"states\":{",
+                in_use, cached);
+    for (int c = 0; c < CT_MEM_CLASS_COUNT; c++) {
+        JSON_APPEND("%s\"%s\":{\"connections\":%llu,\"buffered\":%llu,"
+                    "\"bytes\":%llu}",
+                    c > 0 ? "," : "", mem_class_names[c],
+                    (unsigned long long)mem.classes[c].connections,
+                    (unsigned long long)mem.classes[c].buffered,
+                    (unsigned long long)mem.classes[c].bytes);
+    }
+    
+    ct_mem_pool_stats_t pools[POOL_COUNT];
+    pool_aggregate(server, pools);
+    
+    JSON_APPEND("},\"objectPools\":{");
+    for (int p = 0; p < POOL_COUNT; p++) {
+        JSON_APPEND("%s\"%s\":{\"allocs\":%llu,\"hits\":%llu,\"refills\":%llu,"
+                    "\"inUse\":%zu,\"bytes\":%zu,\"hugeBlocks\":%zu}",
+                    p > 0 ? "," : "", pool_names[p],
+                    (unsigned long long)pools[p].allocs,
+                    (unsigned long long)pools[p].hits,
+                    (unsigned long long)pools[p].refills, pools[p].in_use,
+                    pools[p].bytes, pools[p].huge_blocks);
+    }
+    JSON_APPEND("}}");
+
+#undef JSON_APPEND
+
+    return pos;
+}
@@ -15,6 +15,9 @@ static void signal_handler(int sig) {
         if (g_server) {
             ct_server_stop(g_server);
         }
+    } else if (sig == SIGUSR1) {
+        /* Event loop statistics to stderr */
+        ct_server_request_stats_dump(g_server);
     }
 }
 
@@ -28,9 +31,16 @@ static void print_usage(const char *prog) {
     printf("  -P, --password-hash HASH BCrypt password hash\n");
     printf("  -c, --max-connections N  Max connections (default: 10000)\n");
     printf("  -s, --max-sessions N     Max sessions (default: 1000)\n");
+    printf("  -w, --workers N          Event loop threads, 0 = one per CPU (default: 1)\n");
+    printf("  -J, --job-threads N      Threads for blocking jobs like bcrypt (default: 2)\n");
     printf("  -T, --session-timeout S  Session timeout in seconds (default: 86400)\n");
+    printf("  -I, --idle-timeout S     Keep-alive idle timeout in seconds (default: 60)\n");
+    printf("  -B, --io-budget KB       Bytes moved per connection before yielding (default: 256)\n");
+    printf("  -W, --ws-deflate BITS    WebSocket permessage-deflate window, 9-15, 0 = off (default: 15)\n");
+    printf("  -M, --ws-max-message KB  Largest WebSocket message accepted (default: 16384)\n");
     printf("  -C, --compression        Enable compression\n");
     printf("  -S, --ssl                Enable SSL/TLS\n");
+    printf("  -U, --io-uring           Use the io_uring backend (needs IO_URING=1 build)\n");
     printf("  -v, --version            Show version\n");
     printf("  -?, --help               Show this help\n");
 }
@@ -50,9 +60,19 @@ int main(int argc, char *argv[]) {
         .password_hash = "$2a$10$YourHashHere",
         .max_connections = 10000,
         .max_sessions = 1000,
+        .workers = 1,
+        .job_threads = 2,
+        .io_budget = CT_IO_BUDGET,
         .session_timeout = 86400,
+        .idle_timeout = 60,
+        .header_timeout = 10,
+        .ws_ping_interval = 30,
+        .ws_ping_timeout = 10,
+        .ws_deflate_window_bits = 15,
+        .ws_max_message = CT_WS_MAX_MESSAGE,
         .enable_compression = false,
-        .enable_ssl = false
+        .enable_ssl = false,
+        .use_io_uring = false
     };
     
     /* Parse command line options */
@@ -64,16 +84,23 @@ int main(int argc, char *argv[]) {
         {"password-hash", required_argument, 0, 'P'},
         {"max-connections", required_argument, 0, 'c'},
         {"max-sessions", required_argument, 0, 's'},
+        {"workers", required_argument, 0, 'w'},
+        {"job-threads", required_argument, 0, 'J'},
         {"session-timeout", required_argument, 0, 'T'},
+        {"idle-timeout", required_argument, 0, 'I'},
+        {"io-budget", required_argument, 0, 'B'},
+        {"ws-deflate", required_argument, 0, 'W'},
+        {"ws-max-message", required_argument, 0, 'M'},
         {"compression", no_argument, 0, 'C'},
         {"ssl", no_argument, 0, 'S'},
+        {"io-uring", no_argument, 0, 'U'},
         {"version", no_argument, 0, 'v'},
         {"help", no_argument, 0, '?'},
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "h:p:d:t:P:c:s:T:CSv?", 
+    while ((opt = getopt_long(argc, argv, "h:p:d:t:P:c:s:w:J:T:I:B:W:M:CSUv?", 
                              long_opts, NULL)) != -1) {
         switch (opt) {
             case 'h':
@@ -106,15 +133,48 @@ int main(int argc, char *argv[]) {
             case 's':
                 config.max_sessions = atoi(optarg);
                 break;
+            case 'w':
+                config.workers = atoi(optarg);
+                break;
+            case 'J':
+                config.job_threads = atoi(optarg);
+                break;
             case 'T':
                 config.session_timeout = atoi(optarg);
                 break;
+            case 'I':
+                config.idle_timeout = atoi(optarg);
+                break;
+            case 'B':
+                config.io_budget = (size_t)atoi(optarg) << 10;
+                break;
+            case 'W':
+                config.ws_deflate_window_bits = atoi(optarg);
+                if (config.ws_deflate_window_bits != 0 &&
+                    (config.ws_deflate_window_bits < 9 ||
+                     config.ws_deflate_window_bits > 15)) {
+                    fprintf(stderr, "WebSocket deflate window must be 9-15 or 0\n");
+                    return 1;
+                }
+                break;
+            case 'M': {
+                int kb = atoi(optarg);
+                if (kb <= 0) {
+                    fprintf(stderr, "WebSocket message limit must be at least 1 KB\n");
+                    return 1;
+                }
+                config.ws_max_message = (size_t)kb << 10;
+                break;
+            }
             case 'C':
                 config.enable_compression = true;
                 break;
             case 'S':
                 config.enable_ssl = true;
                 break;
+            case 'U':
+                config.use_io_uring = true;
+                break;
             case 'v':
                 print_version();
                 return 0;
@@ -130,6 +190,7 @@ int main(int argc, char *argv[]) {
     /* Setup signal handlers */
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, signal_handler);
     signal(SIGPIPE, SIG_IGN);
     
     /* Create and start server */
@@ -144,6 +205,8 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    printf("Workers: %zu\n", g_server->reactor_count);
+    
     int ret = ct_server_run(g_server);
     
     ct_server_destroy(g_server);
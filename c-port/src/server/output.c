@@ -0,0 +1,384 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/* Chunk read from a file body when sendfile can't be used (io_uring
+ * backend, non-Linux) - a buf_pool size class */
+#define OUTPUT_STAGE_SIZE ((size_t)64 << 10)
+
+static ct_out_seg_t *seg_alloc(ct_connection_t *conn, ct_out_type_t type) {
+    ct_out_seg_t *seg = ct_mem_pool_calloc(conn->reactor->seg_pool);
+    if (!seg) return NULL;
+    
+    seg->type = type;
+    seg->fd = -1;
+    return seg;
+}
+
+/* Drop a segment's references - cache entry, pool buffer or file */
+static void seg_free(ct_connection_t *conn, ct_out_seg_t *seg) {
+    switch (seg->type) {
+        case CT_OUT_MEM:
+            if (seg->entry) {
+                ct_file_cache_release(conn->server->file_cache, seg->entry);
+            }
+            break;
+        case CT_OUT_BUF:
+            ct_buf_pool_free(&conn->reactor->buf_pool, seg->buf, seg->buf_size,
+                             seg->buf_mirrored);
+            break;
+        case CT_OUT_FILE:
+            close(seg->fd);
+            break;
+        case CT_OUT_RING:
+            break;
+    }
+    
+    ct_mem_pool_free(conn->reactor->seg_pool, seg);
+}
+
+static void seg_append(ct_connection_t *conn, ct_out_seg_t *seg) {
+    if (conn->out_tail) {
+        conn->out_tail->next = seg;
+    } else {
+        conn->out_head = seg;
+    }
+    conn->out_tail = seg;
+}
+
+/* Cover ring bytes written since the last segment, so they go out ahead
+ * of the segment about to be queued */
+static int seal_ring(ct_connection_t *conn) {
+    size_t pending = ct_ring_buffer_available(&conn->write_buf) - conn->out_ring_queued;
+    if (pending == 0) return 0;
+    
+    ct_out_seg_t *seg = seg_alloc(conn, CT_OUT_RING);
+    if (!seg) return -1;
+    
+    seg->len = pending;
+    conn->out_ring_queued += pending;
+    seg_append(conn, seg);
+    return 0;
+}
+
+/* Queue len bytes of memory. With an entry, the segment takes over the
+ * caller's reference; without one, data must outlive the send (static). */
+int ct_output_queue_mem(ct_connection_t *conn, const char *data, size_t len,
+                        ct_file_entry_t *entry) {
+    if (seal_ring(conn) < 0) return -1;
+    
+    ct_out_seg_t *seg = seg_alloc(conn, CT_OUT_MEM);
+    if (!seg) return -1;
+    
+    seg->data = data;
+    seg->len = len;
+    seg->entry = entry;
+    seg_append(conn, seg);
+    return 0;
+}
+
+/* Queue len bytes of a file from offset - the segment owns fd */
+int ct_output_queue_file(ct_connection_t *conn, int fd, off_t offset, size_t len) {
+    if (seal_ring(conn) < 0) return -1;
+    
+    ct_out_seg_t *seg = seg_alloc(conn, CT_OUT_FILE);
+    if (!seg) return -1;
+    
+    seg->fd = fd;
+    seg->offset = offset;
+    seg->len = len;
+    seg_append(conn, seg);
+    return 0;
+}
+
+bool ct_output_pending(ct_connection_t *conn) {
+    return conn->out_head || ct_ring_buffer_available(&conn->write_buf) > 0;
+}
+
+/* Up to two iovecs for len ring bytes starting offset bytes in */
+static unsigned ring_iov(ct_ring_buffer_t *rb, size_t offset, size_t len,
+                         struct iovec *iov, unsigned max_iov) {
+    struct iovec span[2];
+    int spans = ct_ring_buffer_data_iov(rb, span);
+    unsigned n = 0;
+    
+    for (int i = 0; i < spans && len > 0 && n < max_iov; i++) {
+        if (offset >= span[i].iov_len) {
+            offset -= span[i].iov_len;
+            continue;
+        }
+        
+        size_t take = span[i].iov_len - offset;
+        if (take > len) take = len;
+        
+        iov[n].iov_base = (char *)span[i].iov_base + offset;
+        iov[n].iov_len = take;
+        n++;
+        
+        offset = 0;
+        len -= take;
+    }
+    
+    return n;
+}
+
+/* Describe the front of the output as iovecs, stopping at a file segment
+ * (sent with sendfile or staged first). Returns the iovec count. */
+unsigned ct_output_iov(ct_connection_t *conn, struct iovec *iov,
+                       unsigned max_iov) {
+    size_t ring_offset = 0;
+    unsigned n = 0;
+    ct_out_seg_t *seg;
+    
+    for (seg = conn->out_head; seg && n < max_iov; seg = seg->next) {
+        switch (seg->type) {
+            case CT_OUT_RING:
+                n += ring_iov(&conn->write_buf, ring_offset, seg->len,
+                              iov + n, max_iov - n);
+                ring_offset += seg->len;
+                break;
+            case CT_OUT_MEM:
+            case CT_OUT_BUF:
+                iov[n].iov_base = (void *)seg->data;
+                iov[n].iov_len = seg->len;
+                n++;
+                break;
+            case CT_OUT_FILE:
+                return n;
+        }
+    }
+    
+    /* Unqueued ring tail, once every segment is described */
+    size_t tail = ct_ring_buffer_available(&conn->write_buf) - ring_offset;
+    if (!seg && tail > 0 && n < max_iov) {
+        n += ring_iov(&conn->write_buf, ring_offset, tail, iov + n, max_iov - n);
+    }
+    
+    return n;
+}
+
+/* Mark len bytes from the front of the output as sent */
+void ct_output_consume(ct_connection_t *conn, size_t len) {
+    while (len > 0 && conn->out_head) {
+        ct_out_seg_t *seg = conn->out_head;
+        size_t take = len < seg->len ? len : seg->len;
+        
+        switch (seg->type) {
+            case CT_OUT_RING:
+                ct_ring_buffer_skip(&conn->write_buf, take);
+                conn->out_ring_queued -= take;
+                break;
+            case CT_OUT_MEM:
+            case CT_OUT_BUF:
+                seg->data += take;
+                break;
+            case CT_OUT_FILE:
+                seg->offset += take;
+                break;
+        }
+        
+        seg->len -= take;
+        len -= take;
+        
+        if (seg->len == 0) {
+            conn->out_head = seg->next;
+            if (!conn->out_head) {
+                conn->out_tail = NULL;
+            }
+            seg_free(conn, seg);
+        }
+    }
+    
+    if (len > 0) {
+        ct_ring_buffer_skip(&conn->write_buf, len);
+    }
+}
+
+/* Read the next chunk of a leading file segment into a pool buffer queued
+ * ahead of it - for backends that can only send from memory. Returns -1
+ * on a read error or a file that shrank. */
+int ct_output_stage_file(ct_connection_t *conn) {
+    ct_out_seg_t *file = conn->out_head;
+    if (!file || file->type != CT_OUT_FILE) return 0;
+    
+    size_t want = file->len < OUTPUT_STAGE_SIZE ? file->len : OUTPUT_STAGE_SIZE;
+    
+    ct_out_seg_t *seg = seg_alloc(conn, CT_OUT_BUF);
+    if (!seg) return -1;
+    
+    seg->buf = ct_buf_pool_alloc(&conn->reactor->buf_pool, OUTPUT_STAGE_SIZE,
+                                 &seg->buf_mirrored);
+    if (!seg->buf) {
+        ct_mem_pool_free(conn->reactor->seg_pool, seg);
+        return -1;
+    }
+    seg->buf_size = OUTPUT_STAGE_SIZE;
+    
+    ssize_t n;
+    do {
+        n = pread(file->fd, seg->buf, want, file->offset);
+    } while (n < 0 && errno == EINTR);
+    
+    if (n <= 0) {
+        seg_free(conn, seg);
+        return -1;
+    }
+    
+    seg->data = seg->buf;
+    seg->len = n;
+    
+    /* The staged bytes now precede the rest of the file */
+    file->offset += n;
+    file->len -= n;
+    seg->next = file;
+    conn->out_head = seg;
+    
+    if (file->len == 0) {
+        seg->next = file->next;
+        if (conn->out_tail == file) {
+            conn->out_tail = seg;
+        }
+        seg_free(conn, file);
+    }
+    
+    return 0;
+}
+
+/* Send a leading file segment straight from the page cache */
+static ssize_t output_sendfile(ct_connection_t *conn, ct_out_seg_t *seg) {
+#ifdef __linux__
+    ssize_t n = sendfile(conn->fd, seg->fd, &seg->offset, seg->len);
+    if (n > 0) {
+        /* sendfile advanced the offset - consume only the length */
+        seg->offset -= n;
+        ct_output_consume(conn, n);
+    } else if (n == 0) {
+        /* File shrank under us */
+        errno = EIO;
+        return -1;
+    }
+    return n;
+#else
+    (void)seg;
+    if (ct_output_stage_file(conn) < 0) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+/* Flush as much output as the socket takes: writev over ring and memory
+ * segments, sendfile for files. Past io_budget bytes the connection yields
+ * to the ready list - edge-triggered EPOLLOUT won't fire again for a
+ * socket that still has room. Returns bytes sent, 0 if the socket was
+ * full or nothing was pending, -1 on error. */
+int ct_output_write(ct_connection_t *conn) {
+    size_t budget = conn->server->config.io_budget;
+    size_t total = 0;
+    
+    while (ct_output_pending(conn)) {
+        if (total >= budget) {
+            ct_reactor_mark_ready(conn->reactor, conn);
+            break;
+        }
+        
+        ct_out_seg_t *head = conn->out_head;
+        ssize_t n;
+        
+        if (head && head->type == CT_OUT_FILE) {
+            n = output_sendfile(conn, head);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return -1;
+            }
+            total += n;
+            continue;
+        }
+        
+        struct iovec iov[CT_OUTPUT_IOV_MAX];
+        unsigned iovcnt = ct_output_iov(conn, iov, CT_OUTPUT_IOV_MAX);
+        if (iovcnt == 0 || iovcnt > CT_OUTPUT_IOV_MAX) break;
+        
+        size_t want = 0;
+        for (unsigned i = 0; i < iovcnt; i++) {
+            want += iov[i].iov_len;
+        }
+        
+        n = writev(conn->fd, iov, (int)iovcnt);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        
+        ct_output_consume(conn, n);
+        total += n;
+        
+        /* Short write - the socket buffer is full */
+        if ((size_t)n < want) break;
+    }
+    
+    return (int)(total > INT32_MAX ? INT32_MAX : total);
+}
+
+/* Drop everything queued - connection teardown */
+void ct_output_clear(ct_connection_t *conn) {
+    ct_out_seg_t *seg = conn->out_head;
+    while (seg) {
+        ct_out_seg_t *next = seg->next;
+        seg_free(conn, seg);
+        seg = next;
+    }
+    
+    conn->out_head = NULL;
+    conn->out_tail = NULL;
+    conn->out_ring_queued = 0;
+}
+
+/* Append one chunk of a streamed response body to the write buffer -
+ * size line, data, CRLF. len 0 is skipped, as it would end the body.
+ * Returns -1 if the buffer can't take the whole chunk. */
+int ct_response_write_chunk(ct_connection_t *conn, const void *data, size_t len) {
+    ct_ring_buffer_t *rb = &conn->write_buf;
+    char size[16 + 2];
+    
+    if (len == 0) return 0;
+    
+    char *p = ct_fmt_hex(size, len);
+    *p++ = '\r';
+    *p++ = '\n';
+    
+    size_t need = (p - size) + len + 2;
+    if (ct_ring_buffer_reserve(rb, need) < need) return -1;
+    
+    ct_ring_buffer_write(rb, size, p - size);
+    ct_ring_buffer_write(rb, data, len);
+    ct_ring_buffer_write(rb, "\r\n", 2);
+    return 0;
+}
+
+/* Release body sources a response never handed to the queue */
+void ct_response_release(ct_connection_t *conn) {
+    ct_response_t *resp = &conn->response;
+    
+    if (resp->stream) {
+        ct_body_stream_t *stream = resp->stream;
+        resp->stream = NULL;
+        stream->done(conn, stream);
+    }
+    
+    if (resp->body_entry) {
+        ct_file_cache_release(conn->server->file_cache, resp->body_entry);
+        resp->body_entry = NULL;
+    }
+    if (resp->body_from_fd) {
+        close(resp->body_fd);
+        resp->body_from_fd = false;
+    }
+}
@@ -0,0 +1,537 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef CT_HAVE_IO_URING
+#include <liburing.h>
+
+/* Ring sizing - one provided-buffer ring per reactor */
+#define CT_URING_ENTRIES    4096
+#define CT_URING_BUF_COUNT  2048   /* must be a power of 2 */
+#define CT_URING_BUF_SIZE   4096
+#define CT_URING_BUF_GROUP  0
+
+/* Operation tag packed into the low bits of user_data */
+#define URING_OP_ACCEPT     1
+#define URING_OP_WAKE       2
+#define URING_OP_RECV       3
+#define URING_OP_SEND       4
+#define URING_OP_CANCEL     5
+#define URING_OP_POLL       6   /* proxy backend readiness */
+#define URING_OP_MASK       7
+
+/* conn->io_flags */
+#define URING_RECV_ARMED    0x01
+#define URING_SEND_ARMED    0x02
+#define URING_QUEUED        0x04
+#define URING_CLOSING       0x08
+#define URING_POLL_ARMED    0x10
+
+typedef struct {
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring;
+    char *buf_base;
+    int buf_mask;
+    
+    /* Connections with output to flush at the end of this iteration */
+    ct_connection_t *send_queue;
+} uring_state_t;
+
+static inline uint64_t uring_tag(void *ptr, unsigned op) {
+    return (uint64_t)(uintptr_t)ptr | op;
+}
+
+static inline struct io_uring_sqe *uring_sqe(uring_state_t *u) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+    if (!sqe) {
+        /* SQ full - flush what we have and retry once */
+        io_uring_submit(&u->ring);
+        sqe = io_uring_get_sqe(&u->ring);
+    }
+    return sqe;
+}
+
+static int uring_setup(uring_state_t *u) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    
+    /* Only the reactor thread touches the ring; completions are reaped
+     * in-line, so task work need not interrupt us */
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    
+    int ret = io_uring_queue_init_params(CT_URING_ENTRIES, &u->ring, &params);
+    if (ret == -EINVAL) {
+        /* Older kernel - retry without the optional flags */
+        memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(CT_URING_ENTRIES, &u->ring, &params);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+    
+    /* Provided buffers for multishot recv */
+    u->buf_base = aligned_alloc(4096, (size_t)CT_URING_BUF_COUNT * CT_URING_BUF_SIZE);
+    if (!u->buf_base) {
+        io_uring_queue_exit(&u->ring);
+        return -1;
+    }
+    
+    u->buf_ring = io_uring_setup_buf_ring(&u->ring, CT_URING_BUF_COUNT,
+                                          CT_URING_BUF_GROUP, 0, &ret);
+    if (!u->buf_ring) {
+        free(u->buf_base);
+        io_uring_queue_exit(&u->ring);
+        return -1;
+    }
+    
+    u->buf_mask = io_uring_buf_ring_mask(CT_URING_BUF_COUNT);
+    for (int i = 0; i < CT_URING_BUF_COUNT; i++) {
+        io_uring_buf_ring_add(u->buf_ring, u->buf_base + (size_t)i * CT_URING_BUF_SIZE,
+                              CT_URING_BUF_SIZE, i, u->buf_mask, i);
+    }
+    io_uring_buf_ring_advance(u->buf_ring, CT_URING_BUF_COUNT);
+    
+    return 0;
+}
+
+static void uring_teardown(uring_state_t *u) {
+    io_uring_free_buf_ring(&u->ring, u->buf_ring, CT_URING_BUF_COUNT,
+                           CT_URING_BUF_GROUP);
+    io_uring_queue_exit(&u->ring);
+    free(u->buf_base);
+}
+
+/* Hand a provided buffer back to the kernel */
+static inline void uring_recycle_buffer(uring_state_t *u, int bid) {
+    io_uring_buf_ring_add(u->buf_ring, u->buf_base + (size_t)bid * CT_URING_BUF_SIZE,
+                          CT_URING_BUF_SIZE, bid, u->buf_mask, 0);
+    io_uring_buf_ring_advance(u->buf_ring, 1);
+}
+
+static void uring_arm_accept(uring_state_t *u, ct_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    if (!sqe) return;
+    io_uring_prep_multishot_accept(sqe, reactor->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, uring_tag(NULL, URING_OP_ACCEPT));
+}
+
+static void uring_arm_wake(uring_state_t *u, ct_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    if (!sqe) return;
+    io_uring_prep_poll_multishot(sqe, reactor->wake_fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, uring_tag(NULL, URING_OP_WAKE));
+}
+
+static void uring_arm_recv(uring_state_t *u, ct_connection_t *conn) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    if (!sqe) return;
+    io_uring_prep_recv_multishot(sqe, conn->fd, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = CT_URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, uring_tag(conn, URING_OP_RECV));
+    
+    conn->io_flags |= URING_RECV_ARMED;
+    conn->io_pending++;
+}
+
+/* Readiness on a proxy's backend socket, reported as conn's. Multishot
+ * poll is edge-like - a completion per wakeup - as the epoll backend's
+ * EPOLLET registration is. */
+static int uring_arm_poll(uring_state_t *u, ct_connection_t *conn, int fd) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    if (!sqe) return -1;
+    io_uring_prep_poll_multishot(sqe, fd, POLLIN | POLLOUT | POLLRDHUP);
+    io_uring_sqe_set_data64(sqe, uring_tag(conn, URING_OP_POLL));
+    
+    conn->io_backend_fd = fd;
+    conn->io_flags |= URING_POLL_ARMED;
+    conn->io_pending++;
+    return 0;
+}
+
+static void uring_cancel_poll(uring_state_t *u, ct_connection_t *conn) {
+    if (!(conn->io_flags & URING_POLL_ARMED)) return;
+    conn->io_flags &= ~URING_POLL_ARMED;
+    
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    if (sqe) {
+        io_uring_prep_poll_remove(sqe, uring_tag(conn, URING_OP_POLL));
+        io_uring_sqe_set_data64(sqe, uring_tag(NULL, URING_OP_CANCEL));
+    }
+}
+
+/* Queue connection for the once-per-iteration send batch */
+static void uring_queue_send(uring_state_t *u, ct_connection_t *conn) {
+    if (conn->io_flags & (URING_QUEUED | URING_SEND_ARMED)) return;
+    conn->io_flags |= URING_QUEUED;
+    conn->io_next = u->send_queue;
+    u->send_queue = conn;
+}
+
+/* Begin closing - cancel the multishot recv; the connection is freed once
+ * its last in-flight operation completes */
+static void uring_close(uring_state_t *u, ct_connection_t *conn) {
+    if (conn->io_flags & URING_CLOSING) return;
+    conn->io_flags |= URING_CLOSING;
+    
+    /* No more requests are served, though destroy waits for the I/O */
+    ct_reactor_unmark_ready(conn->reactor, conn);
+    
+    if (conn->io_flags & URING_RECV_ARMED) {
+        struct io_uring_sqe *sqe = uring_sqe(u);
+        if (sqe) {
+            io_uring_prep_cancel64(sqe, uring_tag(conn, URING_OP_RECV), 0);
+            io_uring_sqe_set_data64(sqe, uring_tag(NULL, URING_OP_CANCEL));
+        }
+    }
+    uring_cancel_poll(u, conn);
+    
+    /* Unblocks any pending send as well */
+    shutdown(conn->fd, SHUT_RDWR);
+}
+
+/* Reactor hooks - used by timers to flush pings and close idle peers */
+static void uring_flush_hook(ct_reactor_t *reactor, ct_connection_t *conn) {
+    uring_queue_send(reactor->backend, conn);
+}
+
+static void uring_close_hook(ct_reactor_t *reactor, ct_connection_t *conn) {
+    uring_close(reactor->backend, conn);
+}
+
+static int uring_add_backend_hook(ct_reactor_t *reactor, int fd, ct_connection_t *conn) {
+    return uring_arm_poll(reactor->backend, conn, fd);
+}
+
+static void uring_remove_backend_hook(ct_reactor_t *reactor, ct_connection_t *conn) {
+    uring_cancel_poll(reactor->backend, conn);
+}
+
+static void uring_release(ct_reactor_t *reactor, ct_connection_t *conn) {
+    if (--conn->io_pending == 0 && (conn->io_flags & URING_CLOSING) &&
+        !(conn->io_flags & URING_QUEUED)) {
+        ct_connection_destroy(reactor, conn);
+    }
+}
+
+static void uring_handle_accept(uring_state_t *u, ct_reactor_t *reactor,
+                                struct io_uring_cqe *cqe) {
+    ct_server_t *server = reactor->server;
+    
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        /* Multishot terminated (e.g. ENFILE) - re-arm */
+        uring_arm_accept(u, reactor);
+    }
+    
+    int fd = cqe->res;
+    if (fd < 0) return;
+    
+    if (server->active_connections >= server->config.max_connections) {
+        close(fd);
+        return;
+    }
+    
+    ct_connection_t *conn = ct_connection_create(reactor, fd);
+    if (!conn) {
+        close(fd);
+        return;
+    }
+    
+    atomic_fetch_add(&server->active_connections, 1);
+    uring_arm_recv(u, conn);
+}
+
+static void uring_handle_recv(uring_state_t *u, ct_reactor_t *reactor,
+                              ct_connection_t *conn, struct io_uring_cqe *cqe) {
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        
+        if (!(conn->io_flags & URING_CLOSING)) {
+            const char *data = u->buf_base + (size_t)bid * CT_URING_BUF_SIZE;
+            size_t len = cqe->res;
+            
+            /* Land the bytes in the connection buffer, parse, and if the
+             * parser can't make room the peer is over its buffer budget */
+            size_t n = ct_ring_buffer_write(&conn->read_buf, data, len);
+            ct_connection_touch(conn);
+            
+            if (ct_connection_process(reactor->server, conn) < 0) {
+                uring_close(u, conn);
+            } else if (n < len) {
+                n += ct_ring_buffer_write(&conn->read_buf, data + n, len - n);
+                if (n < len) {
+                    uring_close(u, conn);
+                }
+            }
+            
+            if (ct_output_pending(conn)) {
+                uring_queue_send(u, conn);
+            }
+        }
+        
+        uring_recycle_buffer(u, bid);
+    } else if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS)) {
+        /* EOF, error or cancellation */
+        more = false;
+        uring_close(u, conn);
+    }
+    
+    if (!more) {
+        conn->io_flags &= ~URING_RECV_ARMED;
+        if (!(conn->io_flags & URING_CLOSING)) {
+            /* Terminated by ENOBUFS or the kernel - re-arm, reusing the
+             * pending reference */
+            uring_arm_recv(u, conn);
+            conn->io_pending--;
+        } else {
+            uring_release(reactor, conn);
+        }
+    }
+}
+
+/* The backend moved - pump the proxy as the epoll backend does on its
+ * readiness, and send whatever that produced for the client */
+static void uring_handle_poll(uring_state_t *u, ct_reactor_t *reactor,
+                              ct_connection_t *conn, struct io_uring_cqe *cqe) {
+    bool watching = (conn->io_flags & URING_POLL_ARMED) &&
+                    !(conn->io_flags & URING_CLOSING);
+    
+    if (cqe->res > 0 && watching && conn->is_proxying) {
+        ct_connection_touch(conn);
+        if (ct_connection_refill(conn) < 0) {
+            uring_close(u, conn);
+        } else if (ct_output_pending(conn)) {
+            uring_queue_send(u, conn);
+        }
+    }
+    
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        if (watching && cqe->res != -ECANCELED) {
+            /* Terminated by the kernel - re-arm, reusing the pending
+             * reference */
+            conn->io_flags &= ~URING_POLL_ARMED;
+            conn->io_pending--;
+            if (uring_arm_poll(u, conn, conn->io_backend_fd) < 0) {
+                uring_close(u, conn);
+            }
+            return;
+        }
+        conn->io_flags &= ~URING_POLL_ARMED;
+        uring_release(reactor, conn);
+    }
+}
+
+static void uring_handle_send(uring_state_t *u, ct_reactor_t *reactor,
+                              ct_connection_t *conn, struct io_uring_cqe *cqe) {
+    conn->io_flags &= ~URING_SEND_ARMED;
+    ct_ring_buffer_unpin(&conn->write_buf);
+    
+    if (cqe->res > 0) {
+        ct_output_consume(conn, cqe->res);
+        conn->last_activity = ct_now_ms();
+        
+        /* A streamed body, HTTP/2 streams, the terminal proxy or a held
+         * back WebSocket echo refill the output as it drains */
+        if ((conn->body_stream || conn->h2 || conn->is_proxying ||
+             conn->ws_blocked) &&
+            ct_connection_refill(conn) < 0) {
+            uring_close(u, conn);
+        } else if (ct_output_pending(conn)) {
+            uring_queue_send(u, conn);
+        } else if (conn->state == CT_CONN_CLOSING) {
+            uring_close(u, conn);
+        }
+    } else if (cqe->res != -EAGAIN) {
+        uring_close(u, conn);
+    } else {
+        uring_queue_send(u, conn);
+    }
+    
+    uring_release(reactor, conn);
+}
+
+/* Submit one send per dirty connection, straight out of its write ring */
+static void uring_flush_sends(uring_state_t *u, ct_reactor_t *reactor) {
+    ct_connection_t *conn = u->send_queue;
+    u->send_queue = NULL;
+    
+    while (conn) {
+        ct_connection_t *next = conn->io_next;
+        conn->io_flags &= ~URING_QUEUED;
+        conn->io_next = NULL;
+        
+        /* A file body is read a chunk at a time into a pool buffer -
+         * there's no sendfile from a completion */
+        if (!(conn->io_flags & URING_CLOSING) && conn->out_head &&
+            conn->out_head->type == CT_OUT_FILE && ct_output_stage_file(conn) < 0) {
+            uring_close(u, conn);
+        }
+        
+        if (conn->io_flags & URING_CLOSING) {
+            if (conn->io_pending == 0) {
+                ct_connection_destroy(reactor, conn);
+            }
+            conn = next;
+            continue;
+        }
+        
+        ct_ring_buffer_t *rb = &conn->write_buf;
+        struct iovec iov[1];
+        if (ct_output_iov(conn, iov, 1) > 0) {
+            /* First contiguous span of the output; the remainder goes out
+             * on the next completion */
+            struct io_uring_sqe *sqe = uring_sqe(u);
+            if (sqe) {
+                io_uring_prep_send(sqe, conn->fd, iov[0].iov_base, iov[0].iov_len,
+                                   MSG_NOSIGNAL);
+                io_uring_sqe_set_data64(sqe, uring_tag(conn, URING_OP_SEND));
+                conn->io_flags |= URING_SEND_ARMED;
+                conn->io_pending++;
+                
+                /* The kernel reads from the ring until completion - keep
+                 * the buffer alive if the ring grows, and out of the pool */
+                rb->pinned = true;
+            }
+        }
+        
+        conn = next;
+    }
+}
+
+int ct_uring_run(ct_reactor_t *reactor, const _Atomic bool *running) {
+    uring_state_t u;
+    memset(&u, 0, sizeof(u));
+    
+    if (uring_setup(&u) < 0) {
+        return 1;
+    }
+    
+    /* io_uring waits on the listener itself; a non-blocking listener would
+     * make older kernels complete the accept with -EAGAIN */
+    int flags = fcntl(reactor->listen_fd, F_GETFL, 0);
+    if (flags != -1) {
+        fcntl(reactor->listen_fd, F_SETFL, flags & ~O_NONBLOCK);
+    }
+    
+    reactor->backend = &u;
+    reactor->flush_connection = uring_flush_hook;
+    reactor->close_connection = uring_close_hook;
+    reactor->add_backend = uring_add_backend_hook;
+    reactor->remove_backend = uring_remove_backend_hook;
+    
+    uring_arm_accept(&u, reactor);
+    uring_arm_wake(&u, reactor);
+    
+    while (atomic_load_explicit(running, memory_order_relaxed)) {
+        /* One io_uring_enter per iteration: submits every queued SQE and
+         * waits for at least one completion or the next timer */
+        struct io_uring_cqe *cqe;
+        int timeout_ms = reactor->ready_head ? 0 :
+                         ct_timer_wheel_timeout(&reactor->timers, ct_now_ms());
+        struct __kernel_timespec timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_nsec = (timeout_ms % 1000) * 1000000L
+        };
+        uint64_t blocked = ct_cycles();
+        int ret = io_uring_submit_and_wait_timeout(&u.ring, &cqe, 1,
+                                                   timeout_ms < 0 ? NULL : &timeout,
+                                                   NULL);
+        uint64_t woke = ct_cycles();
+        ct_histogram_add(&reactor->stats.blocked, woke - blocked);
+        
+        /* One clock sample serves every completion in this batch */
+        ct_clock_update();
+        
+        if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+            fprintf(stderr, "io_uring_submit_and_wait: %s\n", strerror(-ret));
+            uring_teardown(&u);
+            return -1;
+        }
+        
+        unsigned head;
+        unsigned count = 0;
+        io_uring_for_each_cqe(&u.ring, head, cqe) {
+            uint64_t data = io_uring_cqe_get_data64(cqe);
+            unsigned op = data & URING_OP_MASK;
+            ct_connection_t *conn = (ct_connection_t *)(uintptr_t)(data & ~(uint64_t)URING_OP_MASK);
+            uint64_t start = ct_cycles();
+            
+            switch (op) {
+                case URING_OP_ACCEPT:
+                    uring_handle_accept(&u, reactor, cqe);
+                    ct_loop_stats_record(&reactor->stats, CT_LOOP_ACCEPT, start);
+                    break;
+                case URING_OP_WAKE: {
+                    uint64_t value;
+                    ssize_t n = read(reactor->wake_fd, &value, sizeof(value));
+                    (void)n;
+                    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                        uring_arm_wake(&u, reactor);
+                    }
+                    ct_reactor_handle_wake(reactor);
+                    ct_loop_stats_record(&reactor->stats, CT_LOOP_JOBS, start);
+                    break;
+                }
+                case URING_OP_RECV: {
+                    /* Classify first - the handler may free the connection */
+                    ct_loop_handler_t handler = ct_connection_handler_class(conn);
+                    uring_handle_recv(&u, reactor, conn, cqe);
+                    ct_loop_stats_record(&reactor->stats, handler, start);
+                    break;
+                }
+                case URING_OP_SEND:
+                    uring_handle_send(&u, reactor, conn, cqe);
+                    ct_loop_stats_record(&reactor->stats, CT_LOOP_WRITE, start);
+                    break;
+                case URING_OP_POLL:
+                    uring_handle_poll(&u, reactor, conn, cqe);
+                    ct_loop_stats_record(&reactor->stats, CT_LOOP_PROXY, start);
+                    break;
+                default:
+                    break;
+            }
+            count++;
+        }
+        io_uring_cq_advance(&u.ring, count);
+        
+        /* Pipelined requests left over from earlier passes */
+        ct_reactor_run_ready(reactor);
+        
+        /* Deadlines may queue pings or closes - run them before flushing */
+        uint64_t start = ct_cycles();
+        ct_timer_wheel_advance(&reactor->timers, ct_now_ms());
+        ct_loop_stats_record(&reactor->stats, CT_LOOP_TIMERS, start);
+        
+        /* Batched sends go out with the next submit_and_wait */
+        start = ct_cycles();
+        uring_flush_sends(&u, reactor);
+        ct_loop_stats_record(&reactor->stats, CT_LOOP_WRITE, start);
+        
+        ct_histogram_add(&reactor->stats.events, count);
+        ct_histogram_add(&reactor->stats.busy, ct_cycles() - woke);
+    }
+    
+    uring_teardown(&u);
+    return 0;
+}
+
+#else /* !CT_HAVE_IO_URING */
+
+int ct_uring_run(ct_reactor_t *reactor, const _Atomic bool *running) {
+    (void)reactor;
+    (void)running;
+    return 1;
+}
+
+#endif /* CT_HAVE_IO_URING */
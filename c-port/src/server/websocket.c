@@ -23,7 +23,7 @@ static const char b64_table[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 /* Fast base64 encode - optimized for SHA1 output (20 bytes) */
-static void base64_encode(const unsigned char *in, size_t in_len, char *out) {
+void ct_base64_encode(const unsigned char *in, size_t in_len, char *out) {
     size_t i, j;
     uint32_t buf;
     
@@ -52,34 +52,46 @@ static void base64_encode(const unsigned char *in, size_t in_len, char *out) {
 /* WebSocket handshake - generate accept key */
 int ct_ws_handshake(ct_connection_t *conn) {
     /* Find Sec-WebSocket-Key header */
-    const char *ws_key = ct_request_get_header(&conn->request, 
-                                               "Sec-WebSocket-Key");
-    if (!ws_key) return -1;
+    ct_header_t ws_key = ct_request_header(&conn->request, CT_HDR_SEC_WEBSOCKET_KEY);
+    if (!ws_key.value) return -1;
     
     /* Concatenate with GUID */
     char key_guid[256];
-    snprintf(key_guid, sizeof(key_guid), "%s%s", ws_key, WS_GUID);
+    snprintf(key_guid, sizeof(key_guid), "%.*s%s",
+             (int)ws_key.value_len, ws_key.value, WS_GUID);
     
     /* SHA1 hash */
     unsigned char hash[SHA_DIGEST_LENGTH];
     SHA1((unsigned char *)key_guid, strlen(key_guid), hash);
     
-    /* Base64 encode */
-    char accept_key[64];
-    base64_encode(hash, SHA_DIGEST_LENGTH, accept_key);
+    /* Base64 encode - headers hold pointers until the response is built */
+    static __thread char accept_key[64];
+    ct_base64_encode(hash, SHA_DIGEST_LENGTH, accept_key);
     
     /* Build response */
     ct_response_init(&conn->response, 101, "Switching Protocols");
-    ct_response_add_header(&conn->response, "Upgrade", "websocket");
-    ct_response_add_header(&conn->response, "Connection", "Upgrade");
+    ct_response_add_block(&conn->response, &ct_headers_upgrade);
     ct_response_add_header(&conn->response, "Sec-WebSocket-Accept", accept_key);
     
     /* Check for protocol */
-    const char *ws_protocol = ct_request_get_header(&conn->request,
-                                                   "Sec-WebSocket-Protocol");
-    if (ws_protocol) {
-        ct_response_add_header(&conn->response, "Sec-WebSocket-Protocol", 
-                              ws_protocol);
+    ct_header_t ws_protocol = ct_request_header(&conn->request,
+                                                CT_HDR_SEC_WEBSOCKET_PROTOCOL);
+    if (ws_protocol.value) {
+        ct_response_add_header_len(&conn->response, "Sec-WebSocket-Protocol",
+                                   ws_protocol.value, ws_protocol.value_len);
+    }
+    
+    /* permessage-deflate, if offered in a form we can take */
+    ct_header_t ws_extensions = ct_request_header(&conn->request,
+                                                  CT_HDR_SEC_WEBSOCKET_EXTENSIONS);
+    if (ws_extensions.value) {
+        static __thread char extensions[CT_WS_DEFLATE_RESPONSE_MAX];
+        size_t len = ct_ws_deflate_negotiate(conn, ws_extensions.value,
+                                             ws_extensions.value_len, extensions);
+        if (len > 0) {
+            ct_response_add_header_len(&conn->response, "Sec-WebSocket-Extensions",
+                                       extensions, len);
+        }
     }
     
     conn->is_websocket = true;
@@ -88,121 +100,322 @@ int ct_ws_handshake(ct_connection_t *conn) {
     return 0;
 }
 
-/* Parse WebSocket frame - optimized for common cases */
-int ct_ws_parse_frame(const char *data, size_t len, ct_ws_opcode_t *opcode,
-                      const char **payload, size_t *payload_len) {
-    if (len < 2) return -1; /* Need at least 2 bytes for header */
+/* Fill in a piece of the current data frame - n payload bytes at data,
+ * unmasked here, each exactly once */
+static int ws_read_payload(ct_ws_rx_t *rx, char *data, size_t n,
+                           size_t header_len, ct_ws_piece_t *piece) {
+    if (rx->masked && n > 0) {
+        ct_ws_unmask(data, n, rx->mask_key, rx->frame_pos);
+    }
+    rx->frame_pos += n;
+    rx->frame_left -= n;
+    rx->in_frame = rx->frame_left > 0;
+    rx->consumed = header_len + n;
+    
+    piece->data = data;
+    piece->len = n;
+    piece->opcode = rx->message_opcode;
+    piece->first = rx->message_first;
+    piece->fin = !rx->in_frame && rx->frame_fin;
+    piece->compressed = rx->message_compressed;
+    
+    rx->message_first = false;
+    if (piece->fin) {
+        rx->message_opcode = CT_WS_CONTINUATION;
+    }
+    return 1;
+}
+
+/* Read the next piece of WebSocket input from rb: a whole control frame,
+ * a whole data frame up to CT_WS_FRAME_WHOLE, or as much of a larger one
+ * as has arrived, up to the same size - so a piece always fits whatever
+ * it is copied into next. Payloads are unmasked in place. The last piece's bytes
+ * are consumed on the next call, so it stays valid until then. With
+ * deflate (permessage-deflate negotiated) RSV1 may mark a message as
+ * compressed. Returns 1 with a piece, 0 if more input is needed, -1 on a
+ * protocol error. */
+int ct_ws_read(ct_ws_rx_t *rx, ct_ring_buffer_t *rb, bool deflate,
+               ct_ws_piece_t *piece) {
+    if (rx->consumed > 0) {
+        ct_ring_buffer_skip(rb, rx->consumed);
+        rx->consumed = 0;
+    }
     
-    const uint8_t *p = (const uint8_t *)data;
+    size_t available;
+    char *buf = (char *)ct_ring_buffer_peek_ptr(rb, &available);
+    if (available == 0) return 0;
+    
+    /* The rest of a large frame, as it arrives */
+    if (rx->in_frame) {
+        size_t n = available < rx->frame_left ? available : (size_t)rx->frame_left;
+        if (n > CT_WS_FRAME_WHOLE) n = CT_WS_FRAME_WHOLE;
+        return ws_read_payload(rx, buf, n, 0, piece);
+    }
+    
+    if (available < 2) return 0; /* Need at least 2 bytes for header */
+    
+    const uint8_t *p = (const uint8_t *)buf;
     
     /* Parse first byte */
-    uint8_t fin = (p[0] >> 7) & 0x01;
+    bool fin = p[0] & 0x80;
     uint8_t rsv = (p[0] >> 4) & 0x07;
-    *opcode = (ct_ws_opcode_t)(p[0] & 0x0F);
+    ct_ws_opcode_t opcode = (ct_ws_opcode_t)(p[0] & 0x0F);
+    bool control = opcode & 0x8;
+    
+    /* Control frames are whole and short, and may come between the
+     * fragments of a message; data frames start a message or continue
+     * the one in progress */
+    if (control) {
+        if (!fin || opcode > CT_WS_PONG) return -1;
+    } else if (opcode == CT_WS_CONTINUATION) {
+        if (rx->message_opcode == CT_WS_CONTINUATION) return -1;
+    } else if (opcode > CT_WS_BINARY || rx->message_opcode != CT_WS_CONTINUATION) {
+        return -1;
+    }
     
-    /* We don't support fragmented frames for simplicity */
-    if (!fin) return -2;
-    if (rsv != 0) return -2; /* No extensions supported */
+    /* RSV1 marks a compressed message, on its first frame only */
+    if ((rsv & 0x3) ||
+        ((rsv & 0x4) && (!deflate || control || opcode == CT_WS_CONTINUATION))) {
+        return -1;
+    }
     
     /* Parse second byte */
-    uint8_t mask = (p[1] >> 7) & 0x01;
+    bool mask = p[1] & 0x80;
     uint64_t plen = p[1] & 0x7F;
-    
     size_t header_len = 2;
     
     /* Extended payload length */
     if (plen == 126) {
-        if (len < 4) return -1;
-        plen = ntohs(*(uint16_t *)(p + 2));
+        if (available < 4) return 0;
+        plen = (uint64_t)p[2] << 8 | p[3];
         header_len = 4;
     } else if (plen == 127) {
-        if (len < 10) return -1;
-        /* We don't support >4GB frames */
-        uint32_t high = ntohl(*(uint32_t *)(p + 2));
-        if (high != 0) return -2;
-        plen = ntohl(*(uint32_t *)(p + 6));
+        if (available < 10) return 0;
+        plen = 0;
+        for (int i = 2; i < 10; i++) {
+            plen = plen << 8 | p[i];
+        }
+        if (plen >> 63) return -1;
         header_len = 10;
     }
+    if (control && plen > 125) return -1;
     
     /* Masking key */
-    const uint8_t *mask_key = NULL;
     if (mask) {
-        if (len < header_len + 4) return -1;
-        mask_key = p + header_len;
+        if (available < header_len + 4) return 0;
+        memcpy(rx->mask_key, p + header_len, 4);
         header_len += 4;
     }
     
-    /* Check if we have complete frame */
-    if (len < header_len + plen) return -1;
+    /* Frames that fit the buffer are handed on whole */
+    if (plen <= CT_WS_FRAME_WHOLE && available < header_len + plen) return 0;
     
-    *payload = (const char *)(p + header_len);
-    *payload_len = plen;
+    if (control) {
+        if (mask && plen > 0) {
+            ct_ws_unmask(buf + header_len, plen, rx->mask_key, 0);
+        }
+        rx->consumed = header_len + plen;
+        
+        piece->data = buf + header_len;
+        piece->len = plen;
+        piece->opcode = opcode;
+        piece->first = true;
+        piece->fin = true;
+        piece->compressed = false;
+        return 1;
+    }
+    
+    if (opcode != CT_WS_CONTINUATION) {
+        rx->message_opcode = opcode;
+        rx->message_compressed = rsv & 0x4;
+        rx->message_first = true;
+        rx->message_len = 0;
+    }
+    rx->masked = mask;
+    rx->frame_fin = fin;
+    rx->frame_left = plen;
+    rx->frame_pos = 0;
+    
+    size_t n = available - header_len;
+    if (n > plen) n = plen;
+    if (n > CT_WS_FRAME_WHOLE) n = CT_WS_FRAME_WHOLE;
+    
+    /* Only the header of a large frame so far */
+    if (n == 0 && plen > 0) {
+        rx->in_frame = true;
+        rx->consumed = header_len;
+        return ct_ws_read(rx, rb, deflate, piece);
+    }
+    
+    return ws_read_payload(rx, buf + header_len, n, header_len, piece);
+}
+
+/* Hand a piece on, chunk by chunk - the inflater already has its input.
+ * A chunk fn takes but reports full (1) after pauses the piece: what is
+ * left stays in the inflater, and the piece's bytes in the read buffer,
+ * until ct_ws_deliver_resume. */
+static int deliver_chunks(ct_connection_t *conn, ct_ws_piece_t *piece,
+                          ct_ws_piece_fn fn) {
+    ct_ws_rx_t *rx = &conn->ws_rx;
+    size_t limit = conn->server->config.ws_max_message;
+    if (limit == 0) limit = CT_WS_MAX_MESSAGE;
     
-    /* Unmask payload in-place if needed (modifies input!) */
-    if (mask && plen > 0) {
-        uint8_t *payload_data = (uint8_t *)*payload;
+    const char *data = piece->data;
+    size_t len = piece->len;
+    int more = 0;
+    
+    do {
+        if (piece->compressed) {
+            more = ct_ws_inflate_next(conn, &data, &len);
+            if (more < 0) {
+                ct_ws_send_close(conn, 1007, "Invalid compressed data");
+                conn->state = CT_CONN_CLOSING;
+                return -1;
+            }
+        }
         
-        /* Optimized unmasking - process 4 bytes at a time */
-        size_t i;
-        for (i = 0; i + 3 < plen; i += 4) {
-            *(uint32_t *)(payload_data + i) ^= *(uint32_t *)mask_key;
+        rx->message_len += len;
+        if (rx->message_len > limit) {
+            ct_ws_send_close(conn, 1009, "Message too big");
+            conn->state = CT_CONN_CLOSING;
+            return -1;
         }
         
-        /* Handle remaining bytes */
-        for (; i < plen; i++) {
-            payload_data[i] ^= mask_key[i & 3];
+        int rc = fn(conn, piece->opcode, data, len, piece->first, piece->fin && !more);
+        if (rc < 0) return -1;
+        piece->first = false;
+        
+        if (rc > 0) {
+            if (more) {
+                rx->pending = *piece;
+                rx->paused = true;
+            }
+            return 1;
         }
+    } while (more);
+    
+    return 0;
+}
+
+/* Pass a piece of a data message on to fn as plain bytes - inflated,
+ * chunk by chunk, if compressed - counting them against ws_max_message.
+ * fn returns 1 once it has taken a chunk but can take no more for now,
+ * and delivery stops there; so does this, returning 1, and the caller
+ * stops reading until ct_ws_deliver_resume has finished the piece.
+ * Returns -1 if the connection must close: fn failed, or the message is
+ * corrupt or too big (the close frame is queued). */
+int ct_ws_deliver(ct_connection_t *conn, const ct_ws_piece_t *piece,
+                  ct_ws_piece_fn fn) {
+    ct_ws_piece_t current = *piece;
+    
+    if (piece->compressed) {
+        ct_ws_inflate_begin(conn, piece->data, piece->len, piece->fin);
     }
     
-    return header_len + plen; /* Total frame size */
+    return deliver_chunks(conn, &current, fn);
 }
 
-/* Build WebSocket frame - optimized for server->client (no masking) */
-int ct_ws_build_frame(ct_ws_opcode_t opcode, const char *payload,
-                      size_t payload_len, char *buf, size_t buf_len) {
-    if (buf_len < 2 + payload_len) return -1;
+/* Carry on with a piece paused by a full sink - its input is still the
+ * last bytes ct_ws_read handed out, wherever the read buffer now has
+ * them. Returns 0 once it is done (or if none was paused), 1 if the sink
+ * filled again, -1 as ct_ws_deliver. */
+int ct_ws_deliver_resume(ct_connection_t *conn, ct_ws_piece_fn fn) {
+    ct_ws_rx_t *rx = &conn->ws_rx;
+    if (!rx->paused) return 0;
     
-    uint8_t *p = (uint8_t *)buf;
-    size_t header_len;
+    size_t available;
+    const char *buf = ct_ring_buffer_peek_ptr(&conn->read_buf, &available);
+    ct_ws_inflate_rebase(conn, buf + rx->consumed);
     
-    /* First byte: FIN=1, RSV=0, Opcode */
-    p[0] = 0x80 | (opcode & 0x0F);
+    rx->paused = false;
+    rx->pending.data = NULL;
+    rx->pending.len = 0;
+    return deliver_chunks(conn, &rx->pending, fn);
+}
+
+/* Install the consumer for a connection's messages */
+void ct_ws_set_handler(ct_connection_t *conn, ct_ws_handler_t *handler) {
+    conn->ws_handler = handler;
+}
+
+/* Frame header for len payload bytes after first byte b0; returns its
+ * length (at most 10) */
+static size_t ws_frame_header(uint8_t *p, uint8_t b0, size_t len) {
+    p[0] = b0;
     
     /* Payload length encoding */
-    if (payload_len < 126) {
-        p[1] = payload_len;
-        header_len = 2;
-    } else if (payload_len < 65536) {
-        if (buf_len < 4 + payload_len) return -1;
+    if (len < 126) {
+        p[1] = len;
+        return 2;
+    }
+    if (len < 65536) {
         p[1] = 126;
-        *(uint16_t *)(p + 2) = htons(payload_len);
-        header_len = 4;
-    } else {
-        if (buf_len < 10 + payload_len) return -1;
-        p[1] = 127;
-        *(uint32_t *)(p + 2) = 0; /* High 32 bits */
-        *(uint32_t *)(p + 6) = htonl(payload_len);
-        header_len = 10;
+        p[2] = len >> 8;
+        p[3] = len & 0xFF;
+        return 4;
+    }
+    p[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        p[2 + i] = (uint64_t)len >> (56 - 8 * i);
     }
+    return 10;
+}
+
+/* Build WebSocket frame - optimized for server->client (no masking) */
+int ct_ws_build_frame(ct_ws_opcode_t opcode, const char *payload,
+                      size_t payload_len, char *buf, size_t buf_len) {
+    uint8_t header[10];
+    
+    /* First byte: FIN=1, RSV=0, Opcode */
+    size_t header_len = ws_frame_header(header, 0x80 | (opcode & 0x0F), payload_len);
+    if (buf_len < header_len + payload_len) return -1;
+    
+    memcpy(buf, header, header_len);
     
     /* Copy payload */
     if (payload && payload_len > 0) {
-        memcpy(p + header_len, payload, payload_len);
+        memcpy(buf + header_len, payload, payload_len);
     }
     
     return header_len + payload_len;
 }
 
+/* Send one piece of a message as a frame of its own - the first with the
+ * opcode, the rest as continuations, FIN on the last - so a message need
+ * never be whole in memory. A message sent in one piece is compressed
+ * (once, before framing) when permessage-deflate was negotiated; each
+ * message may choose, so fragmented ones go as they are. Returns bytes
+ * queued, -1 if the frame can't be. */
+int ct_ws_send_fragment(ct_connection_t *conn, ct_ws_opcode_t opcode,
+                        const char *data, size_t len, bool first, bool fin) {
+    uint8_t b0 = (fin ? 0x80 : 0) | (first ? (opcode & 0x0F) : CT_WS_CONTINUATION);
+    
+    if (first && fin && conn->ws_deflate &&
+        len >= CT_WS_DEFLATE_MIN && len <= CT_BUFFER_SIZE &&
+        (opcode == CT_WS_TEXT || opcode == CT_WS_BINARY)) {
+        if (ct_ws_deflate_message(conn, data, len, &data, &len) < 0) return -1;
+        
+        /* RSV1 - the message is compressed */
+        b0 |= 0x40;
+    }
+    
+    uint8_t header[10];
+    size_t header_len = ws_frame_header(header, b0, len);
+    
+    /* All or nothing - half a frame would desynchronise the stream */
+    if (ct_ring_buffer_reserve(&conn->write_buf, header_len + len) < header_len + len) {
+        return -1;
+    }
+    
+    ct_ring_buffer_write(&conn->write_buf, (const char *)header, header_len);
+    ct_ring_buffer_write(&conn->write_buf, data, len);
+    return (int)(header_len + len);
+}
+
 /* Send WebSocket message */
 int ct_ws_send_message(ct_connection_t *conn, ct_ws_opcode_t opcode,
                        const char *data, size_t len) {
-    char frame[CT_BUFFER_SIZE];
-    
-    int frame_len = ct_ws_build_frame(opcode, data, len, frame, sizeof(frame));
-    if (frame_len < 0) return -1;
-    
-    /* Write to connection buffer */
-    return ct_ring_buffer_write(&conn->write_buf, frame, frame_len);
+    return ct_ws_send_fragment(conn, opcode, data, len, true, true);
 }
 
 /* Send WebSocket text message */
@@ -253,27 +466,28 @@ int ct_ws_process_frame(ct_connection_t *conn, ct_ws_opcode_t opcode,
         case CT_WS_BINARY:
             /* Application should handle these */
             return 0;
-            
+        
         case CT_WS_CLOSE:
             /* Echo close frame and mark for closing */
             if (payload_len >= 2) {
-                uint16_t code = ntohs(*(uint16_t *)payload);
-                const char *reason = (payload_len > 2) ? payload + 2 : NULL;
-                ct_ws_send_close(conn, code, reason);
+                /* The code alone - the reason isn't NUL-terminated */
+                uint16_t code = (uint16_t)((uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+                ct_ws_send_close(conn, code, NULL);
             } else {
                 ct_ws_send_close(conn, 1000, "Normal closure");
             }
             conn->state = CT_CONN_CLOSING;
             return 0;
-            
+        
         case CT_WS_PING:
             /* Reply with pong */
             return ct_ws_send_pong(conn, payload, payload_len);
-            
+        
         case CT_WS_PONG:
-            /* Ignore pongs */
+            /* Answers our keepalive ping */
+            conn->ws_ping_sent = 0;
             return 0;
-            
+        
         default:
             /* Unknown opcode */
             ct_ws_send_close(conn, 1002, "Protocol error");
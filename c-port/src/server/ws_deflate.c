@@ -0,0 +1,358 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/* permessage-deflate (RFC 7692). Each message is one raw deflate stream
+ * flushed with Z_SYNC_FLUSH, its trailing 00 00 ff ff dropped; with
+ * context takeover (the default) both directions keep their window
+ * across messages, which is where terminal output - prompts, escape
+ * sequences, repeated lines - compresses best. The zlib streams are
+ * large (a 15-bit deflate window is ~256 KB), so each reactor keeps a
+ * free list of reset ones for the next WebSocket instead of freeing. */
+
+#define DEFLATE_MEM_LEVEL 8
+#define DEFLATE_LEVEL     6
+
+struct ct_ws_deflate {
+    z_stream deflate;           /* to the client */
+    z_stream inflate;           /* from the client */
+    int window_bits;            /* deflate window, as negotiated */
+    bool reset_deflate;         /* server_no_context_takeover */
+    bool reset_inflate;         /* client_no_context_takeover */
+    bool inflate_tail;          /* message's flush tail still to feed */
+    bool inflate_fin;           /* input is the message's last piece */
+    struct ct_ws_deflate *next; /* reactor free list */
+};
+
+static const uint8_t sync_tail[4] = {0x00, 0x00, 0xff, 0xff};
+
+static ct_ws_deflate_t *deflate_create(int window_bits) {
+    ct_ws_deflate_t *wd = calloc(1, sizeof(ct_ws_deflate_t));
+    if (!wd) return NULL;
+    
+    /* Negative bits - raw deflate, no zlib header */
+    if (deflateInit2(&wd->deflate, DEFLATE_LEVEL, Z_DEFLATED, -window_bits,
+                     DEFLATE_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(wd);
+        return NULL;
+    }
+    if (inflateInit2(&wd->inflate, -15) != Z_OK) {
+        deflateEnd(&wd->deflate);
+        free(wd);
+        return NULL;
+    }
+    
+    wd->window_bits = window_bits;
+    return wd;
+}
+
+static void deflate_destroy(ct_ws_deflate_t *wd) {
+    deflateEnd(&wd->deflate);
+    inflateEnd(&wd->inflate);
+    free(wd);
+}
+
+/* A stream with this window - from the reactor's free list when the
+ * window is the configured one, which is what nearly every client gets */
+static ct_ws_deflate_t *deflate_acquire(ct_reactor_t *reactor, int window_bits) {
+    ct_ws_deflate_t *wd = reactor->deflate_pool;
+    
+    if (wd && wd->window_bits == window_bits) {
+        reactor->deflate_pool = wd->next;
+        reactor->deflate_pool_count--;
+        wd->next = NULL;
+        return wd;
+    }
+    
+    return deflate_create(window_bits);
+}
+
+/* Back to the free list, reset - or freed if the list is full or the
+ * window is one the next client is unlikely to ask for */
+void ct_ws_deflate_release(ct_connection_t *conn) {
+    ct_ws_deflate_t *wd = conn->ws_deflate;
+    ct_reactor_t *reactor = conn->reactor;
+    if (!wd) return;
+    
+    conn->ws_deflate = NULL;
+    
+    if (reactor->deflate_pool_count >= CT_WS_DEFLATE_POOL ||
+        wd->window_bits != conn->server->config.ws_deflate_window_bits) {
+        deflate_destroy(wd);
+        return;
+    }
+    
+    deflateReset(&wd->deflate);
+    inflateReset(&wd->inflate);
+    wd->reset_deflate = false;
+    wd->reset_inflate = false;
+    wd->inflate_tail = false;
+    wd->inflate_fin = false;
+    wd->next = reactor->deflate_pool;
+    reactor->deflate_pool = wd;
+    reactor->deflate_pool_count++;
+}
+
+void ct_ws_deflate_pool_destroy(ct_reactor_t *reactor) {
+    while (reactor->deflate_pool) {
+        ct_ws_deflate_t *wd = reactor->deflate_pool;
+        reactor->deflate_pool = wd->next;
+        deflate_destroy(wd);
+    }
+    reactor->deflate_pool_count = 0;
+}
+
+/* One permessage-deflate offer's parameters */
+typedef struct {
+    bool server_no_context_takeover;
+    bool client_no_context_takeover;
+    int server_max_window_bits;     /* 0 if absent */
+    int client_max_window_bits;     /* 0 if absent, -1 if without a value */
+} deflate_offer_t;
+
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static bool token_is(const char *p, size_t len, const char *token) {
+    return strlen(token) == len && strncasecmp(p, token, len) == 0;
+}
+
+/* "8".."15", optionally quoted */
+static int parse_window_bits(const char *p, size_t len) {
+    if (len >= 2 && p[0] == '"' && p[len - 1] == '"') {
+        p++;
+        len -= 2;
+    }
+    if (len == 0 || len > 2) return -1;
+    
+    int bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] < '0' || p[i] > '9') return -1;
+        bits = bits * 10 + (p[i] - '0');
+    }
+    return bits >= 8 && bits <= 15 ? bits : -1;
+}
+
+/* Parse one offer - the text between commas. Returns false if it isn't
+ * permessage-deflate or has a parameter we must not accept (unknown,
+ * repeated or out of range). */
+static bool parse_offer(const char *p, const char *end, deflate_offer_t *offer) {
+    memset(offer, 0, sizeof(*offer));
+    
+    const char *semi = memchr(p, ';', end - p);
+    const char *name_end = semi ? semi : end;
+    p = skip_ws(p, name_end);
+    while (name_end > p && (name_end[-1] == ' ' || name_end[-1] == '\t')) name_end--;
+    if (!token_is(p, name_end - p, "permessage-deflate")) return false;
+    
+    while (semi) {
+        p = skip_ws(semi + 1, end);
+        semi = memchr(p, ';', end - p);
+        const char *param_end = semi ? semi : end;
+        while (param_end > p && (param_end[-1] == ' ' || param_end[-1] == '\t')) param_end--;
+        
+        const char *eq = memchr(p, '=', param_end - p);
+        const char *name_stop = eq ? eq : param_end;
+        while (name_stop > p && (name_stop[-1] == ' ' || name_stop[-1] == '\t')) name_stop--;
+        size_t name_len = name_stop - p;
+        const char *value = eq ? skip_ws(eq + 1, param_end) : NULL;
+        size_t value_len = eq ? (size_t)(param_end - value) : 0;
+        
+        if (token_is(p, name_len, "server_no_context_takeover")) {
+            if (eq || offer->server_no_context_takeover) return false;
+            offer->server_no_context_takeover = true;
+        } else if (token_is(p, name_len, "client_no_context_takeover")) {
+            if (eq || offer->client_no_context_takeover) return false;
+            offer->client_no_context_takeover = true;
+        } else if (token_is(p, name_len, "server_max_window_bits")) {
+            if (!eq || offer->server_max_window_bits) return false;
+            offer->server_max_window_bits = parse_window_bits(value, value_len);
+            if (offer->server_max_window_bits < 0) return false;
+        } else if (token_is(p, name_len, "client_max_window_bits")) {
+            if (offer->client_max_window_bits) return false;
+            offer->client_max_window_bits = eq ? parse_window_bits(value, value_len) : -1;
+            if (eq && offer->client_max_window_bits < 0) return false;
+        } else {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static char *put_str(char *p, const char *s) {
+    size_t len = strlen(s);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static char *put_bits(char *p, const char *name, int bits) {
+    p = put_str(p, name);
+    if (bits >= 10) *p++ = '1';
+    *p++ = (char)('0' + bits % 10);
+    return p;
+}
+
+/* Accept the first permessage-deflate offer in a Sec-WebSocket-Extensions
+ * value we can honour, attaching a compressor to conn. Writes the
+ * response value to out (at least CT_WS_DEFLATE_RESPONSE_MAX bytes) and
+ * returns its length, or 0 if no offer was accepted. */
+size_t ct_ws_deflate_negotiate(ct_connection_t *conn, const char *value,
+                               size_t value_len, char *out) {
+    int max_bits = conn->server->config.ws_deflate_window_bits;
+    const char *p = value;
+    const char *end = value + value_len;
+    
+    if (max_bits <= 0 || conn->ws_deflate) return 0;
+    
+    while (p < end) {
+        const char *comma = memchr(p, ',', end - p);
+        const char *offer_end = comma ? comma : end;
+        deflate_offer_t offer;
+        
+        if (parse_offer(p, offer_end, &offer)) {
+            int bits = max_bits;
+            if (offer.server_max_window_bits && offer.server_max_window_bits < bits) {
+                bits = offer.server_max_window_bits;
+            }
+            
+            /* zlib can't produce an 8-bit raw window - decline, the client
+             * may have a fallback offer */
+            if (bits >= 9) {
+                ct_ws_deflate_t *wd = deflate_acquire(conn->reactor, bits);
+                if (!wd) return 0;
+                
+                wd->reset_deflate = offer.server_no_context_takeover;
+                wd->reset_inflate = offer.client_no_context_takeover;
+                conn->ws_deflate = wd;
+                
+                char *q = put_str(out, "permessage-deflate");
+                if (offer.server_no_context_takeover) {
+                    q = put_str(q, "; server_no_context_takeover");
+                }
+                if (offer.client_no_context_takeover) {
+                    q = put_str(q, "; client_no_context_takeover");
+                }
+                if (offer.server_max_window_bits) {
+                    q = put_bits(q, "; server_max_window_bits=", bits);
+                }
+                return q - out;
+            }
+        }
+        
+        p = comma ? comma + 1 : end;
+    }
+    
+    return 0;
+}
+
+/* Compress one message. The result is in a thread-local buffer, valid
+ * until the next call. Returns -1 if the stream failed - the connection
+ * can't continue, as the peer's window would no longer match. */
+int ct_ws_deflate_message(ct_connection_t *conn, const char *data, size_t len,
+                          const char **out, size_t *out_len) {
+    static __thread char buf[CT_BUFFER_SIZE + 1024];
+    ct_ws_deflate_t *wd = conn->ws_deflate;
+    z_stream *zs = &wd->deflate;
+    
+    if (len > CT_BUFFER_SIZE) return -1;
+    
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+    zs->next_out = (Bytef *)buf;
+    zs->avail_out = sizeof(buf);
+    
+    /* A sync flush of at most CT_BUFFER_SIZE input always fits */
+    if (deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in != 0 || zs->avail_out == 0) {
+        return -1;
+    }
+    
+    size_t n = sizeof(buf) - zs->avail_out;
+    if (n < 4 || memcmp(buf + n - 4, sync_tail, 4) != 0) return -1;
+    
+    if (wd->reset_deflate) {
+        deflateReset(zs);
+    }
+    
+    *out = buf;
+    *out_len = n - 4;
+    return 0;
+}
+
+/* Start decompressing a piece of a message - fin if it is the last,
+ * which restores the flush tail the sender dropped. The output comes
+ * from ct_ws_inflate_next, so a small piece can inflate to any size
+ * without a buffer that holds it all. */
+void ct_ws_inflate_begin(ct_connection_t *conn, const char *data, size_t len,
+                         bool fin) {
+    ct_ws_deflate_t *wd = conn->ws_deflate;
+    
+    wd->inflate.next_in = (Bytef *)data;
+    wd->inflate.avail_in = (uInt)len;
+    wd->inflate_tail = fin;
+    wd->inflate_fin = fin;
+}
+
+/* The piece being inflated now ends at end - its buffer moved while
+ * delivery was paused. The flush tail, if that is what is being fed,
+ * stays where it is. */
+void ct_ws_inflate_rebase(ct_connection_t *conn, const char *end) {
+    z_stream *zs = &conn->ws_deflate->inflate;
+    const Bytef *tail = sync_tail;
+    
+    if (zs->next_in >= tail && zs->next_in <= tail + sizeof(sync_tail)) return;
+    zs->next_in = (Bytef *)end - zs->avail_in;
+}
+
+/* The next chunk of output, in a thread-local buffer valid until the
+ * next call. Returns 1 if more follows, 0 if this was the piece's last
+ * (possibly empty), -1 if the data is corrupt. */
+int ct_ws_inflate_next(ct_connection_t *conn, const char **out, size_t *out_len) {
+    static __thread char buf[CT_BUFFER_SIZE];
+    ct_ws_deflate_t *wd = conn->ws_deflate;
+    z_stream *zs = &wd->inflate;
+    
+    zs->next_out = (Bytef *)buf;
+    zs->avail_out = sizeof(buf);
+    
+    while (zs->avail_out > 0) {
+        /* The payload, then the tail - not written after the payload,
+         * which sits in the read buffer before the next frame */
+        if (zs->avail_in == 0 && wd->inflate_tail) {
+            zs->next_in = (Bytef *)sync_tail;
+            zs->avail_in = sizeof(sync_tail);
+            wd->inflate_tail = false;
+        }
+        
+        int rc = inflate(zs, Z_SYNC_FLUSH);
+        if (rc == Z_STREAM_END) {
+            /* A final block - what follows starts a new stream */
+            inflateReset(zs);
+        } else if (rc == Z_BUF_ERROR) {
+            /* No progress - out of input, or corrupt if not */
+            if (zs->avail_in > 0) return -1;
+            break;
+        } else if (rc != Z_OK) {
+            return -1;
+        }
+        
+        if (zs->avail_in == 0 && !wd->inflate_tail) break;
+    }
+    
+    *out = buf;
+    *out_len = sizeof(buf) - zs->avail_out;
+    
+    /* A full buffer may have more behind it */
+    if (zs->avail_out == 0 || zs->avail_in > 0 || wd->inflate_tail) {
+        return 1;
+    }
+    
+    if (wd->inflate_fin && wd->reset_inflate) {
+        inflateReset(zs);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "terminal.h"
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MASK_X86 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MASK_NEON 1
+#endif
+
+/* WebSocket payload unmasking (RFC 6455 5.3): byte i of the payload is
+ * XORed with key[i % 4]. The key is rotated once to the starting offset
+ * and broadcast to a word or vector; the vector versions go through
+ * unaligned loads, the portable one steps up to an 8-byte boundary
+ * first, so nothing needs a cast or an aligned payload. The
+ * implementation is picked once at startup, as for the HTTP scanners. */
+
+/* The key as a native word, rotated so its first byte is key[pos % 4] */
+static inline uint32_t key_word(const uint8_t key[4], uint64_t pos) {
+    uint32_t k;
+    unsigned r = (unsigned)(pos & 3) * 8;
+    
+    memcpy(&k, key, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return k << r | k >> ((32 - r) & 31);
+#else
+    return k >> r | k << ((32 - r) & 31);
+#endif
+}
+
+/* Portable - 8 bytes per step once aligned, through memcpy */
+static void unmask_scalar(uint8_t *p, size_t len, const uint8_t key[4], uint64_t pos) {
+    size_t head = (size_t)(-(uintptr_t)p & 7);
+    if (head > len) head = len;
+    
+    for (size_t i = 0; i < head; i++) {
+        p[i] ^= key[(pos + i) & 3];
+    }
+    p += head;
+    len -= head;
+    pos += head;
+    
+    uint32_t k = key_word(key, pos);
+    uint64_t mask = (uint64_t)k << 32 | k;
+    
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= mask;
+        memcpy(p, &v, 8);
+    }
+    
+    /* The mask's bytes in payload order - pos moved by a multiple of 4 */
+    uint8_t tail[8];
+    memcpy(tail, &mask, 8);
+    for (size_t i = 0; i < len; i++) {
+        p[i] ^= tail[i];
+    }
+}
+
+#ifdef MASK_X86
+
+__attribute__((target("sse2")))
+static void unmask_sse2(uint8_t *p, size_t len, const uint8_t key[4], uint64_t pos) {
+    __m128i mask = _mm_set1_epi32((int)key_word(key, pos));
+    size_t i = 0;
+    
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(p + i + 48));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_xor_si128(a, mask));
+        _mm_storeu_si128((__m128i *)(p + i + 16), _mm_xor_si128(b, mask));
+        _mm_storeu_si128((__m128i *)(p + i + 32), _mm_xor_si128(c, mask));
+        _mm_storeu_si128((__m128i *)(p + i + 48), _mm_xor_si128(d, mask));
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_xor_si128(a, mask));
+    }
+    
+    if (i < len) {
+        unmask_scalar(p + i, len - i, key, pos + i);
+    }
+}
+
+__attribute__((target("avx2")))
+static void unmask_avx2(uint8_t *p, size_t len, const uint8_t key[4], uint64_t pos) {
+    __m256i mask = _mm256_set1_epi32((int)key_word(key, pos));
+    size_t i = 0;
+    
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(p + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(p + i + 96));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_xor_si256(a, mask));
+        _mm256_storeu_si256((__m256i *)(p + i + 32), _mm256_xor_si256(b, mask));
+        _mm256_storeu_si256((__m256i *)(p + i + 64), _mm256_xor_si256(c, mask));
+        _mm256_storeu_si256((__m256i *)(p + i + 96), _mm256_xor_si256(d, mask));
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_xor_si256(a, mask));
+    }
+    
+    /* Here rather than through unmask_sse2 - calling legacy SSE code with
+     * the upper halves dirty stalls on the state transition */
+    if (i + 16 <= len) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        _mm_storeu_si128((__m128i *)(p + i),
+                         _mm_xor_si128(a, _mm256_castsi256_si128(mask)));
+        i += 16;
+    }
+    
+    if (i < len) {
+        unmask_scalar(p + i, len - i, key, pos + i);
+    }
+}
+
+#endif /* MASK_X86 */
+
+#ifdef MASK_NEON
+
+static void unmask_neon(uint8_t *p, size_t len, const uint8_t key[4], uint64_t pos) {
+    uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(key_word(key, pos)));
+    size_t i = 0;
+    
+    for (; i + 64 <= len; i += 64) {
+        vst1q_u8(p + i, veorq_u8(vld1q_u8(p + i), mask));
+        vst1q_u8(p + i + 16, veorq_u8(vld1q_u8(p + i + 16), mask));
+        vst1q_u8(p + i + 32, veorq_u8(vld1q_u8(p + i + 32), mask));
+        vst1q_u8(p + i + 48, veorq_u8(vld1q_u8(p + i + 48), mask));
+    }
+    for (; i + 16 <= len; i += 16) {
+        vst1q_u8(p + i, veorq_u8(vld1q_u8(p + i), mask));
+    }
+    
+    if (i < len) {
+        unmask_scalar(p + i, len - i, key, pos + i);
+    }
+}
+
+#endif /* MASK_NEON */
+
+typedef struct {
+    const char *name;
+    void (*unmask)(uint8_t *p, size_t len, const uint8_t key[4], uint64_t pos);
+} mask_impl_t;
+
+static const mask_impl_t mask_impls[] = {
+#ifdef MASK_X86
+    {"avx2", unmask_avx2},
+    {"sse2", unmask_sse2},
+#endif
+#ifdef MASK_NEON
+    {"neon", unmask_neon},
+#endif
+    {"scalar", unmask_scalar},
+};
+
+#define MASK_IMPL_COUNT (sizeof(mask_impls) / sizeof(mask_impls[0]))
+
+/* Until ct_ws_unmask_init runs, unmasking is scalar */
+static const mask_impl_t *mask_impl = &mask_impls[MASK_IMPL_COUNT - 1];
+
+static bool mask_supported(const mask_impl_t *impl) {
+#ifdef MASK_X86
+    __builtin_cpu_init();
+    if (strcmp(impl->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(impl->name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+#ifdef MASK_NEON
+    /* Part of the base AArch64 and ARMv7-with-NEON ABIs */
+    if (strcmp(impl->name, "neon") == 0) return true;
+#endif
+    return strcmp(impl->name, "scalar") == 0;
+}
+
+/* Pick the widest unmasker the CPU supports, or the named one ("avx2",
+ * "sse2", "neon", "scalar"). Returns -1 if the named one is unavailable.
+ * Call before any reactor starts. */
+int ct_ws_unmask_init(const char *name) {
+    for (size_t i = 0; i < MASK_IMPL_COUNT; i++) {
+        const mask_impl_t *impl = &mask_impls[i];
+        if (name && strcmp(name, impl->name) != 0) continue;
+        if (!mask_supported(impl)) continue;
+        
+        mask_impl = impl;
+        return 0;
+    }
+    
+    return -1;
+}
+
+const char *ct_ws_unmask_name(void) {
+    return mask_impl->name;
+}
+
+/* Unmask len payload bytes in place. pos is data's offset in the payload,
+ * so a payload can be unmasked in pieces as it arrives. */
+void ct_ws_unmask(char *data, size_t len, const uint8_t key[4], uint64_t pos) {
+    mask_impl->unmask((uint8_t *)data, len, key, pos);
+}
@@ -7,43 +7,10 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <zlib.h>
 
-/* File cache entry */
-typedef struct ct_file_entry {
-    char *path;
-    char *content;
-    size_t size;
-    char *content_type;
-    time_t mtime;
-    
-    /* Compressed version */
-    char *gzip_content;
-    size_t gzip_size;
-    
-    /* Memory mapping info */
-    void *mmap_addr;
-    size_t mmap_size;
-    
-    /* LRU tracking */
-    struct ct_file_entry *lru_prev;
-    struct ct_file_entry *lru_next;
-    
-    /* Reference counting */
-    _Atomic int ref_count;
-} ct_file_entry_t;
-
-/* File cache structure */
-typedef struct ct_file_cache {
-    ct_hash_table_t *entries;
-    ct_file_entry_t *lru_head;
-    ct_file_entry_t *lru_tail;
-    size_t max_size;
-    size_t current_size;
-    _Atomic size_t hits;
-    _Atomic size_t misses;
-} ct_file_cache_t;
-
 /* MIME types - perfect hash would be ideal */
 static struct {
     const char *ext;
@@ -70,7 +37,7 @@ static struct {
 };
 
 /* Get MIME type from file extension */
-static const char *get_mime_type(const char *path) {
+const char *ct_file_mime_type(const char *path) {
     const char *ext = strrchr(path, '.');
     if (!ext) return "application/octet-stream";
     
@@ -125,6 +92,62 @@ static int compress_content(const char *input, size_t input_len,
     return 0;
 }
 
+/* Free an entry and its content - mapped content is unmapped, never freed */
+static void file_entry_free(ct_file_entry_t *entry) {
+    if (entry->mmap_addr) {
+        munmap(entry->mmap_addr, entry->mmap_size);
+    } else {
+        free(entry->content);
+    }
+    free(entry->path);
+    free(entry->gzip_content);
+    free((char *)entry->head.data);
+    free(entry);
+}
+
+/* Precompute the ETag and the 200 heads - every response for the entry
+ * starts with the same bytes. The gzip head is the plain one plus a
+ * Content-Encoding line, so both share one buffer. */
+static int build_heads(ct_file_entry_t *entry) {
+    static const char status[] = "HTTP/1.1 200 OK\r\nContent-Type: ";
+    static const char cache_control[] = "\r\nCache-Control: public, max-age=3600\r\nETag: ";
+    static const char encoding[] = "Content-Encoding: gzip\r\n";
+    
+    char *p = entry->etag;
+    *p++ = '"';
+    p = ct_fmt_hex(p, (uint64_t)entry->mtime);
+    *p++ = '-';
+    p = ct_fmt_hex(p, entry->size);
+    *p++ = '"';
+    entry->etag_len = p - entry->etag;
+    
+    size_t type_len = strlen(entry->content_type);
+    size_t len = sizeof(status) - 1 + type_len + sizeof(cache_control) - 1 +
+                 entry->etag_len + 2;
+    
+    char *head = malloc(len + sizeof(encoding) - 1);
+    if (!head) return -1;
+    
+    p = head;
+    memcpy(p, status, sizeof(status) - 1);
+    p += sizeof(status) - 1;
+    memcpy(p, entry->content_type, type_len);
+    p += type_len;
+    memcpy(p, cache_control, sizeof(cache_control) - 1);
+    p += sizeof(cache_control) - 1;
+    memcpy(p, entry->etag, entry->etag_len);
+    p += entry->etag_len;
+    *p++ = '\r';
+    *p++ = '\n';
+    memcpy(p, encoding, sizeof(encoding) - 1);
+    
+    entry->head.data = head;
+    entry->head.len = len;
+    entry->head_gzip.data = head;
+    entry->head_gzip.len = len + sizeof(encoding) - 1;
+    return 0;
+}
+
 /* Create file cache */
 ct_file_cache_t *ct_file_cache_create(size_t max_size) {
     ct_file_cache_t *cache = calloc(1, sizeof(ct_file_cache_t));
@@ -136,6 +159,7 @@ ct_file_cache_t *ct_file_cache_create(size_t max_size) {
         return NULL;
     }
     
+    pthread_mutex_init(&cache->lock, NULL);
     cache->max_size = max_size;
     atomic_init(&cache->hits, 0);
     atomic_init(&cache->misses, 0);
@@ -174,15 +198,20 @@ static void lru_add_front(ct_file_cache_t *cache, ct_file_entry_t *entry) {
     }
 }
 
-/* Evict LRU entries to make space */
-static void evict_lru(ct_file_cache_t *cache, size_t needed) {
-    while (cache->current_size + needed > cache->max_size && cache->lru_tail) {
-        ct_file_entry_t *entry = cache->lru_tail;
+/* Evict LRU entries to make space - one pass from the tail, so when
+ * everything is pinned by responses in flight it gives up rather than
+ * spinning under the lock. Returns false if the space isn't there. */
+static bool evict_lru(ct_file_cache_t *cache, size_t needed) {
+    ct_file_entry_t *entry = cache->lru_tail;
+    
+    while (cache->current_size + needed > cache->max_size && entry) {
+        ct_file_entry_t *prev = entry->lru_prev;
         
-        /* Skip if still referenced */
-        if (atomic_load(&entry->ref_count) > 0) {
-            lru_remove(cache, entry);
-            lru_add_front(cache, entry);
+        /* Skip if a response still references it - only the cache's own
+         * reference leaves it at 1, and nobody can take another without
+         * the lock */
+        if (atomic_load(&entry->ref_count) > 1) {
+            entry = prev;
             continue;
         }
         
@@ -192,16 +221,11 @@ static void evict_lru(ct_file_cache_t *cache, size_t needed) {
         
         /* Free resources */
         cache->current_size -= entry->size + entry->gzip_size;
-        
-        if (entry->mmap_addr) {
-            munmap(entry->mmap_addr, entry->mmap_size);
-        }
-        
-        free(entry->path);
-        free(entry->content);
-        free(entry->gzip_content);
-        free(entry);
+        ct_file_cache_release(cache, entry);
+        entry = prev;
     }
+    
+    return cache->current_size + needed <= cache->max_size;
 }
 
 /* Load file into cache */
@@ -212,7 +236,7 @@ static ct_file_entry_t *load_file(ct_file_cache_t *cache, const char *path) {
     }
     
     /* Check file size */
-    if (st.st_size > cache->max_size / 4) {
+    if ((size_t)st.st_size > cache->max_size / 4) {
         return NULL; /* Too large for cache */
     }
     
@@ -222,7 +246,7 @@ static ct_file_entry_t *load_file(ct_file_cache_t *cache, const char *path) {
     entry->path = strdup(path);
     entry->size = st.st_size;
     entry->mtime = st.st_mtime;
-    entry->content_type = get_mime_type(path);
+    entry->content_type = ct_file_mime_type(path);
     atomic_init(&entry->ref_count, 1);
     
     /* Try memory mapping for large files */
@@ -260,7 +284,7 @@ static ct_file_entry_t *load_file(ct_file_cache_t *cache, const char *path) {
     }
     
     entry->content = malloc(st.st_size);
-    if (!entry->content || fread(entry->content, 1, st.st_size, f) != st.st_size) {
+    if (!entry->content || fread(entry->content, 1, st.st_size, f) != (size_t)st.st_size) {
         fclose(f);
         free(entry->path);
         free(entry->content);
@@ -282,11 +306,29 @@ static ct_file_entry_t *load_file(ct_file_cache_t *cache, const char *path) {
     return entry;
 }
 
-/* Get file from cache or load it */
+/* Drop an entry whose file changed - caller holds the lock. Responses
+ * still sending the old content keep it alive; the last release frees
+ * it. */
+static void file_entry_retire(ct_file_cache_t *cache, ct_file_entry_t *entry) {
+    ct_hash_table_delete(cache->entries, entry->path, strlen(entry->path));
+    lru_remove(cache, entry);
+    cache->current_size -= entry->size + entry->gzip_size;
+    ct_file_cache_release(cache, entry);
+}
+
+/* Get file from cache or load it. The lock covers only the table and LRU
+ * list: the mtime check (once per CT_FILE_CACHE_RECHECK per file), the
+ * read and the compression of a miss all run outside it, so a cold miss
+ * on one reactor doesn't stall the others. */
 ct_file_entry_t *ct_file_cache_get(ct_file_cache_t *cache, const char *path) {
+    size_t path_len = strlen(path);
+    time_t now = ct_now();
+    bool recheck = false;
+    
+    pthread_mutex_lock(&cache->lock);
+    
     /* Check cache first - O(1) */
-    ct_file_entry_t *entry = ct_hash_table_get(cache->entries, 
-                                              path, strlen(path));
+    ct_file_entry_t *entry = ct_hash_table_get(cache->entries, path, path_len);
     
     if (entry) {
         /* Cache hit - move to front of LRU */
@@ -296,53 +338,88 @@ ct_file_entry_t *ct_file_cache_get(ct_file_cache_t *cache, const char *path) {
         lru_remove(cache, entry);
         lru_add_front(cache, entry);
         
-        /* Check if file was modified */
+        /* One caller per interval looks at the file */
+        if (now - entry->checked >= CT_FILE_CACHE_RECHECK) {
+            entry->checked = now;
+            recheck = true;
+        }
+    }
+    
+    pthread_mutex_unlock(&cache->lock);
+    
+    if (entry && recheck) {
         struct stat st;
         if (stat(path, &st) == 0 && st.st_mtime > entry->mtime) {
-            /* File changed - reload */
-            ct_hash_table_delete(cache->entries, path, strlen(path));
-            lru_remove(cache, entry);
-            
-            if (atomic_fetch_sub(&entry->ref_count, 1) == 1) {
-                /* We were the last reference */
-                if (entry->mmap_addr) {
-                    munmap(entry->mmap_addr, entry->mmap_size);
-                }
-                free(entry->path);
-                free(entry->content);
-                free(entry->gzip_content);
-                free(entry);
+            /* File changed - retire it, unless another reactor already
+             * did, and reload */
+            pthread_mutex_lock(&cache->lock);
+            if (ct_hash_table_get(cache->entries, path, path_len) == entry) {
+                file_entry_retire(cache, entry);
             }
+            pthread_mutex_unlock(&cache->lock);
             
+            ct_file_cache_release(cache, entry);
             entry = NULL;
         }
     }
     
+    if (entry) {
+        return entry;
+    }
+    
+    /* Cache miss - load file */
+    atomic_fetch_add(&cache->misses, 1);
+    
+    entry = load_file(cache, path);
+    if (entry && build_heads(entry) < 0) {
+        file_entry_free(entry);
+        entry = NULL;
+    }
     if (!entry) {
-        /* Cache miss - load file */
-        atomic_fetch_add(&cache->misses, 1);
-        
-        entry = load_file(cache, path);
-        if (!entry) return NULL;
-        
-        /* Make space if needed */
-        size_t needed = entry->size + entry->gzip_size;
-        evict_lru(cache, needed);
-        
-        /* Add to cache */
-        ct_hash_table_set(cache->entries, entry->path, 
-                         strlen(entry->path), entry);
-        lru_add_front(cache, entry);
-        cache->current_size += needed;
+        return NULL;
+    }
+    entry->checked = now;
+    
+    pthread_mutex_lock(&cache->lock);
+    
+    /* Another reactor may have loaded it meanwhile - serve theirs */
+    ct_file_entry_t *loaded = ct_hash_table_get(cache->entries, path, path_len);
+    if (loaded && loaded->mtime >= entry->mtime) {
+        atomic_fetch_add(&loaded->ref_count, 1);
+        pthread_mutex_unlock(&cache->lock);
+        file_entry_free(entry);
+        return loaded;
+    }
+    if (loaded) {
+        /* Older than ours - responses still using it keep it alive */
+        file_entry_retire(cache, loaded);
+    }
+    
+    /* Make space if needed - if it can't be had, serve this one
+     * uncached; the caller's release frees it */
+    size_t needed = entry->size + entry->gzip_size;
+    if (!evict_lru(cache, needed)) {
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
     }
     
+    /* Add to cache - the table's reference on top of the caller's */
+    atomic_fetch_add(&entry->ref_count, 1);
+    ct_hash_table_set(cache->entries, entry->path, path_len, entry);
+    lru_add_front(cache, entry);
+    cache->current_size += needed;
+    
+    pthread_mutex_unlock(&cache->lock);
     return entry;
 }
 
-/* Release file reference */
+/* Release file reference - the last one, the cache's included, frees it */
 void ct_file_cache_release(ct_file_cache_t *cache, ct_file_entry_t *entry) {
+    (void)cache;
     if (!entry) return;
-    atomic_fetch_sub(&entry->ref_count, 1);
+    if (atomic_fetch_sub(&entry->ref_count, 1) == 1) {
+        file_entry_free(entry);
+    }
 }
 
 /* Get cache statistics */
@@ -362,21 +439,11 @@ void ct_file_cache_destroy(ct_file_cache_t *cache) {
     ct_file_entry_t *entry = cache->lru_head;
     while (entry) {
         ct_file_entry_t *next = entry->lru_next;
-        
-        if (entry->mmap_addr) {
-            munmap(entry->mmap_addr, entry->mmap_size);
-        }
-        
-        free(entry->path);
-        if (!entry->mmap_addr) {
-            free(entry->content);
-        }
-        free(entry->gzip_content);
-        free(entry);
-        
+        file_entry_free(entry);
         entry = next;
     }
     
     ct_hash_table_destroy(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
     free(cache);
 }
\ No newline at end of file
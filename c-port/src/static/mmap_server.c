@@ -66,6 +66,32 @@ static int normalize_path(const char *base_dir, const char *url_path,
     return 0;
 }
 
+/* Serve a file the cache won't hold - the response owns the fd and the
+ * body goes out with sendfile */
+static int serve_uncached_file(ct_connection_t *conn, const char *full_path) {
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    
+    ct_response_init(&conn->response, 200, "OK");
+    ct_response_add_header(&conn->response, "Content-Type", 
+                          ct_file_mime_type(full_path));
+    ct_response_add_header(&conn->response, "Cache-Control", 
+                          "public, max-age=3600");
+    
+    conn->response.body_len = st.st_size;
+    conn->response.body_fd = fd;
+    conn->response.body_offset = 0;
+    conn->response.body_from_fd = true;
+    
+    return 0;
+}
+
 /* Serve static file using zero-copy sendfile */
 int ct_serve_static_file(ct_connection_t *conn, const char *base_dir,
                         const char *url_path) {
@@ -84,6 +110,11 @@ int ct_serve_static_file(ct_connection_t *conn, const char *base_dir,
     ct_file_entry_t *entry = ct_file_cache_get(cache, full_path);
     
     if (!entry) {
+        /* Too large to cache - stream it from the page cache instead */
+        if (serve_uncached_file(conn, full_path) == 0) {
+            return 0;
+        }
+        
         ct_response_init(&conn->response, 404, "Not Found");
         ct_response_html(&conn->response, 404,
                         "<html><body><h1>404 Not Found</h1></body></html>");
@@ -92,38 +123,32 @@ int ct_serve_static_file(ct_connection_t *conn, const char *base_dir,
     
     /* Check if client accepts gzip */
     bool accepts_gzip = false;
-    const char *accept_encoding = ct_request_get_header(&conn->request, 
-                                                       "Accept-Encoding");
-    if (accept_encoding && strstr(accept_encoding, "gzip") && 
+    ct_header_t accept_encoding = ct_request_header(&conn->request,
+                                                    CT_HDR_ACCEPT_ENCODING);
+    if (accept_encoding.value &&
+        memmem(accept_encoding.value, accept_encoding.value_len, "gzip", 4) &&
         entry->gzip_content) {
         accepts_gzip = true;
     }
     
-    /* Build response */
-    ct_response_init(&conn->response, 200, "OK");
-    ct_response_add_header(&conn->response, "Content-Type", entry->content_type);
-    
-    /* Cache headers */
-    ct_response_add_header(&conn->response, "Cache-Control", 
-                          "public, max-age=3600");
-    
-    char etag[64];
-    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", 
-            (long)entry->mtime, (long)entry->size);
-    ct_response_add_header(&conn->response, "ETag", etag);
-    
-    /* Check if-none-match */
-    const char *if_none_match = ct_request_get_header(&conn->request, 
-                                                     "If-None-Match");
-    if (if_none_match && strcmp(if_none_match, etag) == 0) {
+    /* Check if-none-match - the ETag was formatted when the entry loaded */
+    ct_header_t if_none_match = ct_request_header(&conn->request,
+                                                  CT_HDR_IF_NONE_MATCH);
+    if (if_none_match.value && if_none_match.value_len == entry->etag_len &&
+        memcmp(if_none_match.value, entry->etag, entry->etag_len) == 0) {
         ct_file_cache_release(cache, entry);
         ct_response_init(&conn->response, 304, "Not Modified");
         return 0;
     }
     
+    /* Build response - the entry's template carries the status line,
+     * Content-Type, Cache-Control and ETag */
+    ct_response_init(&conn->response, 200, "OK");
+    conn->response.head_template = &entry->head;
+    
     /* Use gzipped version if available and accepted */
     if (accepts_gzip && entry->gzip_content) {
-        ct_response_add_header(&conn->response, "Content-Encoding", "gzip");
+        conn->response.head_template = &entry->head_gzip;
         conn->response.body = entry->gzip_content;
         conn->response.body_len = entry->gzip_size;
     } else {
@@ -132,7 +157,7 @@ int ct_serve_static_file(ct_connection_t *conn, const char *base_dir,
     }
     
     /* Keep reference until response is sent */
-    conn->file_entry = entry;
+    conn->response.body_entry = entry;
     
     return 0;
 }
@@ -150,14 +175,14 @@ int ct_serve_directory(ct_connection_t *conn, const char *base_dir,
 
 /* Handle range requests for large files */
 int ct_serve_range_request(ct_connection_t *conn, ct_file_entry_t *entry) {
-    const char *range_header = ct_request_get_header(&conn->request, "Range");
-    if (!range_header || strncmp(range_header, "bytes=", 6) != 0) {
+    ct_header_t range = ct_request_header(&conn->request, CT_HDR_RANGE);
+    if (!range.value || range.value_len < 6 || strncmp(range.value, "bytes=", 6) != 0) {
         return -1; /* Not a range request */
     }
     
-    /* Parse range header */
+    /* Parse range header - the value ends at CRLF, so sscanf stops there */
     long start = 0, end = entry->size - 1;
-    sscanf(range_header + 6, "%ld-%ld", &start, &end);
+    sscanf(range.value + 6, "%ld-%ld", &start, &end);
     
     if (start < 0 || start >= entry->size || end >= entry->size || start > end) {
         ct_response_init(&conn->response, 416, "Range Not Satisfiable");
@@ -169,7 +194,8 @@ int ct_serve_range_request(ct_connection_t *conn, ct_file_entry_t *entry) {
     ct_response_add_header(&conn->response, "Content-Type", entry->content_type);
     ct_response_add_header(&conn->response, "Accept-Ranges", "bytes");
     
-    char content_range[128];
+    /* Headers hold pointers until the response is built */
+    static __thread char content_range[128];
     snprintf(content_range, sizeof(content_range), "bytes %ld-%ld/%zu",
             start, end, entry->size);
     ct_response_add_header(&conn->response, "Content-Range", content_range);
@@ -0,0 +1,104 @@
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Free buffers are chained through their first bytes */
+typedef struct ct_buf_free {
+    struct ct_buf_free *next;
+} ct_buf_free_t;
+
+static inline unsigned buf_class(size_t size) {
+    assert(size >= CT_BUF_MIN_SIZE && size <= CT_BUF_MAX_SIZE);
+    assert((size & (size - 1)) == 0);
+    return (unsigned)__builtin_ctzll(size) - CT_BUF_MIN_SHIFT;
+}
+
+/* Buffers are mirrored mappings where the platform supports them, so
+ * connection rings can be parsed in place. Support is probed once per
+ * pool; each allocation still falls back to a plain buffer if its
+ * mapping fails (memfd or map count limits), and callers are told which
+ * kind they got. */
+void ct_buf_pool_init(ct_buf_pool_t *pool) {
+    memset(pool, 0, sizeof(*pool));
+    
+    void *probe = ct_mirror_map(CT_BUF_MIN_SIZE);
+    if (probe) {
+        ct_mirror_unmap(probe, CT_BUF_MIN_SIZE);
+        pool->mirrored = true;
+    }
+}
+
+static void buf_unmap(void *buf, size_t size, bool mirrored) {
+    if (mirrored) {
+        ct_mirror_unmap(buf, size);
+    } else {
+        free(buf);
+    }
+}
+
+static void free_list_drain(ct_buf_free_t *buf, size_t size, bool mirrored) {
+    while (buf) {
+        ct_buf_free_t *next = buf->next;
+        buf_unmap(buf, size, mirrored);
+        buf = next;
+    }
+}
+
+void ct_buf_pool_destroy(ct_buf_pool_t *pool) {
+    for (unsigned c = 0; c < CT_BUF_CLASSES; c++) {
+        free_list_drain(pool->free_list[c], CT_BUF_MIN_SIZE << c, true);
+        free_list_drain(pool->plain_list[c], CT_BUF_MIN_SIZE << c, false);
+        pool->free_list[c] = NULL;
+        pool->plain_list[c] = NULL;
+        pool->cached[c] = 0;
+    }
+}
+
+/* size must be a power of two between CT_BUF_MIN_SIZE and CT_BUF_MAX_SIZE.
+ * A mirrored buffer is preferred - cached, then freshly mapped - before a
+ * plain one; *mirrored says which this is, for ct_buf_pool_free. */
+void *ct_buf_pool_alloc(ct_buf_pool_t *pool, size_t size, bool *mirrored) {
+    unsigned c = buf_class(size);
+    ct_buf_free_t *buf;
+    
+    /* Fast path - O(1) from a class free list */
+    if ((buf = pool->free_list[c])) {
+        pool->free_list[c] = buf->next;
+        pool->cached[c]--;
+        *mirrored = true;
+    } else if (pool->mirrored && (buf = ct_mirror_map(size))) {
+        *mirrored = true;
+    } else if ((buf = pool->plain_list[c])) {
+        pool->plain_list[c] = buf->next;
+        pool->cached[c]--;
+        *mirrored = false;
+    } else {
+        buf = malloc(size);
+        if (!buf) return NULL;
+        *mirrored = false;
+    }
+    
+    pool->in_use[c]++;
+    return buf;
+}
+
+void ct_buf_pool_free(ct_buf_pool_t *pool, void *ptr, size_t size,
+                      bool mirrored) {
+    if (!ptr) return;
+    
+    unsigned c = buf_class(size);
+    pool->in_use[c]--;
+    
+    /* Cache up to the per-class budget, always at least one buffer */
+    if ((pool->cached[c] + 1) * size > CT_BUF_CACHE_BYTES && pool->cached[c] > 0) {
+        buf_unmap(ptr, size, mirrored);
+        return;
+    }
+    
+    void **list = mirrored ? &pool->free_list[c] : &pool->plain_list[c];
+    ct_buf_free_t *buf = ptr;
+    buf->next = *list;
+    *list = buf;
+    pool->cached[c]++;
+}
@@ -0,0 +1,102 @@
+#include "terminal.h"
+#include <string.h>
+#include <time.h>
+
+/* Coarse clocks are read from the vDSO without touching the TSC - tick
+ * resolution (1-4 ms) is plenty for timeouts and Date headers */
+#ifdef CLOCK_MONOTONIC_COARSE
+#define CT_CLOCK_MONO   CLOCK_MONOTONIC_COARSE
+#else
+#define CT_CLOCK_MONO   CLOCK_MONOTONIC
+#endif
+
+#ifdef CLOCK_REALTIME_COARSE
+#define CT_CLOCK_WALL   CLOCK_REALTIME_COARSE
+#else
+#define CT_CLOCK_WALL   CLOCK_REALTIME
+#endif
+
+__thread ct_clock_t ct_clock;
+
+static const char day_names[7][4] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char month_names[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* Exactly width digits of v, zero-padded - the formats are fixed width */
+static char *put_digits(char *p, unsigned v, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    return p + width;
+}
+
+static char *put_str(char *p, const char *s, size_t len) {
+    memcpy(p, s, len);
+    return p + len;
+}
+
+/* Rebuild the cached strings - at most once per second */
+static void clock_format(ct_clock_t *clock, time_t now) {
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    
+    unsigned year = (unsigned)tm.tm_year + 1900;
+    char *p = clock->http_date;
+    
+    /* "Sun, 06 Nov 1994 08:49:37 GMT" */
+    p = put_str(p, day_names[tm.tm_wday], 3);
+    p = put_str(p, ", ", 2);
+    p = put_digits(p, (unsigned)tm.tm_mday, 2);
+    *p++ = ' ';
+    p = put_str(p, month_names[tm.tm_mon], 3);
+    *p++ = ' ';
+    p = put_digits(p, year, 4);
+    *p++ = ' ';
+    p = put_digits(p, (unsigned)tm.tm_hour, 2);
+    *p++ = ':';
+    p = put_digits(p, (unsigned)tm.tm_min, 2);
+    *p++ = ':';
+    p = put_digits(p, (unsigned)tm.tm_sec, 2);
+    p = put_str(p, " GMT", 4);
+    *p = '\0';
+    
+    /* "1994-11-06T08:49:37Z" */
+    p = clock->iso_time;
+    p = put_digits(p, year, 4);
+    *p++ = '-';
+    p = put_digits(p, (unsigned)tm.tm_mon + 1, 2);
+    *p++ = '-';
+    p = put_digits(p, (unsigned)tm.tm_mday, 2);
+    *p++ = 'T';
+    p = put_digits(p, (unsigned)tm.tm_hour, 2);
+    *p++ = ':';
+    p = put_digits(p, (unsigned)tm.tm_min, 2);
+    *p++ = ':';
+    p = put_digits(p, (unsigned)tm.tm_sec, 2);
+    *p++ = 'Z';
+    *p = '\0';
+    
+    clock->formatted = now;
+}
+
+/* Sample both clocks - called once per event loop wakeup */
+void ct_clock_update(void) {
+    struct timespec ts;
+    
+    clock_gettime(CT_CLOCK_MONO, &ts);
+    /* +1 keeps mono_ms non-zero, which marks the clock as initialized */
+    ct_clock.mono_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + 1;
+    
+    clock_gettime(CT_CLOCK_WALL, &ts);
+    ct_clock.wall = ts.tv_sec;
+    
+    if (ct_clock.wall != ct_clock.formatted) {
+        clock_format(&ct_clock, ct_clock.wall);
+    }
+}
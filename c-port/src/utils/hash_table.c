@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* FNV-1a hash function - fast and good distribution */
 uint32_t ct_hash_fnv1a(const void *key, size_t len) {
@@ -63,12 +68,242 @@ uint32_t ct_hash_murmur3(const void *key, size_t len) {
     return h1;
 }
 
-typedef struct ct_hash_entry {
-    void *key;
-    size_t key_len;
+/* Control bytes: high bit set = empty, else the top 7 bits of the hash */
+#define CTRL_EMPTY      0x80
+
+struct ct_hash_slot {
     void *value;
-    struct ct_hash_entry *next;
-} ct_hash_entry_t;
+    uint32_t hash;
+    uint32_t key_len;
+    union {
+        char inline_key[CT_HT_INLINE_KEY];
+        char *heap_key;
+    } key;
+};
+
+static inline uint8_t hash_tag(uint32_t hash) {
+    return hash >> 25;
+}
+
+static inline const void *slot_key(const ct_hash_slot_t *slot) {
+    return slot->key_len <= CT_HT_INLINE_KEY ? slot->key.inline_key
+                                             : slot->key.heap_key;
+}
+
+/* Bitmasks over the 16 control bytes at ctrl - one bit per byte for SSE2
+ * and the scalar fallback, one nibble per byte (top bit kept) for NEON */
+#if defined(__SSE2__)
+typedef uint32_t group_mask_t;
+#define GROUP_SHIFT 0
+
+static inline group_mask_t group_match(const uint8_t *ctrl, uint8_t tag) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+}
+
+static inline group_mask_t group_match_empty(const uint8_t *ctrl) {
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+#elif defined(__ARM_NEON)
+typedef uint64_t group_mask_t;
+#define GROUP_SHIFT 2
+
+static inline group_mask_t neon_mask(uint8x16_t bytes) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(bytes), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ULL;
+}
+
+static inline group_mask_t group_match(const uint8_t *ctrl, uint8_t tag) {
+    return neon_mask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(tag)));
+}
+
+static inline group_mask_t group_match_empty(const uint8_t *ctrl) {
+    return neon_mask(vtstq_u8(vld1q_u8(ctrl), vdupq_n_u8(CTRL_EMPTY)));
+}
+#else
+typedef uint32_t group_mask_t;
+#define GROUP_SHIFT 0
+
+static inline group_mask_t group_match(const uint8_t *ctrl, uint8_t tag) {
+    group_mask_t mask = 0;
+    for (int i = 0; i < CT_HT_GROUP; i++) {
+        mask |= (group_mask_t)(ctrl[i] == tag) << i;
+    }
+    return mask;
+}
+
+static inline group_mask_t group_match_empty(const uint8_t *ctrl) {
+    group_mask_t mask = 0;
+    for (int i = 0; i < CT_HT_GROUP; i++) {
+        mask |= (group_mask_t)(ctrl[i] >> 7) << i;
+    }
+    return mask;
+}
+#endif
+
+static inline size_t group_first(group_mask_t mask) {
+    return (size_t)__builtin_ctzll(mask) >> GROUP_SHIFT;
+}
+
+/* Grow at 7/8 load */
+static inline size_t array_limit(const ct_hash_array_t *a) {
+    return a->capacity - a->capacity / 8;
+}
+
+static int array_init(ct_hash_array_t *a, size_t capacity) {
+    a->ctrl = malloc(capacity + CT_HT_GROUP);
+    a->slots = malloc(capacity * sizeof(ct_hash_slot_t));
+    if (!a->ctrl || !a->slots) {
+        free(a->ctrl);
+        free(a->slots);
+        memset(a, 0, sizeof(*a));
+        return -1;
+    }
+    
+    memset(a->ctrl, CTRL_EMPTY, capacity + CT_HT_GROUP);
+    a->capacity = capacity;
+    a->used = 0;
+    return 0;
+}
+
+static void array_free(ct_hash_array_t *a) {
+    for (size_t i = 0; i < a->capacity; i++) {
+        if (!(a->ctrl[i] & CTRL_EMPTY) && a->slots[i].key_len > CT_HT_INLINE_KEY) {
+            free(a->slots[i].key.heap_key);
+        }
+    }
+    
+    free(a->ctrl);
+    free(a->slots);
+    memset(a, 0, sizeof(*a));
+}
+
+/* The first CT_HT_GROUP control bytes are repeated past the end, so a
+ * group load never has to wrap */
+static inline void set_ctrl(ct_hash_array_t *a, size_t i, uint8_t value) {
+    a->ctrl[i] = value;
+    if (i < CT_HT_GROUP) {
+        a->ctrl[a->capacity + i] = value;
+    }
+}
+
+/* Slot index holding key, or -1. The probe run from the home slot has no
+ * gaps, so the first group with an empty byte ends the search. */
+static ssize_t array_find(const ct_hash_array_t *a, uint32_t hash,
+                          const void *key, size_t key_len) {
+    if (a->capacity == 0) return -1;
+    
+    size_t mask = a->capacity - 1;
+    size_t pos = hash & mask;
+    uint8_t tag = hash_tag(hash);
+    
+    for (size_t probed = 0; probed < a->capacity; probed += CT_HT_GROUP) {
+        const uint8_t *group = a->ctrl + pos;
+        
+        for (group_mask_t m = group_match(group, tag); m; m &= m - 1) {
+            size_t i = (pos + group_first(m)) & mask;
+            const ct_hash_slot_t *slot = &a->slots[i];
+            if (slot->hash == hash && slot->key_len == key_len &&
+                memcmp(slot_key(slot), key, key_len) == 0) {
+                return (ssize_t)i;
+            }
+        }
+        
+        if (group_match_empty(group)) return -1;
+        pos = (pos + CT_HT_GROUP) & mask;
+    }
+    
+    return -1;
+}
+
+/* Place a slot in the first empty position of its probe run - the caller
+ * guarantees the key is absent and the array below its limit */
+static void array_place(ct_hash_array_t *a, const ct_hash_slot_t *slot) {
+    size_t mask = a->capacity - 1;
+    size_t pos = slot->hash & mask;
+    
+    while (1) {
+        group_mask_t m = group_match_empty(a->ctrl + pos);
+        if (m) {
+            size_t i = (pos + group_first(m)) & mask;
+            a->slots[i] = *slot;
+            set_ctrl(a, i, hash_tag(slot->hash));
+            a->used++;
+            return;
+        }
+        pos = (pos + CT_HT_GROUP) & mask;
+    }
+}
+
+/* Empty slot i and pull later members of the run back into the hole, so
+ * lookups never need tombstones. The key is not freed - the slot may have
+ * moved to another array. */
+static void array_remove(ct_hash_array_t *a, size_t i) {
+    size_t mask = a->capacity - 1;
+    size_t j = i;
+    
+    while (1) {
+        j = (j + 1) & mask;
+        if (a->ctrl[j] & CTRL_EMPTY) break;
+        
+        /* Move j into the hole if the hole lies between its home and j */
+        size_t home = a->slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            a->slots[i] = a->slots[j];
+            set_ctrl(a, i, a->ctrl[j]);
+            i = j;
+        }
+    }
+    
+    set_ctrl(a, i, CTRL_EMPTY);
+    a->used--;
+}
+
+/* Move up to CT_HT_MIGRATE_STEP slots out of the old array. Removal
+ * shifts the rest of a run back into the hole, so migrate_pos only
+ * advances past empty slots and everything before it stays empty. */
+static void migrate_step(ct_hash_table_t *ht, size_t budget) {
+    ct_hash_array_t *old = &ht->old;
+    
+    while (old->used > 0 && budget-- > 0) {
+        size_t i = ht->migrate_pos;
+        if (old->ctrl[i] & CTRL_EMPTY) {
+            ht->migrate_pos++;
+            continue;
+        }
+        
+        array_place(&ht->cur, &old->slots[i]);
+        array_remove(old, i);
+    }
+    
+    if (old->used == 0 && old->ctrl) {
+        array_free(old);
+        ht->migrate_pos = 0;
+    }
+}
+
+/* Make room for one more entry - start a resize when the current array
+ * is full. A resize still in progress is finished first. */
+static int reserve_one(ct_hash_table_t *ht) {
+    if (ht->old.ctrl) {
+        migrate_step(ht, CT_HT_MIGRATE_STEP);
+    }
+    
+    if (ht->cur.used < array_limit(&ht->cur)) return 0;
+    
+    if (ht->old.ctrl) {
+        migrate_step(ht, SIZE_MAX);
+    }
+    
+    ct_hash_array_t next;
+    if (array_init(&next, ht->cur.capacity * 2) < 0) return -1;
+    
+    ht->old = ht->cur;
+    ht->cur = next;
+    ht->migrate_pos = 0;
+    migrate_step(ht, CT_HT_MIGRATE_STEP);
+    return 0;
+}
 
 ct_hash_table_t *ct_hash_table_create(size_t size, 
                                       uint32_t (*hash_func)(const void *, size_t)) {
@@ -77,14 +312,11 @@ ct_hash_table_t *ct_hash_table_create(size_t size,
     ct_hash_table_t *ht = calloc(1, sizeof(ct_hash_table_t));
     if (!ht) return NULL;
     
-    ht->buckets = calloc(size, sizeof(void *));
-    if (!ht->buckets) {
+    if (array_init(&ht->cur, size < CT_HT_GROUP ? CT_HT_GROUP : size) < 0) {
         free(ht);
         return NULL;
     }
     
-    ht->size = size;
-    ht->count = 0;
     ht->hash_func = hash_func ? hash_func : ct_hash_murmur3;
     
     return ht;
@@ -93,18 +325,10 @@ ct_hash_table_t *ct_hash_table_create(size_t size,
 void ct_hash_table_destroy(ct_hash_table_t *ht) {
     if (!ht) return;
     
-    /* Free all entries */
-    for (size_t i = 0; i < ht->size; i++) {
-        ct_hash_entry_t *entry = (ct_hash_entry_t *)ht->buckets[i];
-        while (entry) {
-            ct_hash_entry_t *next = entry->next;
-            free(entry->key);
-            free(entry);
-            entry = next;
-        }
+    array_free(&ht->cur);
+    if (ht->old.ctrl) {
+        array_free(&ht->old);
     }
-    
-    free(ht->buckets);
     free(ht);
 }
 
@@ -112,105 +336,114 @@ void *ct_hash_table_get(ct_hash_table_t *ht, const void *key, size_t key_len) {
     if (!ht || !key || key_len == 0) return NULL;
     
     uint32_t hash = ht->hash_func(key, key_len);
-    size_t index = hash & (ht->size - 1);
     
-    ct_hash_entry_t *entry = (ct_hash_entry_t *)ht->buckets[index];
+    ssize_t i = array_find(&ht->cur, hash, key, key_len);
+    if (i >= 0) return ht->cur.slots[i].value;
     
-    /* O(1) average case - walk chain */
-    while (entry) {
-        if (entry->key_len == key_len && 
-            memcmp(entry->key, key, key_len) == 0) {
-            return entry->value;
-        }
-        entry = entry->next;
-    }
+    i = array_find(&ht->old, hash, key, key_len);
+    if (i >= 0) return ht->old.slots[i].value;
     
     return NULL;
 }
 
 void ct_hash_table_set(ct_hash_table_t *ht, const void *key, size_t key_len, 
                        void *value) {
-    if (!ht || !key || key_len == 0) return;
+    if (!ht || !key || key_len == 0 || key_len > UINT32_MAX) return;
     
     uint32_t hash = ht->hash_func(key, key_len);
-    size_t index = hash & (ht->size - 1);
-    
-    ct_hash_entry_t *entry = (ct_hash_entry_t *)ht->buckets[index];
     
-    /* Check if key exists */
-    while (entry) {
-        if (entry->key_len == key_len && 
-            memcmp(entry->key, key, key_len) == 0) {
-            /* Update existing entry */
-            entry->value = value;
-            return;
-        }
-        entry = entry->next;
+    /* Update in place, in whichever array holds the key */
+    ssize_t i = array_find(&ht->cur, hash, key, key_len);
+    if (i >= 0) {
+        ht->cur.slots[i].value = value;
+        return;
+    }
+    i = array_find(&ht->old, hash, key, key_len);
+    if (i >= 0) {
+        ht->old.slots[i].value = value;
+        return;
     }
     
-    /* Create new entry */
-    ct_hash_entry_t *new_entry = malloc(sizeof(ct_hash_entry_t));
-    if (!new_entry) return;
+    ct_hash_slot_t slot;
+    slot.value = value;
+    slot.hash = hash;
+    slot.key_len = key_len;
+    if (key_len <= CT_HT_INLINE_KEY) {
+        memcpy(slot.key.inline_key, key, key_len);
+    } else {
+        slot.key.heap_key = malloc(key_len);
+        if (!slot.key.heap_key) return;
+        memcpy(slot.key.heap_key, key, key_len);
+    }
     
-    new_entry->key = malloc(key_len);
-    if (!new_entry->key) {
-        free(new_entry);
+    if (reserve_one(ht) < 0) {
+        if (key_len > CT_HT_INLINE_KEY) free(slot.key.heap_key);
         return;
     }
     
-    memcpy(new_entry->key, key, key_len);
-    new_entry->key_len = key_len;
-    new_entry->value = value;
-    
-    /* Insert at head of chain - O(1) */
-    new_entry->next = (ct_hash_entry_t *)ht->buckets[index];
-    ht->buckets[index] = new_entry;
+    array_place(&ht->cur, &slot);
     ht->count++;
 }
 
+static bool array_delete(ct_hash_array_t *a, uint32_t hash, const void *key,
+                         size_t key_len) {
+    ssize_t i = array_find(a, hash, key, key_len);
+    if (i < 0) return false;
+    
+    if (key_len > CT_HT_INLINE_KEY) {
+        free(a->slots[i].key.heap_key);
+    }
+    array_remove(a, i);
+    return true;
+}
+
 void ct_hash_table_delete(ct_hash_table_t *ht, const void *key, size_t key_len) {
     if (!ht || !key || key_len == 0) return;
     
     uint32_t hash = ht->hash_func(key, key_len);
-    size_t index = hash & (ht->size - 1);
-    
-    ct_hash_entry_t *entry = (ct_hash_entry_t *)ht->buckets[index];
-    ct_hash_entry_t *prev = NULL;
-    
-    while (entry) {
-        if (entry->key_len == key_len && 
-            memcmp(entry->key, key, key_len) == 0) {
-            /* Remove from chain */
-            if (prev) {
-                prev->next = entry->next;
-            } else {
-                ht->buckets[index] = entry->next;
-            }
-            
-            free(entry->key);
-            free(entry);
-            ht->count--;
-            return;
+    
+    if (array_delete(&ht->cur, hash, key, key_len) ||
+        array_delete(&ht->old, hash, key, key_len)) {
+        ht->count--;
+    }
+}
+
+static void array_foreach(ct_hash_array_t *a,
+                          void (*callback)(void *key, size_t key_len,
+                                           void *value, void *ctx),
+                          void *ctx) {
+    size_t i = 0;
+    while (i < a->capacity) {
+        if (a->ctrl[i] & CTRL_EMPTY) {
+            i++;
+            continue;
         }
         
-        prev = entry;
-        entry = entry->next;
+        ct_hash_slot_t *slot = &a->slots[i];
+        uint32_t hash = slot->hash;
+        void *value = slot->value;
+        callback((void *)slot_key(slot), slot->key_len, value, ctx);
+        
+        /* Deleting the entry may shift a later one into slot i - visit
+         * it before moving on */
+        if ((a->ctrl[i] & CTRL_EMPTY) ||
+            (slot->hash == hash && slot->value == value)) {
+            i++;
+        }
     }
 }
 
-/* Iterate over all entries - useful for cleanup */
+/* Iterate over all entries - the callback may delete the entry it is
+ * given (an entry pulled back across the end of the array is then seen
+ * twice), but must not insert */
 void ct_hash_table_foreach(ct_hash_table_t *ht, 
                           void (*callback)(void *key, size_t key_len, 
                                          void *value, void *ctx),
                           void *ctx) {
     if (!ht || !callback) return;
     
-    for (size_t i = 0; i < ht->size; i++) {
-        ct_hash_entry_t *entry = (ct_hash_entry_t *)ht->buckets[i];
-        while (entry) {
-            ct_hash_entry_t *next = entry->next;
-            callback(entry->key, entry->key_len, entry->value, ctx);
-            entry = next;
-        }
+    array_foreach(&ht->cur, callback, ctx);
+    if (ht->old.ctrl) {
+        array_foreach(&ht->old, callback, ctx);
     }
-}
\ No newline at end of file
+}
@@ -2,50 +2,287 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
-typedef struct ct_mem_chunk {
-    struct ct_mem_chunk *next;
-} ct_mem_chunk_t;
+/* Block header - blocks are CT_MEM_POOL_BLOCK aligned, so a chunk finds
+ * its block by masking its address */
+struct ct_mem_block {
+    ct_mem_block_t *next;
+    ct_mem_block_t *prev;
+    ct_mem_block_t *avail_next;
+    ct_mem_block_t *avail_prev;
+    void *free_list;            /* recycled chunks, chained through them */
+    size_t free_count;          /* free_list plus never-used chunks */
+    size_t bump;                /* next never-used chunk */
+    bool huge;
+    char *data;
+};
 
-typedef struct ct_mem_block {
-    struct ct_mem_block *next;
-    char data[];
-} ct_mem_block_t;
+#define BLOCK_HEADER    ((sizeof(ct_mem_block_t) + 63) & ~(size_t)63)
 
-ct_mem_pool_t *ct_mem_pool_create(size_t chunk_size, size_t initial_chunks) {
-    assert(chunk_size >= sizeof(ct_mem_chunk_t));
-    assert(initial_chunks > 0);
+/* Thread caches - one slot per live shared pool, up to a few at a time;
+ * a destroyed pool's slot goes to the next pool created. A thread hands
+ * its cached chunks back when a slot changes hands under it and when it
+ * exits, so they don't keep blocks mapped. */
+#define POOL_CACHE_SLOTS 8
+
+typedef struct pool_cache {
+    uint64_t pool_id;
+    uint32_t count;
+    uint64_t allocs;            /* folded into the pool stats on refill */
+    uint64_t hits;
+    void *chunks[CT_MEM_POOL_CACHE];
+} pool_cache_t;
+
+static __thread pool_cache_t tls_caches[POOL_CACHE_SLOTS];
+static atomic_uint_fast64_t next_pool_id = 1;
+
+/* Slot owners - slot_lock is taken before any pool lock */
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static ct_mem_pool_t *slot_pools[POOL_CACHE_SLOTS];
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+
+static inline ct_mem_block_t *block_of(const void *chunk) {
+    return (ct_mem_block_t *)((uintptr_t)chunk & ~(uintptr_t)(CT_MEM_POOL_BLOCK - 1));
+}
+
+/* A 2 MB-aligned block: an explicit huge page if any are reserved,
+ * otherwise over-map, trim to alignment and ask for transparent huge
+ * pages */
+static void *block_map(bool *huge) {
+#ifdef MAP_HUGETLB
+    void *p = mmap(NULL, CT_MEM_POOL_BLOCK, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *huge = true;
+        return p;
+    }
+#endif
+
+    size_t len = CT_MEM_POOL_BLOCK * 2;
+    char *raw = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
     
-    ct_mem_pool_t *pool = calloc(1, sizeof(ct_mem_pool_t));
-    if (!pool) return NULL;
+    char *aligned = (char *)(((uintptr_t)raw + CT_MEM_POOL_BLOCK - 1) &
+                             ~(uintptr_t)(CT_MEM_POOL_BLOCK - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    size_t tail = (raw + len) - (aligned + CT_MEM_POOL_BLOCK);
+    if (tail > 0) {
+        munmap(aligned + CT_MEM_POOL_BLOCK, tail);
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, CT_MEM_POOL_BLOCK, MADV_HUGEPAGE);
+#endif
+    *huge = false;
+    return aligned;
+}
+
+static void avail_push(ct_mem_pool_t *pool, ct_mem_block_t *block) {
+    block->avail_prev = NULL;
+    block->avail_next = pool->avail;
+    if (pool->avail) {
+        pool->avail->avail_prev = block;
+    }
+    pool->avail = block;
+}
+
+static void avail_remove(ct_mem_pool_t *pool, ct_mem_block_t *block) {
+    if (block->avail_prev) {
+        block->avail_prev->avail_next = block->avail_next;
+    } else {
+        pool->avail = block->avail_next;
+    }
+    if (block->avail_next) {
+        block->avail_next->avail_prev = block->avail_prev;
+    }
+}
+
+static ct_mem_block_t *block_create(ct_mem_pool_t *pool) {
+    bool huge;
+    ct_mem_block_t *block = block_map(&huge);
+    if (!block) return NULL;
     
-    pool->chunk_size = chunk_size;
-    pool->total_chunks = initial_chunks;
-    pool->free_chunks = initial_chunks;
+    /* The header is the only memory touched until chunks are handed out */
+    memset(block, 0, sizeof(*block));
+    block->data = (char *)block + BLOCK_HEADER;
+    block->free_count = pool->chunks_per_block;
+    block->huge = huge;
     
-    /* Allocate initial block */
-    size_t block_size = sizeof(ct_mem_block_t) + (chunk_size * initial_chunks);
-    ct_mem_block_t *block = malloc(block_size);
+    block->next = pool->blocks;
+    if (pool->blocks) {
+        pool->blocks->prev = block;
+    }
+    pool->blocks = block;
+    avail_push(pool, block);
+    pool->empty_blocks++;
+    
+    pool->stats.blocks++;
+    pool->stats.bytes += CT_MEM_POOL_BLOCK;
+    if (huge) pool->stats.huge_blocks++;
+    return block;
+}
+
+static void block_destroy(ct_mem_pool_t *pool, ct_mem_block_t *block) {
+    avail_remove(pool, block);
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        pool->blocks = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    
+    pool->stats.blocks--;
+    pool->stats.bytes -= CT_MEM_POOL_BLOCK;
+    if (block->huge) pool->stats.huge_blocks--;
+    munmap(block, CT_MEM_POOL_BLOCK);
+}
+
+/* Take one chunk from the block lists, noting whether it was recycled -
+ * caller holds the lock if shared */
+static void *pool_take(ct_mem_pool_t *pool, bool *recycled) {
+    ct_mem_block_t *block = pool->avail;
     if (!block) {
-        free(pool);
-        return NULL;
+        block = block_create(pool);
+        if (!block) return NULL;
     }
     
-    block->next = NULL;
-    pool->chunks = block;
+    if (block->free_count == pool->chunks_per_block) {
+        pool->empty_blocks--;
+    }
+    
+    void *chunk;
+    if (block->free_list) {
+        chunk = block->free_list;
+        block->free_list = *(void **)chunk;
+        *recycled = true;
+    } else {
+        chunk = block->data + block->bump++ * pool->chunk_size;
+        *recycled = false;
+    }
+    
+    if (--block->free_count == 0) {
+        avail_remove(pool, block);
+    }
+    
+    pool->stats.in_use++;
+    return chunk;
+}
+
+/* Return one chunk to its block, unmapping the block once it empties if
+ * a spare is already held - caller holds the lock if shared */
+static void pool_give(ct_mem_pool_t *pool, void *chunk) {
+    ct_mem_block_t *block = block_of(chunk);
+    
+    *(void **)chunk = block->free_list;
+    block->free_list = chunk;
+    pool->stats.in_use--;
     
-    /* Initialize free list - O(n) but only done once */
-    char *ptr = block->data;
-    ct_mem_chunk_t *prev = NULL;
+    if (block->free_count++ == 0) {
+        avail_push(pool, block);
+    }
     
-    for (size_t i = 0; i < initial_chunks; i++) {
-        ct_mem_chunk_t *chunk = (ct_mem_chunk_t *)ptr;
-        chunk->next = prev;
-        prev = chunk;
-        ptr += chunk_size;
+    if (block->free_count == pool->chunks_per_block) {
+        if (pool->empty_blocks > 0) {
+            block_destroy(pool, block);
+        } else {
+            pool->empty_blocks++;
+        }
     }
+}
+
+/* Fold a cache's counters into the pool - caller holds the lock */
+static void cache_account(ct_mem_pool_t *pool, pool_cache_t *cache) {
+    pool->stats.allocs += cache->allocs;
+    pool->stats.hits += cache->hits;
+    cache->allocs = 0;
+    cache->hits = 0;
+}
+
+/* Hand this thread's chunks in a slot back to the pool they came from.
+ * If that pool has been destroyed, its blocks went with it and the
+ * chunks are just forgotten. */
+static void cache_flush(int slot) {
+    pool_cache_t *cache = &tls_caches[slot];
     
-    pool->free_list = prev;
+    pthread_mutex_lock(&slot_lock);
+    ct_mem_pool_t *pool = slot_pools[slot];
+    if (pool && pool->id == cache->pool_id) {
+        pthread_mutex_lock(&pool->lock);
+        cache_account(pool, cache);
+        for (uint32_t i = 0; i < cache->count; i++) {
+            pool_give(pool, cache->chunks[i]);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    pthread_mutex_unlock(&slot_lock);
+    
+    memset(cache, 0, offsetof(pool_cache_t, chunks));
+}
+
+/* Thread exit - the key's value is only a marker that caches were used */
+static void cache_thread_exit(void *unused) {
+    (void)unused;
+    for (int slot = 0; slot < POOL_CACHE_SLOTS; slot++) {
+        if (tls_caches[slot].count > 0) {
+            cache_flush(slot);
+        }
+    }
+}
+
+static void cache_key_init(void) {
+    pthread_key_create(&cache_key, cache_thread_exit);
+}
+
+ct_mem_pool_t *ct_mem_pool_create(size_t chunk_size, size_t initial_chunks,
+                                  unsigned flags) {
+    assert(chunk_size >= sizeof(void *));
+    
+    /* Chunks keep max_align_t alignment */
+    chunk_size = (chunk_size + 15) & ~(size_t)15;
+    assert(chunk_size <= (CT_MEM_POOL_BLOCK - BLOCK_HEADER) / 8);
+    
+    ct_mem_pool_t *pool = calloc(1, sizeof(ct_mem_pool_t));
+    if (!pool) return NULL;
+    
+    pool->chunk_size = chunk_size;
+    pool->chunks_per_block = (CT_MEM_POOL_BLOCK - BLOCK_HEADER) / chunk_size;
+    pool->flags = flags;
+    pool->id = atomic_fetch_add(&next_pool_id, 1);
+    pool->cache_slot = -1;
+    
+    if (flags & CT_MEM_POOL_SHARED) {
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_once(&cache_key_once, cache_key_init);
+        
+        pthread_mutex_lock(&slot_lock);
+        for (int slot = 0; slot < POOL_CACHE_SLOTS; slot++) {
+            if (!slot_pools[slot]) {
+                slot_pools[slot] = pool;
+                pool->cache_slot = slot;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&slot_lock);
+    }
+    
+    /* Map the initial blocks up front - their pages are touched lazily */
+    size_t blocks = (initial_chunks + pool->chunks_per_block - 1) /
+                    pool->chunks_per_block;
+    for (size_t i = 0; i < blocks; i++) {
+        if (!block_create(pool)) {
+            ct_mem_pool_destroy(pool);
+            return NULL;
+        }
+    }
     
     return pool;
 }
@@ -53,66 +290,154 @@ ct_mem_pool_t *ct_mem_pool_create(size_t chunk_size, size_t initial_chunks) {
 void ct_mem_pool_destroy(ct_mem_pool_t *pool) {
     if (!pool) return;
     
-    ct_mem_block_t *block = (ct_mem_block_t *)pool->chunks;
-    while (block) {
-        ct_mem_block_t *next = block->next;
-        free(block);
-        block = next;
+    /* Free the slot; chunks still in other threads' caches are
+     * forgotten when they next touch it, or exit */
+    if (pool->cache_slot >= 0) {
+        pthread_mutex_lock(&slot_lock);
+        slot_pools[pool->cache_slot] = NULL;
+        pthread_mutex_unlock(&slot_lock);
+        memset(&tls_caches[pool->cache_slot], 0, offsetof(pool_cache_t, chunks));
+    }
+    
+    while (pool->blocks) {
+        ct_mem_block_t *block = pool->blocks;
+        pool->blocks = block->next;
+        munmap(block, CT_MEM_POOL_BLOCK);
     }
     
+    if (pool->flags & CT_MEM_POOL_SHARED) {
+        pthread_mutex_destroy(&pool->lock);
+    }
     free(pool);
 }
 
-void *ct_mem_pool_alloc(ct_mem_pool_t *pool) {
-    if (!pool) return NULL;
+static pool_cache_t *thread_cache(ct_mem_pool_t *pool) {
+    if (pool->cache_slot < 0) return NULL;
     
-    /* Fast path - O(1) allocation from free list */
-    if (pool->free_list) {
-        ct_mem_chunk_t *chunk = (ct_mem_chunk_t *)pool->free_list;
-        pool->free_list = chunk->next;
-        pool->free_chunks--;
-        
-        /* Clear the memory for security */
-        memset(chunk, 0, pool->chunk_size);
+    pool_cache_t *cache = &tls_caches[pool->cache_slot];
+    if (cache->pool_id != pool->id) {
+        /* The slot changed hands, or this thread's first use of it */
+        if (cache->count > 0) {
+            cache_flush(pool->cache_slot);
+        } else {
+            memset(cache, 0, offsetof(pool_cache_t, chunks));
+        }
+        cache->pool_id = pool->id;
+        pthread_setspecific(cache_key, tls_caches);
+    }
+    return cache;
+}
+
+static void *shared_alloc(ct_mem_pool_t *pool) {
+    pool_cache_t *cache = thread_cache(pool);
+    
+    bool recycled;
+    
+    if (!cache) {
+        pthread_mutex_lock(&pool->lock);
+        void *chunk = pool_take(pool, &recycled);
+        pool->stats.allocs++;
+        if (chunk && recycled) pool->stats.hits++;
+        pthread_mutex_unlock(&pool->lock);
         return chunk;
     }
     
-    /* Slow path - allocate new block */
-    size_t new_chunks = pool->total_chunks;
-    size_t block_size = sizeof(ct_mem_block_t) + (pool->chunk_size * new_chunks);
-    ct_mem_block_t *block = malloc(block_size);
-    if (!block) return NULL;
+    cache->allocs++;
+    if (cache->count > 0) {
+        cache->hits++;
+        return cache->chunks[--cache->count];
+    }
     
-    /* Link new block */
-    block->next = (ct_mem_block_t *)pool->chunks;
-    pool->chunks = block;
-    pool->total_chunks += new_chunks;
-    pool->free_chunks += new_chunks - 1; /* -1 because we'll return one */
+    /* Refill half the cache in one lock round trip */
+    pthread_mutex_lock(&pool->lock);
+    cache_account(pool, cache);
+    while (cache->count < CT_MEM_POOL_CACHE / 2) {
+        void *chunk = pool_take(pool, &recycled);
+        if (!chunk) break;
+        cache->chunks[cache->count++] = chunk;
+    }
+    pool->stats.refills++;
+    pthread_mutex_unlock(&pool->lock);
     
-    /* Initialize new free chunks */
-    char *ptr = block->data + pool->chunk_size; /* Skip first chunk */
-    ct_mem_chunk_t *prev = NULL;
+    return cache->count > 0 ? cache->chunks[--cache->count] : NULL;
+}
+
+static void shared_free(ct_mem_pool_t *pool, void *ptr) {
+    pool_cache_t *cache = thread_cache(pool);
     
-    for (size_t i = 1; i < new_chunks; i++) {
-        ct_mem_chunk_t *chunk = (ct_mem_chunk_t *)ptr;
-        chunk->next = prev;
-        prev = chunk;
-        ptr += pool->chunk_size;
+    if (!cache) {
+        pthread_mutex_lock(&pool->lock);
+        pool_give(pool, ptr);
+        pthread_mutex_unlock(&pool->lock);
+        return;
     }
     
-    pool->free_list = prev;
+    /* Full cache - hand the older half back in one lock round trip */
+    if (cache->count == CT_MEM_POOL_CACHE) {
+        size_t half = CT_MEM_POOL_CACHE / 2;
+        
+        pthread_mutex_lock(&pool->lock);
+        cache_account(pool, cache);
+        for (size_t i = 0; i < half; i++) {
+            pool_give(pool, cache->chunks[i]);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        
+        memmove(cache->chunks, cache->chunks + half,
+                (CT_MEM_POOL_CACHE - half) * sizeof(void *));
+        cache->count -= half;
+    }
+    
+    cache->chunks[cache->count++] = ptr;
+}
+
+/* Uninitialised chunk - O(1) */
+void *ct_mem_pool_alloc(ct_mem_pool_t *pool) {
+    if (!pool) return NULL;
+    
+    if (pool->flags & CT_MEM_POOL_SHARED) {
+        return shared_alloc(pool);
+    }
     
-    /* Return first chunk from new block */
-    memset(block->data, 0, pool->chunk_size);
-    return block->data;
+    bool recycled;
+    void *chunk = pool_take(pool, &recycled);
+    pool->stats.allocs++;
+    if (chunk && recycled) pool->stats.hits++;
+    return chunk;
+}
+
+/* Zeroed chunk */
+void *ct_mem_pool_calloc(ct_mem_pool_t *pool) {
+    void *chunk = ct_mem_pool_alloc(pool);
+    if (chunk) {
+        memset(chunk, 0, pool->chunk_size);
+    }
+    return chunk;
 }
 
 void ct_mem_pool_free(ct_mem_pool_t *pool, void *ptr) {
     if (!pool || !ptr) return;
     
-    /* O(1) return to free list */
-    ct_mem_chunk_t *chunk = (ct_mem_chunk_t *)ptr;
-    chunk->next = (ct_mem_chunk_t *)pool->free_list;
-    pool->free_list = chunk;
-    pool->free_chunks++;
-}
\ No newline at end of file
+    if (pool->flags & CT_MEM_POOL_SHARED) {
+        shared_free(pool, ptr);
+    } else {
+        pool_give(pool, ptr);
+    }
+}
+
+/* Counters snapshot - exact for shared pools up to what thread caches
+ * haven't folded in yet, racy for another thread's private pool */
+void ct_mem_pool_get_stats(ct_mem_pool_t *pool, ct_mem_pool_stats_t *out) {
+    if (!pool) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    
+    if (pool->flags & CT_MEM_POOL_SHARED) {
+        pthread_mutex_lock(&pool->lock);
+        *out = pool->stats;
+        pthread_mutex_unlock(&pool->lock);
+    } else {
+        *out = pool->stats;
+    }
+}
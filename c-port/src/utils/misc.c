@@ -2,15 +2,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <ctype.h>
 
-/* Get current timestamp in ISO format */
+/* Get current timestamp in ISO format - preformatted by the loop clock */
 void ct_get_timestamp(char *buf, size_t buf_len) {
-    time_t now = time(NULL);
-    struct tm *tm = gmtime(&now);
+    if (buf_len == 0) return;
     
-    strftime(buf, buf_len, "%Y-%m-%dT%H:%M:%SZ", tm);
+    const ct_clock_t *clock = ct_clock_get();
+    size_t len = buf_len - 1 < CT_ISO_TIME_LEN ? buf_len - 1 : CT_ISO_TIME_LEN;
+    memcpy(buf, clock->iso_time, len);
+    buf[len] = '\0';
+}
+
+/* "00".."99" - integers are formatted two digits per step */
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Decimal digits of v at p, no terminator. Returns the end; p needs room
+ * for CT_U64_DIGITS bytes. */
+char *ct_fmt_u64(char *p, uint64_t v) {
+    char tmp[CT_U64_DIGITS];
+    char *t = tmp + sizeof(tmp);
+    
+    while (v >= 100) {
+        unsigned pair = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--t = digit_pairs[pair + 1];
+        *--t = digit_pairs[pair];
+    }
+    if (v >= 10) {
+        *--t = digit_pairs[v * 2 + 1];
+        *--t = digit_pairs[v * 2];
+    } else {
+        *--t = (char)('0' + v);
+    }
+    
+    size_t len = tmp + sizeof(tmp) - t;
+    memcpy(p, t, len);
+    return p + len;
+}
+
+/* Lowercase hex digits of v at p, no terminator. Returns the end; p needs
+ * room for 16 bytes. */
+char *ct_fmt_hex(char *p, uint64_t v) {
+    static const char hex[] = "0123456789abcdef";
+    int len = v ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+    
+    for (int i = len - 1; i >= 0; i--) {
+        p[i] = hex[v & 15];
+        v >>= 4;
+    }
+    return p + len;
 }
 
 /* URL decode */
@@ -217,22 +261,10 @@ void ct_response_error(ct_response_t *resp, int status, const char *message) {
 
 /* CORS headers */
 void ct_response_add_cors_headers(ct_response_t *resp) {
-    ct_response_add_header(resp, "Access-Control-Allow-Origin", "*");
-    ct_response_add_header(resp, "Access-Control-Allow-Methods", 
-                          "GET, POST, PUT, DELETE, OPTIONS");
-    ct_response_add_header(resp, "Access-Control-Allow-Headers", 
-                          "Content-Type, Authorization");
-    ct_response_add_header(resp, "Access-Control-Max-Age", "86400");
+    ct_response_add_block(resp, &ct_headers_cors);
 }
 
 /* Security headers */
 void ct_response_add_security_headers(ct_response_t *resp) {
-    ct_response_add_header(resp, "X-Content-Type-Options", "nosniff");
-    ct_response_add_header(resp, "X-Frame-Options", "SAMEORIGIN");
-    ct_response_add_header(resp, "X-XSS-Protection", "1; mode=block");
-    ct_response_add_header(resp, "Referrer-Policy", "strict-origin-when-cross-origin");
-    ct_response_add_header(resp, "Content-Security-Policy", 
-                          "default-src 'self'; script-src 'self' 'unsafe-inline' 'unsafe-eval'; "
-                          "style-src 'self' 'unsafe-inline'; font-src 'self' data:; "
-                          "img-src 'self' data: blob:; connect-src 'self' ws: wss:");
+    ct_response_add_block(resp, &ct_headers_security);
 }
\ No newline at end of file
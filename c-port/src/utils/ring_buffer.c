@@ -3,6 +3,8 @@
 #include <string.h>
 #include <stdatomic.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /* Ensure power of 2 for efficient modulo operation */
 static inline size_t next_power_of_2(size_t n) {
@@ -17,6 +19,54 @@ static inline size_t next_power_of_2(size_t n) {
     return n;
 }
 
+/* Map size bytes of memfd-backed memory twice, back-to-back, so accesses
+ * that run off the end wrap to the start in hardware. size must be a
+ * multiple of the page size. Returns NULL where this isn't supported -
+ * callers fall back to a plain buffer and two-part copies. */
+void *ct_mirror_map(size_t size) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0 || size % (size_t)page != 0) return NULL;
+    
+    int fd = memfd_create("ct-ring", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    /* Reserve both halves first so nothing else lands in between */
+    char *base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             fd, 0) == MAP_FAILED ||
+        mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * size);
+        close(fd);
+        return NULL;
+    }
+    
+    /* The mappings keep the memory alive */
+    close(fd);
+    return base;
+#else
+    (void)size;
+    return NULL;
+#endif
+}
+
+void ct_mirror_unmap(void *base, size_t size) {
+    if (base) {
+        munmap(base, 2 * size);
+    }
+}
+
 ct_ring_buffer_t *ct_ring_buffer_create(size_t size) {
     /* Ensure size is power of 2 for fast modulo */
     size = next_power_of_2(size);
@@ -24,7 +74,11 @@ ct_ring_buffer_t *ct_ring_buffer_create(size_t size) {
     ct_ring_buffer_t *rb = calloc(1, sizeof(ct_ring_buffer_t));
     if (!rb) return NULL;
     
-    rb->data = calloc(1, size);
+    rb->data = ct_mirror_map(size);
+    rb->mirrored = rb->data != NULL;
+    if (!rb->data) {
+        rb->data = calloc(1, size);
+    }
     if (!rb->data) {
         free(rb);
         return NULL;
@@ -39,10 +93,129 @@ ct_ring_buffer_t *ct_ring_buffer_create(size_t size) {
 
 void ct_ring_buffer_destroy(ct_ring_buffer_t *rb) {
     if (!rb) return;
-    free(rb->data);
+    if (rb->mirrored) {
+        ct_mirror_unmap(rb->data, rb->size);
+    } else {
+        free(rb->data);
+    }
     free(rb);
 }
 
+/* Pooled ring - embedded in its owner, no memory until first write */
+void ct_ring_buffer_init_pooled(ct_ring_buffer_t *rb, ct_buf_pool_t *pool) {
+    rb->data = NULL;
+    rb->size = 0;
+    atomic_init(&rb->read_pos, 0);
+    atomic_init(&rb->write_pos, 0);
+    rb->pool = pool;
+    rb->size_hint = CT_BUF_MIN_SIZE;
+    rb->high_water = 0;
+    rb->pinned = false;
+    rb->mirrored = false;
+    rb->retired = NULL;
+    rb->retired_size = 0;
+}
+
+/* Move the contents into a buffer of new_size, linearized at offset 0.
+ * A pinned ring's old buffer is kept until ct_ring_buffer_unpin - the
+ * kernel is still sending from it. */
+static int ring_resize(ct_ring_buffer_t *rb, size_t new_size) {
+    bool mirrored;
+    char *data = ct_buf_pool_alloc(rb->pool, new_size, &mirrored);
+    if (!data) return -1;
+    
+    size_t available = ct_ring_buffer_peek(rb, data, new_size);
+    
+    if (rb->data && rb->pinned && !rb->retired) {
+        rb->retired = rb->data;
+        rb->retired_size = rb->size;
+        rb->retired_mirrored = rb->mirrored;
+    } else if (rb->data) {
+        ct_buf_pool_free(rb->pool, rb->data, rb->size, rb->mirrored);
+    }
+    
+    rb->data = data;
+    rb->size = new_size;
+    rb->mirrored = mirrored;
+    atomic_store_explicit(&rb->read_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&rb->write_pos, available, memory_order_release);
+    
+    return 0;
+}
+
+/* Hand a drained pooled buffer back. The next allocation keeps this size
+ * if more than half of it was used, otherwise halves it - so a chatty
+ * terminal stays large and a one-off burst decays back to 4 KB. */
+static void ring_release_if_empty(ct_ring_buffer_t *rb) {
+    if (!rb->pool || !rb->data || rb->pinned) return;
+    if (ct_ring_buffer_available(rb) > 0) return;
+    
+    if (rb->high_water * 2 > rb->size) {
+        rb->size_hint = rb->size;
+    } else {
+        rb->size_hint = rb->size / 2 > CT_BUF_MIN_SIZE ? rb->size / 2 : CT_BUF_MIN_SIZE;
+    }
+    
+    ct_ring_buffer_release(rb);
+}
+
+/* The kernel is done with the ring - free a buffer it outgrew meanwhile */
+void ct_ring_buffer_unpin(ct_ring_buffer_t *rb) {
+    rb->pinned = false;
+    if (rb->retired) {
+        ct_buf_pool_free(rb->pool, rb->retired, rb->retired_size,
+                         rb->retired_mirrored);
+        rb->retired = NULL;
+        rb->retired_size = 0;
+    }
+}
+
+/* Free a pooled ring's buffer regardless of contents (connection teardown) */
+void ct_ring_buffer_release(ct_ring_buffer_t *rb) {
+    if (!rb || !rb->pool) return;
+    
+    if (rb->retired) {
+        ct_buf_pool_free(rb->pool, rb->retired, rb->retired_size,
+                         rb->retired_mirrored);
+        rb->retired = NULL;
+        rb->retired_size = 0;
+    }
+    if (!rb->data) return;
+    
+    ct_buf_pool_free(rb->pool, rb->data, rb->size, rb->mirrored);
+    rb->data = NULL;
+    rb->size = 0;
+    rb->high_water = 0;
+    atomic_store_explicit(&rb->read_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&rb->write_pos, 0, memory_order_relaxed);
+}
+
+/* Make room for len more bytes - allocates or doubles a pooled ring up to
+ * CT_BUF_MAX_SIZE, pinned or not. Returns the free space afterwards,
+ * which may still be less than len. */
+size_t ct_ring_buffer_reserve(ct_ring_buffer_t *rb, size_t len) {
+    if (!rb) return 0;
+    
+    size_t free_space = ct_ring_buffer_free_space(rb);
+    if (free_space >= len || !rb->pool) {
+        return free_space;
+    }
+    
+    size_t available = ct_ring_buffer_available(rb);
+    size_t want = available + len + 1;
+    size_t size = rb->data ? rb->size * 2 : rb->size_hint;
+    
+    while (size < want && size < CT_BUF_MAX_SIZE) {
+        size <<= 1;
+    }
+    if (size > CT_BUF_MAX_SIZE) size = CT_BUF_MAX_SIZE;
+    if (size <= rb->size || ring_resize(rb, size) < 0) {
+        return free_space;
+    }
+    
+    return rb->size - available - 1;
+}
+
 size_t ct_ring_buffer_available(ct_ring_buffer_t *rb) {
     if (!rb) return 0;
     
@@ -53,13 +226,16 @@ size_t ct_ring_buffer_available(ct_ring_buffer_t *rb) {
 }
 
 size_t ct_ring_buffer_free_space(ct_ring_buffer_t *rb) {
-    if (!rb) return 0;
+    if (!rb || rb->size == 0) return 0;
     return rb->size - ct_ring_buffer_available(rb) - 1;
 }
 
 size_t ct_ring_buffer_write(ct_ring_buffer_t *rb, const char *data, size_t len) {
     if (!rb || !data || len == 0) return 0;
     
+    /* Pooled rings allocate or grow on demand */
+    if (rb->pool && ct_ring_buffer_reserve(rb, len) == 0) return 0;
+    
     size_t write_pos = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
     size_t read_pos = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
     
@@ -74,8 +250,8 @@ size_t ct_ring_buffer_write(ct_ring_buffer_t *rb, const char *data, size_t len)
     size_t write_idx = write_pos & (rb->size - 1);
     size_t first_part = rb->size - write_idx;
     
-    if (to_write <= first_part) {
-        /* No wrap needed - single memcpy */
+    if (to_write <= first_part || rb->mirrored) {
+        /* No wrap needed, or the mirror takes it - single memcpy */
         memcpy(rb->data + write_idx, data, to_write);
     } else {
         /* Handle wrap - two memcpy operations */
@@ -87,6 +263,9 @@ size_t ct_ring_buffer_write(ct_ring_buffer_t *rb, const char *data, size_t len)
     atomic_store_explicit(&rb->write_pos, write_pos + to_write, 
                          memory_order_release);
     
+    size_t held = (write_pos + to_write - read_pos) & (rb->size - 1);
+    if (held > rb->high_water) rb->high_water = held;
+    
     return to_write;
 }
 
@@ -107,8 +286,8 @@ size_t ct_ring_buffer_read(ct_ring_buffer_t *rb, char *data, size_t len) {
     size_t read_idx = read_pos & (rb->size - 1);
     size_t first_part = rb->size - read_idx;
     
-    if (to_read <= first_part) {
-        /* No wrap needed - single memcpy */
+    if (to_read <= first_part || rb->mirrored) {
+        /* No wrap needed, or the mirror takes it - single memcpy */
         memcpy(data, rb->data + read_idx, to_read);
     } else {
         /* Handle wrap - two memcpy operations */
@@ -120,6 +299,7 @@ size_t ct_ring_buffer_read(ct_ring_buffer_t *rb, char *data, size_t len) {
     atomic_store_explicit(&rb->read_pos, read_pos + to_read, 
                          memory_order_release);
     
+    ring_release_if_empty(rb);
     return to_read;
 }
 
@@ -141,8 +321,8 @@ size_t ct_ring_buffer_peek(ct_ring_buffer_t *rb, char *data, size_t len) {
     size_t read_idx = read_pos & (rb->size - 1);
     size_t first_part = rb->size - read_idx;
     
-    if (to_peek <= first_part) {
-        /* No wrap needed - single memcpy */
+    if (to_peek <= first_part || rb->mirrored) {
+        /* No wrap needed, or the mirror takes it - single memcpy */
         memcpy(data, rb->data + read_idx, to_peek);
     } else {
         /* Handle wrap - two memcpy operations */
@@ -171,5 +351,123 @@ size_t ct_ring_buffer_skip(ct_ring_buffer_t *rb, size_t len) {
     atomic_store_explicit(&rb->read_pos, read_pos + to_skip, 
                          memory_order_release);
     
+    ring_release_if_empty(rb);
     return to_skip;
-}
\ No newline at end of file
+}
+
+/* Scatter/gather access - describe the ring's contiguous spans as iovecs
+ * so readv/writev move bytes straight in and out, with commit/skip
+ * publishing the result. Both return the number of segments (0-2). */
+
+/* Free space, for readv - follow with ct_ring_buffer_commit() */
+int ct_ring_buffer_free_iov(ct_ring_buffer_t *rb, struct iovec iov[2]) {
+    if (!rb || rb->size == 0) return 0;
+    
+    size_t write_pos = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    size_t read_pos = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+    
+    size_t free_space = (read_pos - write_pos - 1) & (rb->size - 1);
+    if (free_space == 0) return 0;
+    
+    size_t write_idx = write_pos & (rb->size - 1);
+    size_t first_part = rb->size - write_idx;
+    
+    iov[0].iov_base = rb->data + write_idx;
+    if (free_space <= first_part || rb->mirrored) {
+        iov[0].iov_len = free_space;
+        return 1;
+    }
+    
+    iov[0].iov_len = first_part;
+    iov[1].iov_base = rb->data;
+    iov[1].iov_len = free_space - first_part;
+    return 2;
+}
+
+/* Publish len bytes written into the spans from ct_ring_buffer_free_iov() */
+void ct_ring_buffer_commit(ct_ring_buffer_t *rb, size_t len) {
+    if (!rb || len == 0) return;
+    
+    size_t write_pos = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+    size_t read_pos = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+    
+    assert(len <= ((read_pos - write_pos - 1) & (rb->size - 1)));
+    
+    atomic_store_explicit(&rb->write_pos, write_pos + len, 
+                         memory_order_release);
+    
+    size_t held = (write_pos + len - read_pos) & (rb->size - 1);
+    if (held > rb->high_water) rb->high_water = held;
+}
+
+/* Pending data, for writev - follow with ct_ring_buffer_skip() */
+int ct_ring_buffer_data_iov(ct_ring_buffer_t *rb, struct iovec iov[2]) {
+    if (!rb || rb->size == 0) return 0;
+    
+    size_t read_pos = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    size_t write_pos = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+    
+    size_t available = (write_pos - read_pos) & (rb->size - 1);
+    if (available == 0) return 0;
+    
+    size_t read_idx = read_pos & (rb->size - 1);
+    size_t first_part = rb->size - read_idx;
+    
+    iov[0].iov_base = rb->data + read_idx;
+    if (available <= first_part || rb->mirrored) {
+        iov[0].iov_len = available;
+        return 1;
+    }
+    
+    iov[0].iov_len = first_part;
+    iov[1].iov_base = rb->data;
+    iov[1].iov_len = available - first_part;
+    return 2;
+}
+
+/* Rewrite the contents to start at offset 0 - the fallback that makes a
+ * wrapped plain ring contiguous */
+static int ring_linearize(ct_ring_buffer_t *rb) {
+    if (rb->pool) {
+        return ring_resize(rb, rb->size);
+    }
+    
+    char *data = malloc(rb->size);
+    if (!data) return -1;
+    
+    size_t available = ct_ring_buffer_peek(rb, data, rb->size);
+    free(rb->data);
+    rb->data = data;
+    atomic_store_explicit(&rb->read_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&rb->write_pos, available, memory_order_release);
+    return 0;
+}
+
+/* All readable bytes as one contiguous span, for parsing in place. Free
+ * on a mirrored ring; a wrapped plain ring is linearized first (at most
+ * once per wrap). The pointer stays valid until the ring is next written,
+ * skipped or read - a drained pooled ring gives its buffer back. Returns
+ * NULL with *len = 0 when empty. */
+const char *ct_ring_buffer_peek_ptr(ct_ring_buffer_t *rb, size_t *len) {
+    *len = 0;
+    if (!rb || rb->size == 0) return NULL;
+    
+    size_t read_pos = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+    size_t write_pos = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+    
+    size_t available = (write_pos - read_pos) & (rb->size - 1);
+    if (available == 0) return NULL;
+    
+    size_t read_idx = read_pos & (rb->size - 1);
+    if (read_idx + available > rb->size && !rb->mirrored) {
+        /* A pinned ring can't move - expose the first span only */
+        if (rb->pinned || ring_linearize(rb) < 0) {
+            *len = rb->size - read_idx;
+            return rb->data + read_idx;
+        }
+        read_idx = 0;
+    }
+    
+    *len = available;
+    return rb->data + read_idx;
+}
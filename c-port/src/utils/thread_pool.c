@@ -0,0 +1,172 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Small fixed pool for blocking CPU work. One mutex-protected FIFO feeds
+ * the threads; jobs are rare (logins, precompression) so contention is
+ * not a concern. Finished jobs go back to the owning reactor's done list
+ * and its wake fd is signalled, so completions run on the loop thread. */
+struct ct_thread_pool {
+    pthread_t *threads;
+    size_t thread_count;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ct_job_t *head;
+    ct_job_t *tail;
+    bool stopping;
+};
+
+/* Hand a finished job back to its reactor */
+static void job_deliver(ct_job_t *job) {
+    ct_reactor_t *reactor = job->reactor;
+    
+    pthread_mutex_lock(&reactor->job_lock);
+    bool was_empty = reactor->jobs_done == NULL;
+    job->next = reactor->jobs_done;
+    reactor->jobs_done = job;
+    pthread_mutex_unlock(&reactor->job_lock);
+    
+    /* A non-empty list already has a wakeup in flight */
+    if (was_empty) {
+        ct_reactor_wake(reactor);
+    }
+}
+
+static void *pool_thread(void *arg) {
+    ct_thread_pool_t *pool = arg;
+    
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        
+        ct_job_t *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        
+        job->next = NULL;
+        job->run(job);
+        job_deliver(job);
+    }
+    
+    return NULL;
+}
+
+ct_thread_pool_t *ct_thread_pool_create(size_t threads) {
+    if (threads == 0) return NULL;
+    
+    ct_thread_pool_t *pool = calloc(1, sizeof(ct_thread_pool_t));
+    if (!pool) return NULL;
+    
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    
+    for (size_t i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, pool) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        pool->thread_count++;
+    }
+    
+    if (pool->thread_count == 0) {
+        ct_thread_pool_destroy(pool);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+/* Stop and join the threads. Jobs that never started are handed back to
+ * their reactors as cancelled, so reactor teardown frees them. */
+void ct_thread_pool_destroy(ct_thread_pool_t *pool) {
+    if (!pool) return;
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    ct_job_t *job = pool->head;
+    while (job) {
+        ct_job_t *next = job->next;
+        job->conn = NULL;
+        job_deliver(job);
+        job = next;
+    }
+    
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+/* Queue a job - returns -1 if there is no pool, so the caller can run the
+ * work inline instead */
+int ct_thread_pool_submit(ct_thread_pool_t *pool, ct_job_t *job) {
+    if (!pool) return -1;
+    
+    job->next = NULL;
+    
+    pthread_mutex_lock(&pool->lock);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    
+    return 0;
+}
+
+/* Run completions on the reactor thread - called after the wake fd fires */
+void ct_reactor_complete_jobs(ct_reactor_t *reactor) {
+    pthread_mutex_lock(&reactor->job_lock);
+    ct_job_t *list = reactor->jobs_done;
+    reactor->jobs_done = NULL;
+    pthread_mutex_unlock(&reactor->job_lock);
+    
+    /* Pushed LIFO - reverse so completions run in finishing order */
+    ct_job_t *ordered = NULL;
+    while (list) {
+        ct_job_t *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    
+    while (ordered) {
+        ct_job_t *next = ordered->next;
+        ordered->complete(ordered);
+        ordered = next;
+    }
+}
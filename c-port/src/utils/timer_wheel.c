@@ -0,0 +1,193 @@
+#include "terminal.h"
+#include <string.h>
+#include <assert.h>
+
+#define WHEEL_MASK      (CT_TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(l)  ((l) * CT_TIMER_WHEEL_BITS)
+
+/* Longest representable delay - later expiries are clamped */
+#define WHEEL_MAX_DELAY ((1ULL << (CT_TIMER_WHEEL_LEVELS * CT_TIMER_WHEEL_BITS)) - 1)
+
+void ct_timer_wheel_init(ct_timer_wheel_t *wheel, uint64_t now_ms) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->current = now_ms;
+}
+
+void ct_timer_init(ct_timer_t *timer, ct_timer_cb callback) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->index = 0;
+    timer->callback = callback;
+}
+
+bool ct_timer_pending(const ct_timer_t *timer) {
+    return timer->pprev != NULL;
+}
+
+/* Link into the slot for its expiry - the lowest level whose parent block
+ * matches the current tick, so it cascades down exactly once per level */
+static void wheel_link(ct_timer_wheel_t *wheel, ct_timer_t *timer) {
+    uint64_t expires = timer->expires;
+    int level = 0;
+    
+    while (level < CT_TIMER_WHEEL_LEVELS - 1 &&
+           (expires >> LEVEL_SHIFT(level + 1)) != 
+           (wheel->current >> LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    
+    int slot = (expires >> LEVEL_SHIFT(level)) & WHEEL_MASK;
+    ct_timer_t **head = &wheel->slots[level][slot];
+    
+    timer->index = level * CT_TIMER_WHEEL_SLOTS + slot;
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+    
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void wheel_unlink(ct_timer_wheel_t *wheel, ct_timer_t *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    
+    int level = timer->index / CT_TIMER_WHEEL_SLOTS;
+    int slot = timer->index % CT_TIMER_WHEEL_SLOTS;
+    if (!wheel->slots[level][slot]) {
+        wheel->occupied[level] &= ~(1ULL << slot);
+    }
+    
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* Schedule (or reschedule) a timer - O(1) */
+void ct_timer_add(ct_timer_wheel_t *wheel, ct_timer_t *timer, uint64_t expires_ms) {
+    if (timer->pprev) {
+        wheel_unlink(wheel, timer);
+    } else {
+        wheel->count++;
+    }
+    
+    /* Overdue timers fire on the next advance */
+    if (expires_ms < wheel->current) {
+        expires_ms = wheel->current;
+    } else if (expires_ms - wheel->current > WHEEL_MAX_DELAY) {
+        expires_ms = wheel->current + WHEEL_MAX_DELAY;
+    }
+    
+    timer->expires = expires_ms;
+    wheel_link(wheel, timer);
+}
+
+/* Cancel a timer - O(1), safe on idle timers */
+void ct_timer_cancel(ct_timer_wheel_t *wheel, ct_timer_t *timer) {
+    if (!timer->pprev) return;
+    
+    wheel_unlink(wheel, timer);
+    wheel->count--;
+}
+
+/* Move every timer in a higher-level slot down to its final level */
+static void wheel_cascade(ct_timer_wheel_t *wheel, int level, int slot) {
+    ct_timer_t *timer = wheel->slots[level][slot];
+    
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    
+    while (timer) {
+        ct_timer_t *next = timer->next;
+        wheel_link(wheel, timer);
+        timer = next;
+    }
+}
+
+/* Fire all timers due at or before now_ms. Callbacks may re-add or cancel
+ * any timer, including their own. */
+void ct_timer_wheel_advance(ct_timer_wheel_t *wheel, uint64_t now_ms) {
+    while (wheel->current <= now_ms) {
+        int index = wheel->current & WHEEL_MASK;
+        
+        /* Crossing a level-1 boundary - pull the next block down */
+        if (index == 0) {
+            for (int level = 1; level < CT_TIMER_WHEEL_LEVELS; level++) {
+                int slot = (wheel->current >> LEVEL_SHIFT(level)) & WHEEL_MASK;
+                if (wheel->occupied[level] & (1ULL << slot)) {
+                    wheel_cascade(wheel, level, slot);
+                }
+                if (slot != 0) break;
+            }
+        }
+        
+        /* Expire this tick - unlink one at a time so callbacks can touch
+         * other timers in the same slot */
+        ct_timer_t **head = &wheel->slots[0][index];
+        while (*head) {
+            ct_timer_t *timer = *head;
+            wheel_unlink(wheel, timer);
+            wheel->count--;
+            timer->callback(timer);
+        }
+        
+        /* Skip empty ticks up to the next occupied slot or block boundary */
+        uint64_t pending = wheel->occupied[0] & (~0ULL << index) & ~(1ULL << index);
+        uint64_t next;
+        if (pending) {
+            next = (wheel->current & ~(uint64_t)WHEEL_MASK) + __builtin_ctzll(pending);
+        } else {
+            next = (wheel->current | WHEEL_MASK) + 1;
+        }
+        
+        if (next > now_ms) {
+            wheel->current = now_ms + 1;
+            break;
+        }
+        wheel->current = next;
+    }
+}
+
+/* Milliseconds until the wheel next needs attention (-1 if empty). Timers
+ * above level 0 report their cascade point, which is never later than
+ * their expiry. */
+int ct_timer_wheel_timeout(ct_timer_wheel_t *wheel, uint64_t now_ms) {
+    if (wheel->count == 0) return -1;
+    
+    uint64_t earliest = UINT64_MAX;
+    
+    for (int level = 0; level < CT_TIMER_WHEEL_LEVELS; level++) {
+        uint64_t bits = wheel->occupied[level];
+        if (!bits) continue;
+        
+        int shift = LEVEL_SHIFT(level);
+        int index = (wheel->current >> shift) & WHEEL_MASK;
+        uint64_t block = (wheel->current >> shift >> CT_TIMER_WHEEL_BITS)
+                         << CT_TIMER_WHEEL_BITS;
+        
+        /* Slots from the current index on belong to this block, the rest
+         * to the next one. Above level 0 the current slot has already been
+         * cascaded unless we sit exactly on its boundary. */
+        uint64_t ahead = bits & (~0ULL << index);
+        if (level > 0 && (wheel->current & ((1ULL << shift) - 1)) != 0) {
+            ahead &= ~(1ULL << index);
+        }
+        uint64_t tick;
+        if (ahead) {
+            tick = (block + __builtin_ctzll(ahead)) << shift;
+        } else {
+            tick = (block + CT_TIMER_WHEEL_SLOTS + __builtin_ctzll(bits)) << shift;
+        }
+        
+        if (tick < earliest) earliest = tick;
+    }
+    
+    if (earliest <= now_ms) return 0;
+    
+    uint64_t delta = earliest - now_ms;
+    return delta > 0x7fffffff ? 0x7fffffff : (int)delta;
+}